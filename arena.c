@@ -0,0 +1,114 @@
+#include "arena.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+void arena_init(struct arena *arena)
+{
+    arena->chunks = NULL;
+}
+
+/**
+ * @return size aligned to a multiple of 8 bytes
+ */
+static size_t align(size_t size)
+{
+    return (size + 7) & ~(size_t) 7;
+}
+
+/**
+ * @note Maps a new block with room for at least size bytes and locks it. If locking fails (usually because
+ * of RLIMIT_MEMLOCK), the block is used anyway and a warning is printed once.
+ *
+ * @return the new block, NULL on failure
+ */
+static struct arena_chunk *new_chunk(size_t size)
+{
+    static bool warned = false;
+
+    size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+    size_t chunk_size = sizeof(struct arena_chunk) + (size > ARENA_CHUNK_SIZE ? size : ARENA_CHUNK_SIZE);
+    chunk_size = (chunk_size + page_size - 1) / page_size * page_size;
+
+    struct arena_chunk *chunk = mmap(NULL, chunk_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (chunk == MAP_FAILED) {
+        fprintf(stderr, "failed to allocate memory\n");
+        return NULL;
+    }
+
+#ifdef MADV_DONTDUMP
+    madvise(chunk, chunk_size, MADV_DONTDUMP);
+#endif
+
+    chunk->locked = mlock(chunk, chunk_size) == 0;
+    if (! chunk->locked && ! warned) {
+        fprintf(stderr, "warning: failed to lock memory, saved passwords might be swapped to disk\n");
+        warned = true;
+    }
+
+    chunk->size = chunk_size;
+    chunk->used = 0;
+    chunk->next = NULL;
+    return chunk;
+}
+
+/**
+ * @note The memory is valid until arena_free is called, it is not initialized.
+ *
+ * @return pointer to size bytes aligned to 8 bytes, NULL on failure
+ */
+void *arena_alloc(struct arena *arena, size_t size)
+{
+    size = align(size);
+
+    struct arena_chunk *chunk = arena->chunks;
+    if (chunk == NULL || chunk->size - sizeof(*chunk) - chunk->used < size) {
+        chunk = new_chunk(size);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+    }
+
+    void *memory = chunk->data + chunk->used;
+    chunk->used += size;
+    return memory;
+}
+
+/**
+ * @return copy of length bytes of text terminated by '\0', NULL on failure
+ */
+char *arena_copy(struct arena *arena, const char *text, size_t length)
+{
+    char *copy = arena_alloc(arena, length + 1);
+    if (copy == NULL) {
+        return NULL;
+    }
+
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    return copy;
+}
+
+/**
+ * @note Overwrites every block of the arena with one explicit_bzero, unlocks and unmaps it.
+ */
+void arena_free(struct arena *arena)
+{
+    while (arena->chunks != NULL) {
+        struct arena_chunk *chunk = arena->chunks;
+        struct arena_chunk *next = chunk->next;
+        size_t size = chunk->size;
+        bool locked = chunk->locked;
+
+        explicit_bzero(chunk->data, size - sizeof(*chunk));
+        if (locked) {
+            munlock(chunk, size);
+        }
+        munmap(chunk, size);
+        arena->chunks = next;
+    }
+}
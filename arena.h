@@ -0,0 +1,34 @@
+#ifndef PASSWORD_GENERATOR_ARENA_H
+#define PASSWORD_GENERATOR_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+//Size of the memory blocks the arena maps, bigger allocations get a block of their own
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    //Size of the whole mapping, this header included
+    size_t size;
+    size_t used;
+    bool locked;
+    //Aligned like the allocations, which are multiples of 8 bytes
+    _Alignas(8) unsigned char data[];
+};
+
+/**
+ * Bump pointer allocator for records with passwords. Its blocks are locked in memory (so they are never
+ * swapped to disk) and left out of core dumps. Everything allocated from it is overwritten and freed at once
+ * by arena_free, nothing is freed separately.
+ */
+struct arena {
+    struct arena_chunk *chunks;
+};
+
+void arena_init(struct arena *arena);
+void *arena_alloc(struct arena *arena, size_t size);
+char *arena_copy(struct arena *arena, const char *text, size_t length);
+void arena_free(struct arena *arena);
+
+#endif //PASSWORD_GENERATOR_ARENA_H
@@ -0,0 +1,161 @@
+#include "batch_generation.h"
+#include "character_pool.h"
+#include "random_pool.h"
+#include "char_mapping.h"
+#include "parallel_generation.h"
+#include "pwgen.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @note Writes the buffer to output and overwrites it with zeros, because it contains passwords.
+ *
+ * @return true if everything was written, false otherwise
+ */
+static bool flush_output(char *buffer, size_t *used, FILE *output)
+{
+    bool result = fwrite(buffer, sizeof(char), *used, output) == *used;
+    memset(buffer, 0, *used);
+    *used = 0;
+
+    if (! result) {
+        fprintf(stderr, "failed to write passwords\n");
+    }
+    return result;
+}
+
+static bool generate_character_lines(const void *source, struct random_pool *pool, char *output, size_t count,
+                                     size_t *used)
+{
+    const struct character_lines *lines = source;
+    *used = count * (lines->length + 1);
+    return char_mapping_generate_lines(lines->mapping, pool, output, lines->length, count);
+}
+
+static bool generate_passphrase_lines(const void *source, struct random_pool *pool, char *output, size_t count,
+                                      size_t *used)
+{
+    return passphrase_generate_lines(source, pool, output, count, used);
+}
+
+static bool generate_policy_lines(const void *source, struct random_pool *pool, char *output, size_t count,
+                                  size_t *used)
+{
+    return policy_generate_lines(source, pool, output, count, used);
+}
+
+/**
+ * @note The generator uses lines (and the mapping in it) as long as the generator is used.
+ */
+void line_generator_characters(struct line_generator *generator, const struct character_lines *lines)
+{
+    generator->generate_lines = generate_character_lines;
+    generator->source = lines;
+    generator->longest_line = lines->length + 1;
+}
+
+void line_generator_passphrases(struct line_generator *generator, const struct passphrase_format *format)
+{
+    generator->generate_lines = generate_passphrase_lines;
+    generator->source = format;
+    generator->longest_line = passphrase_longest(format) + 1;
+}
+
+void line_generator_policy(struct line_generator *generator, const struct policy_generator *policy)
+{
+    generator->generate_lines = generate_policy_lines;
+    generator->source = policy;
+    generator->longest_line = policy->length + 1;
+}
+
+/**
+ * @note Generates count lines by one thread.
+ *
+ * @return true on success, false on failure
+ */
+static bool generate_sequential(const struct line_generator *generator, long count, FILE *output)
+{
+    struct random_pool pool;
+    if (! random_pool_init(&pool)) {
+        return false;
+    }
+
+    char *buffer = malloc(BATCH_OUTPUT_BUFFER_SIZE * sizeof(char));
+    if (buffer == NULL) {
+        random_pool_free(&pool);
+        fprintf(stderr, "malloc failed\n");
+        return false;
+    }
+
+    size_t used = 0;
+    size_t lines_per_buffer = BATCH_OUTPUT_BUFFER_SIZE / generator->longest_line;
+    size_t remaining = count;
+
+    while (remaining > 0) {
+        size_t lines = remaining < lines_per_buffer ? remaining : lines_per_buffer;
+
+        if (! generator->generate_lines(generator->source, &pool, buffer, lines, &used)) {
+            memset(buffer, 0, BATCH_OUTPUT_BUFFER_SIZE);
+            random_pool_free(&pool);
+            free(buffer);
+            return false;
+        }
+
+        remaining -= lines;
+
+        if (! flush_output(buffer, &used, output)) {
+            random_pool_free(&pool);
+            free(buffer);
+            return false;
+        }
+    }
+
+    bool result = fflush(output) == 0;
+
+    random_pool_free(&pool);
+    free(buffer);
+    return result;
+}
+
+/**
+ * @note Generates count lines of the generator and writes them to output, by one thread or more.
+ *
+ * @return true on success, false on failure
+ */
+bool generate_batch_lines(const struct line_generator *generator, long count, int threads, FILE *output)
+{
+    if (! initialize_generator()) {
+        return false;
+    }
+
+    if (threads > 1) {
+        return generate_parallel(generator, count, threads, output);
+    }
+    return generate_sequential(generator, count, output);
+}
+
+/**
+ * @note Generates options->count passwords (or passphrases if options->words is not 0) without asking anything
+ * and writes them to output, one password per line. Passwords are collected in a large buffer, so output
+ * is written in big blocks.
+ *
+ * @param options Count, length, excluded characters and policy of the passwords (or words and separator
+ *                of passphrases) and number of threads generating them.
+ * @param output Opened stream where the passwords are written.
+ * @return true on success, false on failure
+ */
+bool generate_batch(const struct batch_options *options, FILE *output)
+{
+    struct pwgen_options settings = { .length = options->length, .excluded = options->excluded,
+                                      .policy = options->policy, .words = options->words,
+                                      .separator = options->separator };
+    struct pwgen_generator generator;
+    if (! pwgen_generator_init(&generator, &settings)) {
+        return false;
+    }
+
+    bool result = generate_batch_lines(&generator.lines, options->count, options->threads, output);
+    pwgen_generator_free(&generator);
+    return result;
+}
@@ -0,0 +1,48 @@
+#ifndef PASSWORD_GENERATOR_BATCH_GENERATION_H
+#define PASSWORD_GENERATOR_BATCH_GENERATION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "random_pool.h"
+#include "char_mapping.h"
+#include "passphrase.h"
+#include "policy.h"
+
+//Size of the buffer the generated passwords are collected in before they are written out
+#define BATCH_OUTPUT_BUFFER_SIZE (1 << 20)
+
+struct batch_options {
+    long count;
+    long length;
+    const char *excluded;
+    int threads;
+    //Number of words of passphrases, 0 for passwords of random characters
+    long words;
+    const char *separator;
+    struct password_policy policy;
+};
+
+/**
+ * Fills a buffer with whole lines of passwords of one kind, so the sequential and the parallel batch mode
+ * write random characters and passphrases the same way. No line is longer than longest_line (newline included).
+ */
+struct line_generator {
+    bool (*generate_lines)(const void *source, struct random_pool *pool, char *output, size_t count, size_t *used);
+    const void *source;
+    size_t longest_line;
+};
+
+struct character_lines {
+    const struct char_mapping *mapping;
+    size_t length;
+};
+
+void line_generator_characters(struct line_generator *generator, const struct character_lines *lines);
+void line_generator_passphrases(struct line_generator *generator, const struct passphrase_format *format);
+void line_generator_policy(struct line_generator *generator, const struct policy_generator *policy);
+bool generate_batch_lines(const struct line_generator *generator, long count, int threads, FILE *output);
+bool generate_batch(const struct batch_options *options, FILE *output);
+
+#endif //PASSWORD_GENERATOR_BATCH_GENERATION_H
@@ -0,0 +1,1429 @@
+#include "benchmark.h"
+#include "password_tools.h"
+#include "random_pool.h"
+#include "char_mapping.h"
+#include "strength.h"
+#include "breach_filter.h"
+#include "patterns.h"
+#include "passphrase.h"
+#include "passphrase_words.h"
+#include "policy.h"
+#include "profiles.h"
+#include "daemon.h"
+#include "vault_directory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+
+//Passwords are generated in blocks of this size, like in the batch mode
+#define BENCHMARK_BLOCK_SIZE (1 << 20)
+
+//Records in the vault of the daemon benchmark and requests sent to the daemon
+#define DAEMON_BENCHMARK_RECORDS 1000
+#define DAEMON_BENCHMARK_REQUESTS 100000
+
+//Lookups made by every reader process of the vault benchmark, with up to this many readers
+#define VAULT_BENCHMARK_READS 100000
+#define VAULT_BENCHMARK_MAX_READERS 8
+
+//Passwords saved by the commit benchmark, with group commit they are synced in groups of this size
+#define COMMIT_BENCHMARK_CHANGES 2000
+#define COMMIT_BENCHMARK_GROUP 64
+
+//Sites of the vault searched by the directory benchmark, and how many queries of each kind it runs
+#define DIRECTORY_BENCHMARK_SITES 100000
+#define DIRECTORY_BENCHMARK_QUERIES 10000
+//The scan of all sites is much slower, so it runs fewer queries
+#define DIRECTORY_BENCHMARK_SCANS 100
+#define DIRECTORY_BENCHMARK_DISTANCE 2
+
+//Vault sizes of the listing benchmark go from the smallest to the largest, 10 times bigger each time
+#define LISTING_BENCHMARK_SMALLEST 1000
+#define LISTING_BENCHMARK_LARGEST 1000000
+#define LISTING_BENCHMARK_PAGE 50
+#define LISTING_BENCHMARK_PAGES 1000
+
+//Profiles are loaded from their cache this many times
+#define PROFILE_BENCHMARK_LOADS 100
+
+//Sum of generated characters, so the compiler can't throw the generation away
+static volatile unsigned long benchmark_sink = 0;
+
+static double seconds_since(const struct timespec *start)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (double) (end.tv_sec - start->tv_sec) + (double) (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void report(const char *name, long count, double seconds)
+{
+    printf("%-40s %10.3f s %14.0f passwords/s\n", name, seconds, count / seconds);
+}
+
+/**
+ * @note The original mapping - one byte modulo the pool size. It is slow because of the division and
+ * it prefers the first 256 % size characters of the pool. Kept here only to compare the new mapping with it.
+ */
+static void map_with_modulo(const unsigned char *random_bytes, long length, const char *character_pool,
+                            int char_pool_end_index, char *password)
+{
+    int char_pool_size = char_pool_end_index + 1;
+
+    for (long i = 0; i < length; i++) {
+        password[i] = character_pool[random_bytes[i] % char_pool_size];
+    }
+}
+
+/**
+ * @note This is how passwords used to be generated - two mallocs and one RAND_bytes call per password.
+ */
+static bool benchmark_per_password_rand(long count, long length, const char *character_pool, int char_pool_end_index)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (long i = 0; i < count; i++) {
+        unsigned char *random_bytes = malloc(length * sizeof(unsigned char));
+        char *password = malloc((length + 2) * sizeof(char));
+        if (random_bytes == NULL || password == NULL) {
+            free(random_bytes);
+            free(password);
+            fprintf(stderr, "malloc failed\n");
+            return false;
+        }
+
+        if (RAND_bytes(random_bytes, length) != 1) {
+            fprintf(stderr, "failed to generate random numbers\n");
+            free(random_bytes);
+            free(password);
+            return false;
+        }
+
+        map_with_modulo(random_bytes, length, character_pool, char_pool_end_index, password);
+        benchmark_sink += password[0];
+
+        memset(random_bytes, 0, length);
+        memset(password, 0, length);
+        free(random_bytes);
+        free(password);
+    }
+
+    report("RAND_bytes per password, modulo", count, seconds_since(&start));
+    return true;
+}
+
+static bool benchmark_random_pool(long count, long length, const char *character_pool, int char_pool_end_index)
+{
+    char password[MAX_GENERATED_LENGTH + 1];
+
+    struct random_pool pool;
+    if (! random_pool_init(&pool)) {
+        return false;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (long i = 0; i < count; i++) {
+        const unsigned char *random_bytes = random_pool_take(&pool, length);
+        if (random_bytes == NULL) {
+            random_pool_free(&pool);
+            return false;
+        }
+
+        map_with_modulo(random_bytes, length, character_pool, char_pool_end_index, password);
+        benchmark_sink += password[0];
+    }
+
+    report("shared random pool, modulo", count, seconds_since(&start));
+
+    random_pool_free(&pool);
+    memset(password, 0, sizeof(password));
+    return true;
+}
+
+static bool benchmark_char_mapping(long count, long length, const struct char_mapping *mapping)
+{
+    size_t lines_per_block = BENCHMARK_BLOCK_SIZE / (length + 1);
+
+    char *block = malloc(BENCHMARK_BLOCK_SIZE * sizeof(char));
+    if (block == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        return false;
+    }
+
+    struct random_pool pool;
+    if (! random_pool_init(&pool)) {
+        free(block);
+        return false;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (long done = 0; done < count; done += (long) lines_per_block) {
+        size_t lines = count - done < (long) lines_per_block ? (size_t) (count - done) : lines_per_block;
+
+        if (! char_mapping_generate_lines(mapping, &pool, block, length, lines)) {
+            random_pool_free(&pool);
+            free(block);
+            return false;
+        }
+        benchmark_sink += block[0];
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "shared random pool, %s mapping", char_mapping_kernel_name(mapping->kernel));
+    report(name, count, seconds_since(&start));
+
+    random_pool_free(&pool);
+    memset(block, 0, BENCHMARK_BLOCK_SIZE);
+    free(block);
+    return true;
+}
+
+/**
+ * @note Generates count passphrases of PASSPHRASE_DEFAULT_WORDS words the way the batch mode does.
+ */
+static bool benchmark_passphrases(long count)
+{
+    struct passphrase_format format;
+    if (! passphrase_format_init(&format, PASSPHRASE_DEFAULT_WORDS, PASSPHRASE_DEFAULT_SEPARATOR)) {
+        return false;
+    }
+    size_t lines_per_block = BENCHMARK_BLOCK_SIZE / (passphrase_longest(&format) + 1);
+
+    char *block = malloc(BENCHMARK_BLOCK_SIZE * sizeof(char));
+    if (block == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        return false;
+    }
+
+    struct random_pool pool;
+    if (! random_pool_init(&pool)) {
+        free(block);
+        return false;
+    }
+
+    printf("\nGenerating %ld passphrases of %zu words (%.1f bits):\n", count, format.words, passphrase_entropy(&format));
+
+    bool result = true;
+    size_t used = 0;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (long done = 0; result && done < count; done += (long) lines_per_block) {
+        size_t lines = count - done < (long) lines_per_block ? (size_t) (count - done) : lines_per_block;
+        result = passphrase_generate_lines(&format, &pool, block, lines, &used);
+        benchmark_sink += block[0];
+    }
+
+    if (result) {
+        report("shared random pool, word list", count, seconds_since(&start));
+    }
+
+    random_pool_free(&pool);
+    OPENSSL_cleanse(block, BENCHMARK_BLOCK_SIZE);
+    free(block);
+    return result;
+}
+
+/**
+ * @note Generates count passwords of the strictest policies (no repeats, no sequences and all classes of the pool)
+ * once by the single pass policy generator and once by generating random passwords until one complies.
+ */
+static bool benchmark_policies(long count)
+{
+    const struct {
+        size_t length;
+        bool digits_only;
+    } cases[] = { { 8, false }, { 16, false }, { 64, false }, { 16, true } };
+
+    char non_digits[CHAR_POOL_LENGTH + 1];
+    size_t non_digit_count = 0;
+    for (char chr = ' '; chr <= '~'; chr++) {
+        if (chr < '0' || chr > '9') {
+            non_digits[non_digit_count++] = chr;
+        }
+    }
+    non_digits[non_digit_count] = '\0';
+
+    char password[POLICY_MAX_LENGTH];
+    struct random_pool pool;
+    if (! random_pool_init(&pool)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        size_t length = cases[i].length;
+        struct password_policy policy = {
+            .required = cases[i].digits_only ? STRENGTH_DIGIT
+                                             : STRENGTH_LOWER | STRENGTH_UPPER | STRENGTH_DIGIT | STRENGTH_SPECIAL,
+            .no_repeats = true,
+            .no_sequences = true
+        };
+
+        char character_pool[CHAR_POOL_LENGTH];
+        int char_pool_end_index = 0;
+        build_character_pool(cases[i].digits_only ? non_digits : "", character_pool, &char_pool_end_index);
+
+        struct char_mapping mapping;
+        struct policy_generator generator;
+        if (! char_mapping_init(&mapping, character_pool, char_pool_end_index)
+            || ! policy_generator_init(&generator, &policy, character_pool, char_pool_end_index, length)) {
+            random_pool_free(&pool);
+            return false;
+        }
+
+        printf("\nGenerating %ld passwords with %zu %s, no repeats or sequences (%.2f bits, %.2f without rules):\n",
+               count, length, cases[i].digits_only ? "digits" : "characters of all classes", policy_entropy(&generator),
+               length * log2(char_pool_end_index + 1));
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        unsigned long attempts = 0;
+        for (long done = 0; done < count; done++) {
+            do {
+                if (! char_mapping_generate(&mapping, &pool, password, length)) {
+                    policy_generator_free(&generator);
+                    random_pool_free(&pool);
+                    return false;
+                }
+                attempts++;
+            } while (! password_policy_allows(&policy, password, length));
+            benchmark_sink += password[0];
+        }
+        double seconds = seconds_since(&start);
+        printf("%-40s %10.3f s %14.0f passwords/s %8.2f tries\n", "generate and retry", seconds, count / seconds,
+               (double) attempts / count);
+
+        //The generator retries by itself when that is faster, the single pass is measured anyway
+        bool retry = generator.retry;
+        generator.retry = false;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (long done = 0; done < count; done++) {
+            if (! policy_generate(&generator, &pool, password)) {
+                policy_generator_free(&generator);
+                random_pool_free(&pool);
+                return false;
+            }
+            benchmark_sink += password[0];
+        }
+        report("single pass policy generator", count, seconds_since(&start));
+        printf("policy_generate %s (%.2f tries expected)\n", retry ? "retries" : "takes the single pass",
+               policy_expected_tries(&generator));
+        policy_generator_free(&generator);
+    }
+
+    random_pool_free(&pool);
+    OPENSSL_cleanse(password, sizeof(password));
+    return true;
+}
+
+//Corpus for the classifier benchmark, passwords of the shapes people really use
+#define STRENGTH_CORPUS_SIZE (64 << 20)
+
+struct strength_corpus {
+    char *text;
+    size_t *offsets;
+    size_t count;
+};
+
+/**
+ * @note Appends count characters chosen from set by the random bytes.
+ */
+static size_t append_from(char *text, const unsigned char *random_bytes, size_t count, const char *set)
+{
+    size_t set_size = strlen(set);
+    for (size_t i = 0; i < count; i++) {
+        text[i] = set[random_bytes[i] % set_size];
+    }
+    return count;
+}
+
+/**
+ * @note Builds passwords of four shapes: a word with a two digit number ("summer23"), a capitalized word
+ * with digits and a symbol ("Dragon1987!"), random printable characters (12 - 20, like generated ones)
+ * and lowercase passphrases (20 - 40 characters with spaces).
+ *
+ * @return true on success, false on failure
+ */
+static bool build_strength_corpus(struct strength_corpus *corpus)
+{
+    const char *lower = "abcdefghijklmnopqrstuvwxyz";
+    const char *upper = "ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    const char *digits = "0123456789";
+    const char *symbols = "!@#$%&*?";
+    const char *words = "abcdefghijklmnopqrstuvwxyz   ";
+
+    char printable[CHAR_POOL_LENGTH + 1];
+    for (int i = 0; i < CHAR_POOL_LENGTH; i++) {
+        printable[i] = (char) (' ' + i);
+    }
+    printable[CHAR_POOL_LENGTH] = '\0';
+
+    size_t capacity = STRENGTH_CORPUS_SIZE / 8;
+    corpus->text = malloc(STRENGTH_CORPUS_SIZE);
+    corpus->offsets = malloc((capacity + 1) * sizeof(*corpus->offsets));
+    corpus->count = 0;
+
+    struct random_pool pool;
+    if (corpus->text == NULL || corpus->offsets == NULL || ! random_pool_init(&pool)) {
+        free(corpus->text);
+        free(corpus->offsets);
+        fprintf(stderr, "malloc failed\n");
+        return false;
+    }
+
+    size_t used = 0;
+    while (corpus->count < capacity && STRENGTH_CORPUS_SIZE - used >= 64) {
+        const unsigned char *random_bytes = random_pool_take(&pool, 48);
+        if (random_bytes == NULL) {
+            break;
+        }
+
+        corpus->offsets[corpus->count++] = used;
+        char *password = corpus->text + used;
+        size_t length = 0;
+
+        switch (random_bytes[0] % 4) {
+            case 0:
+                length += append_from(password, random_bytes + 2, 6 + random_bytes[1] % 5, lower);
+                length += append_from(password + length, random_bytes + 12, 2, digits);
+                break;
+            case 1:
+                length += append_from(password, random_bytes + 2, 1, upper);
+                length += append_from(password + length, random_bytes + 3, 5 + random_bytes[1] % 4, lower);
+                length += append_from(password + length, random_bytes + 12, 4, digits);
+                length += append_from(password + length, random_bytes + 16, 1, symbols);
+                break;
+            case 2:
+                length += append_from(password, random_bytes + 2, 12 + random_bytes[1] % 9, printable);
+                break;
+            default:
+                length += append_from(password, random_bytes + 2, 20 + random_bytes[1] % 21, words);
+                break;
+        }
+        used += length;
+    }
+
+    corpus->offsets[corpus->count] = used;
+    random_pool_free(&pool);
+    return true;
+}
+
+//Passwords of the corpus scored by the pattern matcher
+#define PATTERN_BENCHMARK_PASSWORDS 200000
+
+/**
+ * @note How the classes used to be found - a branchy loop calling the ctype functions for every byte.
+ */
+static unsigned classes_with_ctype(const char *password, size_t length)
+{
+    unsigned classes = 0;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char character = (unsigned char) password[i];
+        if (isupper(character)) {
+            classes |= STRENGTH_UPPER;
+        } else if (islower(character)) {
+            classes |= STRENGTH_LOWER;
+        } else if (isdigit(character)) {
+            classes |= STRENGTH_DIGIT;
+        } else {
+            classes |= STRENGTH_SPECIAL;
+        }
+    }
+    return classes;
+}
+
+/**
+ * @note Finds the classes of every password of the corpus with the old ctype loop and every classifier
+ * kernel the CPU supports, and checks that all of them agree. Then scores a part of the corpus with
+ * the pattern matcher.
+ *
+ * @return true if all kernels gave the same classes, false otherwise
+ */
+static bool benchmark_strength_classes(void)
+{
+    struct strength_corpus corpus;
+    if (! build_strength_corpus(&corpus)) {
+        return false;
+    }
+
+    unsigned char *expected = malloc(corpus.count);
+    if (expected == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        free(corpus.text);
+        free(corpus.offsets);
+        return false;
+    }
+
+    size_t bytes = corpus.offsets[corpus.count];
+    printf("\nFinding character classes of %zu passwords (%.1f MB):\n", corpus.count, (double) bytes / 1e6);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < corpus.count; i++) {
+        expected[i] = (unsigned char) classes_with_ctype(corpus.text + corpus.offsets[i],
+                                                         corpus.offsets[i + 1] - corpus.offsets[i]);
+    }
+    double seconds = seconds_since(&start);
+    printf("%-40s %10.3f s %14.0f passwords/s %8.1f MB/s\n", "ctype loop", seconds, corpus.count / seconds,
+           (double) bytes / 1e6 / seconds);
+
+    enum strength_kernel best = strength_current_kernel();
+    bool matching = true;
+
+    for (int kernel = STRENGTH_SCALAR; kernel < STRENGTH_KERNEL_COUNT; kernel++) {
+        if (! strength_use_kernel(kernel)) {
+            continue;
+        }
+
+        size_t mismatches = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (size_t i = 0; i < corpus.count; i++) {
+            unsigned classes = strength_classes(corpus.text + corpus.offsets[i], corpus.offsets[i + 1] - corpus.offsets[i]);
+            mismatches += classes != expected[i];
+        }
+        seconds = seconds_since(&start);
+
+        char name[64];
+        snprintf(name, sizeof(name), "%s classifier", strength_kernel_name(kernel));
+        printf("%-40s %10.3f s %14.0f passwords/s %8.1f MB/s\n", name, seconds, corpus.count / seconds,
+               (double) bytes / 1e6 / seconds);
+
+        if (mismatches != 0) {
+            printf("%s classifier differs from the ctype loop for %zu passwords\n", strength_kernel_name(kernel),
+                   mismatches);
+            matching = false;
+        }
+    }
+    strength_use_kernel(best);
+
+    //The pattern matcher is much slower, a part of the corpus is enough
+    struct pattern_scorer scorer;
+    if (! pattern_scorer_init(&scorer)) {
+        matching = false;
+    } else {
+        size_t count = corpus.count < PATTERN_BENCHMARK_PASSWORDS ? corpus.count : PATTERN_BENCHMARK_PASSWORDS;
+        double entropy = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (size_t i = 0; i < count; i++) {
+            const char *password = corpus.text + corpus.offsets[i];
+            size_t length = corpus.offsets[i + 1] - corpus.offsets[i];
+            entropy += pattern_entropy(&scorer, password, length, strength_classes(password, length));
+        }
+        seconds = seconds_since(&start);
+        benchmark_sink += (unsigned long) entropy;
+        printf("%-40s %10.3f s %14.0f passwords/s %8.1f us/password\n", "pattern matcher", seconds, count / seconds,
+               seconds * 1e6 / count);
+        pattern_scorer_free(&scorer);
+    }
+
+    free(expected);
+    free(corpus.text);
+    free(corpus.offsets);
+    return matching;
+}
+
+//Passwords in the benchmarked breach filter, its 24 MB do not fit to the caches like real filters
+#define BREACH_BENCHMARK_ENTRIES (16 * 1024 * 1024)
+
+/**
+ * @note Fills the digest with the next numbers of the splitmix64 sequence. SHA-1 digests are uniform,
+ * so these work as digests of different passwords and can be made again for the lookups.
+ */
+static void next_digest(uint64_t *state, unsigned char *digest)
+{
+    for (int i = 0; i < BREACH_FILTER_DIGEST_SIZE; i += 4) {
+        uint64_t value = (*state += 0x9E3779B97F4A7C15u);
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9u;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBu;
+        value ^= value >> 31;
+        memcpy(digest + i, &value, 4);
+    }
+}
+
+/**
+ * @note Adds BREACH_BENCHMARK_ENTRIES digests to a breach filter, looks all of them up and the same number
+ * of digests that are not there, to get the lookup speed and the false positive rate.
+ *
+ * @return true if every added digest was found, false otherwise
+ */
+static bool benchmark_breach_filter(void)
+{
+    struct breach_filter filter;
+    if (! breach_filter_create(&filter, BREACH_BENCHMARK_ENTRIES)) {
+        return false;
+    }
+
+    unsigned char digest[BREACH_FILTER_DIGEST_SIZE];
+    uint64_t state = 1;
+    printf("\nBreach filter with %d passwords (%.1f MB):\n", BREACH_BENCHMARK_ENTRIES, (double) filter.map_size / 1e6);
+
+    for (long i = 0; i < BREACH_BENCHMARK_ENTRIES; i++) {
+        next_digest(&state, digest);
+        breach_filter_add(&filter, digest);
+    }
+
+    struct timespec start;
+    long found = 0;
+    state = 1;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < BREACH_BENCHMARK_ENTRIES; i++) {
+        next_digest(&state, digest);
+        found += breach_filter_contains(&filter, digest);
+    }
+    report("lookups of breached passwords", BREACH_BENCHMARK_ENTRIES, seconds_since(&start));
+
+    long false_positives = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < BREACH_BENCHMARK_ENTRIES; i++) {
+        next_digest(&state, digest);
+        false_positives += breach_filter_contains(&filter, digest);
+    }
+    report("lookups of other passwords", BREACH_BENCHMARK_ENTRIES, seconds_since(&start));
+    printf("%.3f %% of other passwords were reported as breached\n",
+           100.0 * (double) false_positives / BREACH_BENCHMARK_ENTRIES);
+
+    breach_filter_close(&filter);
+    if (found != BREACH_BENCHMARK_ENTRIES) {
+        printf("%ld breached passwords were not found\n", BREACH_BENCHMARK_ENTRIES - found);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @note Writes profiles to a temporary file and compares how long it takes to compile them with how long
+ * it takes to load them from the cache.
+ *
+ * @return true on success, false on failure
+ */
+static bool benchmark_profiles(void)
+{
+    char directory[] = "/tmp/password_generator_XXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        fprintf(stderr, "failed to create a temporary directory\n");
+        return false;
+    }
+
+    char path[sizeof(directory) + sizeof("/" PROFILES_FILE PROFILES_CACHE_SUFFIX)];
+    snprintf(path, sizeof(path), "%s/%s", directory, PROFILES_FILE);
+    FILE *file = fopen(path, "w");
+    if (file == NULL || fputs("[strict]\nlength = 64\nrequire = all\nno-repeats = yes\nno-sequences = yes\n\n"
+                              "[plain]\nlength = 20\n\n[phrase]\nwords = 6\n", file) < 0 || fclose(file) != 0) {
+        fprintf(stderr, "failed to write %s\n", path);
+        rmdir(directory);
+        return false;
+    }
+
+    printf("\nLoading profiles (64 characters with all rules, 20 characters, 6 words):\n");
+    struct profile_set compiled;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    bool loaded = profiles_load(&compiled, path);
+    bool result = loaded;
+    size_t table_limbs = 0;
+    if (result) {
+        printf("%-40s %10.1f us\n", "compiled", seconds_since(&start) * 1e6);
+        const struct policy_generator *strict = &compiled.profiles[0].policy;
+        table_limbs = strict->row_start[strict->length - 1]
+                      + STRENGTH_CLASS_MASKS * (strict->size + 1) * strict->row_limbs[strict->length - 1];
+    }
+
+    double seconds = 0;
+    for (int i = 0; result && i < PROFILE_BENCHMARK_LOADS; i++) {
+        struct profile_set cached;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        result = profiles_load(&cached, path);
+        seconds += seconds_since(&start);
+        if (! result) {
+            break;
+        }
+
+        //The cached profiles must be the same as the compiled ones
+        if (cached.map == NULL || cached.count != compiled.count
+            || memcmp(cached.profiles[0].policy.total, compiled.profiles[0].policy.total,
+                      sizeof(compiled.profiles[0].policy.total)) != 0
+            || memcmp(cached.profiles[0].policy.prefixes, compiled.profiles[0].policy.prefixes,
+                      table_limbs * sizeof(uint64_t)) != 0) {
+            printf("profiles loaded from the cache differ from the compiled ones\n");
+            result = false;
+        }
+        profiles_free(&cached);
+    }
+    if (result) {
+        printf("%-40s %10.1f us\n", "loaded from the cache", seconds / PROFILE_BENCHMARK_LOADS * 1e6);
+    }
+    if (loaded) {
+        profiles_free(&compiled);
+    }
+
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/%s%s", directory, PROFILES_FILE, PROFILES_CACHE_SUFFIX);
+    unlink(path);
+    rmdir(directory);
+    return result;
+}
+
+static void *serve_daemon(void *server)
+{
+    return daemon_run(server) ? server : NULL;
+}
+
+/**
+ * @note Sends requests of one kind to the daemon and prints the average round trip.
+ *
+ * @param request Builds the i-th request.
+ * @param check Checks the response of the i-th request.
+ * @return true if every request was answered correctly, false otherwise
+ */
+static bool time_requests(int fd, const char *name, long count, void (*request)(struct daemon_message *, long),
+                          bool (*check)(struct daemon_message *, long))
+{
+    static struct daemon_message message;
+    static struct daemon_message response;
+    struct timespec start;
+    uint16_t status = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < count; i++) {
+        request(&message, i);
+        if (! daemon_call(fd, &message, &response, &status) || status != DAEMON_OK || ! check(&response, i)) {
+            printf("request %ld of %s failed with status %u\n", i, name, status);
+            return false;
+        }
+    }
+    double seconds = seconds_since(&start);
+    printf("%-40s %10.1f us %12.0f requests/s\n", name, seconds / count * 1e6, count / seconds);
+    return true;
+}
+
+static void get_request(struct daemon_message *message, long i)
+{
+    char site[32];
+    int length = snprintf(site, sizeof(site), "site%ld.example", i % DAEMON_BENCHMARK_RECORDS);
+    daemon_message_start(message, DAEMON_GET);
+    daemon_message_add_string(message, site, (size_t) length);
+    daemon_message_add_string(message, "joe", 3);
+}
+
+static bool check_get(struct daemon_message *response, long i)
+{
+    char expected[32];
+    int expected_length = snprintf(expected, sizeof(expected), "password%ld", i % DAEMON_BENCHMARK_RECORDS);
+    const char *password = NULL;
+    size_t length = 0;
+    return daemon_message_read_string(response, &password, &length) && length == (size_t) expected_length
+           && memcmp(password, expected, length) == 0;
+}
+
+static void generate_request(struct daemon_message *message, long i)
+{
+    (void) i;
+    daemon_message_start(message, DAEMON_GENERATE);
+    daemon_message_add_u16(message, 20);
+    daemon_message_add_u16(message, 0);
+    daemon_message_add_u8(message, 0);
+    daemon_message_add_u8(message, 0);
+    daemon_message_add_string(message, "", 0);
+    daemon_message_add_string(message, "", 0);
+}
+
+static bool check_generate(struct daemon_message *response, long i)
+{
+    (void) i;
+    const char *password = NULL;
+    size_t length = 0;
+    return daemon_message_read_string(response, &password, &length) && length == 20;
+}
+
+static void score_request(struct daemon_message *message, long i)
+{
+    (void) i;
+    daemon_message_start(message, DAEMON_SCORE);
+    daemon_message_add_string(message, "Tr0ub4dour&3", 12);
+}
+
+static bool check_score(struct daemon_message *response, long i)
+{
+    (void) i;
+    uint8_t strength = 0;
+    return daemon_message_read_u8(response, &strength) && strength < STRENGTH_CLASS_COUNT;
+}
+
+/**
+ * @note Removes the vault file of a benchmark directory and the files next to it.
+ */
+static void remove_vault_files(const char *vault_path)
+{
+    const char *suffixes[] = { "", VAULT_LOG_SUFFIX, VAULT_LOCK_SUFFIX };
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(*suffixes); i++) {
+        char path[sizeof("/tmp/password_generator_XXXXXX/vault") + sizeof(VAULT_LOCK_SUFFIX)];
+        snprintf(path, sizeof(path), "%s%s", vault_path, suffixes[i]);
+        unlink(path);
+    }
+}
+
+/**
+ * @note Starts the daemon on a temporary vault in another thread and measures round trips of its requests
+ * from one client.
+ *
+ * @return true on success, false on failure
+ */
+static bool benchmark_daemon(void)
+{
+    char directory[] = "/tmp/password_generator_XXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        fprintf(stderr, "failed to create a temporary directory\n");
+        return false;
+    }
+
+    char vault_path[sizeof(directory) + sizeof("/vault")];
+    char socket_path[sizeof(directory) + sizeof("/socket")];
+    snprintf(vault_path, sizeof(vault_path), "%s/vault", directory);
+    snprintf(socket_path, sizeof(socket_path), "%s/socket", directory);
+
+    struct vault vault;
+    if (! pwgen_vault_encrypt(&vault, vault_path, "benchmark")) {
+        rmdir(directory);
+        return false;
+    }
+
+    bool result = true;
+    for (long i = 0; result && i < DAEMON_BENCHMARK_RECORDS; i++) {
+        char site[32];
+        char password[32];
+        snprintf(site, sizeof(site), "site%ld.example", i);
+        snprintf(password, sizeof(password), "password%ld", i);
+        result = vault_put(&vault, site, "joe", password);
+    }
+
+    static struct daemon_server server;
+    pthread_t thread;
+    bool started = false;
+    int fd = -1;
+    bool initialized = result;
+    result = result && daemon_init(&server, socket_path, &vault, NULL, NULL);
+    if (result) {
+        started = pthread_create(&thread, NULL, serve_daemon, &server) == 0;
+        result = started && daemon_connect(socket_path, &fd);
+    }
+
+    if (result) {
+        printf("\nDaemon on a Unix socket, one client (%d records in the vault):\n", DAEMON_BENCHMARK_RECORDS);
+        result = time_requests(fd, "get round trips", DAEMON_BENCHMARK_REQUESTS, get_request, check_get)
+                 && time_requests(fd, "generate round trips", DAEMON_BENCHMARK_REQUESTS, generate_request,
+                                  check_generate)
+                 && time_requests(fd, "score round trips", DAEMON_BENCHMARK_REQUESTS / 10, score_request,
+                                  check_score);
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (started) {
+        daemon_stop(&server);
+        void *served = NULL;
+        pthread_join(thread, &served);
+        result = result && served != NULL;
+    }
+    if (initialized) {
+        daemon_free(&server);
+    }
+    vault_close(&vault);
+
+    remove_vault_files(vault_path);
+    rmdir(directory);
+    return result;
+}
+
+/**
+ * @note Saves COMMIT_BENCHMARK_CHANGES passwords to the vault and prints how long it took.
+ *
+ * @param group Changes synced at once, 1 for an fsync per change without group commit.
+ * @return true on success, false on failure
+ */
+static bool time_commits(struct vault *vault, const char *name, long group)
+{
+    bool result = vault_set_group_commit(vault, group > 1);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; result && i < COMMIT_BENCHMARK_CHANGES; i++) {
+        char site[32];
+        char password[32];
+        snprintf(site, sizeof(site), "site%ld.example", i);
+        snprintf(password, sizeof(password), "password%ld", i);
+        result = vault_put(vault, site, name, password) && ((i + 1) % group != 0 || vault_sync(vault));
+    }
+    result = result && vault_sync(vault);
+    double seconds = seconds_since(&start);
+
+    if (result) {
+        printf("%-40s %10.1f us %12.0f changes/s\n", name, seconds / COMMIT_BENCHMARK_CHANGES * 1e6,
+               COMMIT_BENCHMARK_CHANGES / seconds);
+    }
+    return vault_set_group_commit(vault, false) && result;
+}
+
+/**
+ * @note Compares saving passwords with an fsync per change and with group commit. The vault is created
+ * in the current directory, like the real one, because /tmp is often kept in memory, where fsync costs nothing.
+ *
+ * @return true on success, false on failure
+ */
+static bool benchmark_commits(void)
+{
+    char directory[] = "password_generator_XXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        fprintf(stderr, "failed to create a temporary directory\n");
+        return false;
+    }
+
+    char vault_path[sizeof(directory) + sizeof("/vault")];
+    snprintf(vault_path, sizeof(vault_path), "%s/vault", directory);
+
+    struct vault vault;
+    bool result = vault_open(&vault, vault_path);
+    if (result) {
+        printf("\nSaving %d passwords to the vault, every change durable:\n", COMMIT_BENCHMARK_CHANGES);
+        char name[64];
+        snprintf(name, sizeof(name), "group commit of %d changes", COMMIT_BENCHMARK_GROUP);
+        result = time_commits(&vault, "fsync per change", 1) && time_commits(&vault, name, COMMIT_BENCHMARK_GROUP);
+        vault_close(&vault);
+    }
+
+    remove_vault_files(vault_path);
+    rmdir(directory);
+    return result;
+}
+
+/**
+ * @note Looks up all records of the benchmark vault in turns, in a process of its own.
+ *
+ * @return exit status of the process
+ */
+static int read_vault(const char *vault_path)
+{
+    struct vault vault;
+    if (! vault_open(&vault, vault_path)) {
+        return EXIT_FAILURE;
+    }
+
+    bool result = true;
+    for (long i = 0; result && i < VAULT_BENCHMARK_READS; i++) {
+        char site[32];
+        char expected[32];
+        snprintf(site, sizeof(site), "site%ld.example", i % DAEMON_BENCHMARK_RECORDS);
+        snprintf(expected, sizeof(expected), "password%ld", i % DAEMON_BENCHMARK_RECORDS);
+
+        struct vault_record record;
+        bool found = false;
+        result = vault_get(&vault, site, "joe", &record, &found) && found && strcmp(record.password, expected) == 0;
+        if (found) {
+            vault_record_free(&record);
+        }
+    }
+
+    vault_close(&vault);
+    return result ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @note Saves the same passwords to the benchmark vault again and again until stop is set, in a process of its own.
+ *
+ * @return exit status of the process
+ */
+static int write_vault(const char *vault_path, volatile sig_atomic_t *stop, long *writes)
+{
+    struct vault vault;
+    if (! vault_open(&vault, vault_path)) {
+        return EXIT_FAILURE;
+    }
+
+    bool result = true;
+    for (long i = 0; result && ! *stop; i++) {
+        char site[32];
+        char password[32];
+        snprintf(site, sizeof(site), "site%ld.example", i % DAEMON_BENCHMARK_RECORDS);
+        snprintf(password, sizeof(password), "password%ld", i % DAEMON_BENCHMARK_RECORDS);
+        result = vault_put(&vault, site, "joe", password);
+        *writes = i + 1;
+    }
+
+    vault_close(&vault);
+    return result ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @return true if the child process exited successfully
+ */
+static bool wait_for(pid_t pid)
+{
+    int status = 0;
+    return pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+/**
+ * @note Measures lookups of more processes reading one vault at once while another process keeps changing it.
+ * The readers never wait for the writer, so the lookups should scale with the number of readers.
+ *
+ * @return true on success, false on failure
+ */
+static bool benchmark_vault_processes(void)
+{
+    char directory[] = "/tmp/password_generator_XXXXXX";
+    if (mkdtemp(directory) == NULL) {
+        fprintf(stderr, "failed to create a temporary directory\n");
+        return false;
+    }
+
+    char vault_path[sizeof(directory) + sizeof("/vault")];
+    snprintf(vault_path, sizeof(vault_path), "%s/vault", directory);
+
+    //Shared with the writer process: the flag that stops it and the number of its writes
+    struct shared_state {
+        volatile sig_atomic_t stop;
+        long writes;
+    } *shared = mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+    struct vault vault;
+    bool result = shared != MAP_FAILED && vault_open(&vault, vault_path);
+    if (result) {
+        for (long i = 0; result && i < DAEMON_BENCHMARK_RECORDS; i++) {
+            char site[32];
+            char password[32];
+            snprintf(site, sizeof(site), "site%ld.example", i);
+            snprintf(password, sizeof(password), "password%ld", i);
+            result = vault_put(&vault, site, "joe", password);
+        }
+        vault_close(&vault);
+    }
+
+    if (result) {
+        printf("\nProcesses reading one vault while another process writes to it (%d records):\n",
+               DAEMON_BENCHMARK_RECORDS);
+    }
+
+    //Output of the parent must not be written once more by the children
+    fflush(stdout);
+
+    for (int readers = 1; result && readers <= VAULT_BENCHMARK_MAX_READERS; readers *= 2) {
+        shared->stop = 0;
+        shared->writes = 0;
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        pid_t writer = fork();
+        if (writer == 0) {
+            _exit(write_vault(vault_path, &shared->stop, &shared->writes));
+        }
+
+        pid_t pids[VAULT_BENCHMARK_MAX_READERS];
+        for (int i = 0; i < readers; i++) {
+            pids[i] = fork();
+            if (pids[i] == 0) {
+                _exit(read_vault(vault_path));
+            }
+        }
+
+        for (int i = 0; i < readers; i++) {
+            result = wait_for(pids[i]) && result;
+        }
+        double seconds = seconds_since(&start);
+        shared->stop = 1;
+        result = wait_for(writer) && result;
+
+        if (! result) {
+            fprintf(stderr, "a process of the vault benchmark failed\n");
+            break;
+        }
+
+        long reads = (long) readers * VAULT_BENCHMARK_READS;
+        char name[64];
+        snprintf(name, sizeof(name), "%d reader%s, one writer", readers, readers == 1 ? "" : "s");
+        printf("%-40s %10.3f s %12.0f lookups/s %8.0f writes/s\n", name, seconds, reads / seconds,
+               shared->writes / seconds);
+    }
+
+    if (shared != MAP_FAILED) {
+        munmap(shared, sizeof(*shared));
+    }
+    remove_vault_files(vault_path);
+    rmdir(directory);
+    return result;
+}
+
+/**
+ * @note Writes the name of the i-th site of the directory benchmark, two passphrase words and a domain,
+ * so the sites share prefixes like real ones do.
+ *
+ * @param site Buffer for VAULT_MAX_NAME_LENGTH + 1 characters.
+ * @return length of the name
+ */
+static size_t directory_site(long i, char *site)
+{
+    long first = i % passphrase_word_count;
+    long second = i / passphrase_word_count;
+    return (size_t) snprintf(site, VAULT_MAX_NAME_LENGTH + 1, "%.*s-%.*s.com",
+                             passphrase_word_offsets[first + 1] - passphrase_word_offsets[first],
+                             passphrase_words + passphrase_word_offsets[first],
+                             passphrase_word_offsets[second + 1] - passphrase_word_offsets[second],
+                             passphrase_words + passphrase_word_offsets[second]);
+}
+
+/**
+ * @note Edit distance of two names by the whole table, like a search without the directory computes it
+ * for every site.
+ */
+static uint32_t edit_distance(const char *first, size_t first_length, const char *second, size_t second_length)
+{
+    static uint32_t table[VAULT_MAX_NAME_LENGTH + 1][VAULT_MAX_NAME_LENGTH + 1];
+
+    for (size_t i = 0; i <= first_length; i++) {
+        table[i][0] = (uint32_t) i;
+    }
+    for (size_t j = 0; j <= second_length; j++) {
+        table[0][j] = (uint32_t) j;
+    }
+
+    for (size_t i = 1; i <= first_length; i++) {
+        for (size_t j = 1; j <= second_length; j++) {
+            uint32_t value = table[i - 1][j - 1] + (first[i - 1] != second[j - 1]);
+            if (table[i - 1][j] + 1 < value) {
+                value = table[i - 1][j] + 1;
+            }
+            if (table[i][j - 1] + 1 < value) {
+                value = table[i][j - 1] + 1;
+            }
+            if (i > 1 && j > 1 && first[i - 1] == second[j - 2] && first[i - 2] == second[j - 1]
+                && table[i - 2][j - 2] + 1 < value) {
+                value = table[i - 2][j - 2] + 1;
+            }
+            table[i][j] = value;
+        }
+    }
+    return table[first_length][second_length];
+}
+
+/**
+ * @note Writes the query of the i-th search of the directory benchmark: the name of a site with two neighbouring
+ * characters swapped, a typical typo.
+ *
+ * @return length of the query
+ */
+static size_t directory_query(long i, char *query)
+{
+    size_t length = directory_site(i * 7919 % DIRECTORY_BENCHMARK_SITES, query);
+    size_t position = (size_t) i % (length - 1);
+    char swapped = query[position];
+    query[position] = query[position + 1];
+    query[position + 1] = swapped;
+    return length;
+}
+
+/**
+ * @note Searches the sites of a big vault by prefix and with typos, with the directory and by a scan of all sites,
+ * and checks that both find the same sites.
+ *
+ * @return true on success, false on failure
+ */
+static bool benchmark_directory(void)
+{
+    char directory_path[] = "/tmp/password_generator_XXXXXX";
+    if (mkdtemp(directory_path) == NULL) {
+        fprintf(stderr, "failed to create a temporary directory\n");
+        return false;
+    }
+
+    char vault_path[sizeof(directory_path) + sizeof("/vault")];
+    snprintf(vault_path, sizeof(vault_path), "%s/vault", directory_path);
+
+    struct arena arena;
+    arena_init(&arena);
+    struct vault_record *records = malloc(DIRECTORY_BENCHMARK_SITES * sizeof(*records));
+    bool result = records != NULL;
+    if (! result) {
+        fprintf(stderr, "malloc failed\n");
+    }
+
+    for (long i = 0; result && i < DIRECTORY_BENCHMARK_SITES; i++) {
+        char site[VAULT_MAX_NAME_LENGTH + 1];
+        size_t length = directory_site(i, site);
+        records[i] = (struct vault_record) { .site = arena_copy(&arena, site, length), .site_length = length,
+                                             .account = "joe", .account_length = 3,
+                                             .password = "password", .password_length = 8 };
+        result = records[i].site != NULL;
+    }
+
+    struct vault vault;
+    struct vault_directory directory = { 0 };
+    bool opened = result && vault_open(&vault, vault_path);
+    result = opened && vault_put_all(&vault, records, DIRECTORY_BENCHMARK_SITES, false);
+    free(records);
+    arena_free(&arena);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    result = result && vault_directory_build(&directory, &vault);
+    double seconds = seconds_since(&start);
+
+    if (result) {
+        printf("\nSearching names of %d sites (names only, nothing decrypted):\n", DIRECTORY_BENCHMARK_SITES);
+        printf("%-40s %10.3f s\n", "building the directory", seconds);
+    }
+
+    //Prefix queries are the first 4 characters of the sites
+    unsigned long found = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; result && i < DIRECTORY_BENCHMARK_QUERIES; i++) {
+        const struct vault_directory_site *site = &directory.sites[i * 7919 % directory.site_count];
+        size_t first = 0;
+        size_t end = 0;
+        vault_directory_prefix(&directory, site->name, 4, &first, &end);
+        found += end - first;
+    }
+    seconds = seconds_since(&start);
+    if (result) {
+        printf("%-40s %10.1f us %12.0f queries/s %8.1f sites each\n", "prefix, directory",
+               seconds / DIRECTORY_BENCHMARK_QUERIES * 1e6, DIRECTORY_BENCHMARK_QUERIES / seconds,
+               (double) found / DIRECTORY_BENCHMARK_QUERIES);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; result && i < DIRECTORY_BENCHMARK_SCANS; i++) {
+        const struct vault_directory_site *site = &directory.sites[i * 7919 % directory.site_count];
+        size_t first = 0;
+        size_t end = 0;
+        vault_directory_prefix(&directory, site->name, 4, &first, &end);
+
+        size_t scanned = 0;
+        for (size_t j = 0; j < directory.site_count; j++) {
+            scanned += directory.sites[j].length >= 4 && memcmp(directory.sites[j].name, site->name, 4) == 0;
+        }
+        if (scanned != end - first) {
+            fprintf(stderr, "the prefix search found %zu sites instead of %zu\n", end - first, scanned);
+            result = false;
+        }
+    }
+    seconds = seconds_since(&start);
+    if (result) {
+        printf("%-40s %10.1f us %12.0f queries/s\n", "prefix, scan of all sites",
+               seconds / DIRECTORY_BENCHMARK_SCANS * 1e6, DIRECTORY_BENCHMARK_SCANS / seconds);
+    }
+
+    found = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; result && i < DIRECTORY_BENCHMARK_QUERIES; i++) {
+        char query[VAULT_MAX_NAME_LENGTH + 1];
+        size_t length = directory_query(i, query);
+        struct vault_directory_match *matches = NULL;
+        size_t count = 0;
+        result = vault_directory_fuzzy(&directory, query, length, DIRECTORY_BENCHMARK_DISTANCE, &matches, &count);
+        found += count;
+        free(matches);
+    }
+    seconds = seconds_since(&start);
+    if (result) {
+        printf("%-40s %10.1f us %12.0f queries/s %8.1f sites each\n", "2 typos, directory",
+               seconds / DIRECTORY_BENCHMARK_QUERIES * 1e6, DIRECTORY_BENCHMARK_QUERIES / seconds,
+               (double) found / DIRECTORY_BENCHMARK_QUERIES);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (long i = 0; result && i < DIRECTORY_BENCHMARK_SCANS; i++) {
+        char query[VAULT_MAX_NAME_LENGTH + 1];
+        size_t length = directory_query(i, query);
+        struct vault_directory_match *matches = NULL;
+        size_t count = 0;
+        result = vault_directory_fuzzy(&directory, query, length, DIRECTORY_BENCHMARK_DISTANCE, &matches, &count);
+        free(matches);
+
+        size_t scanned = 0;
+        for (size_t j = 0; result && j < directory.site_count; j++) {
+            const struct vault_directory_site *site = &directory.sites[j];
+            scanned += edit_distance(site->name, site->length, query, length) <= DIRECTORY_BENCHMARK_DISTANCE;
+        }
+        if (result && scanned != count) {
+            fprintf(stderr, "the search with typos found %zu sites instead of %zu\n", count, scanned);
+            result = false;
+        }
+    }
+    seconds = seconds_since(&start);
+    if (result) {
+        printf("%-40s %10.1f us %12.0f queries/s\n", "2 typos, scan of all sites",
+               seconds / DIRECTORY_BENCHMARK_SCANS * 1e6, DIRECTORY_BENCHMARK_SCANS / seconds);
+    }
+
+    vault_directory_free(&directory);
+    if (opened) {
+        vault_close(&vault);
+    }
+    remove_vault_files(vault_path);
+    rmdir(directory_path);
+    return result;
+}
+
+/**
+ * @note Counts the records passed by vault_list.
+ */
+static bool count_listed(const struct vault_record *record, void *context)
+{
+    (void) record;
+    (*(size_t *) context)++;
+    return true;
+}
+
+/**
+ * @note Lists pages of names from the middle of vaults of growing sizes, by the cursor and by a walk through
+ * all records before the page, which is what listing without the order of the vault file costs.
+ *
+ * @return true on success, false on failure
+ */
+static bool benchmark_listing(void)
+{
+    char directory_path[] = "/tmp/password_generator_XXXXXX";
+    if (mkdtemp(directory_path) == NULL) {
+        fprintf(stderr, "failed to create a temporary directory\n");
+        return false;
+    }
+
+    char vault_path[sizeof(directory_path) + sizeof("/vault")];
+    snprintf(vault_path, sizeof(vault_path), "%s/vault", directory_path);
+
+    printf("\nListing pages of %d names from the middle of the vault:\n", LISTING_BENCHMARK_PAGE);
+    bool result = true;
+
+    for (long size = LISTING_BENCHMARK_SMALLEST; result && size <= LISTING_BENCHMARK_LARGEST; size *= 10) {
+        struct arena arena;
+        arena_init(&arena);
+        struct vault_record *records = malloc(size * sizeof(*records));
+        result = records != NULL;
+        if (! result) {
+            fprintf(stderr, "malloc failed\n");
+        }
+
+        for (long i = 0; result && i < size; i++) {
+            char site[32];
+            int length = snprintf(site, sizeof(site), "site%08ld.example", i);
+            records[i] = (struct vault_record) { .site = arena_copy(&arena, site, length), .site_length = length,
+                                                 .account = "joe", .account_length = 3,
+                                                 .password = "password", .password_length = 8 };
+            result = records[i].site != NULL;
+        }
+
+        struct vault vault;
+        bool opened = result && vault_open(&vault, vault_path);
+        result = opened && vault_put_all(&vault, records, size, false);
+        free(records);
+        arena_free(&arena);
+
+        //The cursor of the page in the middle is the record before it
+        struct vault_cursor middle = { .account_length = 3, .started = true };
+        middle.site_length = (uint32_t) snprintf(middle.site, sizeof(middle.site), "site%08ld.example", size / 2 - 1);
+        memcpy(middle.account, "joe", 3);
+        struct vault_list_query query = { .site_pattern = NULL, .account_pattern = NULL,
+                                          .limit = LISTING_BENCHMARK_PAGE, .passwords = false };
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (long i = 0; result && i < LISTING_BENCHMARK_PAGES; i++) {
+            struct vault_cursor cursor = middle;
+            size_t listed = 0;
+            bool more = false;
+            result = vault_list(&vault, &query, &cursor, count_listed, &listed, &more)
+                     && listed == LISTING_BENCHMARK_PAGE && more;
+        }
+        double cursor_seconds = seconds_since(&start);
+
+        //Without the cursor, the records before the page have to be walked through
+        struct vault_list_query walk = query;
+        walk.limit = size / 2 + LISTING_BENCHMARK_PAGE;
+        long walks = LISTING_BENCHMARK_PAGES * LISTING_BENCHMARK_SMALLEST / size;
+        walks = walks == 0 ? 1 : walks;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (long i = 0; result && i < walks; i++) {
+            struct vault_cursor cursor = { .started = false };
+            size_t listed = 0;
+            bool more = false;
+            result = vault_list(&vault, &walk, &cursor, count_listed, &listed, &more);
+        }
+        double walk_seconds = seconds_since(&start);
+
+        if (opened) {
+            vault_close(&vault);
+        }
+        remove_vault_files(vault_path);
+
+        if (! result) {
+            fprintf(stderr, "the listing benchmark did not list the expected page\n");
+            break;
+        }
+
+        char name[64];
+        snprintf(name, sizeof(name), "%ld records, cursor", size);
+        printf("%-40s %10.1f us per page\n", name, cursor_seconds / LISTING_BENCHMARK_PAGES * 1e6);
+        snprintf(name, sizeof(name), "%ld records, walk from the start", size);
+        printf("%-40s %10.1f us per page\n", name, walk_seconds / walks * 1e6);
+    }
+
+    rmdir(directory_path);
+    return result;
+}
+
+/**
+ * @note Generates count passwords of given length with every generation method and prints how long it took.
+ * The passwords are not written anywhere, so only the generation itself is measured.
+ *
+ * @return true on success, false on failure
+ */
+bool run_benchmarks(long count, long length)
+{
+    char character_pool[CHAR_POOL_LENGTH];
+    int char_pool_end_index = 0;
+    build_character_pool("", character_pool, &char_pool_end_index);
+
+    if (! initialize_generator()) {
+        return false;
+    }
+
+    struct char_mapping mapping;
+    if (! char_mapping_init(&mapping, character_pool, char_pool_end_index)) {
+        return false;
+    }
+
+    printf("Generating %ld passwords with %ld characters:\n", count, length);
+
+    if (! benchmark_per_password_rand(count, length, character_pool, char_pool_end_index)
+        || ! benchmark_random_pool(count, length, character_pool, char_pool_end_index)) {
+        return false;
+    }
+
+    for (int kernel = CHAR_MAPPING_SCALAR; kernel < CHAR_MAPPING_KERNEL_COUNT; kernel++) {
+        struct char_mapping kernel_mapping = mapping;
+        if (char_mapping_use_kernel(&kernel_mapping, kernel) && ! benchmark_char_mapping(count, length, &kernel_mapping)) {
+            return false;
+        }
+    }
+
+    return benchmark_policies(count) && benchmark_passphrases(count) && benchmark_strength_classes()
+           && benchmark_profiles() && benchmark_daemon() && benchmark_commits() && benchmark_vault_processes()
+           && benchmark_directory() && benchmark_listing() && benchmark_breach_filter();
+}
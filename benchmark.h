@@ -0,0 +1,11 @@
+#ifndef PASSWORD_GENERATOR_BENCHMARK_H
+#define PASSWORD_GENERATOR_BENCHMARK_H
+
+#include <stdbool.h>
+
+#define BENCHMARK_DEFAULT_COUNT 1000000
+#define BENCHMARK_DEFAULT_LENGTH 16
+
+bool run_benchmarks(long count, long length);
+
+#endif //PASSWORD_GENERATOR_BENCHMARK_H
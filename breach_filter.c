@@ -0,0 +1,557 @@
+#include "breach_filter.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <openssl/crypto.h>
+
+#define SHA1_HEX_LENGTH (2 * BREACH_FILTER_DIGEST_SIZE)
+//Bits of the digest that choose one bit of a block
+#define POSITION_BITS 9
+#define POSITION_MASK ((1u << POSITION_BITS) - 1)
+
+static void put_u32(unsigned char *destination, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        destination[i] = (unsigned char) (value >> (8 * i));
+    }
+}
+
+static void put_u64(unsigned char *destination, uint64_t value)
+{
+    for (int i = 0; i < 8; i++) {
+        destination[i] = (unsigned char) (value >> (8 * i));
+    }
+}
+
+static uint32_t get_u32(const unsigned char *source)
+{
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) {
+        value = (value << 8) | source[i];
+    }
+    return value;
+}
+
+static uint64_t get_u64(const unsigned char *source)
+{
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) {
+        value = (value << 8) | source[i];
+    }
+    return value;
+}
+
+/**
+ * @return true on success, false on failure
+ */
+bool breach_hasher_init(struct breach_hasher *hasher)
+{
+    hasher->md = EVP_MD_fetch(NULL, "SHA1", NULL);
+    hasher->context = EVP_MD_CTX_new();
+    if (hasher->md == NULL || hasher->context == NULL || EVP_DigestInit_ex2(hasher->context, hasher->md, NULL) != 1) {
+        breach_hasher_free(hasher);
+        fprintf(stderr, "failed to initialize SHA-1\n");
+        return false;
+    }
+    return true;
+}
+
+void breach_hasher_free(struct breach_hasher *hasher)
+{
+    EVP_MD_CTX_free(hasher->context);
+    EVP_MD_free(hasher->md);
+    hasher->context = NULL;
+    hasher->md = NULL;
+}
+
+/**
+ * @note Starts the digest of a new password. The context keeps its SHA-1 from breach_hasher_init,
+ * so it is only reset, which is much cheaper than fetching the digest again for every password.
+ *
+ * @return true on success, false on failure
+ */
+bool breach_hasher_start(struct breach_hasher *hasher)
+{
+    return EVP_DigestInit_ex2(hasher->context, NULL, NULL) == 1;
+}
+
+/**
+ * @return true on success, false on failure
+ */
+bool breach_hasher_update(struct breach_hasher *hasher, const char *data, size_t length)
+{
+    return length == 0 || EVP_DigestUpdate(hasher->context, data, length) == 1;
+}
+
+/**
+ * @param digest BREACH_FILTER_DIGEST_SIZE bytes of SHA-1 of the password are stored here.
+ * @return true on success, false on failure
+ */
+bool breach_hasher_finish(struct breach_hasher *hasher, unsigned char *digest)
+{
+    return EVP_DigestFinal_ex(hasher->context, digest, NULL) == 1;
+}
+
+/**
+ * @return the block of the digest, chosen by its first 64 bits (multiplied instead of divided)
+ */
+static unsigned char *digest_block(const struct breach_filter *filter, const unsigned char *digest)
+{
+    uint64_t block = (uint64_t) (((unsigned __int128) get_u64(digest) * filter->block_count) >> 64);
+    return filter->blocks + block * BREACH_FILTER_BLOCK_SIZE;
+}
+
+/**
+ * @return bit number index of the digest in its block, the bits are taken from the next 96 bits of the digest
+ */
+static unsigned digest_position(const unsigned char *digest, int index)
+{
+    if (index < 7) {
+        return (unsigned) (get_u64(digest + 8) >> (POSITION_BITS * index)) & POSITION_MASK;
+    }
+    return get_u32(digest + 16) & POSITION_MASK;
+}
+
+/**
+ * @note Sets the bits of the digest, threads may add to the same filter at once.
+ */
+void breach_filter_add(struct breach_filter *filter, const unsigned char *digest)
+{
+    unsigned char *block = digest_block(filter, digest);
+    for (int i = 0; i < BREACH_FILTER_HASHES; i++) {
+        unsigned position = digest_position(digest, i);
+        __atomic_fetch_or(&block[position / 8], (unsigned char) (1u << (position % 8)), __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @return true if the digest is probably in the filter, false if it is surely not
+ */
+bool breach_filter_contains(const struct breach_filter *filter, const unsigned char *digest)
+{
+    const unsigned char *block = digest_block(filter, digest);
+    for (int i = 0; i < BREACH_FILTER_HASHES; i++) {
+        unsigned position = digest_position(digest, i);
+        if ((block[position / 8] & (1u << (position % 8))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @param breached Stores true if the password is probably in the filter, false if it is surely not.
+ * @return true on success, false on failure
+ */
+bool breach_filter_contains_password(const struct breach_filter *filter, const char *password, size_t length,
+                                     bool *breached)
+{
+    struct breach_hasher hasher;
+    unsigned char digest[BREACH_FILTER_DIGEST_SIZE];
+
+    if (! breach_hasher_init(&hasher)) {
+        return false;
+    }
+
+    bool result = breach_hasher_start(&hasher) && breach_hasher_update(&hasher, password, length)
+                  && breach_hasher_finish(&hasher, digest);
+    breach_hasher_free(&hasher);
+    if (! result) {
+        fprintf(stderr, "failed to hash the password\n");
+        return false;
+    }
+
+    *breached = breach_filter_contains(filter, digest);
+    return true;
+}
+
+/**
+ * @return size of the filter file with block_count blocks, 0 if it does not fit to memory
+ */
+static size_t filter_size(uint64_t block_count)
+{
+    if (block_count == 0 || block_count > (SIZE_MAX - BREACH_FILTER_HEADER_SIZE) / BREACH_FILTER_BLOCK_SIZE) {
+        return 0;
+    }
+    return BREACH_FILTER_HEADER_SIZE + (size_t) block_count * BREACH_FILTER_BLOCK_SIZE;
+}
+
+/**
+ * @note Maps the filter file to memory. The filter is read only, blocks are read from the disk when they
+ * are looked up for the first time.
+ *
+ * @return true on success, false on failure
+ */
+bool breach_filter_open(struct breach_filter *filter, const char *path)
+{
+    memset(filter, 0, sizeof(*filter));
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "failed to open %s\n", path);
+        return false;
+    }
+
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size < BREACH_FILTER_HEADER_SIZE) {
+        fprintf(stderr, "%s is not a breach filter\n", path);
+        close(fd);
+        return false;
+    }
+
+    size_t size = (size_t) status.st_size;
+    unsigned char *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "failed to map %s\n", path);
+        return false;
+    }
+
+    if (memcmp(map, BREACH_FILTER_MAGIC, BREACH_FILTER_MAGIC_LENGTH) != 0
+        || get_u32(map + 8) != BREACH_FILTER_VERSION || get_u32(map + 12) != BREACH_FILTER_HASHES
+        || filter_size(get_u64(map + 16)) != size) {
+        fprintf(stderr, "%s is not a breach filter\n", path);
+        munmap(map, size);
+        return false;
+    }
+
+    //Lookups go to random blocks, reading ahead would only waste the page cache
+    madvise(map, size, MADV_RANDOM);
+
+    filter->map = map;
+    filter->map_size = size;
+    filter->blocks = map + BREACH_FILTER_HEADER_SIZE;
+    filter->block_count = get_u64(map + 16);
+    filter->entry_count = get_u64(map + 24);
+    return true;
+}
+
+/**
+ * @note Fills the header of the filter mapping.
+ */
+static void write_filter_header(struct breach_filter *filter)
+{
+    memcpy(filter->map, BREACH_FILTER_MAGIC, BREACH_FILTER_MAGIC_LENGTH);
+    put_u32(filter->map + 8, BREACH_FILTER_VERSION);
+    put_u32(filter->map + 12, BREACH_FILTER_HASHES);
+    put_u64(filter->map + 16, filter->block_count);
+    put_u64(filter->map + 24, filter->entry_count);
+}
+
+/**
+ * @return number of blocks of a filter with the entries
+ */
+static uint64_t blocks_for(uint64_t entries)
+{
+    uint64_t bits = entries * BREACH_FILTER_BITS_PER_ENTRY;
+    uint64_t blocks = (bits + 8 * BREACH_FILTER_BLOCK_SIZE - 1) / (8 * BREACH_FILTER_BLOCK_SIZE);
+    return blocks == 0 ? 1 : blocks;
+}
+
+/**
+ * @note Makes an empty filter for the entries in anonymous memory, it is not saved anywhere.
+ *
+ * @return true on success, false on failure
+ */
+bool breach_filter_create(struct breach_filter *filter, uint64_t entries)
+{
+    memset(filter, 0, sizeof(*filter));
+    filter->block_count = blocks_for(entries);
+
+    size_t size = filter_size(filter->block_count);
+    void *map = size == 0 ? MAP_FAILED : mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "failed to allocate the breach filter\n");
+        return false;
+    }
+
+    filter->map = map;
+    filter->map_size = size;
+    filter->blocks = filter->map + BREACH_FILTER_HEADER_SIZE;
+    filter->entry_count = entries;
+    write_filter_header(filter);
+    return true;
+}
+
+void breach_filter_close(struct breach_filter *filter)
+{
+    if (filter->map != NULL) {
+        munmap(filter->map, filter->map_size);
+    }
+    memset(filter, 0, sizeof(*filter));
+}
+
+/**
+ * Part of the password list added by one thread, chunks start at line beginnings.
+ */
+struct build_chunk {
+    struct breach_filter *filter;
+    const char *start;
+    const char *end;
+
+    uint64_t added;
+    bool failed;
+    pthread_t thread;
+};
+
+static int hex_value(char character)
+{
+    if (character >= '0' && character <= '9') {
+        return character - '0';
+    }
+    if (character >= 'a' && character <= 'f') {
+        return character - 'a' + 10;
+    }
+    if (character >= 'A' && character <= 'F') {
+        return character - 'A' + 10;
+    }
+    return -1;
+}
+
+/**
+ * @note Lines of HIBP dumps are SHA-1 in hex, optionally followed by ':' and the number of breaches.
+ *
+ * @param digest The decoded SHA-1 is stored here.
+ * @return true if the line is a SHA-1 in hex, false if it is a plain password
+ */
+static bool parse_hex_digest(const char *line, size_t length, unsigned char *digest)
+{
+    if (length < SHA1_HEX_LENGTH || (length > SHA1_HEX_LENGTH && line[SHA1_HEX_LENGTH] != ':')) {
+        return false;
+    }
+
+    for (int i = 0; i < BREACH_FILTER_DIGEST_SIZE; i++) {
+        int high = hex_value(line[2 * i]);
+        int low = hex_value(line[2 * i + 1]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        digest[i] = (unsigned char) (high << 4 | low);
+    }
+    return true;
+}
+
+/**
+ * @note Adds every non-empty line of the chunk to the filter.
+ */
+static void *build_chunk(void *argument)
+{
+    struct build_chunk *chunk = argument;
+    struct breach_hasher hasher;
+    unsigned char digest[BREACH_FILTER_DIGEST_SIZE];
+
+    if (! breach_hasher_init(&hasher)) {
+        chunk->failed = true;
+        return NULL;
+    }
+
+    const char *line = chunk->start;
+    while (line < chunk->end) {
+        const char *line_end = memchr(line, '\n', (size_t) (chunk->end - line));
+        const char *next = line_end == NULL ? chunk->end : line_end + 1;
+        if (line_end == NULL) {
+            line_end = chunk->end;
+        }
+        if (line_end > line && line_end[-1] == '\r') {
+            line_end--;
+        }
+
+        size_t length = (size_t) (line_end - line);
+        if (length > 0) {
+            if (! parse_hex_digest(line, length, digest)
+                && ! (breach_hasher_start(&hasher) && breach_hasher_update(&hasher, line, length)
+                      && breach_hasher_finish(&hasher, digest))) {
+                fprintf(stderr, "failed to hash a password\n");
+                chunk->failed = true;
+                break;
+            }
+            breach_filter_add(chunk->filter, digest);
+            chunk->added++;
+        }
+        line = next;
+    }
+
+    OPENSSL_cleanse(digest, sizeof(digest));
+    breach_hasher_free(&hasher);
+    return NULL;
+}
+
+/**
+ * @return number of lines of the text, the last one does not need to end with '\n'
+ */
+static uint64_t count_lines(const char *text, size_t size)
+{
+    uint64_t lines = 0;
+    const char *position = text;
+    const char *end = text + size;
+
+    while (position < end) {
+        const char *newline = memchr(position, '\n', (size_t) (end - position));
+        lines++;
+        position = newline == NULL ? end : newline + 1;
+    }
+    return lines;
+}
+
+/**
+ * @note Adds the lines of the mapped list to the filter with thread_count threads.
+ *
+ * @return true on success, false on failure
+ */
+static bool add_list(struct breach_filter *filter, const char *list, size_t size, int thread_count)
+{
+    struct build_chunk *chunks = calloc(thread_count, sizeof(*chunks));
+    bool *started = calloc(thread_count, sizeof(*started));
+    if (chunks == NULL || started == NULL) {
+        free(chunks);
+        free(started);
+        fprintf(stderr, "malloc failed\n");
+        return false;
+    }
+
+    const char *start = list;
+    for (int i = 0; i < thread_count; i++) {
+        const char *end = list + size * (i + 1) / thread_count;
+        if (end < start) {
+            end = start;
+        }
+        if (i + 1 < thread_count && end < list + size) {
+            const char *newline = memchr(end, '\n', (size_t) (list + size - end));
+            end = newline == NULL ? list + size : newline + 1;
+        } else {
+            end = list + size;
+        }
+
+        chunks[i].filter = filter;
+        chunks[i].start = start;
+        chunks[i].end = end;
+        start = end;
+    }
+
+    //Chunk 0 is added by this thread, also any chunk whose thread could not be started
+    for (int i = 1; i < thread_count; i++) {
+        started[i] = pthread_create(&chunks[i].thread, NULL, build_chunk, &chunks[i]) == 0;
+    }
+    for (int i = 0; i < thread_count; i++) {
+        if (! started[i]) {
+            build_chunk(&chunks[i]);
+        }
+    }
+
+    bool result = true;
+    filter->entry_count = 0;
+    for (int i = 0; i < thread_count; i++) {
+        if (started[i]) {
+            pthread_join(chunks[i].thread, NULL);
+        }
+        result = result && ! chunks[i].failed;
+        filter->entry_count += chunks[i].added;
+    }
+
+    free(chunks);
+    free(started);
+    return result;
+}
+
+/**
+ * @note Builds a filter from a list of passwords, one per line. A line is either a SHA-1 of the password
+ * in hex (optionally followed by ':' and anything, like the count of breaches in HIBP dumps) or the password
+ * itself. The list is mapped to memory and added by thread_count threads right to the mapped filter file,
+ * so only the filter and the list have to fit to the memory. The filter is written to a temporary file that
+ * replaces filter_path at the end, so the strength check never sees a half-built filter.
+ *
+ * @param entries Number of added passwords is stored here.
+ * @return true on success, false on failure
+ */
+bool breach_filter_build(const char *list_path, const char *filter_path, int thread_count, uint64_t *entries)
+{
+    *entries = 0;
+
+    int list_fd = open(list_path, O_RDONLY | O_CLOEXEC);
+    if (list_fd < 0) {
+        fprintf(stderr, "failed to open %s\n", list_path);
+        return false;
+    }
+
+    struct stat status;
+    if (fstat(list_fd, &status) != 0) {
+        fprintf(stderr, "failed to read %s\n", list_path);
+        close(list_fd);
+        return false;
+    }
+
+    size_t list_size = (size_t) status.st_size;
+    const char *list = list_size == 0 ? NULL : mmap(NULL, list_size, PROT_READ, MAP_PRIVATE, list_fd, 0);
+    close(list_fd);
+    if (list == MAP_FAILED) {
+        fprintf(stderr, "failed to map %s\n", list_path);
+        return false;
+    }
+    if (list != NULL) {
+        madvise((void *) list, list_size, MADV_SEQUENTIAL);
+    }
+
+    struct breach_filter filter;
+    memset(&filter, 0, sizeof(filter));
+    filter.block_count = blocks_for(count_lines(list, list_size));
+    filter.map_size = filter_size(filter.block_count);
+
+    size_t path_length = strlen(filter_path);
+    char *temporary_path = malloc(path_length + sizeof(".tmp"));
+    int fd = -1;
+    bool result = temporary_path != NULL && filter.map_size != 0;
+
+    if (result) {
+        memcpy(temporary_path, filter_path, path_length);
+        memcpy(temporary_path + path_length, ".tmp", sizeof(".tmp"));
+
+        fd = open(temporary_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        result = fd >= 0 && ftruncate(fd, (off_t) filter.map_size) == 0;
+    }
+    if (result) {
+        void *map = mmap(NULL, filter.map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        result = map != MAP_FAILED;
+        filter.map = result ? map : NULL;
+    }
+    if (! result) {
+        fprintf(stderr, "failed to create %s\n", temporary_path == NULL ? filter_path : temporary_path);
+    }
+
+    if (result) {
+        filter.blocks = filter.map + BREACH_FILTER_HEADER_SIZE;
+        result = add_list(&filter, list, list_size, thread_count);
+        write_filter_header(&filter);
+        *entries = filter.entry_count;
+    }
+
+    if (filter.map != NULL && munmap(filter.map, filter.map_size) != 0) {
+        result = false;
+    }
+    if (fd >= 0) {
+        if (result && fsync(fd) != 0) {
+            fprintf(stderr, "failed to write %s\n", temporary_path);
+            result = false;
+        }
+        close(fd);
+    }
+    if (result && rename(temporary_path, filter_path) != 0) {
+        fprintf(stderr, "failed to replace %s\n", filter_path);
+        result = false;
+    }
+    if (! result && fd >= 0) {
+        unlink(temporary_path);
+    }
+
+    free(temporary_path);
+    if (list != NULL) {
+        munmap((void *) list, list_size);
+    }
+    return result;
+}
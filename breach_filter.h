@@ -0,0 +1,69 @@
+#ifndef PASSWORD_GENERATOR_BREACH_FILTER_H
+#define PASSWORD_GENERATOR_BREACH_FILTER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <openssl/evp.h>
+
+//Filter that is used by the strength check if it exists and no other filter is given
+#define BREACH_FILTER_FILE "breached_passwords.filter"
+#define BREACH_FILTER_MAGIC "PWGBLOOM"
+#define BREACH_FILTER_MAGIC_LENGTH 8
+#define BREACH_FILTER_VERSION 1
+
+/**
+ * The filter is a blocked Bloom filter keyed by SHA-1 of the password, so it can be built from the
+ * HIBP-style dumps of breached passwords as well as from plain password lists. Every password sets
+ * BREACH_FILTER_HASHES bits in one BREACH_FILTER_BLOCK_SIZE block (a cache line), so a lookup is one
+ * cache miss. SHA-1 is uniform, so the block and the bits are taken right from the digest.
+ *
+ * With BREACH_FILTER_BITS_PER_ENTRY bits per password about 0.5 % of other passwords are reported
+ * as breached, there are no misses. 500 million passwords need 750 MB.
+ *
+ * Layout of the filter file, all numbers are little endian:
+ *
+ * header       BREACH_FILTER_HEADER_SIZE bytes - magic, version, hash count (u32 each), block count and
+ *              entry count (u64 each), the rest is reserved and zero
+ * blocks       block count blocks, bit i of a block is bit i % 8 of its byte i / 8
+ */
+#define BREACH_FILTER_HEADER_SIZE 64
+#define BREACH_FILTER_BLOCK_SIZE 64
+#define BREACH_FILTER_BITS_PER_ENTRY 12
+#define BREACH_FILTER_HASHES 8
+#define BREACH_FILTER_DIGEST_SIZE 20
+
+struct breach_filter {
+    unsigned char *map;
+    size_t map_size;
+
+    unsigned char *blocks;
+    uint64_t block_count;
+    uint64_t entry_count;
+};
+
+/**
+ * SHA-1 of passwords that may be given in more pieces, like the lines of the audit.
+ */
+struct breach_hasher {
+    EVP_MD *md;
+    EVP_MD_CTX *context;
+};
+
+bool breach_hasher_init(struct breach_hasher *hasher);
+void breach_hasher_free(struct breach_hasher *hasher);
+bool breach_hasher_start(struct breach_hasher *hasher);
+bool breach_hasher_update(struct breach_hasher *hasher, const char *data, size_t length);
+bool breach_hasher_finish(struct breach_hasher *hasher, unsigned char *digest);
+
+bool breach_filter_open(struct breach_filter *filter, const char *path);
+bool breach_filter_create(struct breach_filter *filter, uint64_t entries);
+void breach_filter_close(struct breach_filter *filter);
+void breach_filter_add(struct breach_filter *filter, const unsigned char *digest);
+bool breach_filter_contains(const struct breach_filter *filter, const unsigned char *digest);
+bool breach_filter_contains_password(const struct breach_filter *filter, const char *password, size_t length,
+                                     bool *breached);
+bool breach_filter_build(const char *list_path, const char *filter_path, int thread_count, uint64_t *entries);
+
+#endif //PASSWORD_GENERATOR_BREACH_FILTER_H
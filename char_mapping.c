@@ -0,0 +1,353 @@
+#include "char_mapping.h"
+
+#include <stdio.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CHAR_MAPPING_X86 1
+#include <immintrin.h>
+#else
+#define CHAR_MAPPING_X86 0
+#endif
+
+static size_t map_scalar(const struct char_mapping *mapping, const unsigned char *bytes, size_t byte_count,
+                         char *output, size_t needed, size_t *produced);
+
+#if CHAR_MAPPING_X86
+
+/**
+ * For every 8 bit mask of accepted bytes, positions of the accepted bytes moved to the front.
+ * Used as pshufb control to pack accepted characters together.
+ */
+static uint64_t compaction_table[256];
+//Mappings are prepared in parallel workers too, so the table is built exactly once
+static pthread_once_t compaction_table_once = PTHREAD_ONCE_INIT;
+
+static void build_compaction_table(void)
+{
+    for (unsigned mask = 0; mask < 256; mask++) {
+        unsigned char positions[8] = { 0 };
+        int count = 0;
+        for (unsigned char bit = 0; bit < 8; bit++) {
+            if (mask & (1u << bit)) {
+                positions[count++] = bit;
+            }
+        }
+        memcpy(&compaction_table[mask], positions, sizeof(positions));
+    }
+}
+
+static void init_compaction_table(void)
+{
+    pthread_once(&compaction_table_once, build_compaction_table);
+}
+
+/**
+ * @note Stores accepted characters of a 16 character vector to output, in order.
+ * Two 8 byte stores are always done, so there must be room for 16 characters.
+ *
+ * @return number of stored characters
+ */
+__attribute__((target("ssse3,popcnt")))
+static size_t compact_16(__m128i characters, unsigned mask, char *output)
+{
+    __m128i control = _mm_set_epi64x((long long) (compaction_table[mask >> 8] + 0x0808080808080808ULL),
+                                     (long long) compaction_table[mask & 0xFF]);
+    __m128i packed = _mm_shuffle_epi8(characters, control);
+
+    size_t low_count = __builtin_popcount(mask & 0xFF);
+    _mm_storel_epi64((__m128i *) output, packed);
+    _mm_storel_epi64((__m128i *) (output + low_count), _mm_unpackhi_epi64(packed, packed));
+    return low_count + __builtin_popcount(mask >> 8);
+}
+
+/**
+ * @note 16 bytes at a time: products are computed in 16 bit lanes, the pool lookup is done by six pshufb
+ * over 16 character tables and the accepted characters are packed by compact_16.
+ * The vector loop runs only while at least 16 characters are still needed, the rest is done by map_scalar.
+ */
+__attribute__((target("ssse3,popcnt")))
+static size_t map_ssse3(const struct char_mapping *mapping, const unsigned char *bytes, size_t byte_count,
+                        char *output, size_t needed, size_t *produced)
+{
+    __m128i tables[CHAR_MAPPING_TABLE_SIZE / 16];
+    for (int i = 0; i < CHAR_MAPPING_TABLE_SIZE / 16; i++) {
+        tables[i] = _mm_loadu_si128((const __m128i *) (mapping->pool + 16 * i));
+    }
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i size = _mm_set1_epi16((short) mapping->size);
+    const __m128i low_byte = _mm_set1_epi16(0xFF);
+    const __m128i threshold = _mm_set1_epi8((char) mapping->threshold);
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+
+    size_t written = 0;
+    size_t used = 0;
+
+    while (needed - written >= 16 && byte_count - used >= 16) {
+        __m128i random = _mm_loadu_si128((const __m128i *) (bytes + used));
+        __m128i product_low = _mm_mullo_epi16(_mm_unpacklo_epi8(random, zero), size);
+        __m128i product_high = _mm_mullo_epi16(_mm_unpackhi_epi8(random, zero), size);
+
+        __m128i index = _mm_packus_epi16(_mm_srli_epi16(product_low, 8), _mm_srli_epi16(product_high, 8));
+        __m128i remainder = _mm_packus_epi16(_mm_and_si128(product_low, low_byte), _mm_and_si128(product_high, low_byte));
+        __m128i accepted = _mm_cmpeq_epi8(_mm_max_epu8(remainder, threshold), remainder);
+
+        __m128i table_number = _mm_and_si128(_mm_srli_epi16(index, 4), nibble);
+        __m128i position = _mm_and_si128(index, nibble);
+        __m128i characters = zero;
+
+        for (int i = 0; i < CHAR_MAPPING_TABLE_SIZE / 16; i++) {
+            __m128i selected = _mm_cmpeq_epi8(table_number, _mm_set1_epi8((char) i));
+            characters = _mm_or_si128(characters, _mm_and_si128(selected, _mm_shuffle_epi8(tables[i], position)));
+        }
+
+        written += compact_16(characters, _mm_movemask_epi8(accepted), output + written);
+        used += 16;
+    }
+
+    size_t tail = 0;
+    used += map_scalar(mapping, bytes + used, byte_count - used, output + written, needed - written, &tail);
+    *produced = written + tail;
+    return used;
+}
+
+/**
+ * @note The same as map_ssse3, but 32 bytes at a time. pshufb works in 128 bit lanes,
+ * so the tables are in both lanes and the lanes are packed separately.
+ */
+__attribute__((target("avx2,popcnt")))
+static size_t map_avx2(const struct char_mapping *mapping, const unsigned char *bytes, size_t byte_count,
+                       char *output, size_t needed, size_t *produced)
+{
+    __m256i tables[CHAR_MAPPING_TABLE_SIZE / 16];
+    for (int i = 0; i < CHAR_MAPPING_TABLE_SIZE / 16; i++) {
+        tables[i] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) (mapping->pool + 16 * i)));
+    }
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i size = _mm256_set1_epi16((short) mapping->size);
+    const __m256i low_byte = _mm256_set1_epi16(0xFF);
+    const __m256i threshold = _mm256_set1_epi8((char) mapping->threshold);
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+
+    size_t written = 0;
+    size_t used = 0;
+
+    while (needed - written >= 32 && byte_count - used >= 32) {
+        __m256i random = _mm256_loadu_si256((const __m256i *) (bytes + used));
+        __m256i product_low = _mm256_mullo_epi16(_mm256_unpacklo_epi8(random, zero), size);
+        __m256i product_high = _mm256_mullo_epi16(_mm256_unpackhi_epi8(random, zero), size);
+
+        __m256i index = _mm256_packus_epi16(_mm256_srli_epi16(product_low, 8), _mm256_srli_epi16(product_high, 8));
+        __m256i remainder = _mm256_packus_epi16(_mm256_and_si256(product_low, low_byte),
+                                                _mm256_and_si256(product_high, low_byte));
+        __m256i accepted = _mm256_cmpeq_epi8(_mm256_max_epu8(remainder, threshold), remainder);
+
+        __m256i table_number = _mm256_and_si256(_mm256_srli_epi16(index, 4), nibble);
+        __m256i position = _mm256_and_si256(index, nibble);
+        __m256i characters = zero;
+
+        for (int i = 0; i < CHAR_MAPPING_TABLE_SIZE / 16; i++) {
+            __m256i selected = _mm256_cmpeq_epi8(table_number, _mm256_set1_epi8((char) i));
+            characters = _mm256_or_si256(characters, _mm256_and_si256(selected, _mm256_shuffle_epi8(tables[i], position)));
+        }
+
+        unsigned mask = (unsigned) _mm256_movemask_epi8(accepted);
+        written += compact_16(_mm256_castsi256_si128(characters), mask & 0xFFFF, output + written);
+        written += compact_16(_mm256_extracti128_si256(characters, 1), mask >> 16, output + written);
+        used += 32;
+    }
+
+    size_t tail = 0;
+    used += map_scalar(mapping, bytes + used, byte_count - used, output + written, needed - written, &tail);
+    *produced = written + tail;
+    return used;
+}
+
+#endif
+
+/**
+ * @return true if this CPU can run the kernel
+ */
+static bool kernel_supported(enum char_mapping_kernel kernel)
+{
+    switch (kernel) {
+        case CHAR_MAPPING_SCALAR:
+            return true;
+#if CHAR_MAPPING_X86
+        case CHAR_MAPPING_SSSE3:
+            return __builtin_cpu_supports("ssse3") && __builtin_cpu_supports("popcnt");
+        case CHAR_MAPPING_AVX2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+#endif
+        default:
+            return false;
+    }
+}
+
+const char *char_mapping_kernel_name(enum char_mapping_kernel kernel)
+{
+    switch (kernel) {
+        case CHAR_MAPPING_SCALAR:
+            return "scalar";
+        case CHAR_MAPPING_SSSE3:
+            return "SSSE3";
+        case CHAR_MAPPING_AVX2:
+            return "AVX2";
+        default:
+            return "unknown";
+    }
+}
+
+/**
+ * @note Makes the mapping use the given kernel, the mapping stays the same if the CPU can't run it.
+ *
+ * @return true if the kernel is used, false if this CPU doesn't support it
+ */
+bool char_mapping_use_kernel(struct char_mapping *mapping, enum char_mapping_kernel kernel)
+{
+    if (! kernel_supported(kernel)) {
+        return false;
+    }
+
+#if CHAR_MAPPING_X86
+    init_compaction_table();
+#endif
+    mapping->kernel = kernel;
+    return true;
+}
+
+/**
+ * @param mapping Mapping to be prepared.
+ * @param character_pool Pool built by build_character_pool.
+ * @param char_pool_end_index Index of the last usable character in character_pool.
+ * @return true on success, false if the pool is empty
+ */
+bool char_mapping_init(struct char_mapping *mapping, const char *character_pool, int char_pool_end_index)
+{
+    if (char_pool_end_index < 0) {
+        fprintf(stderr, "You excluded all characters.\n");
+        return false;
+    }
+
+    mapping->size = char_pool_end_index + 1;
+    mapping->threshold = 256 % mapping->size;
+    memset(mapping->pool, 0, sizeof(mapping->pool));
+    memcpy(mapping->pool, character_pool, mapping->size);
+
+    //The fastest kernel this CPU supports
+    mapping->kernel = CHAR_MAPPING_SCALAR;
+    for (int kernel = CHAR_MAPPING_KERNEL_COUNT - 1; kernel > CHAR_MAPPING_SCALAR; kernel--) {
+        if (char_mapping_use_kernel(mapping, kernel)) {
+            break;
+        }
+    }
+    return true;
+}
+
+/**
+ * @note Maps bytes to characters until needed characters are produced or all bytes are used.
+ * Uses the kernel chosen by char_mapping_init or char_mapping_use_kernel.
+ *
+ * @param mapping Initialized mapping.
+ * @param bytes Random bytes.
+ * @param byte_count Number of random bytes.
+ * @param output Where the characters are written, with capacity of at least needed characters.
+ * @param needed How many characters are wanted.
+ * @param produced Number of written characters is stored here.
+ * @return number of used bytes
+ */
+size_t char_mapping_map(const struct char_mapping *mapping, const unsigned char *bytes, size_t byte_count,
+                        char *output, size_t needed, size_t *produced)
+{
+    switch (mapping->kernel) {
+#if CHAR_MAPPING_X86
+        case CHAR_MAPPING_SSSE3:
+            return map_ssse3(mapping, bytes, byte_count, output, needed, produced);
+        case CHAR_MAPPING_AVX2:
+            return map_avx2(mapping, bytes, byte_count, output, needed, produced);
+#endif
+        default:
+            return map_scalar(mapping, bytes, byte_count, output, needed, produced);
+    }
+}
+
+/**
+ * @note There is no branch on rejection, the character is always written and the output position moves
+ * only if the byte was accepted.
+ */
+static size_t map_scalar(const struct char_mapping *mapping, const unsigned char *bytes, size_t byte_count,
+                         char *output, size_t needed, size_t *produced)
+{
+    size_t written = 0;
+    size_t used = 0;
+
+    while (written < needed && used < byte_count) {
+        //Even if every byte is accepted, this many bytes won't produce more than needed characters
+        size_t end = used + needed - written;
+        if (end > byte_count) {
+            end = byte_count;
+        }
+
+        for (; used < end; used++) {
+            unsigned product = bytes[used] * mapping->size;
+            output[written] = mapping->pool[product >> 8];
+            written += (product & 0xFF) >= mapping->threshold;
+        }
+    }
+
+    *produced = written;
+    return used;
+}
+
+/**
+ * @note Fills output with length characters using as many bytes from the pool as needed.
+ *
+ * @return true on success, false on failure
+ */
+bool char_mapping_generate(const struct char_mapping *mapping, struct random_pool *pool, char *output, size_t length)
+{
+    size_t produced = 0;
+
+    while (produced < length) {
+        size_t available = 0;
+        const unsigned char *bytes = random_pool_next(pool, &available);
+        if (bytes == NULL) {
+            return false;
+        }
+
+        size_t written = 0;
+        size_t used = char_mapping_map(mapping, bytes, available, output + produced, length - produced, &written);
+        random_pool_consume(pool, used);
+        produced += written;
+    }
+    return true;
+}
+
+/**
+ * @note Fills output with count lines, each with length characters and '\n' at the end. All characters are
+ * generated at once to the end of output and then moved to their lines, so the mapping runs over long spans
+ * of the pool instead of being restarted for every password.
+ *
+ * @param output Capacity of at least count * (length + 1) characters.
+ * @return true on success, false on failure
+ */
+bool char_mapping_generate_lines(const struct char_mapping *mapping, struct random_pool *pool, char *output,
+                                 size_t length, size_t count)
+{
+    char *characters = output + count;
+
+    if (! char_mapping_generate(mapping, pool, characters, length * count)) {
+        return false;
+    }
+
+    //Every line moves towards the start of output, so it never overwrites characters of the following lines
+    for (size_t line = 0; line < count; line++) {
+        memmove(output + line * (length + 1), characters + line * length, length);
+        output[line * (length + 1) + length] = '\n';
+    }
+    return true;
+}
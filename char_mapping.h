@@ -0,0 +1,42 @@
+#ifndef PASSWORD_GENERATOR_CHAR_MAPPING_H
+#define PASSWORD_GENERATOR_CHAR_MAPPING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "character_pool.h"
+#include "random_pool.h"
+
+//The pool is padded to six 16 character tables for the vectorized lookup
+#define CHAR_MAPPING_TABLE_SIZE 96
+
+enum char_mapping_kernel {
+    CHAR_MAPPING_SCALAR,
+    CHAR_MAPPING_SSSE3,
+    CHAR_MAPPING_AVX2,
+    CHAR_MAPPING_KERNEL_COUNT
+};
+
+/**
+ * Maps random bytes to characters without bias. A byte b is multiplied by the pool size,
+ * the high byte of the product is the index to the pool and the product is rejected when its low byte
+ * is smaller than threshold = 256 % size. This leaves exactly 256 / size accepted bytes for every character.
+ * All kernels produce exactly the same characters from the same bytes.
+ */
+struct char_mapping {
+    char pool[CHAR_MAPPING_TABLE_SIZE];
+    unsigned size;
+    unsigned threshold;
+    enum char_mapping_kernel kernel;
+};
+
+bool char_mapping_init(struct char_mapping *mapping, const char *character_pool, int char_pool_end_index);
+bool char_mapping_use_kernel(struct char_mapping *mapping, enum char_mapping_kernel kernel);
+const char *char_mapping_kernel_name(enum char_mapping_kernel kernel);
+size_t char_mapping_map(const struct char_mapping *mapping, const unsigned char *bytes, size_t byte_count,
+                        char *output, size_t needed, size_t *produced);
+bool char_mapping_generate(const struct char_mapping *mapping, struct random_pool *pool, char *output, size_t length);
+bool char_mapping_generate_lines(const struct char_mapping *mapping, struct random_pool *pool, char *output,
+                                 size_t length, size_t count);
+
+#endif //PASSWORD_GENERATOR_CHAR_MAPPING_H
@@ -0,0 +1,50 @@
+#include "character_pool.h"
+
+/**
+ * @note Builds the pool without asking anything, so it can be used by the batch mode as well.
+ *
+ * @param excluded Characters that should not be in the pool, terminated by '\n' or '\0'.
+ * @param character_pool Has to be allocated memory with length equal to CHAR_POOL_LENGTH.
+ * @param char_pool_end_index Index of the last usable character in character_pool is stored here.
+ *                            If every character was excluded it is set to -1.
+ */
+void build_character_pool(const char *excluded, char *character_pool, int *char_pool_end_index)
+{
+    for (char chr = ' '; chr <= (char) '~'; chr++) {
+        character_pool[chr - ' '] = chr;
+    }
+
+    int left = 0;
+    while (excluded[left] != '\n' && excluded[left] != '\0') {
+        if (' ' <= excluded[left] && excluded[left] <= '~') {
+            character_pool[excluded[left] - ' '] = '\1';
+        }
+        left++;
+    }
+
+    left = 0;
+    int right = CHAR_POOL_LENGTH - 1;
+
+    while (left < right) {
+        if (character_pool[left] != '\1') {
+            left++;
+            continue;
+        }
+
+        while (left < right && character_pool[right] == '\1') {
+            right--;
+        }
+        if (left == right) {
+            break;
+        }
+
+        character_pool[left] = character_pool[right];
+        character_pool[right] = '\1';
+        right--;
+        left++;
+    }
+    if (character_pool[left] == '\1') {
+        left--;
+    }
+    *char_pool_end_index = left;
+}
@@ -0,0 +1,15 @@
+#ifndef PASSWORD_GENERATOR_CHARACTER_POOL_H
+#define PASSWORD_GENERATOR_CHARACTER_POOL_H
+
+#define LETTER_COUNT 26
+#define DIGIT_COUNT 10
+#define SPECIAL_CHARS 20
+#define MAX_CHAR_RANGE (2 * LETTER_COUNT + DIGIT_COUNT + SPECIAL_CHARS)
+//Generated passwords are made of the printable ASCII characters, space included
+#define CHAR_POOL_LENGTH ('~' - ' ' + 1)
+#define MIN_GENERATED_LENGTH 8
+#define MAX_GENERATED_LENGTH 999
+
+void build_character_pool(const char *excluded, char *character_pool, int *char_pool_end_index);
+
+#endif //PASSWORD_GENERATOR_CHARACTER_POOL_H
@@ -0,0 +1,822 @@
+#include "daemon.h"
+#include "character_pool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <openssl/crypto.h>
+
+//Events handled by one epoll_wait call
+#define DAEMON_EVENTS 64
+
+struct daemon_connection {
+    int fd;
+    //Index in the connections of the server
+    size_t slot;
+    //Bytes received so far, a request is handled as soon as it is whole
+    struct daemon_message input;
+    //Response that could not be sent at once
+    struct daemon_message output;
+    size_t output_sent;
+    //The response is of a change, it is sent once the vault is synced
+    bool waiting_for_sync;
+};
+
+static void put_u16(unsigned char *destination, uint16_t value)
+{
+    destination[0] = (unsigned char) value;
+    destination[1] = (unsigned char) (value >> 8);
+}
+
+static void put_u32(unsigned char *destination, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        destination[i] = (unsigned char) (value >> (8 * i));
+    }
+}
+
+static uint16_t get_u16(const unsigned char *source)
+{
+    return (uint16_t) (source[0] | source[1] << 8);
+}
+
+static uint32_t get_u32(const unsigned char *source)
+{
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) {
+        value = (value << 8) | source[i];
+    }
+    return value;
+}
+
+/**
+ * @note Starts a new message of the type (a request type or a response status), the body is added after it.
+ */
+void daemon_message_start(struct daemon_message *message, uint16_t type)
+{
+    memset(message->data, 0, DAEMON_HEADER_SIZE);
+    put_u16(message->data + 4, type);
+    message->length = DAEMON_HEADER_SIZE;
+    message->position = DAEMON_HEADER_SIZE;
+}
+
+/**
+ * @return true if the value fits in the message, false otherwise
+ */
+bool daemon_message_add_u8(struct daemon_message *message, uint8_t value)
+{
+    if (message->length + 1 > DAEMON_MAX_MESSAGE) {
+        return false;
+    }
+    message->data[message->length++] = value;
+    return true;
+}
+
+bool daemon_message_add_u16(struct daemon_message *message, uint16_t value)
+{
+    if (message->length + 2 > DAEMON_MAX_MESSAGE) {
+        return false;
+    }
+    put_u16(message->data + message->length, value);
+    message->length += 2;
+    return true;
+}
+
+bool daemon_message_add_u32(struct daemon_message *message, uint32_t value)
+{
+    if (message->length + 4 > DAEMON_MAX_MESSAGE) {
+        return false;
+    }
+    put_u32(message->data + message->length, value);
+    message->length += 4;
+    return true;
+}
+
+bool daemon_message_add_string(struct daemon_message *message, const char *text, size_t length)
+{
+    if (length > UINT16_MAX || message->length + 2 + length > DAEMON_MAX_MESSAGE) {
+        return false;
+    }
+    put_u16(message->data + message->length, (uint16_t) length);
+    memcpy(message->data + message->length + 2, text, length);
+    message->length += 2 + length;
+    return true;
+}
+
+/**
+ * @return true if the message has the value, false if it ends before it
+ */
+bool daemon_message_read_u8(struct daemon_message *message, uint8_t *value)
+{
+    if (message->position + 1 > message->length) {
+        return false;
+    }
+    *value = message->data[message->position++];
+    return true;
+}
+
+bool daemon_message_read_u16(struct daemon_message *message, uint16_t *value)
+{
+    if (message->position + 2 > message->length) {
+        return false;
+    }
+    *value = get_u16(message->data + message->position);
+    message->position += 2;
+    return true;
+}
+
+bool daemon_message_read_u32(struct daemon_message *message, uint32_t *value)
+{
+    if (message->position + 4 > message->length) {
+        return false;
+    }
+    *value = get_u32(message->data + message->position);
+    message->position += 4;
+    return true;
+}
+
+/**
+ * @param text Set to the string in the message, it is not terminated by '\0'.
+ */
+bool daemon_message_read_string(struct daemon_message *message, const char **text, size_t *length)
+{
+    uint16_t string_length = 0;
+    if (! daemon_message_read_u16(message, &string_length) || message->position + string_length > message->length) {
+        return false;
+    }
+    *text = (const char *) message->data + message->position;
+    *length = string_length;
+    message->position += string_length;
+    return true;
+}
+
+/**
+ * @note Reads a string of the message to a buffer and terminates it by '\0'.
+ *
+ * @param capacity Capacity of the buffer, the string must be shorter.
+ * @return true on success, false if there is no string or it is too long
+ */
+static bool read_terminated(struct daemon_message *message, char *buffer, size_t capacity)
+{
+    const char *text = NULL;
+    size_t length = 0;
+    if (! daemon_message_read_string(message, &text, &length) || length >= capacity || memchr(text, '\0', length)) {
+        return false;
+    }
+    memcpy(buffer, text, length);
+    buffer[length] = '\0';
+    return true;
+}
+
+/**
+ * @note Fills in the header of a finished message, so it can be sent.
+ */
+static void finish_message(struct daemon_message *message, uint16_t request_type)
+{
+    put_u32(message->data, (uint32_t) (message->length - DAEMON_HEADER_SIZE));
+    put_u16(message->data + 6, request_type);
+}
+
+/**
+ * @note Replaces the response by an empty one with the status.
+ */
+static void fail(struct daemon_message *response, enum daemon_status status)
+{
+    OPENSSL_cleanse(response->data, response->length);
+    daemon_message_start(response, status);
+}
+
+/**
+ * @note Generates one password by the line generator right into the response, as a string.
+ */
+static void add_generated(struct daemon_server *server, const struct line_generator *generator,
+                          struct daemon_message *response)
+{
+    size_t used = 0;
+    if (response->length + 2 + generator->longest_line > DAEMON_MAX_MESSAGE
+        || ! generator->generate_lines(generator->source, &server->pool, (char *) response->data + response->length + 2,
+                                       1, &used)) {
+        fail(response, DAEMON_FAILED);
+        return;
+    }
+
+    //The newline after the password is left out
+    put_u16(response->data + response->length, (uint16_t) (used - 1));
+    response->length += 2 + used - 1;
+}
+
+static void handle_generate(struct daemon_server *server, struct daemon_message *request,
+                            struct daemon_message *response)
+{
+    uint16_t length = 0;
+    uint16_t words = 0;
+    uint8_t required = 0;
+    uint8_t rules = 0;
+    char excluded[CHAR_POOL_LENGTH + 1];
+    char separator[PASSPHRASE_MAX_SEPARATOR + 1];
+
+    if (! daemon_message_read_u16(request, &length) || ! daemon_message_read_u16(request, &words)
+        || ! daemon_message_read_u8(request, &required) || ! daemon_message_read_u8(request, &rules)
+        || ! read_terminated(request, excluded, sizeof(excluded))
+        || ! read_terminated(request, separator, sizeof(separator))
+        || (required & ~(STRENGTH_UPPER | STRENGTH_LOWER | STRENGTH_DIGIT | STRENGTH_SPECIAL)) != 0) {
+        fail(response, DAEMON_BAD_REQUEST);
+        return;
+    }
+
+    struct pwgen_options options = { .length = length, .excluded = excluded,
+                                     .policy = { .required = required,
+                                                 .no_repeats = (rules & DAEMON_RULE_NO_REPEATS) != 0,
+                                                 .no_sequences = (rules & DAEMON_RULE_NO_SEQUENCES) != 0 },
+                                     .words = words, .separator = separator[0] == '\0' ? NULL : separator };
+    struct pwgen_generator generator;
+    if (! pwgen_generator_init(&generator, &options)) {
+        fail(response, DAEMON_BAD_REQUEST);
+        return;
+    }
+
+    add_generated(server, &generator.lines, response);
+    pwgen_generator_free(&generator);
+}
+
+static void handle_generate_profile(struct daemon_server *server, struct daemon_message *request,
+                                    struct daemon_message *response)
+{
+    char name[PROFILE_MAX_NAME + 1];
+    if (! read_terminated(request, name, sizeof(name))) {
+        fail(response, DAEMON_BAD_REQUEST);
+        return;
+    }
+
+    const struct profile *profile = server->use_profiles ? profiles_find(&server->profiles, name) : NULL;
+    if (profile == NULL) {
+        fail(response, DAEMON_NOT_FOUND);
+        return;
+    }
+    add_generated(server, &profile->generator, response);
+}
+
+static void handle_score(struct daemon_server *server, struct daemon_message *request, struct daemon_message *response)
+{
+    char password[VAULT_MAX_PASSWORD_LENGTH + 1];
+    struct pwgen_score score;
+
+    if (! read_terminated(request, password, sizeof(password))) {
+        fail(response, DAEMON_BAD_REQUEST);
+        return;
+    }
+
+    bool result = pwgen_score(&server->scorer, password, strlen(password), &score);
+    OPENSSL_cleanse(password, sizeof(password));
+    if (! result) {
+        fail(response, DAEMON_FAILED);
+        return;
+    }
+
+    daemon_message_add_u8(response, (uint8_t) score.strength);
+    daemon_message_add_u8(response, (uint8_t) ((score.breached ? DAEMON_SCORE_BREACHED : 0)
+                                               | (score.breach_checked ? DAEMON_SCORE_CHECKED : 0)));
+    daemon_message_add_u32(response, (uint32_t) (score.entropy * 100 + 0.5));
+}
+
+/**
+ * @note Handles GET, PUT and DELETE, which all start by the site and the account.
+ */
+static void handle_vault(struct daemon_server *server, uint16_t type, struct daemon_message *request,
+                         struct daemon_message *response)
+{
+    char site[VAULT_MAX_NAME_LENGTH + 1];
+    char account[VAULT_MAX_NAME_LENGTH + 1];
+    char password[VAULT_MAX_PASSWORD_LENGTH + 1];
+
+    if (! read_terminated(request, site, sizeof(site)) || ! read_terminated(request, account, sizeof(account))
+        || site[0] == '\0' || account[0] == '\0'
+        || (type == DAEMON_PUT && ! read_terminated(request, password, sizeof(password)))) {
+        fail(response, DAEMON_BAD_REQUEST);
+        return;
+    }
+
+    bool found = true;
+    bool result = true;
+    if (type == DAEMON_GET) {
+        size_t length = 0;
+        result = pwgen_vault_get(server->vault, site, account, password, sizeof(password), &length, &found);
+        if (result && found) {
+            daemon_message_add_string(response, password, length);
+        }
+    } else if (type == DAEMON_PUT) {
+        result = vault_put(server->vault, site, account, password);
+    } else {
+        result = vault_delete(server->vault, site, account, &found);
+    }
+    OPENSSL_cleanse(password, sizeof(password));
+
+    if (! result) {
+        fail(response, DAEMON_FAILED);
+    } else if (! found) {
+        fail(response, DAEMON_NOT_FOUND);
+    }
+}
+
+/**
+ * @note Handles one whole request and writes its response.
+ */
+static void handle_request(struct daemon_server *server, struct daemon_message *request,
+                           struct daemon_message *response)
+{
+    uint16_t type = get_u16(request->data + 4);
+    request->position = DAEMON_HEADER_SIZE;
+    daemon_message_start(response, DAEMON_OK);
+
+    switch (type) {
+        case DAEMON_GENERATE:
+            handle_generate(server, request, response);
+            break;
+        case DAEMON_GENERATE_PROFILE:
+            handle_generate_profile(server, request, response);
+            break;
+        case DAEMON_SCORE:
+            handle_score(server, request, response);
+            break;
+        case DAEMON_GET:
+        case DAEMON_PUT:
+        case DAEMON_DELETE:
+            handle_vault(server, type, request, response);
+            break;
+        default:
+            fail(response, DAEMON_BAD_REQUEST);
+            break;
+    }
+    finish_message(response, type);
+}
+
+static bool watch(struct daemon_server *server, int operation, int fd, uint32_t events, void *pointer)
+{
+    struct epoll_event event = { .events = events, .data.ptr = pointer };
+    return epoll_ctl(server->epoll_fd, operation, fd, &event) == 0;
+}
+
+static void close_connection(struct daemon_server *server, struct daemon_connection *connection)
+{
+    close(connection->fd);
+
+    //The last connection takes the free slot
+    size_t slot = connection->slot;
+    server->connection_count--;
+    server->connections[slot] = server->connections[server->connection_count];
+    server->connections[slot]->slot = slot;
+
+    OPENSSL_cleanse(connection, sizeof(*connection));
+    free(connection);
+}
+
+static void accept_connections(struct daemon_server *server)
+{
+    while (true) {
+        int fd = accept(server->listen_fd, NULL, NULL);
+        if (fd >= 0 && (fcntl(fd, F_SETFL, O_NONBLOCK) != 0 || fcntl(fd, F_SETFD, FD_CLOEXEC) != 0)) {
+            close(fd);
+            continue;
+        }
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                fprintf(stderr, "failed to accept a client\n");
+            }
+            if (errno != EINTR) {
+                return;
+            }
+            continue;
+        }
+
+        struct daemon_connection *connection = NULL;
+        if (server->connection_count < DAEMON_MAX_CLIENTS) {
+            connection = malloc(sizeof(*connection));
+        }
+        if (connection == NULL) {
+            close(fd);
+            continue;
+        }
+
+        connection->fd = fd;
+        connection->slot = server->connection_count;
+        connection->input.length = 0;
+        connection->output.length = 0;
+        connection->output_sent = 0;
+        connection->waiting_for_sync = false;
+        if (! watch(server, EPOLL_CTL_ADD, fd, EPOLLIN | EPOLLRDHUP, connection)) {
+            close(fd);
+            free(connection);
+            continue;
+        }
+        server->connections[server->connection_count++] = connection;
+    }
+}
+
+/**
+ * @note Sends as much of the pending response as the socket takes.
+ *
+ * @return true if the connection can be used further, false if it has to be closed
+ */
+static bool send_output(struct daemon_server *server, struct daemon_connection *connection)
+{
+    struct daemon_message *output = &connection->output;
+    while (connection->output_sent < output->length) {
+        ssize_t sent = send(connection->fd, output->data + connection->output_sent,
+                            output->length - connection->output_sent, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            //The rest is sent when the socket can take it, nothing is read meanwhile
+            return watch(server, EPOLL_CTL_MOD, connection->fd, EPOLLOUT | EPOLLRDHUP, connection);
+        }
+        if (sent <= 0) {
+            return false;
+        }
+        connection->output_sent += (size_t) sent;
+    }
+
+    OPENSSL_cleanse(output->data, output->length);
+    output->length = 0;
+    connection->output_sent = 0;
+    return true;
+}
+
+/**
+ * @note Handles all whole requests in the input of the connection, one after another.
+ *
+ * @return true if the connection can be used further, false if it has to be closed
+ */
+static bool handle_input(struct daemon_server *server, struct daemon_connection *connection)
+{
+    struct daemon_message *input = &connection->input;
+    while (connection->output.length == 0 && input->length >= DAEMON_HEADER_SIZE) {
+        uint32_t body_length = get_u32(input->data);
+        if (body_length > DAEMON_MAX_MESSAGE - DAEMON_HEADER_SIZE) {
+            return false;
+        }
+        size_t request_length = DAEMON_HEADER_SIZE + body_length;
+        if (input->length < request_length) {
+            return true;
+        }
+
+        //The request is read only up to its end, more requests may follow it
+        size_t received = input->length;
+        uint16_t type = get_u16(input->data + 4);
+        input->length = request_length;
+        handle_request(server, input, &connection->output);
+
+        OPENSSL_cleanse(input->data, request_length);
+        memmove(input->data, input->data + request_length, received - request_length);
+        input->length = received - request_length;
+
+        if ((type == DAEMON_PUT || type == DAEMON_DELETE) && get_u16(connection->output.data + 4) == DAEMON_OK) {
+            //Answered by sync_changes together with the other changes of this round of events
+            connection->waiting_for_sync = true;
+            server->sync_pending = true;
+            return true;
+        }
+        if (! send_output(server, connection)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @note Flushes the changes of the last round of events to the disk with one fsync and then sends their responses,
+ * so a client is told a change is saved only when it is durable. Requests that came after the changes are handled.
+ */
+static void sync_changes(struct daemon_server *server)
+{
+    server->sync_pending = false;
+    bool synced = vault_sync(server->vault);
+
+    //Backwards, because a closed connection is replaced by the last one, which was already visited
+    for (size_t i = server->connection_count; i > 0; i--) {
+        struct daemon_connection *connection = server->connections[i - 1];
+        if (! connection->waiting_for_sync) {
+            continue;
+        }
+        connection->waiting_for_sync = false;
+
+        if (! synced) {
+            uint16_t type = get_u16(connection->output.data + 6);
+            fail(&connection->output, DAEMON_FAILED);
+            finish_message(&connection->output, type);
+        }
+        if (! send_output(server, connection)
+            || (connection->output.length == 0 && ! handle_input(server, connection))) {
+            close_connection(server, connection);
+        }
+    }
+}
+
+/**
+ * @return true if the connection can be used further, false if it has to be closed
+ */
+static bool receive_input(struct daemon_server *server, struct daemon_connection *connection)
+{
+    struct daemon_message *input = &connection->input;
+    while (input->length < DAEMON_MAX_MESSAGE) {
+        ssize_t received = recv(connection->fd, input->data + input->length, DAEMON_MAX_MESSAGE - input->length, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return true;
+        }
+        if (received <= 0) {
+            return false;
+        }
+
+        input->length += (size_t) received;
+        if (! handle_input(server, connection)) {
+            return false;
+        }
+        if (connection->output.length != 0) {
+            return true;
+        }
+    }
+    return true;
+}
+
+/**
+ * @note Creates the socket. A socket left by a daemon that is not running any more is replaced.
+ *
+ * @return true on success, false on failure
+ */
+static bool listen_on(struct daemon_server *server, const char *socket_path)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "The socket path %s is too long.\n", socket_path);
+        return false;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    struct stat status;
+    if (lstat(socket_path, &status) == 0) {
+        int fd = -1;
+        if (! S_ISSOCK(status.st_mode) || daemon_connect(socket_path, &fd)) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            fprintf(stderr, "%s is used by something else, maybe another daemon.\n", socket_path);
+            return false;
+        }
+        unlink(socket_path);
+    }
+
+    server->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server->listen_fd < 0) {
+        fprintf(stderr, "failed to create a socket\n");
+        return false;
+    }
+
+    //Only the owner can connect, the daemon hands out the saved passwords
+    mode_t mask = umask(0177);
+    bool result = bind(server->listen_fd, (struct sockaddr *) &address, sizeof(address)) == 0;
+    umask(mask);
+    if (! result || listen(server->listen_fd, SOMAXCONN) != 0) {
+        fprintf(stderr, "failed to listen on %s\n", socket_path);
+        return false;
+    }
+    server->socket_path = socket_path;
+    return true;
+}
+
+/**
+ * @note Prepares everything the requests need and starts listening on the socket.
+ *
+ * @param server Server to be initialized. Free it with daemon_free, also when this fails.
+ * @param socket_path Path of the socket, it has to stay valid until the server is freed.
+ * @param vault Opened and unlocked vault with its index, it has to stay open until the server is freed.
+ * Group commit is turned on for it.
+ * @param filter_path Breach filter the scored passwords are looked up in, NULL for none.
+ * @param profiles_path Profiles that can be generated, NULL for none.
+ * @return true on success, false on failure
+ */
+bool daemon_init(struct daemon_server *server, const char *socket_path, struct vault *vault, const char *filter_path,
+                 const char *profiles_path)
+{
+    memset(server, 0, sizeof(*server));
+    server->listen_fd = -1;
+    server->epoll_fd = -1;
+    server->stop_fd = -1;
+    server->vault = vault;
+    vault_set_group_commit(vault, true);
+
+    if (! random_pool_init_drbg(&server->pool)) {
+        return false;
+    }
+    server->pool_ready = true;
+    if (! pwgen_scorer_init(&server->scorer, filter_path)) {
+        return false;
+    }
+    server->scorer_ready = true;
+
+    if (profiles_path != NULL) {
+        if (! profiles_load(&server->profiles, profiles_path)) {
+            return false;
+        }
+        server->use_profiles = true;
+    }
+
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    server->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (server->epoll_fd < 0 || server->stop_fd < 0) {
+        fprintf(stderr, "failed to create the event loop\n");
+        return false;
+    }
+
+    return listen_on(server, socket_path) && watch(server, EPOLL_CTL_ADD, server->listen_fd, EPOLLIN, &server->listen_fd)
+           && watch(server, EPOLL_CTL_ADD, server->stop_fd, EPOLLIN, &server->stop_fd);
+}
+
+/**
+ * @note Serves the clients until daemon_stop is called.
+ *
+ * @return true if the server was stopped, false on failure
+ */
+bool daemon_run(struct daemon_server *server)
+{
+    struct epoll_event events[DAEMON_EVENTS];
+
+    while (true) {
+        //Changes waiting for a sync only pick up the events that are ready right now to be synced with them
+        int count = epoll_wait(server->epoll_fd, events, DAEMON_EVENTS, server->sync_pending ? 0 : -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "failed to wait for clients\n");
+            return false;
+        }
+
+        for (int i = 0; i < count; i++) {
+            void *pointer = events[i].data.ptr;
+            if (pointer == &server->stop_fd) {
+                return true;
+            }
+            if (pointer == &server->listen_fd) {
+                accept_connections(server);
+                continue;
+            }
+
+            struct daemon_connection *connection = pointer;
+            bool open = (events[i].events & (EPOLLERR | EPOLLHUP)) == 0;
+            if (open && (events[i].events & EPOLLOUT) != 0) {
+                open = send_output(server, connection);
+                //Requests that came meanwhile are handled once the response is sent
+                if (open && connection->output.length == 0) {
+                    open = watch(server, EPOLL_CTL_MOD, connection->fd, EPOLLIN | EPOLLRDHUP, connection)
+                           && handle_input(server, connection);
+                }
+            }
+            if (open && (events[i].events & EPOLLIN) != 0) {
+                open = receive_input(server, connection);
+            }
+            if (open && (events[i].events & EPOLLRDHUP) != 0 && connection->output.length == 0) {
+                open = false;
+            }
+            if (! open) {
+                close_connection(server, connection);
+            }
+        }
+
+        if (server->sync_pending) {
+            sync_changes(server);
+        }
+    }
+}
+
+/**
+ * @note Makes daemon_run return. It only writes to an eventfd, so it can be called from a signal handler.
+ */
+void daemon_stop(struct daemon_server *server)
+{
+    uint64_t one = 1;
+    ssize_t written = write(server->stop_fd, &one, sizeof(one));
+    (void) written;
+}
+
+void daemon_free(struct daemon_server *server)
+{
+    while (server->connection_count > 0) {
+        close_connection(server, server->connections[server->connection_count - 1]);
+    }
+    if (server->listen_fd >= 0) {
+        close(server->listen_fd);
+        if (server->socket_path != NULL) {
+            unlink(server->socket_path);
+        }
+    }
+    if (server->epoll_fd >= 0) {
+        close(server->epoll_fd);
+    }
+    if (server->stop_fd >= 0) {
+        close(server->stop_fd);
+    }
+    if (server->use_profiles) {
+        profiles_free(&server->profiles);
+    }
+    if (server->scorer_ready) {
+        pwgen_scorer_free(&server->scorer);
+    }
+    if (server->pool_ready) {
+        random_pool_free(&server->pool);
+    }
+    memset(server, 0, sizeof(*server));
+}
+
+/**
+ * @param fd Connected socket is stored here, close it when it is not needed.
+ * @return true on success, false if no daemon listens on the socket
+ */
+bool daemon_connect(const char *socket_path, int *fd)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        return false;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    *fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (*fd < 0) {
+        return false;
+    }
+    if (connect(*fd, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        close(*fd);
+        *fd = -1;
+        return false;
+    }
+    return true;
+}
+
+static bool receive_all(int fd, unsigned char *buffer, size_t length)
+{
+    size_t done = 0;
+    while (done < length) {
+        ssize_t received = recv(fd, buffer + done, length - done, 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        done += (size_t) received;
+    }
+    return true;
+}
+
+/**
+ * @note Sends the request to the daemon and waits for its response. The body of the response is read
+ * by the daemon_message_read functions.
+ *
+ * @param request Request started by daemon_message_start with its body added.
+ * @param status Status of the response is stored here.
+ * @return true on success, false if the daemon could not be reached
+ */
+bool daemon_call(int fd, struct daemon_message *request, struct daemon_message *response, uint16_t *status)
+{
+    finish_message(request, 0);
+    size_t sent = 0;
+    while (sent < request->length) {
+        ssize_t done = send(fd, request->data + sent, request->length - sent, MSG_NOSIGNAL);
+        if (done < 0 && errno == EINTR) {
+            continue;
+        }
+        if (done <= 0) {
+            return false;
+        }
+        sent += (size_t) done;
+    }
+
+    if (! receive_all(fd, response->data, DAEMON_HEADER_SIZE)) {
+        return false;
+    }
+    uint32_t body_length = get_u32(response->data);
+    if (body_length > DAEMON_MAX_MESSAGE - DAEMON_HEADER_SIZE
+        || ! receive_all(fd, response->data + DAEMON_HEADER_SIZE, body_length)) {
+        return false;
+    }
+
+    response->length = DAEMON_HEADER_SIZE + body_length;
+    response->position = DAEMON_HEADER_SIZE;
+    *status = get_u16(response->data + 4);
+    return true;
+}
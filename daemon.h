@@ -0,0 +1,111 @@
+#ifndef PASSWORD_GENERATOR_DAEMON_H
+#define PASSWORD_GENERATOR_DAEMON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pwgen.h"
+
+/**
+ * The daemon keeps everything that is expensive to set up - a seeded DRBG, the vault index with the unlocked key,
+ * the pattern matcher, the breach filter and the compiled profiles - and serves requests on a Unix domain socket.
+ * All clients are served by one thread with an epoll loop, every request is answered right when it is read whole.
+ * Changes of the vault are the exception: they are saved with group commit and answered after the whole round
+ * of events is synced with one fsync.
+ * The socket can be used only by the user that started the daemon.
+ *
+ * Every message is a DAEMON_HEADER_SIZE byte header followed by a body, all numbers are little endian:
+ *
+ * header       body length (u32), type of a request or status of a response (u16), type of the request
+ *              in a response, zero in a request (u16)
+ * string       length (u16) followed by the bytes
+ *
+ * Bodies of the requests and of their responses:
+ *
+ * GENERATE         length (u16), words (u16), required classes (u8), rules (u8: 1 no repeats, 2 no sequences),
+ *                  excluded characters (string), separator (string) -> password (string)
+ * GENERATE_PROFILE profile name (string) -> password (string)
+ * SCORE            password (string) -> strength (u8), breached (u8: 1 breached, 2 checked), entropy in hundredths
+ *                  of a bit (u32)
+ * GET              site, account (strings) -> password (string), DAEMON_NOT_FOUND if there is none
+ * PUT              site, account, password (strings) -> empty
+ * DELETE           site, account (strings) -> empty, DAEMON_NOT_FOUND if there is none
+ */
+#define DAEMON_HEADER_SIZE 8
+#define DAEMON_MAX_MESSAGE 4096
+#define DAEMON_MAX_CLIENTS 1024
+#define DAEMON_RULE_NO_REPEATS 1
+#define DAEMON_RULE_NO_SEQUENCES 2
+#define DAEMON_SCORE_BREACHED 1
+#define DAEMON_SCORE_CHECKED 2
+
+enum daemon_request_type {
+    DAEMON_GENERATE = 1,
+    DAEMON_GENERATE_PROFILE = 2,
+    DAEMON_SCORE = 3,
+    DAEMON_GET = 4,
+    DAEMON_PUT = 5,
+    DAEMON_DELETE = 6
+};
+
+enum daemon_status {
+    DAEMON_OK = 0,
+    DAEMON_NOT_FOUND = 1,
+    DAEMON_BAD_REQUEST = 2,
+    DAEMON_FAILED = 3
+};
+
+/**
+ * Message being built (header included) or read (body only, position is the next unread byte).
+ */
+struct daemon_message {
+    unsigned char data[DAEMON_MAX_MESSAGE];
+    size_t length;
+    size_t position;
+};
+
+struct daemon_connection;
+
+struct daemon_server {
+    int listen_fd;
+    int epoll_fd;
+    //Written by daemon_stop, so the loop can be stopped from a signal handler or another thread
+    int stop_fd;
+    const char *socket_path;
+
+    struct vault *vault;
+    struct pwgen_scorer scorer;
+    bool scorer_ready;
+    struct profile_set profiles;
+    bool use_profiles;
+    //Own DRBG of the daemon, seeded once
+    struct random_pool pool;
+    bool pool_ready;
+
+    struct daemon_connection *connections[DAEMON_MAX_CLIENTS];
+    size_t connection_count;
+    //Some connections wait for their changes to be synced
+    bool sync_pending;
+};
+
+void daemon_message_start(struct daemon_message *message, uint16_t type);
+bool daemon_message_add_u8(struct daemon_message *message, uint8_t value);
+bool daemon_message_add_u16(struct daemon_message *message, uint16_t value);
+bool daemon_message_add_u32(struct daemon_message *message, uint32_t value);
+bool daemon_message_add_string(struct daemon_message *message, const char *text, size_t length);
+bool daemon_message_read_u8(struct daemon_message *message, uint8_t *value);
+bool daemon_message_read_u16(struct daemon_message *message, uint16_t *value);
+bool daemon_message_read_u32(struct daemon_message *message, uint32_t *value);
+bool daemon_message_read_string(struct daemon_message *message, const char **text, size_t *length);
+
+bool daemon_init(struct daemon_server *server, const char *socket_path, struct vault *vault, const char *filter_path,
+                 const char *profiles_path);
+bool daemon_run(struct daemon_server *server);
+void daemon_stop(struct daemon_server *server);
+void daemon_free(struct daemon_server *server);
+
+bool daemon_connect(const char *socket_path, int *fd);
+bool daemon_call(int fd, struct daemon_message *request, struct daemon_message *response, uint16_t *status);
+
+#endif //PASSWORD_GENERATOR_DAEMON_H
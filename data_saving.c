@@ -1,400 +1,464 @@
 #include "data_saving.h"
 #include "password_tools.h"
+#include "vault.h"
+#include "vault_directory.h"
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <termios.h>
 
 //Because I allow passwords to be 999 characters long
 #define MAX_EXPECTED_LINE_LENGTH 1000
-
+//How many times you can try to write the master password
+#define MASTER_PASSWORD_ATTEMPTS 3
+//How many typos a site name may have to be suggested when a password is not found, and how many sites are suggested
+#define SUGGESTED_DISTANCE 2
+#define SUGGESTED_SITES 5
+//Accounts listed at once by the interactive mode
+#define LIST_PAGE_SIZE 20
+
+//The old text format, it is only read once to move the passwords to the vault
 const char *data_file = "file";
-const char *aux_file = "aux";
+const char *migrated_data_file = "file.migrated";
 
 /**
- * @note Reads accounts and saves them to accounts until account_name is found.\n
- * You must have read all sites until the site where it is supposed to be and also the account_count.
+ * @note Removes '\n' from the end of text, if it is there.
  *
- * @param account_name Account to be found. (after the name there should be end of line character)
- * @param account_count Number of accounts saved for this site.
- * @param accounts Allocated array, where will be stored all read accounts until account_name was reached (not including it).
- * @param buffer Must be at least 1000 chars long
- * @param file Opened file with data
- * @param found_account is set to true if the account was found or to false if it wasn't found
- * @param loaded_count number of structs in an array accounts that have to be freed later.
- * @return true if no error occurs, false otherwise
+ * @return length of the text
  */
-bool load_until_account(char *account_name, long account_count, struct account_info **accounts,
-                        char *buffer, FILE *file, bool *found_account, int *loaded_count)
+size_t strip_newline(char *text)
 {
-    *loaded_count = 0;
-
-    for (long i = 0; i < account_count; i++) {
-        if (fgets(buffer, MAX_EXPECTED_LINE_LENGTH + 1, file) == NULL) {
-            fprintf(stderr, "failed to read a line - data file was probably altered\n");
-            return false;
-        }
-
-        if (strcmp(buffer, account_name) == 0) {
-            if (fgets(buffer, MAX_EXPECTED_LINE_LENGTH + 1, file) == NULL) {
-                fprintf(stderr, "failed to read a line - data file was probably altered\n");
-                return false;
-            }
-            *found_account = true;
-            return true;
-        }
-
-        struct account_info *account = malloc(sizeof(*account));
-        if (account == NULL) {
-            fprintf(stderr, "malloc failed\n");
-            return false;
-        }
-
-        account->account_name_length = strlen(buffer);
-
-        account->account_name = malloc((account->account_name_length + 1) * sizeof(char));
-        if (account->account_name == NULL) {
-            free(account);
-            fprintf(stderr, "malloc failed\n");
-            return false;
-        }
-
-        memcpy(account->account_name, buffer, account->account_name_length + 1);
-
-        if (fgets(buffer, MAX_EXPECTED_LINE_LENGTH + 1, file) == NULL) {
-            fprintf(stderr, "failed to read a line - data file was probably altered\n");
-            free(account->account_name);
-            free(account);
-            return false;
-        }
-
-        account->password_length = strlen(buffer);
-        account->password = malloc((account->password_length + 1) * sizeof(char));
-        if (account->password == NULL) {
-            fprintf(stderr, "malloc failed\n");
-            free(account->account_name);
-            free(account);
-            return false;
-        }
-        memcpy(account->password, buffer, account->password_length + 1);
-        accounts[*loaded_count] = account;
-        *loaded_count += 1;
+    size_t length = strlen(text);
+    if (length > 0 && text[length - 1] == '\n') {
+        length--;
+        text[length] = '\0';
     }
-    *found_account = false;
-    return true;
+    return length;
 }
 
 /**
- * @note frees all accounts and their attributes and also the accounts array
+ * Position in the mapped old data file.
  */
-void free_accounts(struct account_info **accounts, int loaded_count)
-{
-    for (int i = 0; i < loaded_count; i++) {
-        free(accounts[i]->account_name);
-        memset(accounts[i]->password, '\0', accounts[i]->password_length);
-        free(accounts[i]->password);
-        free(accounts[i]);
-    }
-    free(accounts);
-}
+struct text_cursor {
+    const char *position;
+    const char *end;
+};
 
 /**
- * @param accounts accounts to be saved to the write file
- * @param loaded_count number of accounts in accounts
- * @param write opened file for writing
+ * @note Finds the next line of the old data file with memchr, nothing is copied.
+ *
+ * @param line Start of the line is stored here.
+ * @param length Length of the line without '\n' is stored here.
+ * @return true if there was a line, false at the end of the file
  */
-void write_loaded_accounts(struct account_info **accounts, int loaded_count, FILE *write)
+bool next_line(struct text_cursor *cursor, const char **line, size_t *length)
 {
-    for (int i = 0; i < loaded_count; i++) {
-        fprintf(write, "%s", accounts[i]->account_name);
-        fprintf(write, "%s", accounts[i]->password);
+    if (cursor->position >= cursor->end) {
+        return false;
     }
+
+    const char *newline = memchr(cursor->position, '\n', cursor->end - cursor->position);
+    const char *line_end = newline == NULL ? cursor->end : newline;
+
+    *line = cursor->position;
+    *length = line_end - cursor->position;
+    cursor->position = newline == NULL ? cursor->end : newline + 1;
+    return true;
 }
 
 /**
- * @note reads lines from <file> until all accounts from current site are read and rewrites them to <write>.
+ * @note Reads all accounts of one site from the old data file and adds them to records.
+ * You must have read the site name already.
  *
- * @param file file with data
- * @param write file where we write data (if it is NULL then just skips to another site and does not print anything)
- * @param buffer at least 1000 characters long
+ * @param site Name of the site, without '\n'.
+ * @param site_length Length of the site name.
+ * @param arena Strings of the records are allocated here.
+ * @param records Array of records, it is reallocated when it gets full.
+ * @param count Number of records in the array.
+ * @param capacity Capacity of the array.
+ * @param cursor Position in the mapped old data file.
  * @return true if no error occurs, false otherwise
  */
-bool skip_to_another_site(FILE *file, FILE *write, char *buffer)
+bool load_site(const char *site, size_t site_length, struct arena *arena, struct vault_record **records, size_t *count, size_t *capacity,
+               struct text_cursor *cursor)
 {
-    if (fgets(buffer, MAX_EXPECTED_LINE_LENGTH + 1, file) == NULL) {
+    const char *line = NULL;
+    size_t length = 0;
+
+    if (! next_line(cursor, &line, &length) || length >= MAX_EXPECTED_LINE_LENGTH) {
         fprintf(stderr, "failed to read a line - data file was probably altered\n");
         return false;
     }
 
-    long count = strtol(buffer, NULL, 10);
-    if (0 >= count || errno == ERANGE) {
+    char number[MAX_EXPECTED_LINE_LENGTH + 1];
+    memcpy(number, line, length);
+    number[length] = '\0';
+
+    errno = 0;
+    long account_count = strtol(number, NULL, 10);
+    if (0 >= account_count || errno == ERANGE) {
         fprintf(stderr, "data file was probably altered\n");
         return false;
     }
 
-    if (write != NULL) {
-        fprintf(write, "%ld\n", count);
-    }
+    for (long i = 0; i < account_count; i++) {
+        const char *account = NULL;
+        const char *password = NULL;
+        size_t account_length = 0;
+        size_t password_length = 0;
 
-    count *= 2;
+        if (! next_line(cursor, &account, &account_length) || ! next_line(cursor, &password, &password_length)
+            || account_length > VAULT_MAX_NAME_LENGTH || password_length > VAULT_MAX_PASSWORD_LENGTH) {
+            fprintf(stderr, "failed to read a line - data file was probably altered\n");
+            return false;
+        }
 
-    while (count > 0 && fgets(buffer, MAX_EXPECTED_LINE_LENGTH + 1, file) != NULL) {
-        if (write != NULL) {
-            fprintf(write, "%s", buffer);
+        if (*count == *capacity) {
+            size_t new_capacity = *capacity == 0 ? 64 : 2 * *capacity;
+            struct vault_record *bigger = realloc(*records, new_capacity * sizeof(**records));
+            if (bigger == NULL) {
+                fprintf(stderr, "malloc failed\n");
+                return false;
+            }
+            *records = bigger;
+            *capacity = new_capacity;
         }
-        count--;
-    }
 
-    return count == 0;
+        if (! vault_record_init_in(&(*records)[*count], arena, site, site_length, account, account_length,
+                                   password, password_length)) {
+            return false;
+        }
+        *count += 1;
+    }
+    return true;
 }
 
 /**
- * @note if account.password == NULL, then the function deletes the account\n
- * if you want to save password for account that is already there the password will change to the new one
+ * @note Moves all passwords from the old line based data file to a new vault and renames the old file
+ * to file.migrated, so it is done only once. The old file is mapped to memory and parsed in one pass.
+ * file.migrated is removed by remove_migrated_data_file once the vault is encrypted.
  *
- * @param site_name name of a site, where the account is
- * @param account information about the account to be saved
- * @return true if no error occurred, false otherwise
+ * @return true on success, false on failure
  */
-bool save_or_delete_password(char *site_name, struct account_info *account)
+bool migrate_data_file(void)
 {
-    char buffer[MAX_EXPECTED_LINE_LENGTH + 1];
-
-    FILE *file = fopen(data_file, "a");
-    if (file == NULL) {
+    int fd = open(data_file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
         fprintf(stderr, "failed to open file with data\n");
         return false;
     }
 
-    fclose(file);
-
-    file = fopen(data_file, "r");
-    if (file == NULL) {
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
         fprintf(stderr, "failed to open file with data\n");
+        close(fd);
         return false;
     }
 
-    FILE *write = fopen(aux_file, "w");
-    if (write == NULL) {
-        fclose(file);
-        fprintf(stderr, "failed to open file with data\n");
-        return false;
-    }
-
-    while (fgets(buffer, MAX_EXPECTED_LINE_LENGTH + 1, file) != NULL) {
-        if (strcmp(buffer, site_name) != 0) {
-            fprintf(write, "%s", buffer);
-            if (! skip_to_another_site(file, write, buffer)) {
-                fclose(file);
-                fclose(write);
-                return false;
-            }
-            continue;
-        }
-
-        size_t length = strlen(buffer) + 1;
-        char *name = malloc(length * sizeof(char));
-        if (name == NULL) {
-            fclose(file);
-            fclose(write);
-            fprintf(stderr,"malloc failed\n");
+    const char *map = NULL;
+    if (status.st_size > 0) {
+        map = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            fprintf(stderr, "failed to map file with data\n");
+            close(fd);
             return false;
         }
+    }
+    close(fd);
 
-        memcpy(name, buffer, length);
+    struct text_cursor cursor = { .position = map, .end = map + status.st_size };
+    struct arena arena;
+    arena_init(&arena);
+    struct vault_record *records = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    bool result = true;
 
-        if (fgets(buffer, MAX_EXPECTED_LINE_LENGTH + 1, file) == NULL) {
-            free(name);
-            fclose(file);
-            fclose(write);
-            fprintf(stderr, "failed to read a line - data file was probably altered\n");
-            return false;
-        }
+    const char *site = NULL;
+    size_t site_length = 0;
 
-        long count = strtol(buffer, NULL, 10);
-        if (0 >= count || errno == ERANGE) {
+    while (result && next_line(&cursor, &site, &site_length)) {
+        if (site_length > VAULT_MAX_NAME_LENGTH) {
             fprintf(stderr, "data file was probably altered\n");
-            free(name);
-            fclose(write);
-            fclose(file);
-            return false;
+            result = false;
+            break;
         }
+        result = load_site(site, site_length, &arena, &records, &count, &capacity, &cursor);
+    }
 
-        struct account_info **accounts = malloc(count * sizeof(*accounts));
-        if (accounts == NULL) {
-            fprintf(stderr, "malloc failed\n");
-            free(name);
-            fclose(write);
-            fclose(file);
-            return false;
-        }
+    if (map != NULL) {
+        munmap((void *) map, status.st_size);
+    }
 
-        int loaded_count = 0;
-        bool found_account = false;
+    result = result && vault_write(VAULT_FILE, NULL, records, count);
+    free(records);
+    arena_free(&arena);
 
-        if (! load_until_account(account->account_name, count, accounts, buffer, file, &found_account, &loaded_count)) {
-            free_accounts(accounts, loaded_count);
-            free(name);
-            fclose(file);
-            fclose(write);
-            return false;
-        }
+    if (! result) {
+        return false;
+    }
 
-        if (account->password == NULL) {
-            if (! found_account) {
-                fprintf(stderr, "The account was not found.\n");
-                fprintf(write, "%s", name);
-                fprintf(write, "%ld\n", count);
-            } else if (count > 1) {
-                fprintf(write, "%s", name);
-                fprintf(write, "%ld\n", count - 1);
-            }
-        } else if (found_account) {
-            fprintf(write, "%s", name);
-            fprintf(write, "%ld\n", count);
-        } else {
-            fprintf(write, "%s", name);
-            fprintf(write, "%ld\n", count + 1);
-        }
+    if (rename(data_file, migrated_data_file)) {
+        fprintf(stderr, "failed to rename the old data file\n");
+        return false;
+    }
 
-        free(name);
+    fprintf(stderr, "Your saved passwords were moved from \"%s\" to the new vault \"%s\".\n", data_file, VAULT_FILE);
+    return true;
+}
 
-        write_loaded_accounts(accounts, loaded_count, write);
-        free_accounts(accounts, loaded_count);
+//The vault stays open for the whole session, so it is read and indexed only once
+struct vault session_vault;
+bool session_vault_open = false;
 
-        if (account->password != NULL) {
-            fprintf(write, "%s", account->account_name);
-            fprintf(write, "%s", account->password);
-        }
+/**
+ * @note Closes the session's vault, waiting for a compaction if one is running.
+ */
+void close_vault(void)
+{
+    if (session_vault_open) {
+        vault_close(&session_vault);
+        session_vault_open = false;
+    }
+}
 
-        while (fgets(buffer, MAX_EXPECTED_LINE_LENGTH + 1, file) != NULL) {
-            fprintf(write, "%s", buffer);
-        }
+/**
+ * @note Overwrites the old data file renamed by migrate_data_file with zeros and removes it. It has all migrated
+ * passwords in plaintext, so it goes once they are encrypted in the vault. Does nothing if there is no such file.
+ *
+ * @return true on success, false on failure
+ */
+bool remove_migrated_data_file(void)
+{
+    int fd = open(migrated_data_file, O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return errno == ENOENT;
+    }
 
-        if (feof(file)) {
-            fclose(file);
-            fclose(write);
+    struct stat status;
+    bool result = fstat(fd, &status) == 0;
+    char zeros[4096] = { 0 };
+    for (off_t written = 0; result && written < status.st_size; written += (off_t) sizeof(zeros)) {
+        size_t length = status.st_size - written < (off_t) sizeof(zeros) ? (size_t) (status.st_size - written)
+                                                                        : sizeof(zeros);
+        result = write(fd, zeros, length) == (ssize_t) length;
+    }
+    result = result && fsync(fd) == 0;
+    result = close(fd) == 0 && result;
 
-            if (remove(data_file)) {
-                fprintf(stderr, "failed to change data_file\n");
-                return false;
-            }
+    if (! result || unlink(migrated_data_file) != 0) {
+        fprintf(stderr, "failed to remove \"%s\", it has your passwords in plaintext, delete it yourself\n",
+                migrated_data_file);
+        return false;
+    }
 
-            if (rename(aux_file, data_file)) {
-                fprintf(stderr, "failed to change data_file\n");
-                return false;
-            }
-            return true;
-        }
+    fprintf(stderr, "The old data file \"%s\" with your passwords in plaintext was overwritten and removed.\n",
+            migrated_data_file);
+    return true;
+}
 
-        fclose(file);
-        fclose(write);
+/**
+ * @note Reads the master password without showing it, if the input is a terminal. Questions about the vault
+ * go to stderr, so they never end up in exported passwords.
+ *
+ * @param password Buffer for MAX_EXPECTED_LINE_LENGTH + 1 characters, the password without '\n' is stored here.
+ * @return true on success, false on failure
+ */
+bool read_master_password(const char *question, char *password)
+{
+    fprintf(stderr, "%s", question);
 
-        fprintf(stderr, "failed to read a line - data file was probably altered\n");
+    struct termios original;
+    bool hidden = isatty(STDIN_FILENO) && tcgetattr(STDIN_FILENO, &original) == 0;
+    if (hidden) {
+        struct termios silent = original;
+        silent.c_lflag &= ~ECHO;
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &silent);
+    }
+
+    bool result = fgets(password, MAX_EXPECTED_LINE_LENGTH + 1, stdin) != NULL;
+
+    if (hidden) {
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &original);
+        fprintf(stderr, "\n");
+    }
+
+    if (! result) {
+        fprintf(stderr, "failed to read input\n");
         return false;
     }
+    strip_newline(password);
+    return true;
+}
+
+/**
+ * @note Asks for the master password of an encrypted vault and unlocks it. A vault that is not encrypted yet
+ * (a new one, or one saved by an older version) is encrypted with a new master password. Then the plaintext copy
+ * of migrated passwords is removed, if there is one.
+ * The master password is kept in a locked arena and wiped right after the key is derived from it.
+ *
+ * @return true on success, false on failure
+ */
+bool unlock_vault(struct vault *vault)
+{
+    struct arena arena;
+    arena_init(&arena);
+
+    char *password = arena_alloc(&arena, MAX_EXPECTED_LINE_LENGTH + 1);
+    char *repeated = arena_alloc(&arena, MAX_EXPECTED_LINE_LENGTH + 1);
+    bool result = false;
 
-    if (! feof(file)) {
-        fclose(file);
-        fclose(write);
-        fprintf(stderr, "failed to read a line\n");
+    if (password == NULL || repeated == NULL) {
+        arena_free(&arena);
         return false;
     }
 
-    fclose(file);
-    if (account->password == NULL) {
-        fprintf(stderr, "The account was not found\n");
-        fclose(write);
-        if (remove(aux_file)) {
-            fprintf(stderr, "failed to change data_file\n");
-            return false;
+    if (vault_is_encrypted(vault)) {
+        bool correct = false;
+        for (int attempt = 0; attempt < MASTER_PASSWORD_ATTEMPTS && ! correct; attempt++) {
+            if (! read_master_password("Write the master password of your vault:\n", password)
+                || ! vault_unlock(vault, password, &correct)) {
+                break;
+            }
+            if (! correct) {
+                fprintf(stderr, "Wrong master password.\n");
+            }
+        }
+        result = correct && vault->unlocked;
+    } else {
+        fprintf(stderr, "Your saved passwords are going to be encrypted, choose a master password for them.\n"
+                        "There is no way to get the passwords back without it.\n");
+
+        while (read_master_password("Write the new master password:\n", password)
+               && read_master_password("Write it once more:\n", repeated)) {
+            if (strlen(password) == 0) {
+                fprintf(stderr, "The master password cannot be empty.\n");
+            } else if (strcmp(password, repeated) != 0) {
+                fprintf(stderr, "The passwords are not the same.\n");
+            } else {
+                result = vault_encrypt_all(vault, password);
+                break;
+            }
         }
-        return true;
     }
 
-    fprintf(write, "%s", site_name);
-    fprintf(write, "%c\n", '1');
-    fprintf(write,"%s%s", account->account_name, account->password);
+    arena_free(&arena);
+    return result && remove_migrated_data_file();
+}
 
-    fclose(write);
+/**
+ * @note Opens the vault the first time it is needed without unlocking it, later calls return the same vault.
+ * Names of the sites and accounts are not encrypted, so they can be read from it without the master password.
+ * Passwords saved in the old data file are moved to the vault first.
+ *
+ * @return the opened vault, NULL on failure
+ */
+struct vault *open_vault_names(void)
+{
+    if (session_vault_open) {
+        return &session_vault;
+    }
 
-    if (remove(data_file)) {
-        fprintf(stderr, "failed to change data_file\n");
-        return false;
+    if (access(VAULT_FILE, F_OK) != 0 && access(data_file, F_OK) == 0 && ! migrate_data_file()) {
+        return NULL;
     }
 
-    if (rename(aux_file, data_file)) {
-        fprintf(stderr, "failed to change data_file\n");
-        return false;
+    if (! vault_open(&session_vault, VAULT_FILE)) {
+        return NULL;
     }
 
-    return true;
+    session_vault_open = true;
+    atexit(close_vault);
+    return &session_vault;
 }
 
 /**
- * @note Asks for account info and calls save_or_delete_password
+ * @note Opens the vault the first time it is needed, unlocks it and builds its in-memory index,
+ * later calls return the same vault.
  *
- * @return true if successful, false otherwise
+ * @return the opened vault, NULL on failure
  */
-bool get_and_remove_password(void)
+struct vault *open_vault(void)
 {
-    char *site_name = malloc((LONGEST_NAME + 1) * sizeof(char));
-    if (site_name == NULL) {
-        fprintf(stderr, "malloc failed\n");
-        return false;
+    struct vault *vault = open_vault_names();
+    if (vault == NULL) {
+        return NULL;
     }
 
-    char *account_name = malloc((LONGEST_NAME + 1) * sizeof(char));
-
-    if (account_name == NULL) {
-        free(site_name);
-        fprintf(stderr, "malloc failed\n");
-        return false;
+    if (! vault->unlocked && (! unlock_vault(vault) || ! vault_use_index(vault))) {
+        close_vault();
+        return NULL;
     }
+    return vault;
+}
 
-    struct account_info *account = malloc(sizeof(*account));
-    if (account == NULL) {
-        free(site_name);
-        free(account_name);
-        fprintf(stderr, "malloc failed\n");
+/**
+ * @note if account.password == NULL, then the function deletes the account\n
+ * if you want to save password for account that is already there the password will change to the new one
+ *
+ * @param site_name name of a site, where the account is (the '\n' at the end is removed)
+ * @param account information about the account to be saved (the '\n' at the end of the name and password is removed)
+ * @return true if no error occurred, false otherwise
+ */
+bool save_or_delete_password(char *site_name, struct account_info *account)
+{
+    struct vault *vault = open_vault();
+    if (vault == NULL) {
         return false;
     }
 
-    account->account_name = account_name;
-    account->password = NULL;
+    strip_newline(site_name);
+    strip_newline(account->account_name);
 
-    printf("Please write which account data you want to delete:\n");
+    bool result = false;
 
-    if (fgets(account->account_name, LONGEST_NAME + 1, stdin) == NULL) {
-        free(site_name);
-        free(account_name);
-        free(account);
-        fprintf(stderr, "failed to read input\n");
-        return false;
+    if (account->password == NULL) {
+        bool found = false;
+        result = vault_delete(vault, site_name, account->account_name, &found);
+        if (result && ! found) {
+            fprintf(stderr, "The account was not found.\n");
+        }
+    } else {
+        strip_newline(account->password);
+        result = vault_put(vault, site_name, account->account_name, account->password);
     }
 
-    printf("Please write to what site is this account:\n");
+    return result;
+}
 
-    if (fgets(site_name, LONGEST_NAME + 1, stdin) == NULL) {
-        free(site_name);
-        free(account_name);
-        free(account);
-        fprintf(stderr, "failed to read input\n");
-        return false;
+/**
+ * @note Allocates an account_info with buffers for the site name, account name and, if with_password is true,
+ * the password in the arena.
+ *
+ * @return the account, NULL on failure
+ */
+struct account_info *new_account(struct arena *arena, char **site_name, bool with_password)
+{
+    struct account_info *account = arena_alloc(arena, sizeof(*account));
+    *site_name = arena_alloc(arena, LONGEST_NAME + 1);
+    if (account == NULL || *site_name == NULL) {
+        return NULL;
     }
 
-    if (! save_or_delete_password(site_name, account)) {
-        free(site_name);
-        free(account_name);
-        free(account);
-        return false;
+    account->account_name = arena_alloc(arena, LONGEST_NAME + 1);
+    account->account_name_length = 0;
+    account->password = NULL;
+    account->password_length = 0;
+
+    if (with_password) {
+        account->password = arena_alloc(arena, MAX_EXPECTED_LINE_LENGTH + 1);
     }
 
-    free(site_name);
-    free(account_name);
-    free(account);
-    return true;
+    if (account->account_name == NULL || (with_password && account->password == NULL)) {
+        return NULL;
+    }
+    return account;
 }
 
 /**
@@ -402,48 +466,47 @@ bool get_and_remove_password(void)
  *
  * @return true if successful, false otherwise
  */
-bool get_and_save_password(void)
+bool get_and_remove_password(void)
 {
-    char *site_name = malloc((LONGEST_NAME + 1) * sizeof(char));
-    if (site_name == NULL) {
-        fprintf(stderr, "malloc failed\n");
-        return false;
-    }
-
-    char *account_name = malloc((LONGEST_NAME + 1) * sizeof(char));
-
-    if (account_name == NULL) {
-        free(site_name);
-        fprintf(stderr, "malloc failed\n");
-        return false;
-    }
+    struct arena arena;
+    arena_init(&arena);
 
-    struct account_info *account = malloc(sizeof(*account));
+    char *site_name = NULL;
+    struct account_info *account = new_account(&arena, &site_name, false);
     if (account == NULL) {
-        free(site_name);
-        free(account_name);
-        fprintf(stderr, "malloc failed\n");
+        arena_free(&arena);
         return false;
     }
 
-    account->account_name = account_name;
+    bool result = false;
+    printf("Please write which account data you want to delete:\n");
 
-    account->password = malloc((MAX_EXPECTED_LINE_LENGTH + 1) * sizeof(char));
-    if (account->password == NULL) {
-        free(site_name);
-        free(account_name);
-        free(account);
-        fprintf(stderr, "malloc failed\n");
-        return false;
+    if (fgets(account->account_name, LONGEST_NAME + 1, stdin) == NULL) {
+        fprintf(stderr, "failed to read input\n");
+    } else {
+        printf("Please write to what site is this account:\n");
+
+        if (fgets(site_name, LONGEST_NAME + 1, stdin) == NULL) {
+            fprintf(stderr, "failed to read input\n");
+        } else {
+            result = save_or_delete_password(site_name, account);
+        }
     }
 
+    arena_free(&arena);
+    return result;
+}
+
+/**
+ * @note Asks for the password, site and account. The answers are stored in account and site_name.
+ *
+ * @return true if successful, false otherwise
+ */
+bool read_account(struct account_info *account, char *site_name)
+{
     printf("Write the password that you want to save:\n");
 
     if (fgets(account->password, MAX_EXPECTED_LINE_LENGTH + 1, stdin) == NULL) {
-        free(account->password);
-        free(site_name);
-        free(account_name);
-        free(account);
         fprintf(stderr, "failed to read input\n");
         return false;
     }
@@ -451,11 +514,6 @@ bool get_and_save_password(void)
     account->password_length = strlen(account->password);
 
     if (account->password_length == MAX_EXPECTED_LINE_LENGTH && account->password[MAX_EXPECTED_LINE_LENGTH - 1] != '\n') {
-        memset(account->password, 0, account->password_length);
-        free(account->password);
-        free(site_name);
-        free(account_name);
-        free(account);
         fprintf(stderr, "The password is too long.\n");
         return false;
     }
@@ -463,11 +521,6 @@ bool get_and_save_password(void)
     printf("Please write to what site is this password: (you can write what you want here, it's just for you so that you can retrieve this password later)\n");
 
     if (fgets(site_name, LONGEST_NAME + 1, stdin) == NULL) {
-        memset(account->password, 0, account->password_length);
-        free(account->password);
-        free(site_name);
-        free(account_name);
-        free(account);
         fprintf(stderr, "failed to read input\n");
         return false;
     }
@@ -475,195 +528,318 @@ bool get_and_save_password(void)
     printf("And please write to what account is this password:\n");
 
     if (fgets(account->account_name, LONGEST_NAME + 1, stdin) == NULL) {
-        memset(account->password, 0, account->password_length);
-        free(account->password);
-        free(site_name);
-        free(account_name);
-        free(account);
         fprintf(stderr, "failed to read input\n");
         return false;
     }
+    return true;
+}
 
-    if (! save_or_delete_password(site_name, account)) {
-        memset(account->password, 0, account->password_length);
-        free(account->password);
-        free(site_name);
-        free(account_name);
-        free(account);
+/**
+ * @note Asks for account info and calls save_or_delete_password. Everything that was typed in is kept
+ * in a locked arena and wiped at once at the end.
+ *
+ * @return true if successful, false otherwise
+ */
+bool get_and_save_password(void)
+{
+    struct arena arena;
+    arena_init(&arena);
+
+    char *site_name = NULL;
+    struct account_info *account = new_account(&arena, &site_name, true);
+
+    bool result = account != NULL && read_account(account, site_name) && save_or_delete_password(site_name, account);
+
+    arena_free(&arena);
+    return result;
+}
+
+/**
+ * @note Prints one record, the site name is printed only before the first account of each site.
+ * The password is printed after the account name, if the record has it.
+ *
+ * @param context Name of the previously printed site.
+ */
+bool print_record(const struct vault_record *record, void *context)
+{
+    char *previous_site = context;
+
+    //Strings of the record are not terminated, they may point right to the mapped vault
+    if (strlen(previous_site) != record->site_length || memcmp(previous_site, record->site, record->site_length) != 0) {
+        printf("%.*s\n", (int) record->site_length, record->site);
+        memcpy(previous_site, record->site, record->site_length);
+        previous_site[record->site_length] = '\0';
+    }
+
+    if (record->password == NULL) {
+        printf("    %.*s\n", (int) record->account_length, record->account);
+    } else {
+        printf("    %.*s: %.*s\n", (int) record->account_length, record->account, (int) record->password_length,
+               record->password);
+    }
+    return true;
+}
+
+/**
+ * @note Writes the cursor as text, the site and account in hex separated by ':', so any names fit
+ * to one command line argument.
+ *
+ * @param text Buffer for LIST_CURSOR_TEXT_SIZE characters.
+ */
+void cursor_to_text(const struct vault_cursor *cursor, char *text)
+{
+    for (uint32_t i = 0; i < cursor->site_length; i++) {
+        text += sprintf(text, "%02x", (unsigned char) cursor->site[i]);
+    }
+    *text++ = ':';
+    for (uint32_t i = 0; i < cursor->account_length; i++) {
+        text += sprintf(text, "%02x", (unsigned char) cursor->account[i]);
+    }
+    *text = '\0';
+}
+
+/**
+ * @return value of the hex digit, -1 if it is not one
+ */
+static int hex_value(char digit)
+{
+    if (digit >= '0' && digit <= '9') {
+        return digit - '0';
+    }
+    if (digit >= 'a' && digit <= 'f') {
+        return digit - 'a' + 10;
+    }
+    return -1;
+}
+
+/**
+ * @note Reads hex digits up to the end character.
+ *
+ * @return number of bytes read, -1 if the hex is not valid or too long
+ */
+static long parse_hex(const char *text, char end, char *bytes)
+{
+    long length = 0;
+    while (*text != end) {
+        int high = hex_value(text[0]);
+        int low = high < 0 ? -1 : hex_value(text[1]);
+        if (low < 0 || length == VAULT_MAX_NAME_LENGTH) {
+            return -1;
+        }
+        bytes[length++] = (char) (high * 16 + low);
+        text += 2;
+    }
+    return length;
+}
+
+/**
+ * @note Reads the cursor written by cursor_to_text.
+ *
+ * @return true if the text is a cursor, false otherwise
+ */
+bool cursor_from_text(const char *text, struct vault_cursor *cursor)
+{
+    const char *separator = strchr(text, ':');
+    if (separator == NULL) {
         return false;
     }
 
-    memset(account->password, 0, account->password_length);
-    free(account->password);
-    free(site_name);
-    free(account_name);
-    free(account);
+    long site_length = parse_hex(text, ':', cursor->site);
+    long account_length = parse_hex(separator + 1, '\0', cursor->account);
+    if (site_length < 0 || account_length < 0) {
+        return false;
+    }
+
+    cursor->site_length = (uint32_t) site_length;
+    cursor->account_length = (uint32_t) account_length;
+    cursor->started = true;
     return true;
 }
 
 /**
- * @note reads lines from <file> until all accounts from current site are read and writes them in formatted form to stdin.
+ * @note Prints one page of the saved accounts that match the query and, if more follow, the cursor of the next
+ * page to stderr. The vault is unlocked only if the query wants passwords.
  *
- * @param file file with data
- * @param buffer at least 1000 characters long
+ * @param after Cursor printed with the previous page, NULL for the first page.
  * @return true if no error occurs, false otherwise
  */
-bool print_site(char *buffer, FILE *file)
+bool list_accounts(const struct vault_list_query *query, const char *after)
 {
-    if (fgets(buffer, MAX_EXPECTED_LINE_LENGTH + 1, file) == NULL) {
-        fprintf(stderr, "failed to read a line - data file was probably altered\n");
+    struct vault_cursor cursor = { .started = false };
+    if (after != NULL && ! cursor_from_text(after, &cursor)) {
+        fprintf(stderr, "%s is not a cursor printed by --list.\n", after);
         return false;
     }
 
-    long count = strtol(buffer, NULL, 10);
-    if (0 >= count || errno == ERANGE) {
-        fprintf(stderr, "data file was probably altered\n");
+    struct vault *vault = query->passwords ? open_vault() : open_vault_names();
+    if (vault == NULL) {
         return false;
     }
 
-    count *= 2;
-
-    while (count > 0 && fgets(buffer, MAX_EXPECTED_LINE_LENGTH + 1, file) != NULL) {
-        if (count % 2 == 0) {
-            printf("    Account name: %s", buffer);
-        } else {
-            printf("    Password: %s\n", buffer);
-        }
-        count--;
+    char previous_site[VAULT_MAX_NAME_LENGTH + 1] = "";
+    bool more = false;
+    if (! vault_list(vault, query, &cursor, print_record, previous_site, &more)) {
+        return false;
     }
 
-    return count == 0;
+    if (more) {
+        char text[LIST_CURSOR_TEXT_SIZE];
+        cursor_to_text(&cursor, text);
+        fprintf(stderr, "More accounts follow, list them with --after %s\n", text);
+    }
+    return true;
 }
 
 /**
- * @note Prints all saved accounts with their passwords.
+ * @note Lists the names of all saved accounts, LIST_PAGE_SIZE at a time, and asks before every next page.
+ * Passwords are not printed, print_password shows them one at a time.
+ *
+ * @return true if no error occurs, false otherwise
  */
 bool print_all()
 {
-    char buffer[MAX_EXPECTED_LINE_LENGTH + 1];
-
-    FILE *file = fopen(data_file, "r");
-    if (file == NULL) {
-        fprintf(stderr, "failed to open data_file\n");
+    struct vault *vault = open_vault_names();
+    if (vault == NULL) {
         return false;
     }
 
-    while (fgets(buffer, MAX_EXPECTED_LINE_LENGTH + 1, file) != NULL) {
-        printf("\n%s", buffer);
+    struct vault_list_query query = { .site_pattern = NULL, .account_pattern = NULL, .limit = LIST_PAGE_SIZE,
+                                      .passwords = false };
+    struct vault_cursor cursor = { .started = false };
+    bool more = true;
+    char buffer[4];
 
-        if (! print_site(buffer, file)) {
-            fclose(file);
+    while (more) {
+        char previous_site[VAULT_MAX_NAME_LENGTH + 1] = "";
+        printf("\n");
+        if (! vault_list(vault, &query, &cursor, print_record, previous_site, &more)) {
             return false;
         }
+        if (more && ! yes_no_question("\nWould you like to see more accounts?", buffer, 4)) {
+            break;
+        }
     }
+    printf("\n");
+    return true;
+}
 
-    if (feof(file)) {
-        fclose(file);
-        return true;
-    }
+/**
+ * @note Prints the name of the site and the names of its accounts, indented below it.
+ */
+void print_site(const struct vault_directory *directory, size_t site, FILE *output)
+{
+    const struct vault_directory_site *entry = &directory->sites[site];
+    fprintf(output, "%.*s\n", (int) entry->length, entry->name);
 
-    fprintf(stderr, "failed to read a line\n");
-    fclose(file);
-    return false;
+    for (size_t i = entry->first_account; i < entry->first_account + entry->account_count; i++) {
+        fprintf(output, "    %.*s\n", (int) directory->accounts[i].length, directory->accounts[i].name);
+    }
 }
 
 /**
- * @note You must read site name and account_count alone and then this reads through accounts and prints the password if
- *  the account is there.
+ * @note Prints the saved sites whose names are within SUGGESTED_DISTANCE typos of site_name, with their accounts,
+ * so a misspelled site or account can be corrected.
  *
- * @param file File with data
- * @param account_count Number of accounts saved for this site
- * @param account_name What we are looking for
- * @param buffer at least 1000 characters long
  * @return true if no error occurs, false otherwise
  */
-bool find_and_print_password(FILE *file, long account_count, char *account_name, char *buffer)
+bool suggest_sites(struct vault *vault, const char *site_name)
 {
-    for (long i = 0; i < account_count; i++) {
-        if (fgets(buffer, MAX_EXPECTED_LINE_LENGTH + 1, file) == NULL) {
-            fprintf(stderr, "failed to read a line - data file was probably altered\n");
-            return false;
-        }
-
-        if (strcmp(buffer, account_name) == 0) {
-            if (fgets(buffer, MAX_EXPECTED_LINE_LENGTH + 1, file) == NULL) {
-                fprintf(stderr, "failed to read a line - data file was probably altered\n");
-                return false;
-            }
-            printf("is:\n%s", buffer);
-            return true;
-        }
-
-        if (fgets(buffer, MAX_EXPECTED_LINE_LENGTH + 1, file) == NULL) {
-            fprintf(stderr, "failed to read a line - data file was probably altered\n");
-            return false;
+    struct vault_directory directory;
+    struct vault_directory_match *matches = NULL;
+    size_t count = 0;
+
+    bool result = vault_directory_build(&directory, vault)
+                  && vault_directory_fuzzy(&directory, site_name, strlen(site_name), SUGGESTED_DISTANCE,
+                                           &matches, &count);
+
+    if (result && count > 0) {
+        fprintf(stderr, "\nSaved sites with a similar name and their accounts:\n");
+        for (size_t i = 0; i < count && i < SUGGESTED_SITES; i++) {
+            print_site(&directory, matches[i].site, stderr);
         }
     }
-    fprintf(stderr, "was not found. Double check if you wrote the site and account name correctly.\n");
-    return true;
+
+    free(matches);
+    vault_directory_free(&directory);
+    return result;
 }
 
 /**
- * @param site_name On what site is this account.
- * @param account_name Name of the account we want password of.
+ * @note Prints the saved sites that match the pattern with the names of their accounts, passwords are not printed
+ * and the vault does not have to be unlocked. A pattern ending with '*' finds the sites starting with the rest
+ * of it, in order; any other pattern finds the sites within max_distance typos of it, closest first.
+ *
  * @return true if no error occurs, false otherwise
  */
-bool print_password(char *site_name, char *account_name)
+bool search_sites(const char *pattern, uint32_t max_distance)
 {
-    FILE *file = fopen(data_file, "r");
-    if (file == NULL) {
-        fprintf(stderr, "Could not open the file with data.\n");
+    struct vault *vault = open_vault_names();
+    if (vault == NULL) {
         return false;
     }
 
-    char buffer[MAX_EXPECTED_LINE_LENGTH + 1];
+    struct vault_directory directory;
+    if (! vault_directory_build(&directory, vault)) {
+        vault_directory_free(&directory);
+        return false;
+    }
 
-    while (fgets(buffer, MAX_EXPECTED_LINE_LENGTH + 1, file) != NULL) {
-        if (strcmp(buffer, site_name) != 0) {
-            if (! skip_to_another_site(file, NULL, buffer)) {
-                fclose(file);
-                return false;
+    size_t length = strlen(pattern);
+    bool result = true;
+
+    if (length > 0 && pattern[length - 1] == '*') {
+        size_t first = 0;
+        size_t end = 0;
+        vault_directory_prefix(&directory, pattern, length - 1, &first, &end);
+        for (size_t i = first; i < end; i++) {
+            print_site(&directory, i, stdout);
+        }
+    } else {
+        struct vault_directory_match *matches = NULL;
+        size_t count = 0;
+        result = vault_directory_fuzzy(&directory, pattern, length, max_distance, &matches, &count);
+        for (size_t i = 0; i < count; i++) {
+            if (matches[i].distance > 0) {
+                printf("(%u typo%s) ", matches[i].distance, matches[i].distance == 1 ? "" : "s");
             }
-            continue;
+            print_site(&directory, matches[i].site, stdout);
         }
+        free(matches);
+    }
 
-        size_t length = strlen(buffer) + 1;
-        char *name = malloc(length * sizeof(char));
-        if (name == NULL) {
-            fclose(file);
-            fprintf(stderr,"malloc failed\n");
-            return false;
-        }
+    vault_directory_free(&directory);
+    return result;
+}
 
-        memcpy(name, buffer, length);
+/**
+ * @param site_name On what site is this account.
+ * @param account_name Name of the account we want password of.
+ * @return true if no error occurs, false otherwise
+ */
+bool print_password(char *site_name, char *account_name)
+{
+    struct vault *vault = open_vault();
+    if (vault == NULL) {
+        return false;
+    }
 
-        if (fgets(buffer, MAX_EXPECTED_LINE_LENGTH + 1, file) == NULL) {
-            free(name);
-            fclose(file);
-            fprintf(stderr, "failed to read a line - data file was probably altered\n");
-            return false;
-        }
+    strip_newline(site_name);
+    strip_newline(account_name);
 
-        long count = strtol(buffer, NULL, 10);
-        if (0 >= count || errno == ERANGE) {
-            fprintf(stderr, "data file was probably altered\n");
-            free(name);
-            fclose(file);
-            return false;
-        }
+    struct vault_record record;
+    bool found = false;
 
-        printf("The password for this account ");
-        if (! find_and_print_password(file, count, account_name, buffer)) {
-            free(name);
-            fclose(file);
-            return false;
-        }
+    if (! vault_get(vault, site_name, account_name, &record, &found)) {
+        return false;
+    }
 
-        free(name);
-        fclose(file);
-        return true;
+    if (! found) {
+        fprintf(stderr, "The password was not found. Double check if you wrote the site and account name correctly.\n");
+        return suggest_sites(vault, site_name);
     }
-    fprintf(stderr, "The password was not found. Double check if you wrote the site and account name correctly.\n");
+
+    printf("The password for this account is:\n%s\n", record.password);
+    vault_record_free(&record);
     return true;
 }
 
@@ -673,8 +849,8 @@ bool print_password(char *site_name, char *account_name)
 bool print_account_info()
 {
     char buffer[4];
-    if (yes_no_question("Would you like to print passwords for all saved accounts?\n", buffer, 4)) {
-        return print_all();
+    if (yes_no_question("Would you like to see the names of all saved accounts first?\n", buffer, 4) && ! print_all()) {
+        return false;
     }
 
     char *site_name = malloc((LONGEST_NAME + 1) * sizeof(char));
@@ -2,8 +2,13 @@
 #define PASSWORD_GENERATOR_DATA_SAVING_H
 
 #include <stdbool.h>
+#include <stdint.h>
+
+#include "vault.h"
 
 #define LONGEST_NAME 128
+//Site and account of a cursor in hex, ':' and '\0'
+#define LIST_CURSOR_TEXT_SIZE (4 * VAULT_MAX_NAME_LENGTH + 2)
 
 struct account_info {
     char *password;
@@ -13,9 +18,14 @@ struct account_info {
     int account_name_length;
 };
 
+struct vault *open_vault_names(void);
+struct vault *open_vault(void);
+void close_vault(void);
 bool save_or_delete_password(char *site_name, struct account_info *account);
 bool get_and_save_password(void);
 bool get_and_remove_password(void);
 bool print_account_info();
+bool search_sites(const char *pattern, uint32_t max_distance);
+bool list_accounts(const struct vault_list_query *query, const char *after);
 
 #endif //PASSWORD_GENERATOR_DATA_SAVING_H
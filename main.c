@@ -2,15 +2,528 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "password_tools.h"
 #include "data_saving.h"
+#include "batch_generation.h"
+#include "benchmark.h"
+#include "parallel_generation.h"
+#include "vault_transfer.h"
+#include "strength.h"
+#include "breach_filter.h"
+#include "passphrase.h"
+#include "profiles.h"
+#include "daemon.h"
+#include "vault_directory.h"
+
+//Typos allowed by --search if --distance is not given
+#define SEARCH_DEFAULT_DISTANCE 2
+//Accounts listed by --list if --page-size is not given
+#define LIST_DEFAULT_PAGE_SIZE 50
+
+void print_usage(const char *program)
+{
+    fprintf(stderr, "Usage: %s                                          (interactive mode)\n"
+                    "       %s --count N --length L [--exclude CHARS] [--threads T]\n"
+                    "                                  (prints N passwords, one per line, generated by T threads)\n"
+                    "           [--require lower,upper,digit,special|all] [--no-repeats] [--no-sequences]\n"
+                    "                                  (every password has the classes, no aa, no ab or 21,\n"
+                    "                                   rules can be used only with L of at most 64)\n"
+                    "       %s --count N --words W [--separator S] [--threads T]\n"
+                    "                                  (prints N passphrases of W random words separated by S)\n"
+                    "       %s --profile NAME [--count N] [--threads T] [--profiles FILE]\n"
+                    "                                  (prints N passwords of a saved profile, 1 by default)\n"
+                    "       %s --list-profiles [--profiles FILE]   (lists saved profiles)\n"
+                    "       %s --daemon SOCKET [--filter FILTER] [--profiles FILE]\n"
+                    "                                  (serves generation and the vault on a Unix socket)\n"
+                    "       %s --benchmark [--count N] [--length L]     (measures generation speed)\n"
+                    "       %s --search PATTERN [--distance D]\n"
+                    "                                  (lists sites starting with PATTERN if it ends with *,\n"
+                    "                                   otherwise sites within D typos of it, 2 by default)\n"
+                    "       %s --list [--site PATTERN] [--account PATTERN] [--page-size N] [--after CURSOR]\n"
+                    "           [--passwords]         (lists a page of N saved accounts matching the shell-like\n"
+                    "                                   patterns, 50 by default, names only unless --passwords)\n"
+                    "       %s --import FILE [--format csv|jsonl] [--threads T]\n"
+                    "                                  (adds all records of FILE to the vault)\n"
+                    "       %s --export FILE [--format csv|jsonl]   (writes all records to FILE, - for stdout)\n"
+                    "       %s --audit FILE [--summary] [--filter FILTER]\n"
+                    "                                  (rates every password of FILE, one per line, - for stdin)\n"
+                    "       %s --build-filter LIST [--filter FILTER] [--threads T]\n"
+                    "                                  (builds the breach filter from LIST, passwords or SHA-1 in hex)\n",
+            program, program, program, program, program, program, program, program, program, program, program,
+            program, program);
+}
+
+/**
+ * @param text Text with the number.
+ * @param min Smallest allowed value.
+ * @param max Largest allowed value.
+ * @param number Where the parsed number is stored.
+ * @return true if text is a whole number between min and max (included), false otherwise
+ */
+bool parse_number(const char *text, long min, long max, long *number)
+{
+    char *end = NULL;
+    errno = 0;
+    *number = strtol(text, &end, 10);
+    return end != text && *end == '\0' && errno != ERANGE && min <= *number && *number <= max;
+}
+
+/**
+ * @note Imports records from import_path or exports them to export_path (one of them is NULL).
+ *
+ * @param format_name Value of --format, NULL if the format is known from the file extension.
+ * @return true on success, false on failure
+ */
+bool run_transfer(const char *import_path, const char *export_path, const char *format_name, int threads)
+{
+    const char *path = import_path != NULL ? import_path : export_path;
+    enum transfer_format format = TRANSFER_CSV;
+
+    if (format_name != NULL ? ! transfer_format_parse(format_name, &format) : ! transfer_format_from_path(path, &format)) {
+        fprintf(stderr, "Unknown format, use --format csv or --format jsonl.\n");
+        return false;
+    }
+
+    struct vault *vault = open_vault();
+    if (vault == NULL) {
+        return false;
+    }
+
+    size_t count = 0;
+    if (import_path != NULL) {
+        bool result = vault_import(vault, import_path, format, threads, &count);
+        close_vault();
+        if (result) {
+            fprintf(stderr, "Imported %zu records.\n", count);
+        }
+        return result;
+    }
+
+    FILE *output = stdout;
+    if (strcmp(export_path, "-") != 0) {
+        //The exported passwords are not encrypted, so only you can read the file, even if it was there before
+        int fd = open(export_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        output = fd < 0 || fchmod(fd, 0600) != 0 ? NULL : fdopen(fd, "w");
+        if (output == NULL) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            fprintf(stderr, "failed to create %s\n", export_path);
+            close_vault();
+            return false;
+        }
+    }
+
+    bool result = vault_export(vault, output, format, &count);
+    if (output != stdout && fclose(output) != 0) {
+        fprintf(stderr, "failed to write %s\n", export_path);
+        result = false;
+    }
+    close_vault();
+
+    if (result) {
+        fprintf(stderr, "Exported %zu records.\n", count);
+    }
+    return result;
+}
+
+/**
+ * @note Builds the breach filter from the list and tells how many passwords it has.
+ *
+ * @return true on success, false on failure
+ */
+bool run_build_filter(const char *list_path, const char *filter_path, int threads)
+{
+    struct timespec start;
+    struct timespec end;
+    uint64_t entries = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (! breach_filter_build(list_path, filter_path, threads, &entries)) {
+        return false;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    fprintf(stderr, "Added %llu passwords to %s in %.3f s.\n", (unsigned long long) entries, filter_path,
+            (double) (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+    return true;
+}
+
+/**
+ * @note Rates the strength of every password in the file, prints the verdicts in order to stdout (unless
+ * summary_only is true) and the histogram of verdicts to stderr.
+ *
+ * @param filter_path Breach filter to look the passwords up in, NULL to use BREACH_FILTER_FILE if there is one.
+ * @return true on success, false on failure
+ */
+bool run_audit(const char *path, bool summary_only, const char *filter_path)
+{
+    struct breach_filter filter;
+    bool use_filter = filter_path != NULL || access(BREACH_FILTER_FILE, F_OK) == 0;
+    if (use_filter && ! breach_filter_open(&filter, filter_path != NULL ? filter_path : BREACH_FILTER_FILE)) {
+        return false;
+    }
+
+    int input = STDIN_FILENO;
+    if (strcmp(path, "-") != 0) {
+        input = open(path, O_RDONLY | O_CLOEXEC);
+        if (input < 0) {
+            fprintf(stderr, "failed to open %s\n", path);
+            if (use_filter) {
+                breach_filter_close(&filter);
+            }
+            return false;
+        }
+    }
+
+    struct timespec start;
+    struct timespec end;
+    struct audit_result result;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    bool success = audit_passwords(input, use_filter ? &filter : NULL, stdout, ! summary_only, &result);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    if (input != STDIN_FILENO) {
+        close(input);
+    }
+    if (use_filter) {
+        breach_filter_close(&filter);
+    }
+
+    if (success) {
+        print_audit_summary(&result, (double) (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9, stderr);
+    }
+    return success;
+}
+
+/**
+ * @note Generates count passwords of the profile with the name, or lists all profiles if name is NULL.
+ *
+ * @return true on success, false on failure
+ */
+bool run_profile(const char *profiles_path, const char *name, long count, int threads)
+{
+    struct profile_set profiles;
+    if (! profiles_load(&profiles, profiles_path)) {
+        return false;
+    }
+
+    bool result = true;
+    if (name == NULL) {
+        for (size_t i = 0; i < profiles.count; i++) {
+            const struct profile *profile = &profiles.profiles[i];
+            printf("%-*s %5.1f bits  ", PROFILE_MAX_NAME, profile->name, profile_entropy(profile));
+            if (profile->kind == PROFILE_PASSPHRASE) {
+                printf("%zu words separated by %s\n", profile->format.words, profile->format.separator);
+            } else {
+                printf("%zu characters%s\n", profile->kind == PROFILE_POLICY ? profile->policy.length
+                                                                             : profile->lines.length,
+                       profile->kind == PROFILE_POLICY ? " with rules" : "");
+            }
+        }
+    } else {
+        const struct profile *profile = profiles_find(&profiles, name);
+        if (profile == NULL) {
+            fprintf(stderr, "There is no profile %s in %s, see --list-profiles.\n", name, profiles_path);
+            result = false;
+        } else {
+            result = generate_batch_lines(&profile->generator, count, threads, stdout);
+        }
+    }
+
+    profiles_free(&profiles);
+    return result;
+}
+
+static struct daemon_server *running_daemon = NULL;
+
+static void stop_daemon(int signal_number)
+{
+    (void) signal_number;
+    daemon_stop(running_daemon);
+}
+
+/**
+ * @note Unlocks the vault (the master password is read from the standard input) and serves the clients
+ * on the socket until SIGINT or SIGTERM.
+ *
+ * @param filter_path Breach filter for the scored passwords, NULL to use BREACH_FILTER_FILE if there is one.
+ * @param profiles_path Profiles that can be generated, NULL to use PROFILES_FILE if there is one.
+ * @return true on success, false on failure
+ */
+bool run_daemon(const char *socket_path, const char *filter_path, const char *profiles_path)
+{
+    struct vault *vault = open_vault();
+    if (vault == NULL) {
+        return false;
+    }
+
+    if (filter_path == NULL && access(BREACH_FILTER_FILE, F_OK) == 0) {
+        filter_path = BREACH_FILTER_FILE;
+    }
+    if (profiles_path == NULL && access(PROFILES_FILE, F_OK) == 0) {
+        profiles_path = PROFILES_FILE;
+    }
+
+    static struct daemon_server server;
+    if (! daemon_init(&server, socket_path, vault, filter_path, profiles_path)) {
+        daemon_free(&server);
+        return false;
+    }
+
+    running_daemon = &server;
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_daemon;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    fprintf(stderr, "Serving on %s, stop by Ctrl+C.\n", socket_path);
+    bool result = daemon_run(&server);
+
+    daemon_free(&server);
+    running_daemon = NULL;
+    return result;
+}
+
+/**
+ * @note Parses command line options for the non-interactive batch mode and generates the passwords.
+ *
+ * @return true on success, false on failure
+ */
+bool run_batch(int argc, char *argv[])
+{
+    struct batch_options options = { .count = 0, .length = 0, .excluded = "", .threads = 1, .words = 0,
+                                     .separator = PASSPHRASE_DEFAULT_SEPARATOR,
+                                     .policy = { .required = 0, .no_repeats = false, .no_sequences = false } };
+    bool benchmark = false;
+    const char *import_path = NULL;
+    const char *export_path = NULL;
+    const char *format = NULL;
+    const char *audit_path = NULL;
+    bool summary_only = false;
+    const char *list_path = NULL;
+    const char *filter_path = NULL;
+    const char *profile_name = NULL;
+    const char *profiles_path = NULL;
+    bool list_profiles = false;
+    const char *socket_path = NULL;
+    const char *search_pattern = NULL;
+    long search_distance = SEARCH_DEFAULT_DISTANCE;
+    bool list = false;
+    struct vault_list_query list_query = { .site_pattern = NULL, .account_pattern = NULL,
+                                           .limit = LIST_DEFAULT_PAGE_SIZE, .passwords = false };
+    const char *list_after = NULL;
+    bool separator_given = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--benchmark") == 0) {
+            benchmark = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--summary") == 0) {
+            summary_only = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--list-profiles") == 0) {
+            list_profiles = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--list") == 0) {
+            list = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--passwords") == 0) {
+            list_query.passwords = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--no-repeats") == 0) {
+            options.policy.no_repeats = true;
+            continue;
+        }
+        if (strcmp(argv[i], "--no-sequences") == 0) {
+            options.policy.no_sequences = true;
+            continue;
+        }
+
+        if (i + 1 == argc) {
+            fprintf(stderr, "Option %s needs a value.\n", argv[i]);
+            print_usage(argv[0]);
+            return false;
+        }
+
+        if (strcmp(argv[i], "--count") == 0) {
+            if (! parse_number(argv[++i], 1, LONG_MAX, &options.count)) {
+                fprintf(stderr, "--count must be a positive number.\n");
+                return false;
+            }
+        } else if (strcmp(argv[i], "--length") == 0) {
+            if (! parse_number(argv[++i], MIN_GENERATED_LENGTH, MAX_GENERATED_LENGTH, &options.length)) {
+                fprintf(stderr, "--length must be a number between %d and %d, included.\n",
+                        MIN_GENERATED_LENGTH, MAX_GENERATED_LENGTH);
+                return false;
+            }
+        } else if (strcmp(argv[i], "--words") == 0) {
+            if (! parse_number(argv[++i], PASSPHRASE_MIN_WORDS, PASSPHRASE_MAX_WORDS, &options.words)) {
+                fprintf(stderr, "--words must be a number between %d and %d, included.\n",
+                        PASSPHRASE_MIN_WORDS, PASSPHRASE_MAX_WORDS);
+                return false;
+            }
+        } else if (strcmp(argv[i], "--require") == 0) {
+            if (! password_policy_parse_classes(argv[++i], &options.policy.required)) {
+                fprintf(stderr, "--require must be a comma separated list of lower, upper, digit and special, or all.\n");
+                return false;
+            }
+        } else if (strcmp(argv[i], "--separator") == 0) {
+            options.separator = argv[++i];
+            separator_given = true;
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            long threads = 0;
+            if (! parse_number(argv[++i], 1, MAX_GENERATION_THREADS, &threads)) {
+                fprintf(stderr, "--threads must be a number between 1 and %d, included.\n", MAX_GENERATION_THREADS);
+                return false;
+            }
+            options.threads = (int) threads;
+        } else if (strcmp(argv[i], "--exclude") == 0) {
+            options.excluded = argv[++i];
+        } else if (strcmp(argv[i], "--import") == 0) {
+            import_path = argv[++i];
+        } else if (strcmp(argv[i], "--export") == 0) {
+            export_path = argv[++i];
+        } else if (strcmp(argv[i], "--format") == 0) {
+            format = argv[++i];
+        } else if (strcmp(argv[i], "--audit") == 0) {
+            audit_path = argv[++i];
+        } else if (strcmp(argv[i], "--build-filter") == 0) {
+            list_path = argv[++i];
+        } else if (strcmp(argv[i], "--filter") == 0) {
+            filter_path = argv[++i];
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            profile_name = argv[++i];
+        } else if (strcmp(argv[i], "--profiles") == 0) {
+            profiles_path = argv[++i];
+        } else if (strcmp(argv[i], "--daemon") == 0) {
+            socket_path = argv[++i];
+        } else if (strcmp(argv[i], "--site") == 0) {
+            list_query.site_pattern = argv[++i];
+        } else if (strcmp(argv[i], "--account") == 0) {
+            list_query.account_pattern = argv[++i];
+        } else if (strcmp(argv[i], "--after") == 0) {
+            list_after = argv[++i];
+        } else if (strcmp(argv[i], "--page-size") == 0) {
+            long page_size = 0;
+            if (! parse_number(argv[++i], 1, LONG_MAX, &page_size)) {
+                fprintf(stderr, "--page-size must be a positive number.\n");
+                return false;
+            }
+            list_query.limit = (size_t) page_size;
+        } else if (strcmp(argv[i], "--search") == 0) {
+            search_pattern = argv[++i];
+        } else if (strcmp(argv[i], "--distance") == 0) {
+            if (! parse_number(argv[++i], 0, VAULT_DIRECTORY_MAX_DISTANCE, &search_distance)) {
+                fprintf(stderr, "--distance must be a number between 0 and %d, included.\n",
+                        VAULT_DIRECTORY_MAX_DISTANCE);
+                return false;
+            }
+        } else {
+            fprintf(stderr, "Unknown option %s.\n", argv[i]);
+            print_usage(argv[0]);
+            return false;
+        }
+    }
+
+    //Every mode runs alone, options of another mode would be silently ignored otherwise
+    int modes = (socket_path != NULL) + list + (search_pattern != NULL) + (list_path != NULL) + (audit_path != NULL)
+                + (import_path != NULL) + (export_path != NULL) + list_profiles + (profile_name != NULL) + benchmark;
+    if (import_path != NULL && export_path != NULL) {
+        fprintf(stderr, "Use either --import or --export, not both.\n");
+        return false;
+    }
+    if (modes > 1) {
+        fprintf(stderr, "Use only one of --daemon, --list, --search, --build-filter, --audit, --import, --export, "
+                        "--list-profiles, --profile and --benchmark.\n");
+        return false;
+    }
+
+    bool profile = list_profiles || profile_name != NULL;
+    if (modes == 1 && ((options.count != 0 && ! benchmark && profile_name == NULL)
+                       || (options.length != 0 && ! benchmark && ! profile)
+                       || (! profile && (options.words != 0 || separator_given || options.excluded[0] != '\0'
+                                         || password_policy_active(&options.policy))))) {
+        fprintf(stderr, "Options of the generated passwords can't be used with this mode.\n");
+        return false;
+    }
+
+    if (socket_path != NULL) {
+        return run_daemon(socket_path, filter_path, profiles_path);
+    }
+
+    if (list) {
+        return list_accounts(&list_query, list_after);
+    }
+
+    if (search_pattern != NULL) {
+        return search_sites(search_pattern, (uint32_t) search_distance);
+    }
+
+    if (list_path != NULL) {
+        return run_build_filter(list_path, filter_path != NULL ? filter_path : BREACH_FILTER_FILE, options.threads);
+    }
+
+    if (audit_path != NULL) {
+        return run_audit(audit_path, summary_only, filter_path);
+    }
+
+    if (import_path != NULL || export_path != NULL) {
+        return run_transfer(import_path, export_path, format, options.threads);
+    }
+
+    if (profile) {
+        if (options.length != 0 || options.words != 0 || separator_given || options.excluded[0] != '\0'
+            || password_policy_active(&options.policy)) {
+            fprintf(stderr, "Settings of a profile are in the profiles file, they can't be given with --profile.\n");
+            return false;
+        }
+        return run_profile(profiles_path == NULL ? PROFILES_FILE : profiles_path, list_profiles ? NULL : profile_name, options.count == 0 ? 1 : options.count,
+                           options.threads);
+    }
+
+    if (benchmark) {
+        return run_benchmarks(options.count == 0 ? BENCHMARK_DEFAULT_COUNT : options.count,
+                              options.length == 0 ? BENCHMARK_DEFAULT_LENGTH : options.length);
+    }
+
+    if (options.length != 0 && options.words != 0) {
+        fprintf(stderr, "Use either --length or --words, not both.\n");
+        return false;
+    }
+
+    if (options.words != 0 && password_policy_active(&options.policy)) {
+        fprintf(stderr, "--require, --no-repeats and --no-sequences can't be used with --words.\n");
+        return false;
+    }
+
+    if (options.count == 0 || (options.length == 0 && options.words == 0)) {
+        fprintf(stderr, "Both --count and --length (or --words) have to be given.\n");
+        print_usage(argv[0]);
+        return false;
+    }
+
+    return generate_batch(&options, stdout);
+}
 
 int main(int argc, char *argv[])
 {
     if (argc != 1) {
-        fprintf(stderr, "Too many arguments.\n");
-        return EXIT_FAILURE;
+        return run_batch(argc, argv) ? EXIT_SUCCESS : EXIT_FAILURE;
     }
 
     int response_capacity = 8;
@@ -21,10 +534,8 @@ int main(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
-    bool rand_initialized = false;
-
     printf("This is a password generator, that can also estimate strength of your passwords or\n"
-           "store your passwords in NOT ENCRYPTED FORM, which I don't recommend. (this feature was implemented just for fun)\n");
+           "store your passwords in a vault encrypted with your master password.\n");
 
     while (true) {
         printf("\nWhat do you want to do: (write the number)\n"
@@ -52,7 +563,7 @@ int main(int argc, char *argv[])
 
         switch (response[0]) {
             case '1':
-                if (! generate_passwords(&rand_initialized)) {
+                if (! generate_passwords()) {
                     free(response);
                     return EXIT_FAILURE;
                 }
@@ -63,12 +574,13 @@ int main(int argc, char *argv[])
                     return EXIT_FAILURE;
                 }
                 printf("\nBut if this test says your password is strong it still might be weak.\n"
-                       "For example if your password consists of some regular word, even with some\n"
-                       "commonly used substitutions and few numbers after it, it still can be weak.\n"
-                       "Example of password that is hard to find by randomly selecting passwords, but\n"
-                       "is easy to find if attacker tries a different technique is P@ssw0rd123!\n"
+                       "The test finds common words (also with substitutions, like P@ssw0rd123!),\n"
+                       "names, keyboard walks, repeats, sequences and dates, but it knows only the most\n"
+                       "common words and nothing about you. A password made of your personal information\n"
+                       "can be easy to find even if it looks strong here.\n"
                        "If you have a similar password I suggest looking at some help on making more\n"
-                       "secure passwords.\n"
+                       "secure passwords. Passwords from lists of breached passwords are found by the\n"
+                       "breach filter, if you build one with --build-filter.\n"
                        "\n");
                 break;
             case '3':
@@ -107,6 +619,8 @@ int main(int argc, char *argv[])
                        "- don't choose dictionary words that typically go together\n"
                        "(e.g. 32 Seagulls deliver bologna sandwiches to Paris\n"
                        " or   32-Seagullsdeliver bologna5andwiches2Paris!)\n"
+                       "The generator (option 1) can pick random words for such a passphrase, six of them are as strong\n"
+                       "as a random password of 10 characters.\n"
                        "\n"
                        "Or you can incorporate shortcuts or acronyms.\n"
                        "- Use phrases that mean something to you and shorten them by using shortcuts\n"
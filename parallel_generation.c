@@ -0,0 +1,216 @@
+#include "parallel_generation.h"
+#include "batch_generation.h"
+#include "random_pool.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/crypto.h>
+
+/**
+ * The output is split into slices of whole lines, each fitting one BATCH_OUTPUT_BUFFER_SIZE buffer.
+ * Slice i is generated by worker i % thread_count into slot i % (2 * thread_count), so every worker
+ * owns two slots and can fill one of them while the main thread writes the other. The main thread
+ * writes the slices strictly in order.
+ */
+struct slot {
+    char *buffer;
+    size_t used;
+    bool full;
+};
+
+struct parallel_job {
+    const struct line_generator *generator;
+    size_t count;
+    size_t lines_per_slice;
+    size_t slice_count;
+    int thread_count;
+
+    struct slot *slots;
+    int slot_count;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    bool failed;
+};
+
+struct worker {
+    struct parallel_job *job;
+    int number;
+    pthread_t thread;
+};
+
+static void fail_job(struct parallel_job *job)
+{
+    pthread_mutex_lock(&job->lock);
+    job->failed = true;
+    pthread_cond_broadcast(&job->changed);
+    pthread_mutex_unlock(&job->lock);
+}
+
+static void *run_worker(void *argument)
+{
+    struct worker *worker = argument;
+    struct parallel_job *job = worker->job;
+
+    struct random_pool pool;
+    if (! random_pool_init_drbg(&pool)) {
+        fail_job(job);
+        return NULL;
+    }
+
+    for (size_t slice = worker->number; slice < job->slice_count; slice += job->thread_count) {
+        struct slot *slot = &job->slots[slice % job->slot_count];
+
+        pthread_mutex_lock(&job->lock);
+        while (slot->full && ! job->failed) {
+            pthread_cond_wait(&job->changed, &job->lock);
+        }
+        bool failed = job->failed;
+        pthread_mutex_unlock(&job->lock);
+
+        if (failed) {
+            break;
+        }
+
+        size_t first_line = slice * job->lines_per_slice;
+        size_t lines = job->count - first_line < job->lines_per_slice ? job->count - first_line : job->lines_per_slice;
+
+        size_t used = 0;
+        if (! job->generator->generate_lines(job->generator->source, &pool, slot->buffer, lines, &used)) {
+            fail_job(job);
+            break;
+        }
+
+        pthread_mutex_lock(&job->lock);
+        slot->used = used;
+        slot->full = true;
+        pthread_cond_broadcast(&job->changed);
+        pthread_mutex_unlock(&job->lock);
+    }
+
+    random_pool_free(&pool);
+    return NULL;
+}
+
+/**
+ * @note Waits for the slices in order and writes them to output.
+ *
+ * @return true if all slices were written, false otherwise
+ */
+static bool write_slices(struct parallel_job *job, FILE *output)
+{
+    for (size_t slice = 0; slice < job->slice_count; slice++) {
+        struct slot *slot = &job->slots[slice % job->slot_count];
+
+        pthread_mutex_lock(&job->lock);
+        while (! slot->full && ! job->failed) {
+            pthread_cond_wait(&job->changed, &job->lock);
+        }
+        bool failed = job->failed;
+        pthread_mutex_unlock(&job->lock);
+
+        if (failed) {
+            return false;
+        }
+
+        bool written = fwrite(slot->buffer, sizeof(char), slot->used, output) == slot->used;
+        OPENSSL_cleanse(slot->buffer, slot->used);
+
+        if (! written) {
+            fprintf(stderr, "failed to write passwords\n");
+            fail_job(job);
+            return false;
+        }
+
+        pthread_mutex_lock(&job->lock);
+        slot->full = false;
+        pthread_cond_broadcast(&job->changed);
+        pthread_mutex_unlock(&job->lock);
+    }
+    return true;
+}
+
+static void free_slots(struct slot *slots, int slot_count)
+{
+    for (int i = 0; i < slot_count; i++) {
+        if (slots[i].buffer != NULL) {
+            OPENSSL_cleanse(slots[i].buffer, BATCH_OUTPUT_BUFFER_SIZE);
+        }
+        free(slots[i].buffer);
+    }
+    free(slots);
+}
+
+/**
+ * @note Generates count passwords by thread_count worker threads, each with its own DRBG,
+ * and writes them to output in order, one password per line.
+ *
+ * @param generator Generator of the lines, shared by all workers.
+ * @param count Number of passwords.
+ * @param thread_count Number of worker threads, between 1 and MAX_GENERATION_THREADS.
+ * @param output Opened stream where the passwords are written.
+ * @return true on success, false on failure
+ */
+bool generate_parallel(const struct line_generator *generator, long count, int thread_count, FILE *output)
+{
+    struct parallel_job job = {
+        .generator = generator,
+        .count = count,
+        .lines_per_slice = BATCH_OUTPUT_BUFFER_SIZE / generator->longest_line,
+        .thread_count = thread_count,
+        .slot_count = 2 * thread_count,
+        .failed = false
+    };
+    job.slice_count = (job.count + job.lines_per_slice - 1) / job.lines_per_slice;
+
+    job.slots = calloc(job.slot_count, sizeof(*job.slots));
+    if (job.slots == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        return false;
+    }
+
+    for (int i = 0; i < job.slot_count; i++) {
+        job.slots[i].buffer = malloc(BATCH_OUTPUT_BUFFER_SIZE * sizeof(char));
+        if (job.slots[i].buffer == NULL) {
+            free_slots(job.slots, job.slot_count);
+            fprintf(stderr, "malloc failed\n");
+            return false;
+        }
+    }
+
+    struct worker *workers = malloc(thread_count * sizeof(*workers));
+    if (workers == NULL) {
+        free_slots(job.slots, job.slot_count);
+        fprintf(stderr, "malloc failed\n");
+        return false;
+    }
+
+    pthread_mutex_init(&job.lock, NULL);
+    pthread_cond_init(&job.changed, NULL);
+
+    int started = 0;
+    for (; started < thread_count; started++) {
+        workers[started].job = &job;
+        workers[started].number = started;
+        if (pthread_create(&workers[started].thread, NULL, run_worker, &workers[started]) != 0) {
+            fprintf(stderr, "failed to start a thread\n");
+            fail_job(&job);
+            break;
+        }
+    }
+
+    bool result = started == thread_count && write_slices(&job, output);
+
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    pthread_cond_destroy(&job.changed);
+    pthread_mutex_destroy(&job.lock);
+    free(workers);
+    free_slots(job.slots, job.slot_count);
+
+    return result && fflush(output) == 0;
+}
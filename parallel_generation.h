@@ -0,0 +1,13 @@
+#ifndef PASSWORD_GENERATOR_PARALLEL_GENERATION_H
+#define PASSWORD_GENERATOR_PARALLEL_GENERATION_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "batch_generation.h"
+
+#define MAX_GENERATION_THREADS 256
+
+bool generate_parallel(const struct line_generator *generator, long count, int thread_count, FILE *output);
+
+#endif //PASSWORD_GENERATOR_PARALLEL_GENERATION_H
@@ -0,0 +1,146 @@
+#include "passphrase.h"
+#include "passphrase_words.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <openssl/crypto.h>
+
+/**
+ * @param words Number of words, between PASSPHRASE_MIN_WORDS and PASSPHRASE_MAX_WORDS.
+ * @param separator Printable characters except letters put between the words, at least one and at most
+ * PASSPHRASE_MAX_SEPARATOR.
+ * @return true if the format is valid, false otherwise (the reason is printed)
+ */
+bool passphrase_format_init(struct passphrase_format *format, long words, const char *separator)
+{
+    if (words < PASSPHRASE_MIN_WORDS || words > PASSPHRASE_MAX_WORDS) {
+        fprintf(stderr, "A passphrase must have between %d and %d words, included.\n", PASSPHRASE_MIN_WORDS,
+                PASSPHRASE_MAX_WORDS);
+        return false;
+    }
+
+    size_t length = strlen(separator);
+    if (length == 0 || length > PASSPHRASE_MAX_SEPARATOR) {
+        fprintf(stderr, "The separator must have between 1 and %d characters, included.\n", PASSPHRASE_MAX_SEPARATOR);
+        return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+        if (separator[i] < ' ' || separator[i] > '~') {
+            fprintf(stderr, "The separator can have only printable ASCII characters.\n");
+            return false;
+        }
+        //With letters, other words could make the same passphrase and the entropy would be smaller
+        if ((separator[i] >= 'a' && separator[i] <= 'z') || (separator[i] >= 'A' && separator[i] <= 'Z')) {
+            fprintf(stderr, "The separator cannot have letters.\n");
+            return false;
+        }
+    }
+
+    format->words = (size_t) words;
+    memcpy(format->separator, separator, length + 1);
+    format->separator_length = length;
+    format->limit = 65536 - 65536 % passphrase_word_count;
+    return true;
+}
+
+/**
+ * @return entropy of the passphrases in bits
+ */
+double passphrase_entropy(const struct passphrase_format *format)
+{
+    return (double) format->words * log2(passphrase_word_count);
+}
+
+/**
+ * @return length of the longest passphrase of the format
+ */
+size_t passphrase_longest(const struct passphrase_format *format)
+{
+    return format->words * passphrase_longest_word + (format->words - 1) * format->separator_length;
+}
+
+/**
+ * @note Picks words of one passphrase. Every word takes two random bytes as a 16 bit number, numbers from
+ * format->limit up are rejected and the rest is taken modulo the word count, so every word is picked
+ * by exactly limit / passphrase_word_count numbers.
+ *
+ * @return true on success, false on failure
+ */
+static bool pick_words(const struct passphrase_format *format, struct random_pool *pool, uint16_t *picked)
+{
+    size_t done = 0;
+    while (done < format->words) {
+        size_t available = 0;
+        const unsigned char *bytes = random_pool_next(pool, &available);
+        if (bytes == NULL) {
+            return false;
+        }
+
+        size_t used = 0;
+        for (; done < format->words && used + 2 <= available; used += 2) {
+            uint32_t number = bytes[used] | (uint32_t) bytes[used + 1] << 8;
+            picked[done] = (uint16_t) (number % passphrase_word_count);
+            done += number < format->limit;
+        }
+        //A single byte at the end of the pool is thrown away
+        random_pool_consume(pool, used + 2 > available ? available : used);
+    }
+    return true;
+}
+
+/**
+ * @note Writes one passphrase to output, without a newline or terminating zero.
+ *
+ * @param output Capacity of at least passphrase_longest(format) characters.
+ * @return length of the passphrase, 0 on failure
+ */
+size_t passphrase_generate(const struct passphrase_format *format, struct random_pool *pool, char *output)
+{
+    uint16_t picked[PASSPHRASE_MAX_WORDS];
+    if (! pick_words(format, pool, picked)) {
+        OPENSSL_cleanse(picked, sizeof(picked));
+        return 0;
+    }
+
+    size_t length = 0;
+    for (size_t i = 0; i < format->words; i++) {
+        if (i > 0) {
+            memcpy(output + length, format->separator, format->separator_length);
+            length += format->separator_length;
+        }
+        uint16_t start = passphrase_word_offsets[picked[i]];
+        size_t word_length = passphrase_word_offsets[picked[i] + 1] - start;
+        memcpy(output + length, passphrase_words + start, word_length);
+        length += word_length;
+    }
+
+    OPENSSL_cleanse(picked, sizeof(picked));
+    return length;
+}
+
+/**
+ * @note Fills output with count passphrases, each on its own line.
+ *
+ * @param output Capacity of at least count * (passphrase_longest(format) + 1) characters.
+ * @param used Number of written characters is stored here.
+ * @return true on success, false on failure
+ */
+bool passphrase_generate_lines(const struct passphrase_format *format, struct random_pool *pool, char *output,
+                               size_t count, size_t *used)
+{
+    size_t written = 0;
+    for (size_t line = 0; line < count; line++) {
+        size_t length = passphrase_generate(format, pool, output + written);
+        if (length == 0) {
+            OPENSSL_cleanse(output, written);
+            return false;
+        }
+        written += length;
+        output[written++] = '\n';
+    }
+
+    *used = written;
+    return true;
+}
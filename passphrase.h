@@ -0,0 +1,36 @@
+#ifndef PASSWORD_GENERATOR_PASSPHRASE_H
+#define PASSWORD_GENERATOR_PASSPHRASE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "random_pool.h"
+
+#define PASSPHRASE_MIN_WORDS 3
+#define PASSPHRASE_MAX_WORDS 32
+#define PASSPHRASE_DEFAULT_WORDS 6
+#define PASSPHRASE_MAX_SEPARATOR 8
+#define PASSPHRASE_DEFAULT_SEPARATOR "-"
+
+/**
+ * Passphrases are words picked uniformly from the compiled in word list (passphrase_words.h), joined
+ * by the separator. Every word adds exactly log2(passphrase_word_count) bits of entropy, the separator adds none.
+ * The separator can't be empty, otherwise different words could give the same passphrase (sun set and sunset).
+ */
+struct passphrase_format {
+    size_t words;
+    char separator[PASSPHRASE_MAX_SEPARATOR + 1];
+    size_t separator_length;
+    //Multiple of the word count below 2^16, random 16 bit numbers from it up are rejected
+    uint32_t limit;
+};
+
+bool passphrase_format_init(struct passphrase_format *format, long words, const char *separator);
+double passphrase_entropy(const struct passphrase_format *format);
+size_t passphrase_longest(const struct passphrase_format *format);
+size_t passphrase_generate(const struct passphrase_format *format, struct random_pool *pool, char *output);
+bool passphrase_generate_lines(const struct passphrase_format *format, struct random_pool *pool, char *output,
+                               size_t count, size_t *used);
+
+#endif //PASSWORD_GENERATOR_PASSPHRASE_H
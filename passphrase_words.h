@@ -0,0 +1,20 @@
+#ifndef PASSWORD_GENERATOR_PASSPHRASE_WORDS_H
+#define PASSWORD_GENERATOR_PASSPHRASE_WORDS_H
+
+#include <stdint.h>
+
+/**
+ * Word list of passphrases. It is generated at build time by passphrase_words_generator from
+ * dictionaries/passphrase_words.txt, so it is a part of the program and can't be changed by anyone.
+ *
+ * All words are stored one after another without separators or terminating zeros, word i is
+ * passphrase_words[passphrase_word_offsets[i]] up to passphrase_words[passphrase_word_offsets[i + 1]].
+ */
+#define PASSPHRASE_WORDS_MAX_SIZE UINT16_MAX
+
+extern const char passphrase_words[];
+extern const uint16_t passphrase_word_offsets[];
+extern const uint32_t passphrase_word_count;
+extern const uint32_t passphrase_longest_word;
+
+#endif //PASSWORD_GENERATOR_PASSPHRASE_WORDS_H
@@ -0,0 +1,186 @@
+/**
+ * Build time tool that writes passphrase_words.c, the word list declared in passphrase_words.h.
+ *
+ * Usage: passphrase_words_generator OUTPUT WORDLIST
+ *
+ * The word list has one word per line. Every word is picked with the same probability, so the list is checked
+ * for duplicates (a duplicate would be picked twice as often) and for characters other than lowercase letters.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "passphrase_words.h"
+
+#define MAX_WORD_LENGTH 32
+
+static char *words = NULL;
+static size_t words_size = 0;
+static size_t words_capacity = 0;
+
+static uint32_t *offsets = NULL;
+static size_t word_count = 0;
+static size_t offsets_capacity = 0;
+
+static void add_word(const char *word, size_t length)
+{
+    if (words_size + length > words_capacity) {
+        words_capacity = words_capacity == 0 ? 4096 : 2 * words_capacity;
+        words = realloc(words, words_capacity);
+    }
+    if (word_count + 2 > offsets_capacity) {
+        offsets_capacity = offsets_capacity == 0 ? 1024 : 2 * offsets_capacity;
+        offsets = realloc(offsets, offsets_capacity * sizeof(*offsets));
+    }
+    if (words == NULL || offsets == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(words + words_size, word, length);
+    offsets[word_count] = (uint32_t) words_size;
+    words_size += length;
+    word_count++;
+    offsets[word_count] = (uint32_t) words_size;
+}
+
+static bool read_words(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "failed to open %s\n", path);
+        return false;
+    }
+
+    char line[MAX_WORD_LENGTH + 2];
+    size_t number = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        number++;
+        size_t length = strcspn(line, "\r\n");
+        if (line[length] == '\0' && ! feof(file)) {
+            fprintf(stderr, "%s:%zu: word is longer than %d characters\n", path, number, MAX_WORD_LENGTH);
+            fclose(file);
+            return false;
+        }
+
+        for (size_t i = 0; i < length; i++) {
+            if (line[i] < 'a' || line[i] > 'z') {
+                fprintf(stderr, "%s:%zu: words can have only lowercase letters\n", path, number);
+                fclose(file);
+                return false;
+            }
+        }
+        if (length > 0) {
+            add_word(line, length);
+        }
+    }
+
+    fclose(file);
+    return true;
+}
+
+static int compare_words(const void *first, const void *second)
+{
+    uint32_t a = *(const uint32_t *) first;
+    uint32_t b = *(const uint32_t *) second;
+    size_t a_length = offsets[a + 1] - offsets[a];
+    size_t b_length = offsets[b + 1] - offsets[b];
+
+    int result = memcmp(words + offsets[a], words + offsets[b], a_length < b_length ? a_length : b_length);
+    if (result != 0) {
+        return result;
+    }
+    return a_length < b_length ? -1 : a_length > b_length;
+}
+
+/**
+ * @return true if no word is in the list twice
+ */
+static bool check_unique(const char *path)
+{
+    uint32_t *sorted = malloc(word_count * sizeof(*sorted));
+    if (sorted == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < word_count; i++) {
+        sorted[i] = (uint32_t) i;
+    }
+    qsort(sorted, word_count, sizeof(*sorted), compare_words);
+
+    for (size_t i = 1; i < word_count; i++) {
+        if (compare_words(&sorted[i - 1], &sorted[i]) == 0) {
+            uint32_t word = sorted[i];
+            fprintf(stderr, "%s: word %.*s is in the list more than once\n", path,
+                    (int) (offsets[word + 1] - offsets[word]), words + offsets[word]);
+            free(sorted);
+            return false;
+        }
+    }
+
+    free(sorted);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s OUTPUT WORDLIST\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (! read_words(argv[2]) || ! check_unique(argv[2])) {
+        return EXIT_FAILURE;
+    }
+    if (word_count < 2) {
+        fprintf(stderr, "%s: the list needs at least two words\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+    if (words_size > PASSPHRASE_WORDS_MAX_SIZE) {
+        fprintf(stderr, "%s: the words take more than %d bytes\n", argv[2], PASSPHRASE_WORDS_MAX_SIZE);
+        return EXIT_FAILURE;
+    }
+
+    FILE *output = fopen(argv[1], "w");
+    if (output == NULL) {
+        fprintf(stderr, "failed to create %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(output, "//Generated by passphrase_words_generator, do not edit.\n\n#include \"passphrase_words.h\"\n\n");
+
+    //Lines of the string literal end after whole words, so the words can be read in the generated file
+    fprintf(output, "const char passphrase_words[] =");
+    size_t longest = 0;
+    size_t line_length = 0;
+    for (size_t i = 0; i < word_count; i++) {
+        size_t length = offsets[i + 1] - offsets[i];
+        longest = length > longest ? length : longest;
+        if (i == 0 || line_length + length > 100) {
+            fprintf(output, "%s\n    \"", i == 0 ? "" : "\"");
+            line_length = 5;
+        }
+        fprintf(output, "%.*s", (int) length, words + offsets[i]);
+        line_length += length;
+    }
+    fprintf(output, "\";\n\n");
+
+    fprintf(output, "const uint16_t passphrase_word_offsets[] = {");
+    for (size_t i = 0; i <= word_count; i++) {
+        fprintf(output, "%s %u,", i % 12 == 0 ? "\n   " : "", offsets[i]);
+    }
+    fprintf(output, "\n};\n\n");
+
+    fprintf(output, "const uint32_t passphrase_word_count = %zu;\nconst uint32_t passphrase_longest_word = %zu;\n",
+            word_count, longest);
+
+    free(words);
+    free(offsets);
+    if (fclose(output) != 0) {
+        fprintf(stderr, "failed to write %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
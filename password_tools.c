@@ -1,10 +1,19 @@
 #include "password_tools.h"
 #include "data_saving.h"
+#include "random_pool.h"
+#include "char_mapping.h"
+#include "strength.h"
+#include "passphrase.h"
+#include "passphrase_words.h"
+#include "batch_generation.h"
+#include "policy.h"
+#include "profiles.h"
+#include "pwgen.h"
+
+#include <unistd.h>
 
 #include <openssl/rand.h>
 
-#define CHAR_POOL_LENGTH ('~' - ' ' + 1)
-
 /**
  * @note This function will ask continuously until user answers with "y" or "n".
  *
@@ -77,7 +86,7 @@ bool get_password_length(char *response, int response_capacity, long *length)
  *                       To fit all the characters. After failure you have to free it.
  * @return true if successful, false otherwise.
  */
-bool get_character_pool(char *response, int response_capacity, char *character_pool, int *char_pool_end_index)
+bool get_excluded_characters(char *response, int response_capacity, char *excluded)
 {
     printf("\nWrite which characters you don't want. Characters that are automatically included are all ASCII characters,\n"
            "those are all upper and lower case letters, all digits, space and these special characters:\n");
@@ -102,119 +111,99 @@ bool get_character_pool(char *response, int response_capacity, char *character_p
         return false;
     }
 
-    for (char chr = ' '; chr <= (char) '~'; chr++) {
-        character_pool[chr - ' '] = chr;
-    }
+    response[strcspn(response, "\n")] = '\0';
+    strncpy(excluded, response, CHAR_POOL_LENGTH);
+    excluded[CHAR_POOL_LENGTH] = '\0';
+    return true;
+}
 
-    int left = 0;
-    while (response[left] != '\n' && response[left] != '\0') {
-        if (' ' <= response[left] && response[left] <= '~') {
-            character_pool[response[left] - ' '] = '\1';
-        }
-        left++;
-    }
 
-    left = 0;
-    int right = CHAR_POOL_LENGTH - 1;
+/**
+ * @note Asks how many words and which separator the passphrases should have.
+ *
+ * @param response Has to be allocated memory. After failure you have to free it.
+ * @param response_capacity Capacity of response.
+ * @param format Format of the passphrases is stored here.
+ * @return true if successful, false otherwise.
+ */
+bool get_passphrase_format(char *response, int response_capacity, struct passphrase_format *format)
+{
+    long words = 0;
+    while (true) {
+        printf("How many words do you want your passphrase to have? (%d words are a good choice)\n",
+               PASSPHRASE_DEFAULT_WORDS);
 
-    while (left < right) {
-        if (character_pool[left] != '\1') {
-            left++;
-            continue;
+        if (fgets(response, response_capacity, stdin) == NULL) {
+            fprintf(stderr, "failed to read response\n");
+            return false;
         }
 
-        while (left < right && character_pool[right] == '\1') {
-            right--;
-        }
-        if (left == right) {
+        char *end = response;
+        words = strtol(response, &end, 10);
+        if (end != response && (*end == '\n' || *end == '\0') && PASSPHRASE_MIN_WORDS <= words
+            && words <= PASSPHRASE_MAX_WORDS) {
             break;
         }
-
-        character_pool[left] = character_pool[right];
-        character_pool[right] = '\1';
-        right--;
-        left++;
+        fprintf(stderr, "You should enter a number between %d and %d, included.\n", PASSPHRASE_MIN_WORDS,
+                PASSPHRASE_MAX_WORDS);
     }
-    if (character_pool[left] == '\1') {
-        left--;
-    }
-    *char_pool_end_index = left;
-    return true;
-}
 
-/**
- * @return true if OpenSSL's random functions are initialized; false otherwise
- */
-bool initialize_generator(bool *rand_initialized)
-{
-    if (*rand_initialized) {
-        return true;
-    }
+    while (true) {
+        printf("Write the characters that should separate the words, like this: _9 (just press enter for %s)\n",
+               PASSPHRASE_DEFAULT_SEPARATOR);
 
-    if (RAND_poll() == 0) {
-        fprintf(stderr, "Error initializing OpenSSL.\n");
-        return false;
-    }
+        if (fgets(response, response_capacity, stdin) == NULL) {
+            fprintf(stderr, "failed to read response\n");
+            return false;
+        }
+        response[strcspn(response, "\n")] = '\0';
 
-    if (RAND_status() == 0) {
-        fprintf(stderr, "Insufficient entropy for secure random numbers.\n"
-                        "Wait a bit before trying again.\n");
-        return false;
+        if (passphrase_format_init(format, words, response[0] == '\0' ? PASSPHRASE_DEFAULT_SEPARATOR : response)) {
+            break;
+        }
     }
 
-    *rand_initialized = true;
+    printf("Every passphrase will have %.1f bits of entropy (%zu words, each picked from %u words).\n",
+           passphrase_entropy(format), format->words, passphrase_word_count);
     return true;
 }
 
-bool generate_password(char *response, char *character_pool, int char_pool_end_index, long length, int response_capacity)
+/**
+ * @note Generates one password (or passphrase) by the generator, shows it and saves it if the user wants to.
+ */
+bool generate_password(char *response, struct pwgen_generator *generator, int response_capacity)
 {
-    unsigned char *random_bytes = malloc(length * sizeof(unsigned char));
-    if (random_bytes == NULL) {
-        fprintf(stderr, "malloc failed\n");
-        return false;
-    }
+    long length = (long) pwgen_max_length(generator);
 
     char *password = malloc((length + 2) * sizeof(char));
     if (password == NULL) {
-        free(random_bytes);
         fprintf(stderr, "failed to allocate memory for password\n");
         return false;
     }
 
     bool save_password = false;
 
-    if (yes_no_question("\nWould you like to save the generated password? (NOT ENCRYPTED)\n", response, response_capacity)) {
+    if (yes_no_question("\nWould you like to save the generated password?\n", response, response_capacity)) {
         save_password = true;
     }
 
     if (! yes_no_question("\nYour password is going to be generated, make sure no one can see your password when it "
                           "will be displayed.\nWould you like to generate it right now?\n", response, response_capacity)) {
-        free(random_bytes);
         free(password);
         return true;
     }
 
-    if (RAND_bytes(random_bytes, length) != 1) {
-        fprintf(stderr, "failed to generate random numbers\n");
-        free(random_bytes);
+    size_t generated = pwgen_generate(generator, password, length + 1);
+    if (generated == 0) {
+        memset(password, 0, length);
         free(password);
         return false;
     }
 
-    int char_pool_index = 0;
-    char_pool_end_index++;
-
-    for (int i = 0; i < length; i++) {
-        char_pool_index = random_bytes[i] % char_pool_end_index;
-        password[i] = character_pool[char_pool_index];
-        random_bytes[i] = 0; //Just for safety
-    }
-    password[length] = '\n';
-    password[length + 1] = '\0';
-
-    free(random_bytes);
-
     printf("Your password is: %s\n", password);
+    //The saved password ends with '\n' like the passwords read by fgets
+    password[generated] = '\n';
+    password[generated + 1] = '\0';
 
     if (! save_password) {
         memset(password, 0, length);
@@ -296,7 +285,115 @@ bool generate_password(char *response, char *character_pool, int char_pool_end_i
     return true;
 }
 
-bool generate_passwords(bool *rand_initialized)
+/**
+ * @note Asks which rules the password has to follow. Rules can be used only for passwords of at most
+ * POLICY_MAX_LENGTH characters, nothing is asked for longer ones.
+ *
+ * @param response Has to be allocated memory. After failure you have to free it.
+ * @param response_capacity Capacity of response.
+ * @param length Length of the password.
+ * @param policy The rules are stored here.
+ */
+void get_password_policy(char *response, int response_capacity, long length, struct password_policy *policy)
+{
+    policy->required = 0;
+    policy->no_repeats = false;
+    policy->no_sequences = false;
+
+    if (length > POLICY_MAX_LENGTH) {
+        printf("Rules can be used only for passwords with at most %d characters, so none are asked for.\n",
+               POLICY_MAX_LENGTH);
+        return;
+    }
+
+    if (yes_no_question("Must the password have at least one lowercase letter, uppercase letter, digit and special "
+                        "character (of those you did not exclude)?", response, response_capacity)) {
+        policy->required = STRENGTH_LOWER | STRENGTH_UPPER | STRENGTH_DIGIT | STRENGTH_SPECIAL;
+    }
+    if (yes_no_question("Must the password be without repeated characters (like aa) and sequences (like ab or 21)?",
+                        response, response_capacity)) {
+        policy->no_repeats = true;
+        policy->no_sequences = true;
+    }
+}
+
+/**
+ * @note Generates passwords by the generator until the user does not want another one.
+ *
+ * @param question Asked after every password, whether the user wants another one.
+ * @return true on success, false on failure
+ */
+static bool generate_until_done(char *response, int response_capacity, struct pwgen_generator *generator,
+                                const char *question)
+{
+    bool another_password = true;
+    bool result = true;
+
+    while (another_password) {
+        if (! generate_password(response, generator, response_capacity)) {
+            result = false;
+            break;
+        }
+        another_password = yes_no_question(question, response, response_capacity);
+    }
+    return result;
+}
+
+/**
+ * @note Offers the saved profiles of PROFILES_FILE, if there is one, and generates passwords of the chosen one.
+ *
+ * @param used Set to true if the passwords were generated by a profile, false if the user wants to choose
+ *             the settings (or there are no profiles).
+ * @return true on success, false on failure
+ */
+static bool generate_from_profile(char *response, int response_capacity, bool *used)
+{
+    *used = false;
+    if (access(PROFILES_FILE, F_OK) != 0) {
+        return true;
+    }
+
+    struct profile_set profiles;
+    if (! profiles_load(&profiles, PROFILES_FILE)) {
+        fprintf(stderr, "The saved profiles can't be used, fix %s first.\n", PROFILES_FILE);
+        return true;
+    }
+    if (profiles.count == 0 || ! yes_no_question("Do you want to use a saved profile?", response, response_capacity)) {
+        profiles_free(&profiles);
+        return true;
+    }
+
+    const struct profile *profile = NULL;
+    while (profile == NULL) {
+        printf("Write the name of the profile:\n");
+        for (size_t i = 0; i < profiles.count; i++) {
+            printf("- %s (%.1f bits of entropy)\n", profiles.profiles[i].name, profile_entropy(&profiles.profiles[i]));
+        }
+
+        if (fgets(response, response_capacity, stdin) == NULL) {
+            fprintf(stderr, "failed to read response\n");
+            profiles_free(&profiles);
+            return false;
+        }
+        response[strcspn(response, "\n")] = '\0';
+
+        profile = profiles_find(&profiles, response);
+        if (profile == NULL) {
+            fprintf(stderr, "There is no profile %s.\n", response);
+        }
+    }
+
+    *used = true;
+    struct pwgen_generator generator;
+    pwgen_generator_from_profile(&generator, profile);
+    bool result = generate_until_done(response, response_capacity, &generator,
+                                      "Do you want to create another password of the same profile?");
+    pwgen_generator_free(&generator);
+    profiles_free(&profiles);
+    return result;
+}
+
+bool generate_passwords(void)
 {
     int response_capacity = MAX_CHAR_RANGE;
     char *response = malloc(response_capacity * sizeof(char));
@@ -306,67 +403,96 @@ bool generate_passwords(bool *rand_initialized)
         return false;
     }
 
-    long length = 0;
-
-    if (! get_password_length(response, response_capacity, &length)) {
-        fprintf(stderr, "failed to get password length\n");
+    bool used_profile = false;
+    bool profile_result = generate_from_profile(response, response_capacity, &used_profile);
+    if (! profile_result || used_profile) {
         free(response);
-        return false;
+        return profile_result;
     }
 
-    char *character_pool = malloc( CHAR_POOL_LENGTH * sizeof(char));
+    struct pwgen_options options = { .length = 0, .excluded = NULL,
+                                     .policy = { .required = 0, .no_repeats = false, .no_sequences = false },
+                                     .words = 0, .separator = NULL };
+    struct passphrase_format format;
+    bool passphrase = yes_no_question("Do you want a passphrase of random words (easier to remember) "
+                                      "instead of random characters?", response, response_capacity);
 
-    if (character_pool == NULL) {
-        fprintf(stderr, "failed to allocate memory\n");
-        free(response);
-        return false;
-    }
-
-    int char_pool_end_index = 0;
-
-    if (! get_character_pool(response, response_capacity, character_pool, &char_pool_end_index)) {
-        free(response);
-        free(character_pool);
-        return false;
+    if (passphrase) {
+        if (! get_passphrase_format(response, response_capacity, &format)) {
+            free(response);
+            return false;
+        }
+        options.words = (long) format.words;
+        options.separator = format.separator;
     }
 
-    if (! initialize_generator(rand_initialized)) {
+    if (! passphrase && ! get_password_length(response, response_capacity, &options.length)) {
+        fprintf(stderr, "failed to get password length\n");
         free(response);
-        free(character_pool);
         return false;
     }
 
-    bool another_password = true;
-
-    while (another_password) {
-        if (! generate_password(response, character_pool, char_pool_end_index, length, response_capacity)) {
+    char excluded[CHAR_POOL_LENGTH + 1];
+    if (! passphrase) {
+        if (! get_excluded_characters(response, response_capacity, excluded)) {
             free(response);
-            free(character_pool);
             return false;
         }
-        another_password = yes_no_question("Do you want to create another password with same length and character set as previous one?",
-                                           response, response_capacity);
+        options.excluded = excluded;
+        get_password_policy(response, response_capacity, options.length, &options.policy);
+    }
+
+    struct pwgen_generator generator;
+    if (! pwgen_generator_init(&generator, &options)) {
+        free(response);
+        return true;
     }
+    if (generator.use_policy) {
+        printf("Every password will have %.1f bits of entropy (%.1f without the rules).\n",
+               pwgen_entropy(&generator, &options), options.length * log2(generator.policy.size));
+    }
+
+    bool result = generate_until_done(response, response_capacity, &generator,
+                                      passphrase ? "Do you want to create another passphrase with the same words and separator?"
+                                                 : "Do you want to create another password with same length and character set as previous one?");
 
+    pwgen_generator_free(&generator);
     free(response);
-    free(character_pool);
-    return true;
+    return result;
+}
+
+/**
+ * @note Tells which patterns were found in the password, brute forced parts are left out.
+ */
+static void print_patterns(const struct pattern_scorer *scorer, const char *password)
+{
+    for (size_t i = 0; i < scorer->sequence_length; i++) {
+        const struct pattern_match *match = &scorer->sequence[i];
+        if (match->type == PATTERN_BRUTEFORCE) {
+            continue;
+        }
+
+        printf("- %s \"%.*s\"", pattern_type_name(match->type), (int) (match->end - match->start + 1),
+               password + match->start);
+        if (match->type == PATTERN_DICTIONARY) {
+            printf(" (%s, rank %u%s%s)", pattern_source_name(match), match->rank, match->reversed ? ", reversed" : "",
+                   match->l33t ? ", with substitutions" : "");
+        } else if (match->type == PATTERN_SPATIAL) {
+            printf(" (%s)", pattern_source_name(match));
+        }
+        printf(", %.0f guesses\n", match->guesses);
+    }
 }
 
 /**
- * @brief Asks for a password, calculates its entropy and uses it to tell the strength of the password.
- *        The strength is written in bold.
+ * @brief Asks for a password, estimates how many guesses are needed to find it with the pattern matcher
+ *        and uses it to tell the strength of the password. The strength is written in bold, the patterns
+ *        found in the password follow.
  * @note After entropy calculation the password is overwritten and the memory is freed.
  * @return true on success, false on failure
  */
 bool password_strength(void)
 {
-    bool upper = false;
-    bool lower = false;
-    bool digits = false;
-    bool special = false;
-    int char_range = 0;
-
     char *password = malloc(MAX_PASSWORD_LENGTH * sizeof(char));
     if (password == NULL) {
         fprintf(stderr, "malloc failed\n");
@@ -398,62 +524,41 @@ bool password_strength(void)
         return true;
     }
 
-    for (int i = 0; i < length; i++) {
-        if (char_range == MAX_CHAR_RANGE) {
-            break;
-        }
-
-        if (isupper(password[i])) {
-            if (! upper) {
-                upper = true;
-                char_range += LETTER_COUNT;
-            }
-            password[i] = '\0';
-            continue;
-        }
-
-        if (islower(password[i])) {
-            if (! lower) {
-                lower = true;
-                char_range += LETTER_COUNT;
-            }
-            password[i] = '\0';
-            continue;
-        }
+    //Passwords from breaches are tried first by attackers, no matter how random they look
+    //A filter that can't be opened is left out, the password is still scored
+    struct pwgen_scorer scorer;
+    bool initialized = access(BREACH_FILTER_FILE, F_OK) == 0 && pwgen_scorer_init(&scorer, BREACH_FILTER_FILE);
+    if (! initialized && ! pwgen_scorer_init(&scorer, NULL)) {
+        memset(password, 0, MAX_PASSWORD_LENGTH);
+        free(password);
+        return false;
+    }
 
-        if (isdigit(password[i])) {
-            if (! digits) {
-                digits = true;
-                char_range += DIGIT_COUNT;
-            }
-            password[i] = '\0';
-            continue;
-        }
+    struct pwgen_score score;
+    if (! pwgen_score(&scorer, password, length, &score)) {
+        memset(password, 0, MAX_PASSWORD_LENGTH);
+        free(password);
+        pwgen_scorer_free(&scorer);
+        return false;
+    }
 
-        if (! special) {
-            special = true;
-            char_range += SPECIAL_CHARS;
-        }
-        password[i] = '\0';
+    if (score.breached) {
+        memset(password, 0, MAX_PASSWORD_LENGTH);
+        free(password);
+        pwgen_scorer_free(&scorer);
+        printf("%s\e[m, it is in the list of breached passwords.\n", strength_class_name(STRENGTH_VERY_WEAK));
+        return true;
     }
 
+    printf("%s", strength_class_name(score.strength));
+    printf("\e[m, about 10^%.0f guesses are needed to find it.\n", score.entropy * log10(2));
+    print_patterns(&scorer.patterns, password);
+
     memset(password, 0, MAX_PASSWORD_LENGTH);
     free(password);
-
-    double password_entropy = length * log2(char_range);
-
-    if (password_entropy < 25) {
-        printf("very weak");
-    } else if (password_entropy < 50) {
-        printf("weak");
-    } else if (password_entropy < 75) {
-        printf("reasonable");
-    } else if (password_entropy < 100) {
-        printf("strong");
-    } else {
-        printf("very strong");
+    pwgen_scorer_free(&scorer);
+    if (! score.breach_checked) {
+        printf("Build %s with --build-filter to also look for it among breached passwords.\n", BREACH_FILTER_FILE);
     }
-
-    printf("\e[m.\n");
     return true;
 }
@@ -9,14 +9,12 @@
 #include <math.h>
 #include <limits.h>
 
-#define LETTER_COUNT 26
-#define DIGIT_COUNT 10
-#define SPECIAL_CHARS 20
-#define MAX_CHAR_RANGE (2 * LETTER_COUNT + DIGIT_COUNT + SPECIAL_CHARS)
+#include "character_pool.h"
+
 #define MAX_PASSWORD_LENGTH 32
 
 bool password_strength(void);
-bool generate_passwords(bool *rand_initialized);
+bool generate_passwords(void);
 bool yes_no_question(const char *question, char *response, int response_capacity);
 
 #endif //PASSWORD_GENERATOR_PASSWORD_TOOLS_H
@@ -0,0 +1,55 @@
+#ifndef PASSWORD_GENERATOR_PATTERN_TABLES_H
+#define PASSWORD_GENERATOR_PATTERN_TABLES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Tables of the pattern matcher. They are generated at build time by pattern_tables_generator from the word
+ * lists in dictionaries/ and the keyboard layouts in the generator, so nothing is loaded or built at run time.
+ *
+ * All words are in one trie. A node is a word if its rank is not 0, the rank is the position of the word
+ * in its list (1 for the most common word), a word in more lists has its best rank. Edges of a node are
+ * consecutive and sorted by their byte.
+ */
+struct pattern_trie_node {
+    uint32_t first_edge;
+    uint16_t edge_count;
+    uint16_t dictionary;
+    uint32_t rank;
+};
+
+struct pattern_trie_edge {
+    unsigned char byte;
+    uint32_t child;
+};
+
+/**
+ * Keys of every pair of printable ASCII characters (index character - ' '): adjacency[previous][next] is -1
+ * if next is not on a neighbour of the key of previous, otherwise it is the direction of the neighbour
+ * times 2, plus 1 if next is the shifted character of the neighbour.
+ */
+#define PATTERN_PRINTABLE_FIRST ' '
+#define PATTERN_PRINTABLE_COUNT 95
+
+struct pattern_keyboard {
+    const char *name;
+    //Number of keys and average number of neighbours, they give the count of walks of given length and turns
+    double starting_positions;
+    double average_degree;
+    //True if shifted characters of the layout are typed with shift (not on keypads)
+    bool shifts;
+    signed char adjacency[PATTERN_PRINTABLE_COUNT][PATTERN_PRINTABLE_COUNT];
+    //1 for characters that are typed with shift
+    unsigned char shifted[PATTERN_PRINTABLE_COUNT];
+};
+
+extern const struct pattern_trie_node pattern_trie_nodes[];
+extern const struct pattern_trie_edge pattern_trie_edges[];
+extern const char *const pattern_dictionary_names[];
+extern const int pattern_dictionary_count;
+
+extern const struct pattern_keyboard pattern_keyboards[];
+extern const int pattern_keyboard_count;
+
+#endif //PASSWORD_GENERATOR_PATTERN_TABLES_H
@@ -0,0 +1,348 @@
+/**
+ * Build time tool that writes pattern_tables.c, the tables declared in pattern_tables.h.
+ *
+ * Usage: pattern_tables_generator OUTPUT DICTIONARY...
+ *
+ * Every dictionary is a word list, one word per line from the most common one. The name of a dictionary
+ * is its file name without the directory and extension. Words are lowercased, words shorter than
+ * MIN_WORD_LENGTH are left out, because they are found in almost every password and add nothing but noise.
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pattern_tables.h"
+
+#define MIN_WORD_LENGTH 3
+#define MAX_WORD_LENGTH 64
+
+struct keyboard_layout {
+    const char *name;
+    //Slanted layouts are typewriter keyboards, every row is shifted by half a key, keypads are aligned
+    bool slanted;
+    const char *rows[6];
+};
+
+/**
+ * The keys of a row are separated by spaces, a key is its unshifted and shifted character. The position
+ * of a key in its row gives its column, so the rows of a slanted layout are indented by one more space.
+ * QWERTZ is QWERTY with Y and Z swapped, the other keys differ from the American layout only in
+ * characters outside ASCII.
+ */
+static const struct keyboard_layout layouts[] = {
+    { "qwerty", true, {
+        "`~ 1! 2@ 3# 4$ 5% 6^ 7& 8* 9( 0) -_ =+",
+        "    qQ wW eE rR tT yY uU iI oO pP [{ ]} \\|",
+        "     aA sS dD fF gG hH jJ kK lL ;: '\"",
+        "      zZ xX cC vV bB nN mM ,< .> /?",
+        NULL } },
+    { "qwertz", true, {
+        "`~ 1! 2@ 3# 4$ 5% 6^ 7& 8* 9( 0) -_ =+",
+        "    qQ wW eE rR tT zZ uU iI oO pP [{ ]} \\|",
+        "     aA sS dD fF gG hH jJ kK lL ;: '\"",
+        "      yY xX cC vV bB nN mM ,< .> /?",
+        NULL } },
+    { "dvorak", true, {
+        "`~ 1! 2@ 3# 4$ 5% 6^ 7& 8* 9( 0) [{ ]}",
+        "    '\" ,< .> pP yY fF gG cC rR lL /? =+ \\|",
+        "     aA oO eE uU iI dD hH tT nN sS -_",
+        "      ;: qQ jJ kK xX bB mM wW vV zZ",
+        NULL } },
+    { "keypad", false, {
+        "  / * -",
+        "7 8 9 +",
+        "4 5 6",
+        "1 2 3",
+        "  0 .",
+        NULL } },
+};
+#define LAYOUT_COUNT ((int) (sizeof(layouts) / sizeof(layouts[0])))
+
+#define GRID_SIZE 32
+
+struct trie_node {
+    uint32_t children[256];
+    uint32_t rank;
+    uint16_t dictionary;
+};
+
+static struct trie_node *nodes = NULL;
+static size_t node_count = 0;
+static size_t node_capacity = 0;
+
+static uint32_t new_node(void)
+{
+    if (node_count == node_capacity) {
+        node_capacity = node_capacity == 0 ? 1024 : 2 * node_capacity;
+        nodes = realloc(nodes, node_capacity * sizeof(*nodes));
+        if (nodes == NULL) {
+            fprintf(stderr, "malloc failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    memset(&nodes[node_count], 0, sizeof(*nodes));
+    return (uint32_t) node_count++;
+}
+
+static void add_word(const char *word, size_t length, uint16_t dictionary, uint32_t rank)
+{
+    uint32_t node = 0;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char byte = (unsigned char) word[i];
+        if (nodes[node].children[byte] == 0) {
+            uint32_t child = new_node();
+            nodes[node].children[byte] = child;
+        }
+        node = nodes[node].children[byte];
+    }
+
+    if (nodes[node].rank == 0 || rank < nodes[node].rank) {
+        nodes[node].rank = rank;
+        nodes[node].dictionary = dictionary;
+    }
+}
+
+/**
+ * @note Adds every word of the list to the trie, the rank of a word is the number of its line.
+ */
+static bool read_dictionary(const char *path, uint16_t dictionary)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "failed to open %s\n", path);
+        return false;
+    }
+
+    char line[MAX_WORD_LENGTH + 2];
+    uint32_t rank = 0;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        size_t length = strcspn(line, "\r\n");
+        if (line[length] == '\0' && ! feof(file)) {
+            fprintf(stderr, "%s: word %u is longer than %d characters\n", path, rank + 1, MAX_WORD_LENGTH);
+            fclose(file);
+            return false;
+        }
+        line[length] = '\0';
+        rank++;
+
+        for (size_t i = 0; i < length; i++) {
+            if (line[i] >= 'A' && line[i] <= 'Z') {
+                line[i] = (char) (line[i] - 'A' + 'a');
+            }
+        }
+        if (length >= MIN_WORD_LENGTH) {
+            add_word(line, length, dictionary, rank);
+        }
+    }
+
+    fclose(file);
+    return true;
+}
+
+/**
+ * @return name of the dictionary, the file name without directories and extension (not terminated)
+ */
+static const char *dictionary_name(const char *path, int *length)
+{
+    const char *name = strrchr(path, '/');
+    name = name == NULL ? path : name + 1;
+    const char *dot = strchr(name, '.');
+    *length = dot == NULL ? (int) strlen(name) : (int) (dot - name);
+    return name;
+}
+
+static void write_char(FILE *output, unsigned char character)
+{
+    if (character == '\'' || character == '\\') {
+        fprintf(output, "'\\%c'", character);
+    } else if (character >= ' ' && character <= '~') {
+        fprintf(output, "'%c'", character);
+    } else {
+        fprintf(output, "%u", character);
+    }
+}
+
+/**
+ * @note Writes the trie in breadth first order, so the edges of every node are consecutive.
+ */
+static void write_trie(FILE *output)
+{
+    uint32_t *order = malloc(node_count * sizeof(*order));
+    uint32_t *position = malloc(node_count * sizeof(*position));
+    if (order == NULL || position == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t ordered = 1;
+    order[0] = 0;
+    position[0] = 0;
+    for (size_t i = 0; i < ordered; i++) {
+        for (int byte = 0; byte < 256; byte++) {
+            uint32_t child = nodes[order[i]].children[byte];
+            if (child != 0) {
+                position[child] = (uint32_t) ordered;
+                order[ordered++] = child;
+            }
+        }
+    }
+
+    fprintf(output, "const struct pattern_trie_node pattern_trie_nodes[] = {\n");
+    uint32_t edge = 0;
+    for (size_t i = 0; i < node_count; i++) {
+        const struct trie_node *node = &nodes[order[i]];
+        uint16_t edges = 0;
+        for (int byte = 0; byte < 256; byte++) {
+            edges += node->children[byte] != 0;
+        }
+        fprintf(output, "    { %u, %u, %u, %u },\n", edge, edges, node->dictionary, node->rank);
+        edge += edges;
+    }
+    fprintf(output, "};\n\n");
+
+    fprintf(output, "const struct pattern_trie_edge pattern_trie_edges[] = {\n");
+    for (size_t i = 0; i < node_count; i++) {
+        for (int byte = 0; byte < 256; byte++) {
+            uint32_t child = nodes[order[i]].children[byte];
+            if (child != 0) {
+                fprintf(output, "    { ");
+                write_char(output, (unsigned char) byte);
+                fprintf(output, ", %u },\n", position[child]);
+            }
+        }
+    }
+    //An array can't be empty
+    fprintf(output, "    { 0, 0 }\n};\n\n");
+
+    free(order);
+    free(position);
+}
+
+/**
+ * @note Places the keys of the layout to a grid and writes which characters are on neighbouring keys, the same
+ * way zxcvbn builds its adjacency graphs.
+ */
+static void write_keyboard(FILE *output, const struct keyboard_layout *layout)
+{
+    //Key (its characters) at every position, empty for none
+    char grid[GRID_SIZE][GRID_SIZE][3];
+    memset(grid, 0, sizeof(grid));
+
+    int key_size = 0;
+    for (int y = 0; layout->rows[y] != NULL; y++) {
+        const char *row = layout->rows[y];
+        for (int column = 0; row[column] != '\0';) {
+            if (row[column] == ' ') {
+                column++;
+                continue;
+            }
+            int length = (int) strcspn(row + column, " ");
+            key_size = length;
+            int x = (column - (layout->slanted ? y : 0)) / (length + 1);
+            memcpy(grid[y][x], row + column, (size_t) length);
+            column += length;
+        }
+    }
+
+    static const int slanted[6][2] = { { -1, 0 }, { 0, -1 }, { 1, -1 }, { 1, 0 }, { 0, 1 }, { -1, 1 } };
+    static const int aligned[8][2] = { { -1, 0 }, { -1, -1 }, { 0, -1 }, { 1, -1 }, { 1, 0 }, { 1, 1 }, { 0, 1 },
+                                       { -1, 1 } };
+    const int (*directions)[2] = layout->slanted ? slanted : aligned;
+    int direction_count = layout->slanted ? 6 : 8;
+
+
+    signed char adjacency[PATTERN_PRINTABLE_COUNT][PATTERN_PRINTABLE_COUNT];
+    unsigned char shifted[PATTERN_PRINTABLE_COUNT];
+    memset(adjacency, -1, sizeof(adjacency));
+    memset(shifted, 0, sizeof(shifted));
+
+    int characters = 0;
+    int degrees = 0;
+    for (int y = 0; y < GRID_SIZE; y++) {
+        for (int x = 0; x < GRID_SIZE; x++) {
+            for (int i = 0; i < key_size && grid[y][x][i] != '\0'; i++) {
+                int index = grid[y][x][i] - PATTERN_PRINTABLE_FIRST;
+                characters++;
+                shifted[index] = (unsigned char) (i == 1);
+
+                //Directions are searched in order, the first one with the next character wins
+                for (int direction = direction_count - 1; direction >= 0; direction--) {
+                    int neighbour_x = x + directions[direction][0];
+                    int neighbour_y = y + directions[direction][1];
+                    if (neighbour_x < 0 || neighbour_y < 0 || neighbour_x >= GRID_SIZE || neighbour_y >= GRID_SIZE
+                        || grid[neighbour_y][neighbour_x][0] == '\0') {
+                        continue;
+                    }
+                    degrees++;
+                    for (int j = 0; j < key_size && grid[neighbour_y][neighbour_x][j] != '\0'; j++) {
+                        int next = grid[neighbour_y][neighbour_x][j] - PATTERN_PRINTABLE_FIRST;
+                        adjacency[index][next] = (signed char) (2 * direction + j);
+                    }
+                }
+            }
+        }
+    }
+
+    fprintf(output, "    { \"%s\", %d, %.17g, %s,\n      {\n", layout->name, characters,
+            (double) degrees / characters, key_size > 1 ? "true" : "false");
+    for (int index = 0; index < PATTERN_PRINTABLE_COUNT; index++) {
+        fprintf(output, "        {");
+        for (int next = 0; next < PATTERN_PRINTABLE_COUNT; next++) {
+            fprintf(output, "%s%d,", next % 24 == 0 && next > 0 ? "\n         " : " ", adjacency[index][next]);
+        }
+        fprintf(output, " },\n");
+    }
+    fprintf(output, "      },\n      {");
+    for (int index = 0; index < PATTERN_PRINTABLE_COUNT; index++) {
+        fprintf(output, "%s%u,", index % 32 == 0 ? "\n        " : " ", shifted[index]);
+    }
+    fprintf(output, "\n      } },\n");
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s OUTPUT DICTIONARY...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    new_node();
+    for (int i = 2; i < argc; i++) {
+        if (! read_dictionary(argv[i], (uint16_t) (i - 2))) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    FILE *output = fopen(argv[1], "w");
+    if (output == NULL) {
+        fprintf(stderr, "failed to create %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(output, "//Generated by pattern_tables_generator, do not edit.\n\n#include \"pattern_tables.h\"\n\n");
+
+    fprintf(output, "const char *const pattern_dictionary_names[] = {\n");
+    for (int i = 2; i < argc; i++) {
+        int length = 0;
+        const char *name = dictionary_name(argv[i], &length);
+        fprintf(output, "    \"%.*s\",\n", length, name);
+    }
+    fprintf(output, "};\nconst int pattern_dictionary_count = %d;\n\n", argc - 2);
+
+    write_trie(output);
+
+    fprintf(output, "const struct pattern_keyboard pattern_keyboards[] = {\n");
+    for (int i = 0; i < LAYOUT_COUNT; i++) {
+        write_keyboard(output, &layouts[i]);
+    }
+    fprintf(output, "};\nconst int pattern_keyboard_count = %d;\n", LAYOUT_COUNT);
+
+    free(nodes);
+    if (fclose(output) != 0) {
+        fprintf(stderr, "failed to write %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,871 @@
+#include "patterns.h"
+#include "pattern_tables.h"
+#include "strength.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <openssl/crypto.h>
+
+//Constants of zxcvbn, a sequence of l matches costs l! times their guesses plus this to the power of l - 1
+#define MIN_GUESSES_BEFORE_GROWING_SEQUENCE 10000.0
+#define MIN_SUBMATCH_GUESSES_SINGLE_CHAR 10.0
+#define MIN_SUBMATCH_GUESSES_MULTI_CHAR 50.0
+#define MIN_YEAR_SPACE 20
+#define DATE_MIN_YEAR 1000
+#define DATE_MAX_YEAR 2050
+#define SEQUENCE_MAX_DELTA 5
+#define DAYS_IN_YEAR 365
+//Dates with a separator can use any of DATE_SEPARATORS
+#define DATE_SEPARATORS " /\\_.-"
+
+//Back pointer of a brute forced part starting at start
+#define BRUTEFORCE_BACK(start) ((int16_t) (-1 - (int) (start)))
+
+struct pattern_dp {
+    //Best sequence of l matches that covers the password up to byte k: guesses[k][l], the product of
+    //the guesses of its matches and the match it ends with (an index to matches or BRUTEFORCE_BACK)
+    double guesses[PATTERN_MAX_LENGTH][PATTERN_MAX_LENGTH + 1];
+    double product[PATTERN_MAX_LENGTH][PATTERN_MAX_LENGTH + 1];
+    int16_t back[PATTERN_MAX_LENGTH][PATTERN_MAX_LENGTH + 1];
+    //Bit l - 1 is set if there is a sequence of l matches ending at k, in ends_with_match if its last
+    //match is not brute forced, so the loops visit only the sequences that exist
+    uint64_t present[PATTERN_MAX_LENGTH];
+    uint64_t ends_with_match[PATTERN_MAX_LENGTH];
+    //Bit k is set if ends_with_match[k] is not 0
+    uint64_t match_ends;
+
+    //Guesses of a brute forced part of every length
+    double bruteforce[PATTERN_MAX_LENGTH + 1];
+
+    //Matches in order of their last byte, the ones ending at k are by_end[first_by_end[k] .. first_by_end[k + 1] - 1]
+    uint16_t first_by_end[PATTERN_MAX_LENGTH + 1];
+    uint16_t by_end[PATTERN_MAX_MATCHES];
+
+    //The lowercased password and the same reversed, for dictionary matching
+    unsigned char lower[PATTERN_MAX_LENGTH];
+    unsigned char reversed[PATTERN_MAX_LENGTH];
+};
+
+static const char *const type_names[PATTERN_TYPE_COUNT] = {
+    "brute force", "dictionary word", "keyboard walk", "repeat", "sequence", "date", "year"
+};
+
+/**
+ * Letters that can be written as a leet character (zxcvbn's table), each is terminated by '\0'.
+ */
+static const char *const leet_letters[128] = {
+    ['4'] = "a", ['@'] = "a", ['8'] = "b", ['('] = "c", ['{'] = "c", ['['] = "c", ['<'] = "c", ['3'] = "e",
+    ['6'] = "g", ['9'] = "g", ['1'] = "il", ['!'] = "i", ['|'] = "il", ['7'] = "lt", ['0'] = "o", ['$'] = "s",
+    ['5'] = "s", ['+'] = "t", ['%'] = "x", ['2'] = "z",
+};
+
+static double factorials[PATTERN_MAX_LENGTH + 2];
+static double sequence_penalties[PATTERN_MAX_LENGTH + 2];
+static double binomials[PATTERN_MAX_LENGTH + 1][PATTERN_MAX_LENGTH + 1];
+static int reference_year = 2000;
+//Children of the trie root by byte, most walks end in the first levels of the trie
+static uint32_t root_children[256];
+//Scorers of different threads are initialized at the same time, so the tables are built exactly once
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+static void build_tables(void)
+{
+    factorials[0] = 1;
+    sequence_penalties[0] = 0;
+    for (int l = 1; l <= PATTERN_MAX_LENGTH + 1; l++) {
+        factorials[l] = factorials[l - 1] * l;
+        sequence_penalties[l] = pow(MIN_GUESSES_BEFORE_GROWING_SEQUENCE, l - 1);
+    }
+
+    for (int n = 0; n <= PATTERN_MAX_LENGTH; n++) {
+        binomials[n][0] = 1;
+        for (int k = 1; k <= n; k++) {
+            binomials[n][k] = binomials[n - 1][k - 1] + (k < n ? binomials[n - 1][k] : 0);
+        }
+    }
+
+    for (uint32_t i = 0; i < pattern_trie_nodes[0].edge_count; i++) {
+        const struct pattern_trie_edge *edge = &pattern_trie_edges[pattern_trie_nodes[0].first_edge + i];
+        root_children[edge->byte] = edge->child;
+    }
+
+    //Years close to now are the most likely ones
+    time_t now = time(NULL);
+    struct tm local;
+    if (localtime_r(&now, &local) != NULL) {
+        reference_year = local.tm_year + 1900;
+    }
+}
+
+static void prepare_tables(void)
+{
+    pthread_once(&tables_once, build_tables);
+}
+
+/**
+ * @return true on success, false on failure
+ */
+bool pattern_scorer_init(struct pattern_scorer *scorer)
+{
+    prepare_tables();
+    memset(scorer, 0, sizeof(*scorer));
+
+    scorer->matches = malloc(PATTERN_MAX_MATCHES * sizeof(*scorer->matches));
+    scorer->dp = malloc(sizeof(*scorer->dp));
+    if (scorer->matches == NULL || scorer->dp == NULL) {
+        pattern_scorer_free(scorer);
+        fprintf(stderr, "malloc failed\n");
+        return false;
+    }
+    return true;
+}
+
+void pattern_scorer_free(struct pattern_scorer *scorer)
+{
+    free(scorer->matches);
+    free(scorer->dp);
+    scorer->matches = NULL;
+    scorer->dp = NULL;
+}
+
+const char *pattern_type_name(enum pattern_type type)
+{
+    return type_names[type];
+}
+
+/**
+ * @return name of the dictionary or keyboard of the match, NULL for other matches
+ */
+const char *pattern_source_name(const struct pattern_match *match)
+{
+    if (match->type == PATTERN_DICTIONARY) {
+        return pattern_dictionary_names[match->source];
+    }
+    if (match->type == PATTERN_SPATIAL) {
+        return pattern_keyboards[match->source].name;
+    }
+    return NULL;
+}
+
+static struct pattern_match *add_match(struct pattern_scorer *scorer, enum pattern_type type, size_t start, size_t end,
+                                       double guesses)
+{
+    //There can be this many only in long passwords made of short words, the rest is brute forced
+    if (scorer->match_count == PATTERN_MAX_MATCHES) {
+        return NULL;
+    }
+
+    struct pattern_match *match = &scorer->matches[scorer->match_count++];
+    memset(match, 0, sizeof(*match));
+    match->type = type;
+    match->start = (uint16_t) start;
+    match->end = (uint16_t) end;
+    match->guesses = guesses;
+    return match;
+}
+
+static bool is_upper(unsigned char character)
+{
+    return character >= 'A' && character <= 'Z';
+}
+
+static bool is_lower(unsigned char character)
+{
+    return character >= 'a' && character <= 'z';
+}
+
+static bool is_digit(unsigned char character)
+{
+    return character >= '0' && character <= '9';
+}
+
+/**
+ * @return sum of binomial(n, i) for i from 1 to k
+ */
+static double binomial_sum(int n, int k)
+{
+    double sum = 0;
+    for (int i = 1; i <= k; i++) {
+        sum += binomials[n][i];
+    }
+    return sum;
+}
+
+/**
+ * @return how many ways of capitalization of the word are tried before this one, first letter or
+ * last letter or all letters capitalized are tried first
+ */
+static double uppercase_variations(const unsigned char *word, size_t length)
+{
+    int upper = 0;
+    int lower = 0;
+    for (size_t i = 0; i < length; i++) {
+        upper += is_upper(word[i]);
+        lower += is_lower(word[i]);
+    }
+
+    if (upper == 0) {
+        return 1;
+    }
+    if (lower == 0 || (upper == 1 && (is_upper(word[0]) || is_upper(word[length - 1])))) {
+        return 2;
+    }
+    return binomial_sum(upper + lower, upper < lower ? upper : lower);
+}
+
+/**
+ * Dictionary search from one start, the trie is walked along the text and every leet character also
+ * along the letters it stands for.
+ */
+struct word_walk {
+    struct pattern_scorer *scorer;
+    const unsigned char *password;
+    const unsigned char *text;
+    size_t length;
+    size_t start;
+    bool reversed;
+
+    //The letter a leet character was read as at every position, 0 where it was read as itself
+    unsigned char letters[PATTERN_MAX_LENGTH];
+};
+
+/**
+ * @return how many ways of substitution are tried before this one, for every substituted letter it is
+ * the number of ways to choose which of its occurrences are substituted
+ */
+static double l33t_variations(const struct word_walk *walk, size_t end)
+{
+    double variations = 1;
+    bool counted[PATTERN_MAX_LENGTH] = { false };
+
+    for (size_t i = walk->start; i <= end; i++) {
+        if (walk->letters[i] == 0 || counted[i]) {
+            continue;
+        }
+
+        unsigned char subbed = walk->text[i];
+        unsigned char letter = walk->letters[i];
+        int subbed_count = 0;
+        int letter_count = 0;
+        for (size_t j = walk->start; j <= end; j++) {
+            subbed_count += walk->text[j] == subbed;
+            letter_count += walk->text[j] == letter;
+            //Later substitutions of the same character to the same letter are counted now
+            if (walk->letters[j] == letter && walk->text[j] == subbed) {
+                counted[j] = true;
+            }
+        }
+
+        if (letter_count == 0) {
+            variations *= 2;
+        } else {
+            variations *= binomial_sum(subbed_count + letter_count,
+                                       subbed_count < letter_count ? subbed_count : letter_count);
+        }
+    }
+    return variations;
+}
+
+/**
+ * @note Adds the word that ends at end of the text, its guesses are its rank times the variations.
+ */
+static void add_word(struct word_walk *walk, const struct pattern_trie_node *node, size_t end, bool l33t)
+{
+    size_t start = walk->start;
+    if (walk->reversed) {
+        start = walk->length - 1 - end;
+        end = walk->length - 1 - walk->start;
+    }
+
+    double guesses = node->rank * uppercase_variations(walk->password + start, end - start + 1);
+    if (l33t) {
+        guesses *= l33t_variations(walk, walk->reversed ? walk->length - 1 - start : end);
+    }
+    if (walk->reversed) {
+        guesses *= 2;
+    }
+
+    struct pattern_match *match = add_match(walk->scorer, PATTERN_DICTIONARY, start, end, guesses);
+    if (match != NULL) {
+        match->source = node->dictionary;
+        match->rank = node->rank;
+        match->reversed = walk->reversed;
+        match->l33t = l33t;
+    }
+}
+
+/**
+ * @return the child of the node along the byte, 0 if there is none
+ */
+static uint32_t trie_child(uint32_t node, unsigned char byte)
+{
+    if (node == 0) {
+        return root_children[byte];
+    }
+
+    const struct pattern_trie_edge *edge = &pattern_trie_edges[pattern_trie_nodes[node].first_edge];
+    const struct pattern_trie_edge *end = edge + pattern_trie_nodes[node].edge_count;
+
+    for (; edge < end && edge->byte <= byte; edge++) {
+        if (edge->byte == byte) {
+            return edge->child;
+        }
+    }
+    return 0;
+}
+
+static void walk_words(struct word_walk *walk, uint32_t node, size_t position, int substitutions)
+{
+    if (position > walk->start && pattern_trie_nodes[node].rank != 0) {
+        add_word(walk, &pattern_trie_nodes[node], position - 1, substitutions > 0);
+    }
+    if (position == walk->length || pattern_trie_nodes[node].edge_count == 0) {
+        return;
+    }
+
+    unsigned char byte = walk->text[position];
+    uint32_t child = trie_child(node, byte);
+    if (child != 0) {
+        walk->letters[position] = 0;
+        walk_words(walk, child, position + 1, substitutions);
+    }
+
+    const char *letters = byte < 128 ? leet_letters[byte] : NULL;
+    for (; letters != NULL && *letters != '\0'; letters++) {
+        child = trie_child(node, (unsigned char) *letters);
+        if (child != 0) {
+            walk->letters[position] = (unsigned char) *letters;
+            walk_words(walk, child, position + 1, substitutions + 1);
+        }
+    }
+}
+
+static void match_dictionaries(struct pattern_scorer *scorer, const unsigned char *password, size_t length)
+{
+    struct pattern_dp *dp = scorer->dp;
+    for (size_t i = 0; i < length; i++) {
+        dp->lower[i] = is_upper(password[i]) ? (unsigned char) (password[i] - 'A' + 'a') : password[i];
+        dp->reversed[length - 1 - i] = dp->lower[i];
+    }
+
+    struct word_walk walk = { .scorer = scorer, .password = password, .length = length };
+    for (int reversed = 0; reversed < 2; reversed++) {
+        walk.text = reversed ? dp->reversed : dp->lower;
+        walk.reversed = reversed;
+        for (walk.start = 0; walk.start < length; walk.start++) {
+            walk_words(&walk, 0, walk.start, 0);
+        }
+    }
+}
+
+/**
+ * @return guesses of a walk of given length with given turns on the keyboard, the walks with fewer
+ * turns and shorter walks are tried first
+ */
+static double spatial_guesses(const struct pattern_keyboard *keyboard, int length, int turns, int shifted)
+{
+    double guesses = 0;
+    for (int i = 2; i <= length; i++) {
+        int possible_turns = turns < i - 1 ? turns : i - 1;
+        for (int j = 1; j <= possible_turns; j++) {
+            guesses += binomials[i - 1][j - 1] * keyboard->starting_positions * pow(keyboard->average_degree, j);
+        }
+    }
+
+    int unshifted = length - shifted;
+    if (shifted > 0) {
+        guesses *= unshifted == 0 ? 2 : binomial_sum(length, shifted < unshifted ? shifted : unshifted);
+    }
+    return guesses;
+}
+
+/**
+ * @return direction of the key of next from the key of previous, -1 if they are not neighbours
+ */
+static int key_direction(const struct pattern_keyboard *keyboard, unsigned char previous, unsigned char next,
+                         bool *shifted)
+{
+    if (previous < PATTERN_PRINTABLE_FIRST || previous >= PATTERN_PRINTABLE_FIRST + PATTERN_PRINTABLE_COUNT
+        || next < PATTERN_PRINTABLE_FIRST || next >= PATTERN_PRINTABLE_FIRST + PATTERN_PRINTABLE_COUNT) {
+        return -1;
+    }
+
+    int adjacency = keyboard->adjacency[previous - PATTERN_PRINTABLE_FIRST][next - PATTERN_PRINTABLE_FIRST];
+    *shifted = adjacency & 1;
+    return adjacency < 0 ? -1 : adjacency >> 1;
+}
+
+/**
+ * @note Finds runs of at least 3 neighbouring keys on every keyboard.
+ */
+static void match_keyboards(struct pattern_scorer *scorer, const unsigned char *password, size_t length)
+{
+    for (int board = 0; board < pattern_keyboard_count; board++) {
+        const struct pattern_keyboard *keyboard = &pattern_keyboards[board];
+
+        size_t i = 0;
+        while (i + 1 < length) {
+            size_t j = i + 1;
+            int last_direction = -1;
+            int turns = 0;
+            int shifted_count = 0;
+            if (keyboard->shifts && password[i] >= PATTERN_PRINTABLE_FIRST
+                && password[i] < PATTERN_PRINTABLE_FIRST + PATTERN_PRINTABLE_COUNT) {
+                shifted_count = keyboard->shifted[password[i] - PATTERN_PRINTABLE_FIRST];
+            }
+
+            for (; j < length; j++) {
+                bool shifted = false;
+                int direction = key_direction(keyboard, password[j - 1], password[j], &shifted);
+                if (direction < 0) {
+                    break;
+                }
+                shifted_count += shifted && keyboard->shifts;
+                if (direction != last_direction) {
+                    turns++;
+                    last_direction = direction;
+                }
+            }
+
+            if (j - i > 2) {
+                struct pattern_match *match = add_match(scorer, PATTERN_SPATIAL, i, j - 1,
+                                                        spatial_guesses(keyboard, (int) (j - i), turns, shifted_count));
+                if (match != NULL) {
+                    match->source = (uint16_t) board;
+                }
+            }
+            i = j;
+        }
+    }
+}
+
+static void add_sequence(struct pattern_scorer *scorer, const unsigned char *password, size_t start, size_t end,
+                         int delta)
+{
+    if ((end - start <= 1 && abs(delta) != 1) || delta == 0 || abs(delta) > SEQUENCE_MAX_DELTA) {
+        return;
+    }
+
+    //Sequences from the obvious characters are tried first
+    unsigned char first = password[start];
+    double base = 26;
+    if (strchr("aAzZ019", first) != NULL) {
+        base = 4;
+    } else if (is_digit(first)) {
+        base = 10;
+    }
+    if (delta < 0) {
+        base *= 2;
+    }
+    add_match(scorer, PATTERN_SEQUENCE, start, end, base * (double) (end - start + 1));
+}
+
+/**
+ * @note Finds runs of characters with the same difference of codes, like abc, 2468 or zyx.
+ */
+static void match_sequences(struct pattern_scorer *scorer, const unsigned char *password, size_t length)
+{
+    if (length < 2) {
+        return;
+    }
+
+    size_t start = 0;
+    int last_delta = password[1] - password[0];
+    for (size_t k = 2; k < length; k++) {
+        int delta = password[k] - password[k - 1];
+        if (delta == last_delta) {
+            continue;
+        }
+        add_sequence(scorer, password, start, k - 1, last_delta);
+        start = k - 1;
+        last_delta = delta;
+    }
+    add_sequence(scorer, password, start, length - 1, last_delta);
+}
+
+/**
+ * @return guesses of the best match that covers exactly start to end, brute force if there is none
+ */
+static double part_guesses(const struct pattern_scorer *scorer, size_t start, size_t end)
+{
+    double guesses = scorer->dp->bruteforce[end - start + 1];
+    for (size_t i = 0; i < scorer->match_count; i++) {
+        const struct pattern_match *match = &scorer->matches[i];
+        if (match->start == start && match->end == end && match->guesses < guesses) {
+            guesses = match->guesses;
+        }
+    }
+    return guesses;
+}
+
+/**
+ * @note Finds parts repeated at least twice, like aaa or abcabc, the longest repeat from every start
+ * with its shortest base. It must run after the other matchers, the base is guessed as their best match.
+ */
+static void match_repeats(struct pattern_scorer *scorer, const unsigned char *password, size_t length)
+{
+    size_t i = 0;
+    while (i + 1 < length) {
+        size_t best_end = i;
+        size_t best_base = 0;
+
+        for (size_t base = 1; 2 * base <= length - i; base++) {
+            size_t j = i + base;
+            while (j + base <= length && password[j] == password[i] && memcmp(password + i, password + j, base) == 0) {
+                j += base;
+            }
+            if (j - i >= 2 * base && j - 1 > best_end) {
+                best_end = j - 1;
+                best_base = base;
+            }
+        }
+
+        if (best_base == 0) {
+            i++;
+            continue;
+        }
+
+        double repeats = (double) ((best_end - i + 1) / best_base);
+        add_match(scorer, PATTERN_REPEAT, i, best_end, part_guesses(scorer, i, i + best_base - 1) * repeats);
+        i = best_end + 1;
+    }
+}
+
+/**
+ * @return 4 digit year of a 2 digit one
+ */
+static int four_digit_year(int year)
+{
+    if (year > 99) {
+        return year;
+    }
+    return year > 50 ? year + 1900 : year + 2000;
+}
+
+static bool is_day_month(int day, int month)
+{
+    return day >= 1 && day <= 31 && month >= 1 && month <= 12;
+}
+
+/**
+ * @note Reads three numbers as a day, month and year in any order that makes sense.
+ *
+ * @param year The year is stored here.
+ * @return true if the numbers are a date, false otherwise
+ */
+static bool numbers_to_date(const int numbers[3], int *year)
+{
+    if (numbers[1] > 31 || numbers[1] <= 0) {
+        return false;
+    }
+
+    int over_12 = 0;
+    int over_31 = 0;
+    int under_1 = 0;
+    for (int i = 0; i < 3; i++) {
+        if ((numbers[i] > 99 && numbers[i] < DATE_MIN_YEAR) || numbers[i] > DATE_MAX_YEAR) {
+            return false;
+        }
+        over_31 += numbers[i] > 31;
+        over_12 += numbers[i] > 12;
+        under_1 += numbers[i] <= 0;
+    }
+    if (over_31 >= 2 || over_12 == 3 || under_1 >= 2) {
+        return false;
+    }
+
+    //The year is first or last
+    const int splits[2][3] = { { numbers[2], numbers[0], numbers[1] }, { numbers[0], numbers[1], numbers[2] } };
+    for (int i = 0; i < 2; i++) {
+        if (splits[i][0] >= DATE_MIN_YEAR && splits[i][0] <= DATE_MAX_YEAR) {
+            *year = splits[i][0];
+            return is_day_month(splits[i][1], splits[i][2]) || is_day_month(splits[i][2], splits[i][1]);
+        }
+    }
+    for (int i = 0; i < 2; i++) {
+        if (is_day_month(splits[i][1], splits[i][2]) || is_day_month(splits[i][2], splits[i][1])) {
+            *year = four_digit_year(splits[i][0]);
+            return true;
+        }
+    }
+    return false;
+}
+
+static int parse_digits(const unsigned char *digits, size_t length)
+{
+    int number = 0;
+    for (size_t i = 0; i < length; i++) {
+        number = 10 * number + (digits[i] - '0');
+    }
+    return number;
+}
+
+static double date_guesses(int year, bool separator)
+{
+    int year_space = abs(year - reference_year);
+    if (year_space < MIN_YEAR_SPACE) {
+        year_space = MIN_YEAR_SPACE;
+    }
+    return (double) year_space * DAYS_IN_YEAR * (separator ? 4 : 1);
+}
+
+/**
+ * @note Finds dates of 4 to 8 digits without separators, like 1312 or 13121990, and with separators,
+ * like 13.12.1990 or 90/12/13.
+ */
+static void match_dates(struct pattern_scorer *scorer, const unsigned char *password, size_t length)
+{
+    //Where the day, month and year of a date of 4 to 8 digits can be split (zxcvbn's DATE_SPLITS)
+    static const int splits[9][4][2] = {
+        [4] = { { 1, 2 }, { 2, 3 } },
+        [5] = { { 1, 3 }, { 2, 3 } },
+        [6] = { { 1, 2 }, { 2, 4 }, { 4, 5 } },
+        [7] = { { 1, 3 }, { 2, 3 }, { 4, 5 }, { 4, 6 } },
+        [8] = { { 2, 4 }, { 4, 6 } },
+    };
+
+    for (size_t i = 0; i < length; i++) {
+        size_t digits = 0;
+        while (i + digits < length && is_digit(password[i + digits])) {
+            digits++;
+        }
+
+        for (size_t date_length = 4; date_length <= 8 && date_length <= digits; date_length++) {
+            int best_year = 0;
+            bool found = false;
+            for (int split = 0; split < 4 && splits[date_length][split][0] != 0; split++) {
+                size_t first = (size_t) splits[date_length][split][0];
+                size_t second = (size_t) splits[date_length][split][1];
+                int numbers[3] = { parse_digits(password + i, first),
+                                   parse_digits(password + i + first, second - first),
+                                   parse_digits(password + i + second, date_length - second) };
+                int year = 0;
+                if (numbers_to_date(numbers, &year)
+                    && (! found || abs(year - reference_year) < abs(best_year - reference_year))) {
+                    best_year = year;
+                    found = true;
+                }
+            }
+            if (found) {
+                add_match(scorer, PATTERN_DATE, i, i + date_length - 1, date_guesses(best_year, false));
+            }
+        }
+
+        //Day, month and year with the same separator between them
+        if (digits < 1 || digits > 4 || i + digits >= length || strchr(DATE_SEPARATORS, password[i + digits]) == NULL) {
+            continue;
+        }
+        unsigned char separator = password[i + digits];
+        size_t middle = i + digits + 1;
+        size_t middle_digits = 0;
+        while (middle + middle_digits < length && is_digit(password[middle + middle_digits])) {
+            middle_digits++;
+        }
+        size_t last = middle + middle_digits + 1;
+        if (middle_digits < 1 || middle_digits > 2 || last > length || password[last - 1] != separator) {
+            continue;
+        }
+
+        for (size_t last_digits = 1; last_digits <= 4 && last + last_digits <= length
+                                     && is_digit(password[last + last_digits - 1]); last_digits++) {
+            size_t date_length = last + last_digits - i;
+            int numbers[3] = { parse_digits(password + i, digits), parse_digits(password + middle, middle_digits),
+                               parse_digits(password + last, last_digits) };
+            int year = 0;
+            if (date_length >= 6 && date_length <= 10 && numbers_to_date(numbers, &year)) {
+                add_match(scorer, PATTERN_DATE, i, last + last_digits - 1, date_guesses(year, true));
+            }
+        }
+    }
+}
+
+/**
+ * @note Finds years from 1900 to 2099.
+ */
+static void match_years(struct pattern_scorer *scorer, const unsigned char *password, size_t length)
+{
+    for (size_t i = 0; i + 4 <= length; i++) {
+        if (! (is_digit(password[i + 2]) && is_digit(password[i + 3])
+               && ((password[i] == '1' && password[i + 1] == '9') || (password[i] == '2' && password[i + 1] == '0')))) {
+            continue;
+        }
+
+        int year_space = abs(parse_digits(password + i, 4) - reference_year);
+        add_match(scorer, PATTERN_YEAR, i, i + 3, year_space < MIN_YEAR_SPACE ? MIN_YEAR_SPACE : year_space);
+        i += 3;
+    }
+}
+
+/**
+ * @note Adds the sequence that ends with the match (or brute forced part) to the best sequences ending
+ * at end, if no sequence of at most as many matches is better.
+ */
+static void update_sequence(struct pattern_dp *dp, size_t start, size_t end, double guesses, int16_t back,
+                            size_t count)
+{
+    double product = guesses * (count > 1 ? dp->product[start - 1][count - 1] : 1);
+    double total = factorials[count] * product + sequence_penalties[count];
+
+    uint64_t bit = (uint64_t) 1 << (count - 1);
+    for (uint64_t counts = dp->present[end] & (bit | (bit - 1)); counts != 0; counts &= counts - 1) {
+        if (dp->guesses[end][__builtin_ctzll(counts) + 1] <= total) {
+            return;
+        }
+    }
+
+    dp->guesses[end][count] = total;
+    dp->product[end][count] = product;
+    dp->back[end][count] = back;
+    dp->present[end] |= bit;
+    dp->ends_with_match[end] = back >= 0 ? dp->ends_with_match[end] | bit : dp->ends_with_match[end] & ~bit;
+    dp->match_ends = dp->ends_with_match[end] != 0 ? dp->match_ends | (uint64_t) 1 << end
+                                                   : dp->match_ends & ~((uint64_t) 1 << end);
+}
+
+/**
+ * @return guesses of the match, matches shorter than the password are guessed at least a few times
+ */
+static double match_guesses(const struct pattern_match *match, size_t length)
+{
+    size_t match_length = (size_t) (match->end - match->start + 1);
+    if (match_length == length) {
+        return match->guesses;
+    }
+
+    double min_guesses = match_length == 1 ? MIN_SUBMATCH_GUESSES_SINGLE_CHAR : MIN_SUBMATCH_GUESSES_MULTI_CHAR;
+    return match->guesses > min_guesses ? match->guesses : min_guesses;
+}
+
+/**
+ * @note Finds the sequence of matches and brute forced parts with the fewest guesses, zxcvbn's
+ * most_guessable_match_sequence, and stores it to the scorer.
+ *
+ * @return guesses of the best sequence
+ */
+static double best_sequence(struct pattern_scorer *scorer, size_t length)
+{
+    struct pattern_dp *dp = scorer->dp;
+
+    memset(dp->first_by_end, 0, sizeof(dp->first_by_end));
+    for (size_t i = 0; i < scorer->match_count; i++) {
+        dp->first_by_end[scorer->matches[i].end + 1]++;
+    }
+    for (size_t k = 0; k < length; k++) {
+        dp->first_by_end[k + 1] += dp->first_by_end[k];
+    }
+    uint16_t filled[PATTERN_MAX_LENGTH];
+    memcpy(filled, dp->first_by_end, sizeof(filled));
+    for (size_t i = 0; i < scorer->match_count; i++) {
+        dp->by_end[filled[scorer->matches[i].end]++] = (uint16_t) i;
+    }
+
+    dp->match_ends = 0;
+    for (size_t k = 0; k < length; k++) {
+        dp->present[k] = 0;
+        dp->ends_with_match[k] = 0;
+
+        for (size_t i = dp->first_by_end[k]; i < dp->first_by_end[k + 1]; i++) {
+            const struct pattern_match *match = &scorer->matches[dp->by_end[i]];
+            double guesses = match_guesses(match, length);
+
+            if (match->start == 0) {
+                update_sequence(dp, 0, k, guesses, (int16_t) dp->by_end[i], 1);
+                continue;
+            }
+            for (uint64_t counts = dp->present[match->start - 1]; counts != 0; counts &= counts - 1) {
+                size_t l = (size_t) __builtin_ctzll(counts) + 1;
+                update_sequence(dp, match->start, k, guesses, (int16_t) dp->by_end[i], l + 1);
+            }
+        }
+
+        //Brute forced parts, but never right after another one, they would be one part
+        update_sequence(dp, 0, k, dp->bruteforce[k + 1], BRUTEFORCE_BACK(0), 1);
+        for (uint64_t ends = dp->match_ends & (((uint64_t) 1 << k) - 1); ends != 0; ends &= ends - 1) {
+            size_t start = (size_t) __builtin_ctzll(ends) + 1;
+            for (uint64_t counts = dp->ends_with_match[start - 1]; counts != 0; counts &= counts - 1) {
+                size_t l = (size_t) __builtin_ctzll(counts) + 1;
+                update_sequence(dp, start, k, dp->bruteforce[k - start + 1], BRUTEFORCE_BACK(start), l + 1);
+            }
+        }
+    }
+
+    size_t count = 1;
+    for (uint64_t counts = dp->present[length - 1]; counts != 0; counts &= counts - 1) {
+        size_t l = (size_t) __builtin_ctzll(counts) + 1;
+        if (dp->guesses[length - 1][l] < dp->guesses[length - 1][count]) {
+            count = l;
+        }
+    }
+    double guesses = dp->guesses[length - 1][count];
+
+    scorer->sequence_length = count;
+    size_t end = length - 1;
+    for (size_t l = count; l > 0; l--) {
+        struct pattern_match *match = &scorer->sequence[l - 1];
+        int16_t back = dp->back[end][l];
+
+        if (back >= 0) {
+            *match = scorer->matches[back];
+            match->guesses = match_guesses(match, length);
+        } else {
+            memset(match, 0, sizeof(*match));
+            match->type = PATTERN_BRUTEFORCE;
+            match->start = (uint16_t) (-1 - back);
+            match->end = (uint16_t) end;
+            match->guesses = dp->bruteforce[end - match->start + 1];
+        }
+        end = match->start - 1;
+    }
+    return guesses;
+}
+
+/**
+ * @note The matches of the password are stored in scorer->sequence. Only the first PATTERN_MAX_LENGTH bytes
+ * of the password are read, the rest is brute forced, so a longer password may be given just by its start.
+ *
+ * @param length Length of the whole password.
+ * @param classes Character classes used in the password (strength_classes), they give the cost of brute force.
+ * @return entropy of the password in bits, log2 of the guesses needed to find it
+ */
+double pattern_entropy(struct pattern_scorer *scorer, const char *password, size_t length, unsigned classes)
+{
+    scorer->match_count = 0;
+    scorer->sequence_length = 0;
+    if (length == 0) {
+        return 0;
+    }
+
+    size_t searched = length < PATTERN_MAX_LENGTH ? length : PATTERN_MAX_LENGTH;
+    const unsigned char *bytes = (const unsigned char *) password;
+    struct pattern_dp *dp = scorer->dp;
+
+    double cardinality = exp2(strength_entropy(classes, 1));
+    dp->bruteforce[0] = 1;
+    for (size_t i = 1; i <= searched; i++) {
+        dp->bruteforce[i] = dp->bruteforce[i - 1] * cardinality;
+    }
+    for (size_t i = 1; i < searched; i++) {
+        double min_guesses = (i == 1 ? MIN_SUBMATCH_GUESSES_SINGLE_CHAR : MIN_SUBMATCH_GUESSES_MULTI_CHAR) + 1;
+        if (dp->bruteforce[i] < min_guesses) {
+            dp->bruteforce[i] = min_guesses;
+        }
+    }
+
+    match_dictionaries(scorer, bytes, searched);
+    match_keyboards(scorer, bytes, searched);
+    match_sequences(scorer, bytes, searched);
+    match_dates(scorer, bytes, searched);
+    match_years(scorer, bytes, searched);
+    match_repeats(scorer, bytes, searched);
+
+    double entropy = log2(best_sequence(scorer, searched));
+    OPENSSL_cleanse(dp->lower, sizeof(dp->lower));
+    OPENSSL_cleanse(dp->reversed, sizeof(dp->reversed));
+
+    return entropy + strength_entropy(classes, length - searched);
+}
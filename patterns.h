@@ -0,0 +1,65 @@
+#ifndef PASSWORD_GENERATOR_PATTERNS_H
+#define PASSWORD_GENERATOR_PATTERNS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Pattern aware strength estimate in the way of zxcvbn. All dictionary words (also reversed and with leet
+ * substitutions), keyboard walks, repeats, sequences, dates and years of the password are found, every match
+ * gets a number of guesses an attacker needs to find it, and dynamic programming picks the sequence
+ * of matches and brute forced parts that covers the password with the fewest guesses. A brute forced
+ * character costs the character range of the whole password, so a password without patterns gets the same
+ * entropy as before.
+ *
+ * Only the first PATTERN_MAX_LENGTH characters are searched for patterns, the rest is brute forced.
+ */
+#define PATTERN_MAX_LENGTH 64
+#define PATTERN_MAX_MATCHES 1024
+
+enum pattern_type {
+    PATTERN_BRUTEFORCE,
+    PATTERN_DICTIONARY,
+    PATTERN_SPATIAL,
+    PATTERN_REPEAT,
+    PATTERN_SEQUENCE,
+    PATTERN_DATE,
+    PATTERN_YEAR,
+    PATTERN_TYPE_COUNT
+};
+
+struct pattern_match {
+    enum pattern_type type;
+    //First and last byte of the match in the password
+    uint16_t start;
+    uint16_t end;
+    double guesses;
+
+    //Dictionary (PATTERN_DICTIONARY) or keyboard (PATTERN_SPATIAL) of the match
+    uint16_t source;
+    uint32_t rank;
+    bool reversed;
+    bool l33t;
+};
+
+//Tables of the dynamic programming, they are too big for the stack
+struct pattern_dp;
+
+struct pattern_scorer {
+    struct pattern_match *matches;
+    size_t match_count;
+    struct pattern_dp *dp;
+
+    //Matches of the last scored password from its start, brute forced parts included
+    struct pattern_match sequence[PATTERN_MAX_LENGTH];
+    size_t sequence_length;
+};
+
+bool pattern_scorer_init(struct pattern_scorer *scorer);
+void pattern_scorer_free(struct pattern_scorer *scorer);
+double pattern_entropy(struct pattern_scorer *scorer, const char *password, size_t length, unsigned classes);
+const char *pattern_type_name(enum pattern_type type);
+const char *pattern_source_name(const struct pattern_match *match);
+
+#endif //PASSWORD_GENERATOR_PATTERNS_H
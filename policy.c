@@ -0,0 +1,536 @@
+#include "policy.h"
+#include "strength.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/crypto.h>
+
+static unsigned character_class(char chr)
+{
+    if (chr >= 'a' && chr <= 'z') {
+        return STRENGTH_LOWER;
+    }
+    if (chr >= 'A' && chr <= 'Z') {
+        return STRENGTH_UPPER;
+    }
+    if (chr >= '0' && chr <= '9') {
+        return STRENGTH_DIGIT;
+    }
+    return STRENGTH_SPECIAL;
+}
+
+/**
+ * @return true if next can't follow previous in a password of the policy
+ */
+static bool is_forbidden(const struct password_policy *policy, char previous, char next)
+{
+    if (policy->no_repeats && previous == next) {
+        return true;
+    }
+    return policy->no_sequences && (next == previous + 1 || next == previous - 1)
+           && character_class(previous) != STRENGTH_SPECIAL && character_class(previous) == character_class(next);
+}
+
+/**
+ * @return true if the policy has any rule
+ */
+bool password_policy_active(const struct password_policy *policy)
+{
+    return policy->required != 0 || policy->no_repeats || policy->no_sequences;
+}
+
+/**
+ * @param text Comma separated classes: lower, upper, digit and special, or all for all of them.
+ * @param classes The classes are stored here.
+ * @return true if text is a valid list, false otherwise
+ */
+bool password_policy_parse_classes(const char *text, unsigned *classes)
+{
+    static const struct {
+        const char *name;
+        unsigned classes;
+    } names[] = {
+        { "lower", STRENGTH_LOWER },
+        { "upper", STRENGTH_UPPER },
+        { "digit", STRENGTH_DIGIT },
+        { "special", STRENGTH_SPECIAL },
+        { "all", STRENGTH_LOWER | STRENGTH_UPPER | STRENGTH_DIGIT | STRENGTH_SPECIAL },
+    };
+
+    *classes = 0;
+    while (true) {
+        size_t length = strcspn(text, ",");
+        bool found = false;
+        for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+            if (strlen(names[i].name) == length && strncmp(text, names[i].name, length) == 0) {
+                *classes |= names[i].classes;
+                found = true;
+            }
+        }
+        if (! found) {
+            return false;
+        }
+        if (text[length] == '\0') {
+            return true;
+        }
+        text += length + 1;
+    }
+}
+
+/**
+ * @note Checks a password against the policy the slow way, used to test the generator and by the retry
+ * based generation in the benchmark.
+ *
+ * @return true if the password follows all rules of the policy
+ */
+bool password_policy_allows(const struct password_policy *policy, const char *password, size_t length)
+{
+    unsigned classes = 0;
+    for (size_t i = 0; i < length; i++) {
+        classes |= character_class(password[i]);
+        if (i > 0 && is_forbidden(policy, password[i - 1], password[i])) {
+            return false;
+        }
+    }
+    return (classes & policy->required) == policy->required;
+}
+
+static bool big_less(const uint64_t *a, const uint64_t *b, size_t limbs)
+{
+    for (size_t i = limbs; i-- > 0;) {
+        if (a[i] != b[i]) {
+            return a[i] < b[i];
+        }
+    }
+    return false;
+}
+
+static void big_add(uint64_t *a, const uint64_t *b, size_t limbs)
+{
+    uint64_t carry = 0;
+    for (size_t i = 0; i < limbs; i++) {
+        uint64_t sum = a[i] + carry;
+        carry = sum < carry;
+        a[i] = sum + b[i];
+        carry += a[i] < sum;
+    }
+}
+
+static void big_sub(uint64_t *a, const uint64_t *b, size_t limbs)
+{
+    uint64_t borrow = 0;
+    for (size_t i = 0; i < limbs; i++) {
+        uint64_t difference = a[i] - b[i] - borrow;
+        borrow = a[i] < b[i] || (a[i] == b[i] && borrow);
+        a[i] = difference;
+    }
+}
+
+static void big_sum(uint64_t *sum, const uint64_t *a, const uint64_t *b, size_t limbs)
+{
+    memcpy(sum, a, limbs * sizeof(*sum));
+    big_add(sum, b, limbs);
+}
+
+/**
+ * @return row of the prefix sums of the characters that can come with left characters after them when
+ * the classes missing are still missing before them
+ */
+static uint64_t *row_of(const struct policy_generator *generator, size_t left, unsigned missing)
+{
+    return generator->prefixes + generator->row_start[left]
+           + missing * (generator->size + 1) * generator->row_limbs[left];
+}
+
+/**
+ * @note Copies a number to a number with more limbs.
+ */
+static void widen(uint64_t *wide, size_t wide_limbs, const uint64_t *number, size_t limbs)
+{
+    memcpy(wide, number, limbs * sizeof(*wide));
+    memset(wide + limbs, 0, (wide_limbs - limbs) * sizeof(*wide));
+}
+
+/**
+ * @note Takes the number of all compliant passwords from the last prefix sum of the first row.
+ */
+static void take_total(struct policy_generator *generator)
+{
+    size_t limbs = generator->limbs;
+    widen(generator->total, POLICY_MAX_LIMBS,
+          row_of(generator, generator->length - 1, generator->policy.required) + generator->size * limbs, limbs);
+
+    generator->total_bits = 0;
+    for (size_t i = limbs; i-- > 0;) {
+        if (generator->total[i] != 0) {
+            generator->total_bits = 64 * i + 64 - __builtin_clzll(generator->total[i]);
+            break;
+        }
+    }
+}
+
+/**
+ * @note Fills the rows from the last character of the password to the first one. The number of ways to
+ * finish a password after character c is the number of ways after any character (the last prefix sum of a row),
+ * minus the ways after the characters that can't follow c, so every count costs at most
+ * POLICY_MAX_FORBIDDEN + 1 operations.
+ */
+static void count_passwords(struct policy_generator *generator, uint64_t *after)
+{
+    size_t size = (size_t) generator->size;
+    unsigned required = generator->policy.required;
+    uint64_t count[POLICY_MAX_LIMBS];
+
+    //The last character ends the password, it is a way to finish it if no class is missing after it
+    size_t limbs = generator->row_limbs[0];
+    for (unsigned missing = 0; missing < STRENGTH_CLASS_MASKS; missing++) {
+        uint64_t *row = row_of(generator, 0, missing);
+        memset(row, 0, (size + 1) * limbs * sizeof(*row));
+        for (size_t chr = 0; chr < size; chr++) {
+            memcpy(row + (chr + 1) * limbs, row + chr * limbs, limbs * sizeof(*row));
+            row[(chr + 1) * limbs] += (missing & ~generator->classes[chr]) == 0;
+        }
+    }
+
+    for (size_t left = 0; left + 1 < generator->length; left++) {
+        limbs = generator->row_limbs[left];
+        size_t next_limbs = generator->row_limbs[left + 1];
+
+        //after[missing][c] is the number of ways to finish the password after c with left + 1 characters left
+        for (unsigned missing = 0; missing < STRENGTH_CLASS_MASKS; missing++) {
+            if ((missing & ~required) != 0) {
+                continue;
+            }
+            const uint64_t *row = row_of(generator, left, missing);
+            for (size_t chr = 0; chr < size; chr++) {
+                uint64_t *ways = after + (missing * size + chr) * next_limbs;
+                widen(ways, next_limbs, row + size * limbs, limbs);
+                for (int i = 0; i < POLICY_MAX_FORBIDDEN && generator->forbidden[chr][i] >= 0; i++) {
+                    int next = generator->forbidden[chr][i];
+                    widen(count, next_limbs, row + (next + 1) * limbs, limbs);
+                    big_sub(ways, count, next_limbs);
+                    widen(count, next_limbs, row + next * limbs, limbs);
+                    big_add(ways, count, next_limbs);
+                }
+            }
+        }
+
+        for (unsigned missing = 0; missing < STRENGTH_CLASS_MASKS; missing++) {
+            if ((missing & ~required) != 0) {
+                continue;
+            }
+            uint64_t *row = row_of(generator, left + 1, missing);
+            memset(row, 0, next_limbs * sizeof(*row));
+            for (size_t chr = 0; chr < size; chr++) {
+                big_sum(row + (chr + 1) * next_limbs, row + chr * next_limbs,
+                        after + ((missing & ~generator->classes[chr]) * size + chr) * next_limbs, next_limbs);
+            }
+        }
+    }
+
+    take_total(generator);
+    OPENSSL_cleanse(count, sizeof(count));
+}
+
+/**
+ * @note Retries by the mapping if few random passwords are expected per compliant one, the single pass is
+ * several times slower than one random password.
+ *
+ * @return true on success, false on failure
+ */
+static bool choose_method(struct policy_generator *generator)
+{
+    generator->retry = policy_expected_tries(generator) <= POLICY_RETRY_TRIES;
+    if (generator->retry && ! char_mapping_init(&generator->mapping, generator->pool, generator->size - 1)) {
+        policy_generator_free(generator);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @note Fills everything of the generator except the prefixes: the pool with the classes and forbidden
+ * neighbours of its characters and the layout of the prefix rows.
+ *
+ * @return true on success, false on failure (the reason is printed)
+ */
+static bool prepare_generator(struct policy_generator *generator, const struct password_policy *policy,
+                              const char *character_pool, int char_pool_end_index, size_t length)
+{
+    if (length == 0 || length > POLICY_MAX_LENGTH) {
+        fprintf(stderr, "Rules can be used only for passwords with at most %d characters.\n", POLICY_MAX_LENGTH);
+        return false;
+    }
+    if (char_pool_end_index < 0) {
+        fprintf(stderr, "You excluded all characters.\n");
+        return false;
+    }
+
+    generator->policy = *policy;
+    generator->length = length;
+    generator->prefixes = NULL;
+    generator->mapped = false;
+    generator->size = char_pool_end_index + 1;
+
+    unsigned available = 0;
+    for (int chr = 0; chr < generator->size; chr++) {
+        generator->pool[chr] = character_pool[chr];
+        generator->classes[chr] = character_class(character_pool[chr]);
+        available |= generator->classes[chr];
+
+        int forbidden = 0;
+        for (int next = 0; next < generator->size; next++) {
+            if (is_forbidden(policy, character_pool[chr], character_pool[next])) {
+                generator->forbidden[chr][forbidden++] = next;
+            }
+        }
+        for (; forbidden < POLICY_MAX_FORBIDDEN; forbidden++) {
+            generator->forbidden[chr][forbidden] = -1;
+        }
+    }
+
+    if ((policy->required & available) != policy->required) {
+        fprintf(stderr, "Some required kinds of characters were all excluded.\n");
+        return false;
+    }
+
+    //Counts with left characters after them are below size^(left + 1), one more bit leaves room for the sums
+    generator->table_size = 0;
+    for (size_t left = 0; left < length; left++) {
+        double bits = (double) (left + 1) * log2(generator->size) + 1;
+        generator->row_limbs[left] = (size_t) (bits / 64) + 1;
+        generator->row_start[left] = generator->table_size;
+        generator->table_size += STRENGTH_CLASS_MASKS * (generator->size + 1) * generator->row_limbs[left];
+    }
+    generator->limbs = generator->row_limbs[length - 1];
+    return true;
+}
+
+/**
+ * @note Counts all compliant passwords, so the generator can pick them uniformly.
+ *
+ * @param generator Generator to be initialized. Free it with policy_generator_free.
+ * @param policy Rules of the passwords.
+ * @param character_pool Pool built by build_character_pool.
+ * @param char_pool_end_index Index of the last character of the pool.
+ * @param length Length of the passwords, at most POLICY_MAX_LENGTH.
+ * @return true on success, false on failure (the reason is printed)
+ */
+bool policy_generator_init(struct policy_generator *generator, const struct password_policy *policy,
+                           const char *character_pool, int char_pool_end_index, size_t length)
+{
+    if (! prepare_generator(generator, policy, character_pool, char_pool_end_index, length)) {
+        return false;
+    }
+
+    generator->prefixes = malloc(generator->table_size * sizeof(*generator->prefixes));
+    uint64_t *after = malloc(STRENGTH_CLASS_MASKS * generator->size * generator->limbs * sizeof(*after));
+    if (generator->prefixes == NULL || after == NULL) {
+        free(generator->prefixes);
+        free(after);
+        generator->prefixes = NULL;
+        fprintf(stderr, "malloc failed\n");
+        return false;
+    }
+
+    count_passwords(generator, after);
+    free(after);
+
+    if (generator->total_bits == 0) {
+        fprintf(stderr, "No password can follow these rules.\n");
+        policy_generator_free(generator);
+        return false;
+    }
+    return choose_method(generator);
+}
+
+/**
+ * @note Like policy_generator_init, but the prefixes are not counted. They are taken from a table counted
+ * by policy_generator_init of the same rules, pool and length before, like the ones in a mapped profile cache
+ * (profiles.h). The table is not freed by policy_generator_free. Everything else is built again, only the counts
+ * are taken from the table, so a damaged table can't make the generator read outside of it.
+ *
+ * @param table_size Number of limbs in prefixes.
+ * @return true on success, false if the table does not fit the generator or on failure
+ */
+bool policy_generator_map(struct policy_generator *generator, const struct password_policy *policy,
+                          const char *character_pool, int char_pool_end_index, size_t length, uint64_t *prefixes,
+                          size_t table_size)
+{
+    if (! prepare_generator(generator, policy, character_pool, char_pool_end_index, length)
+        || table_size != generator->table_size) {
+        return false;
+    }
+
+    generator->prefixes = prefixes;
+    generator->mapped = true;
+    take_total(generator);
+    return generator->total_bits != 0 && choose_method(generator);
+}
+
+void policy_generator_free(struct policy_generator *generator)
+{
+    if (! generator->mapped) {
+        free(generator->prefixes);
+    }
+    generator->prefixes = NULL;
+}
+
+/**
+ * @return entropy of the passwords in bits, log2 of the number of compliant passwords
+ */
+double policy_entropy(const struct policy_generator *generator)
+{
+    size_t top = (generator->total_bits - 1) / 64;
+    double value = (double) generator->total[top];
+    if (top > 0) {
+        value += ldexp((double) generator->total[top - 1], -64);
+    }
+    return log2(value) + 64.0 * (double) top;
+}
+
+/**
+ * @return how many random passwords of the pool are generated on average until one follows the rules
+ */
+double policy_expected_tries(const struct policy_generator *generator)
+{
+    return exp2((double) generator->length * log2(generator->size) - policy_entropy(generator));
+}
+
+/**
+ * @note Picks a uniformly random number below the number of compliant passwords. Random numbers with
+ * the bit length of the count are rejected while they are too big, which happens less than half of the time.
+ */
+static bool pick_rank(const struct policy_generator *generator, struct random_pool *pool, uint64_t *rank)
+{
+    size_t bytes = (generator->total_bits + 7) / 8;
+    unsigned top_bits = generator->total_bits % 8;
+
+    do {
+        const unsigned char *random_bytes = random_pool_take(pool, bytes);
+        if (random_bytes == NULL) {
+            return false;
+        }
+        memset(rank, 0, generator->limbs * sizeof(*rank));
+        for (size_t i = 0; i < bytes; i++) {
+            unsigned char byte = random_bytes[i];
+            if (i + 1 == bytes && top_bits != 0) {
+                byte &= (unsigned char) ((1u << top_bits) - 1);
+            }
+            rank[i / 8] |= (uint64_t) byte << (8 * (i % 8));
+        }
+    } while (! big_less(rank, generator->total, generator->limbs));
+    return true;
+}
+
+/**
+ * @note Finds the character at the rank in the row and leaves the rank of the password among those with this
+ * character. Characters that can't follow the previous one take no ranks, so with shifted[i] the rank plus the counts
+ * of the first i forbidden characters, the character is the first one whose prefix sum after it is bigger than
+ * shifted[forbidden characters before it]. It is found by binary search, shifted is scratch memory of the caller.
+ */
+static int find_character(const struct policy_generator *generator, size_t left, unsigned missing,
+                          const int *forbidden, uint64_t *rank, uint64_t (*shifted)[POLICY_MAX_LIMBS])
+{
+    //The rank is below the last prefix sum of the row, so its higher limbs are zero
+    size_t limbs = generator->row_limbs[left];
+    const uint64_t *row = row_of(generator, left, missing);
+
+    memcpy(shifted[0], rank, limbs * sizeof(*rank));
+    int forbidden_count = 0;
+    for (; forbidden_count < POLICY_MAX_FORBIDDEN && forbidden[forbidden_count] >= 0; forbidden_count++) {
+        int chr = forbidden[forbidden_count];
+        big_sum(shifted[forbidden_count + 1], shifted[forbidden_count], row + (chr + 1) * limbs, limbs);
+        big_sub(shifted[forbidden_count + 1], row + chr * limbs, limbs);
+    }
+
+    int low = 0;
+    int high = generator->size - 1;
+    while (low < high) {
+        int middle = (low + high) / 2;
+        int before = 0;
+        while (before < forbidden_count && forbidden[before] <= middle) {
+            before++;
+        }
+        if (big_less(shifted[before], row + (middle + 1) * limbs, limbs)) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+
+    int before = 0;
+    while (before < forbidden_count && forbidden[before] < low) {
+        before++;
+    }
+    memcpy(rank, shifted[before], limbs * sizeof(*rank));
+    big_sub(rank, row + low * limbs, limbs);
+    return low;
+}
+
+/**
+ * @note Writes one compliant password of generator->length characters to output (without a newline).
+ * Random passwords are generated until one complies if the generator retries, otherwise the rank is the number
+ * of compliant passwords before the generated one and the characters are in pool order.
+ *
+ * @return true on success, false on failure
+ */
+bool policy_generate(const struct policy_generator *generator, struct random_pool *pool, char *output)
+{
+    if (generator->retry) {
+        do {
+            if (! char_mapping_generate(&generator->mapping, pool, output, generator->length)) {
+                return false;
+            }
+        } while (! password_policy_allows(&generator->policy, output, generator->length));
+        return true;
+    }
+
+    static const int none[POLICY_MAX_FORBIDDEN] = { -1, -1, -1 };
+    uint64_t rank[POLICY_MAX_LIMBS];
+    uint64_t shifted[POLICY_MAX_FORBIDDEN + 1][POLICY_MAX_LIMBS];
+    if (! pick_rank(generator, pool, rank)) {
+        return false;
+    }
+
+    unsigned missing = generator->policy.required;
+    const int *forbidden = none;
+
+    for (size_t position = 0; position < generator->length; position++) {
+        int chr = find_character(generator, generator->length - position - 1, missing, forbidden, rank, shifted);
+
+        output[position] = generator->pool[chr];
+        missing &= ~generator->classes[chr];
+        forbidden = generator->forbidden[chr];
+    }
+
+    OPENSSL_cleanse(rank, sizeof(rank));
+    OPENSSL_cleanse(shifted, sizeof(shifted));
+    return true;
+}
+
+/**
+ * @note Fills output with count compliant passwords, each on its own line.
+ *
+ * @param output Capacity of at least count * (generator->length + 1) characters.
+ * @param used Number of written characters is stored here.
+ * @return true on success, false on failure
+ */
+bool policy_generate_lines(const struct policy_generator *generator, struct random_pool *pool, char *output,
+                           size_t count, size_t *used)
+{
+    size_t line_length = generator->length + 1;
+    for (size_t line = 0; line < count; line++) {
+        if (! policy_generate(generator, pool, output + line * line_length)) {
+            OPENSSL_cleanse(output, line * line_length);
+            return false;
+        }
+        output[line * line_length + generator->length] = '\n';
+    }
+
+    *used = count * line_length;
+    return true;
+}
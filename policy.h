@@ -0,0 +1,85 @@
+#ifndef PASSWORD_GENERATOR_POLICY_H
+#define PASSWORD_GENERATOR_POLICY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "character_pool.h"
+#include "char_mapping.h"
+#include "random_pool.h"
+
+/**
+ * Rules a password has to follow. Classes are the STRENGTH_UPPER, STRENGTH_LOWER, STRENGTH_DIGIT and STRENGTH_SPECIAL
+ * bits of strength.h. A repeat is the same character twice in a row (aa), a sequence is two neighbouring letters
+ * of the same case or digits in a row (ab, ba, 12, 21).
+ */
+struct password_policy {
+    unsigned required;
+    bool no_repeats;
+    bool no_sequences;
+};
+
+/**
+ * Compliant passwords are generated in a single pass without retries. The generator counts how many compliant
+ * passwords there are (N), picks one uniformly random number r < N and writes the r-th compliant password,
+ * one character after another. prefixes[k][missing] is a row of prefix sums over the pool: the i-th sum is
+ * the number of ways to finish a password by one of the first i characters followed by k more characters, when
+ * the classes missing are still missing. Every compliant password is then exactly equally likely, the entropy
+ * is exactly log2(N) and a character is found in its row by binary search.
+ *
+ * The counts are exact integers of up to POLICY_MAX_LIMBS 64 bit limbs, which limits the length of the passwords.
+ *
+ * When a random password of the pool follows the rules often enough (POLICY_RETRY_TRIES random passwords or fewer
+ * per compliant one are expected), generating random passwords until one complies is faster than the single pass.
+ * Such generators retry by their mapping instead, which is just as uniform.
+ */
+#define POLICY_MAX_LENGTH 64
+#define POLICY_MAX_LIMBS 8
+#define POLICY_MAX_FORBIDDEN 3
+#define POLICY_RETRY_TRIES 8
+
+struct policy_generator {
+    struct password_policy policy;
+    size_t length;
+
+    char pool[CHAR_POOL_LENGTH];
+    unsigned classes[CHAR_POOL_LENGTH];
+    int size;
+    //Pool indexes of characters that can't follow a character in ascending order, -1 for none
+    int forbidden[CHAR_POOL_LENGTH][POLICY_MAX_FORBIDDEN];
+
+    //Rows of counts with left characters after them have row_limbs[left] limbs and start at row_start[left]
+    size_t row_limbs[POLICY_MAX_LENGTH];
+    size_t row_start[POLICY_MAX_LENGTH];
+    size_t limbs;
+    //Limbs of all rows
+    size_t table_size;
+    uint64_t *prefixes;
+    //The prefixes are in a mapped profile cache (profiles.h) and are not freed
+    bool mapped;
+    uint64_t total[POLICY_MAX_LIMBS];
+    size_t total_bits;
+
+    //Passwords are generated by the mapping until one complies instead of in a single pass
+    bool retry;
+    struct char_mapping mapping;
+};
+
+bool password_policy_active(const struct password_policy *policy);
+bool password_policy_parse_classes(const char *text, unsigned *classes);
+bool password_policy_allows(const struct password_policy *policy, const char *password, size_t length);
+
+bool policy_generator_init(struct policy_generator *generator, const struct password_policy *policy,
+                           const char *character_pool, int char_pool_end_index, size_t length);
+bool policy_generator_map(struct policy_generator *generator, const struct password_policy *policy,
+                          const char *character_pool, int char_pool_end_index, size_t length, uint64_t *prefixes,
+                          size_t table_size);
+void policy_generator_free(struct policy_generator *generator);
+double policy_expected_tries(const struct policy_generator *generator);
+double policy_entropy(const struct policy_generator *generator);
+bool policy_generate(const struct policy_generator *generator, struct random_pool *pool, char *output);
+bool policy_generate_lines(const struct policy_generator *generator, struct random_pool *pool, char *output,
+                           size_t count, size_t *used);
+
+#endif //PASSWORD_GENERATOR_POLICY_H
@@ -0,0 +1,598 @@
+#include "profiles.h"
+#include "character_pool.h"
+#include "strength.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <openssl/evp.h>
+
+#define PROFILES_MAX_FILE_SIZE (1 << 20)
+#define PROFILES_DIGEST_SIZE 32
+
+/**
+ * Settings of one profile as they are written in the profiles file.
+ */
+struct profile_settings {
+    char name[PROFILE_MAX_NAME + 1];
+    size_t line;
+    long length;
+    char excluded[CHAR_POOL_LENGTH + 1];
+    struct password_policy policy;
+    long words;
+    char separator[PASSPHRASE_MAX_SEPARATOR + 1];
+};
+
+/**
+ * Layout of the cache, in the byte order of the build that wrote it:
+ *
+ * header       struct cache_header
+ * tables       count struct cached_table records, one for every profile in the order of the profiles file
+ * prefixes     prefixes of the policy profiles, each at its offset (a multiple of 8)
+ *
+ * Only the prefixes are cached. Everything else is compiled from the profiles file again on load, which is fast,
+ * so nothing in the cache is used as an index and a damaged cache can't make a generator read outside of it.
+ */
+struct cache_header {
+    char magic[PROFILES_CACHE_MAGIC_LENGTH];
+    uint32_t record_size;
+    uint32_t count;
+    unsigned char digest[PROFILES_DIGEST_SIZE];
+};
+
+struct cached_table {
+    uint64_t offset;
+    //Number of limbs, 0 for profiles without rules
+    uint64_t size;
+};
+
+/**
+ * @note Points the line generator of the profile to the profile, it has to be done whenever the profile is placed
+ * in memory.
+ */
+static void connect_generator(struct profile *profile)
+{
+    switch (profile->kind) {
+        case PROFILE_CHARACTERS:
+            profile->lines.mapping = &profile->mapping;
+            line_generator_characters(&profile->generator, &profile->lines);
+            break;
+        case PROFILE_POLICY:
+            line_generator_policy(&profile->generator, &profile->policy);
+            break;
+        case PROFILE_PASSPHRASE:
+            line_generator_passphrases(&profile->generator, &profile->format);
+            break;
+    }
+}
+
+/**
+ * @note Reads the whole profiles file to a new buffer, which is terminated by zero.
+ *
+ * @return true on success, false on failure
+ */
+static bool read_profiles_file(const char *path, char **text, size_t *size)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "failed to open %s\n", path);
+        return false;
+    }
+
+    *text = malloc(PROFILES_MAX_FILE_SIZE + 1);
+    if (*text == NULL) {
+        fclose(file);
+        fprintf(stderr, "malloc failed\n");
+        return false;
+    }
+
+    *size = fread(*text, sizeof(char), PROFILES_MAX_FILE_SIZE + 1, file);
+    bool result = ! ferror(file);
+    fclose(file);
+
+    if (! result) {
+        fprintf(stderr, "failed to read %s\n", path);
+    } else if (*size > PROFILES_MAX_FILE_SIZE) {
+        fprintf(stderr, "%s is larger than 1 MiB\n", path);
+        result = false;
+    }
+    if (! result) {
+        free(*text);
+        return false;
+    }
+    (*text)[*size] = '\0';
+    return true;
+}
+
+static bool digest_text(const char *text, size_t size, unsigned char *digest)
+{
+    if (EVP_Digest(text, size, digest, NULL, EVP_sha256(), NULL) != 1) {
+        fprintf(stderr, "failed to compute SHA-256\n");
+        return false;
+    }
+    return true;
+}
+
+static char *trim(char *text)
+{
+    while (*text == ' ' || *text == '\t') {
+        text++;
+    }
+    size_t length = strlen(text);
+    while (length > 0 && (text[length - 1] == ' ' || text[length - 1] == '\t')) {
+        text[--length] = '\0';
+    }
+    return text;
+}
+
+static bool parse_yes_no(const char *value, bool *result)
+{
+    if (strcmp(value, "yes") == 0 || strcmp(value, "true") == 0) {
+        *result = true;
+        return true;
+    }
+    if (strcmp(value, "no") == 0 || strcmp(value, "false") == 0) {
+        *result = false;
+        return true;
+    }
+    return false;
+}
+
+static bool parse_long(const char *text, long min, long max, long *number)
+{
+    char *end = NULL;
+    errno = 0;
+    *number = strtol(text, &end, 10);
+    return end != text && *end == '\0' && errno != ERANGE && min <= *number && *number <= max;
+}
+
+static bool valid_name(const char *name)
+{
+    size_t length = strlen(name);
+    if (length == 0 || length > PROFILE_MAX_NAME) {
+        return false;
+    }
+    for (size_t i = 0; i < length; i++) {
+        char chr = name[i];
+        if (! ((chr >= 'a' && chr <= 'z') || (chr >= 'A' && chr <= 'Z') || (chr >= '0' && chr <= '9')
+               || chr == '-' || chr == '_' || chr == '.')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @note Sets one key of the profile.
+ *
+ * @return true on success, false if the key or the value is wrong (the reason is printed)
+ */
+static bool set_value(struct profile_settings *settings, const char *key, const char *value, const char *path,
+                      size_t number)
+{
+    if (strcmp(key, "length") == 0) {
+        if (! parse_long(value, MIN_GENERATED_LENGTH, MAX_GENERATED_LENGTH, &settings->length)) {
+            fprintf(stderr, "%s:%zu: length must be a number between %d and %d, included\n", path, number,
+                    MIN_GENERATED_LENGTH, MAX_GENERATED_LENGTH);
+            return false;
+        }
+    } else if (strcmp(key, "words") == 0) {
+        if (! parse_long(value, PASSPHRASE_MIN_WORDS, PASSPHRASE_MAX_WORDS, &settings->words)) {
+            fprintf(stderr, "%s:%zu: words must be a number between %d and %d, included\n", path, number,
+                    PASSPHRASE_MIN_WORDS, PASSPHRASE_MAX_WORDS);
+            return false;
+        }
+    } else if (strcmp(key, "exclude") == 0) {
+        if (strlen(value) > CHAR_POOL_LENGTH) {
+            fprintf(stderr, "%s:%zu: too many excluded characters\n", path, number);
+            return false;
+        }
+        strcpy(settings->excluded, value);
+    } else if (strcmp(key, "separator") == 0) {
+        if (strlen(value) > PASSPHRASE_MAX_SEPARATOR) {
+            fprintf(stderr, "%s:%zu: the separator can have at most %d characters\n", path, number,
+                    PASSPHRASE_MAX_SEPARATOR);
+            return false;
+        }
+        strcpy(settings->separator, value);
+    } else if (strcmp(key, "require") == 0) {
+        if (! password_policy_parse_classes(value, &settings->policy.required)) {
+            fprintf(stderr, "%s:%zu: require must be a comma separated list of lower, upper, digit and special, "
+                            "or all\n", path, number);
+            return false;
+        }
+    } else if (strcmp(key, "no-repeats") == 0 || strcmp(key, "no-sequences") == 0) {
+        if (! parse_yes_no(value, key[3] == 'r' ? &settings->policy.no_repeats : &settings->policy.no_sequences)) {
+            fprintf(stderr, "%s:%zu: %s must be yes or no\n", path, number, key);
+            return false;
+        }
+    } else {
+        fprintf(stderr, "%s:%zu: unknown key %s\n", path, number, key);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @note Parses the profiles file. Every profile starts by [name] on its own line, followed by key = value lines.
+ * Empty lines and lines starting by # are skipped.
+ *
+ * @param settings Capacity of PROFILES_MAX_COUNT profiles.
+ * @return true on success, false on failure (the line and the reason are printed)
+ */
+static bool parse_profiles(char *text, const char *path, struct profile_settings *settings, size_t *count)
+{
+    *count = 0;
+    size_t number = 0;
+    char *line = text;
+
+    while (*line != '\0') {
+        char *end = line + strcspn(line, "\n");
+        char *next = *end == '\0' ? end : end + 1;
+        *end = '\0';
+        if (end > line && end[-1] == '\r') {
+            end[-1] = '\0';
+        }
+        number++;
+
+        char *content = trim(line);
+        line = next;
+        if (*content == '\0' || *content == '#') {
+            continue;
+        }
+
+        if (*content == '[') {
+            size_t length = strlen(content);
+            if (content[length - 1] != ']') {
+                fprintf(stderr, "%s:%zu: missing ] after the profile name\n", path, number);
+                return false;
+            }
+            content[length - 1] = '\0';
+            char *name = trim(content + 1);
+            if (! valid_name(name)) {
+                fprintf(stderr, "%s:%zu: a profile name has 1 to %d letters, digits, -, _ and .\n", path, number,
+                        PROFILE_MAX_NAME);
+                return false;
+            }
+            for (size_t i = 0; i < *count; i++) {
+                if (strcmp(settings[i].name, name) == 0) {
+                    fprintf(stderr, "%s:%zu: profile %s is defined twice\n", path, number, name);
+                    return false;
+                }
+            }
+            if (*count == PROFILES_MAX_COUNT) {
+                fprintf(stderr, "%s:%zu: there can be at most %d profiles\n", path, number, PROFILES_MAX_COUNT);
+                return false;
+            }
+
+            struct profile_settings *profile = &settings[(*count)++];
+            memset(profile, 0, sizeof(*profile));
+            strcpy(profile->name, name);
+            strcpy(profile->separator, PASSPHRASE_DEFAULT_SEPARATOR);
+            profile->line = number;
+            continue;
+        }
+
+        char *equals = strchr(content, '=');
+        if (equals == NULL) {
+            fprintf(stderr, "%s:%zu: expected [name] or key = value\n", path, number);
+            return false;
+        }
+        if (*count == 0) {
+            fprintf(stderr, "%s:%zu: a setting must be in a profile, start one by [name]\n", path, number);
+            return false;
+        }
+
+        *equals = '\0';
+        char *key = trim(content);
+        char *value = trim(equals + 1);
+        size_t value_length = strlen(value);
+        if (value_length >= 2 && value[0] == '"' && value[value_length - 1] == '"') {
+            value[value_length - 1] = '\0';
+            value++;
+        }
+
+        if (! set_value(&settings[*count - 1], key, value, path, number)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @note Compiles the settings of one profile to a ready generator.
+ *
+ * @param prefixes Prefixes of the policy from the cache, NULL to count them.
+ * @param table_size Number of limbs in prefixes.
+ * @return true on success, false on failure (the reason is printed)
+ */
+static bool compile_profile(const struct profile_settings *settings, const char *path, struct profile *profile,
+                            uint64_t *prefixes, size_t table_size)
+{
+    memset(profile, 0, sizeof(*profile));
+    strcpy(profile->name, settings->name);
+
+    if ((settings->length == 0) == (settings->words == 0)) {
+        fprintf(stderr, "%s:%zu: profile %s needs either a length or words\n", path, settings->line, settings->name);
+        return false;
+    }
+
+    if (settings->words != 0) {
+        if (password_policy_active(&settings->policy) || settings->excluded[0] != '\0') {
+            fprintf(stderr, "%s:%zu: profile %s has words, so it can't have exclude, require, no-repeats "
+                            "or no-sequences\n", path, settings->line, settings->name);
+            return false;
+        }
+        profile->kind = PROFILE_PASSPHRASE;
+        if (! passphrase_format_init(&profile->format, settings->words, settings->separator)) {
+            fprintf(stderr, "%s:%zu: profile %s is not valid\n", path, settings->line, settings->name);
+            return false;
+        }
+        connect_generator(profile);
+        return true;
+    }
+
+    char character_pool[CHAR_POOL_LENGTH];
+    int char_pool_end_index = 0;
+    build_character_pool(settings->excluded, character_pool, &char_pool_end_index);
+
+    bool result = true;
+    profile->lines.length = settings->length;
+    if (password_policy_active(&settings->policy)) {
+        profile->kind = PROFILE_POLICY;
+        //Prefixes that don't fit the profile are counted again
+        result = (prefixes != NULL && policy_generator_map(&profile->policy, &settings->policy, character_pool,
+                                                           char_pool_end_index, settings->length, prefixes,
+                                                           table_size))
+                 || policy_generator_init(&profile->policy, &settings->policy, character_pool, char_pool_end_index,
+                                          settings->length);
+    } else {
+        profile->kind = PROFILE_CHARACTERS;
+        result = char_mapping_init(&profile->mapping, character_pool, char_pool_end_index);
+    }
+
+    if (! result) {
+        fprintf(stderr, "%s:%zu: profile %s is not valid\n", path, settings->line, settings->name);
+        return false;
+    }
+    connect_generator(profile);
+    return true;
+}
+
+static char *cache_path_of(const char *path)
+{
+    size_t length = strlen(path);
+    char *cache_path = malloc(length + sizeof(PROFILES_CACHE_SUFFIX));
+    if (cache_path == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        return NULL;
+    }
+    memcpy(cache_path, path, length);
+    memcpy(cache_path + length, PROFILES_CACHE_SUFFIX, sizeof(PROFILES_CACHE_SUFFIX));
+    return cache_path;
+}
+
+/**
+ * @note Maps the cache of the profiles file, if it was written for a file with the digest and count profiles
+ * by this build. Tables of the cache are checked to be inside of it.
+ *
+ * @return tables of the profiles in the mapped cache, NULL if the cache can't be used
+ */
+static const struct cached_table *map_cache(struct profile_set *set, const char *cache_path,
+                                            const unsigned char *digest, size_t count)
+{
+    int fd = open(cache_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    struct stat status;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &status) == 0 && (size_t) status.st_size >= sizeof(struct cache_header)) {
+        map = mmap(NULL, (size_t) status.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    size_t map_size = (size_t) status.st_size;
+    const struct cache_header *header = map;
+    const struct cached_table *tables = (const struct cached_table *) (header + 1);
+    bool valid = memcmp(header->magic, PROFILES_CACHE_MAGIC, PROFILES_CACHE_MAGIC_LENGTH) == 0
+                 && header->record_size == sizeof(struct cached_table) && header->count == count
+                 && memcmp(header->digest, digest, PROFILES_DIGEST_SIZE) == 0
+                 && sizeof(*header) + count * sizeof(*tables) <= map_size;
+
+    for (size_t i = 0; valid && i < count; i++) {
+        valid = tables[i].offset % sizeof(uint64_t) == 0 && tables[i].offset <= map_size
+                && tables[i].size <= (map_size - tables[i].offset) / sizeof(uint64_t);
+    }
+
+    if (! valid) {
+        munmap(map, map_size);
+        return NULL;
+    }
+    set->map = map;
+    set->map_size = map_size;
+    return tables;
+}
+
+/**
+ * @note Writes the compiled profiles to a temporary file and renames it over the cache. Losing the cache only
+ * costs compiling the profiles again, so a failure is reported but the profiles can be used.
+ */
+static void write_cache(const struct profile_set *set, const char *cache_path, const unsigned char *digest)
+{
+    size_t path_length = strlen(cache_path);
+    char *temporary_path = malloc(path_length + sizeof(".tmp"));
+    struct cached_table *tables = calloc(set->count == 0 ? 1 : set->count, sizeof(*tables));
+    if (temporary_path == NULL || tables == NULL) {
+        free(temporary_path);
+        free(tables);
+        fprintf(stderr, "malloc failed\n");
+        return;
+    }
+    memcpy(temporary_path, cache_path, path_length);
+    memcpy(temporary_path + path_length, ".tmp", sizeof(".tmp"));
+
+    struct cache_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PROFILES_CACHE_MAGIC, PROFILES_CACHE_MAGIC_LENGTH);
+    header.record_size = sizeof(struct cached_table);
+    header.count = (uint32_t) set->count;
+    memcpy(header.digest, digest, PROFILES_DIGEST_SIZE);
+
+    uint64_t offset = sizeof(header) + set->count * sizeof(*tables);
+    for (size_t i = 0; i < set->count; i++) {
+        tables[i].offset = offset;
+        if (set->profiles[i].kind == PROFILE_POLICY) {
+            tables[i].size = set->profiles[i].policy.table_size;
+            offset += tables[i].size * sizeof(uint64_t);
+        }
+    }
+
+    int fd = open(temporary_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    FILE *file = fd < 0 ? NULL : fdopen(fd, "w");
+    bool result = file != NULL && fwrite(&header, sizeof(header), 1, file) == 1
+                  && fwrite(tables, sizeof(*tables), set->count, file) == set->count;
+
+    for (size_t i = 0; result && i < set->count; i++) {
+        if (set->profiles[i].kind == PROFILE_POLICY) {
+            result = fwrite(set->profiles[i].policy.prefixes, sizeof(uint64_t), tables[i].size, file)
+                     == tables[i].size;
+        }
+    }
+
+    if (file != NULL) {
+        result = fclose(file) == 0 && result;
+    } else if (fd >= 0) {
+        close(fd);
+    }
+    if (result && rename(temporary_path, cache_path) != 0) {
+        result = false;
+    }
+    if (! result) {
+        fprintf(stderr, "failed to write %s, the profiles will be compiled again next time\n", cache_path);
+        if (fd >= 0) {
+            unlink(temporary_path);
+        }
+    }
+
+    free(temporary_path);
+    free(tables);
+}
+
+/**
+ * @note Loads the profiles of the file. They are taken from the cache of the file if it is up to date,
+ * otherwise they are compiled and the cache is written again.
+ *
+ * @param set Loaded profiles, free them by profiles_free.
+ * @param path Profiles file.
+ * @return true on success, false on failure (the reason is printed)
+ */
+bool profiles_load(struct profile_set *set, const char *path)
+{
+    memset(set, 0, sizeof(*set));
+
+    char *text = NULL;
+    size_t size = 0;
+    unsigned char digest[PROFILES_DIGEST_SIZE];
+    if (! read_profiles_file(path, &text, &size)) {
+        return false;
+    }
+    char *cache_path = cache_path_of(path);
+    if (cache_path == NULL || ! digest_text(text, size, digest)) {
+        free(cache_path);
+        free(text);
+        return false;
+    }
+
+    struct profile_settings *settings = malloc(PROFILES_MAX_COUNT * sizeof(*settings));
+    size_t count = 0;
+    bool result = settings != NULL;
+    if (! result) {
+        fprintf(stderr, "malloc failed\n");
+    }
+
+    result = result && parse_profiles(text, path, settings, &count);
+    if (result) {
+        set->profiles = calloc(count == 0 ? 1 : count, sizeof(*set->profiles));
+        result = set->profiles != NULL;
+        if (! result) {
+            fprintf(stderr, "malloc failed\n");
+        }
+    }
+
+    //The cache is written again if any profile had to be counted
+    const struct cached_table *tables = result ? map_cache(set, cache_path, digest, count) : NULL;
+    bool counted = tables == NULL;
+    for (size_t i = 0; result && i < count; i++) {
+        uint64_t *prefixes = tables == NULL || tables[i].size == 0
+                             ? NULL : (uint64_t *) ((unsigned char *) set->map + tables[i].offset);
+        result = compile_profile(&settings[i], path, &set->profiles[i], prefixes,
+                                 tables == NULL ? 0 : (size_t) tables[i].size);
+        set->count += result;
+        counted = counted || (result && set->profiles[i].kind == PROFILE_POLICY && ! set->profiles[i].policy.mapped);
+    }
+
+    if (! result) {
+        profiles_free(set);
+    } else if (counted) {
+        write_cache(set, cache_path, digest);
+    }
+
+    free(settings);
+    free(cache_path);
+    free(text);
+    return result;
+}
+
+void profiles_free(struct profile_set *set)
+{
+    for (size_t i = 0; i < set->count; i++) {
+        if (set->profiles[i].kind == PROFILE_POLICY) {
+            policy_generator_free(&set->profiles[i].policy);
+        }
+    }
+    free(set->profiles);
+    if (set->map != NULL) {
+        munmap(set->map, set->map_size);
+    }
+    memset(set, 0, sizeof(*set));
+}
+
+/**
+ * @return profile with the name, NULL if there is none
+ */
+const struct profile *profiles_find(const struct profile_set *set, const char *name)
+{
+    for (size_t i = 0; i < set->count; i++) {
+        if (strcmp(set->profiles[i].name, name) == 0) {
+            return &set->profiles[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @return entropy of the passwords of the profile in bits
+ */
+double profile_entropy(const struct profile *profile)
+{
+    switch (profile->kind) {
+        case PROFILE_POLICY:
+            return policy_entropy(&profile->policy);
+        case PROFILE_PASSPHRASE:
+            return passphrase_entropy(&profile->format);
+        default:
+            return (double) profile->lines.length * log2(profile->mapping.size);
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef PASSWORD_GENERATOR_PROFILES_H
+#define PASSWORD_GENERATOR_PROFILES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "batch_generation.h"
+#include "char_mapping.h"
+#include "passphrase.h"
+#include "policy.h"
+
+//Profiles that are used by --profile and the interactive generator if no other file is given
+#define PROFILES_FILE "profiles.conf"
+#define PROFILES_CACHE_SUFFIX ".cache"
+#define PROFILES_CACHE_MAGIC "PWGPROF3"
+#define PROFILES_CACHE_MAGIC_LENGTH 8
+#define PROFILE_MAX_NAME 32
+#define PROFILES_MAX_COUNT 64
+
+/**
+ * A profile is a named set of generation settings in the profiles file, for example:
+ *
+ * [db-creds]
+ * length = 32
+ * exclude = "'`\
+ * require = all
+ * no-repeats = yes
+ *
+ * [wifi]
+ * words = 6
+ * separator = .
+ *
+ * A profile has either a length (with optional exclude, require, no-repeats and no-sequences) or words
+ * (with an optional separator). Values may be put in double quotes to keep spaces at their ends.
+ *
+ * Profiles are compiled when they are loaded: the pool and the threshold of the mapping, the counts
+ * of compliant passwords of a policy and the passphrase format are ready to generate. Counting a policy is
+ * the slow part, so only the counts are written next to the profiles file (PROFILES_CACHE_SUFFIX) and mapped
+ * on the next load, as long as the SHA-256 of the profiles file is the one they were counted for. The cache
+ * is specific to the build that wrote it, the counts are stored as they are in memory.
+ */
+enum profile_kind {
+    PROFILE_CHARACTERS,
+    PROFILE_POLICY,
+    PROFILE_PASSPHRASE
+};
+
+struct profile {
+    char name[PROFILE_MAX_NAME + 1];
+    enum profile_kind kind;
+    //Only the member of the kind is used
+    struct char_mapping mapping;
+    struct character_lines lines;
+    struct policy_generator policy;
+    struct passphrase_format format;
+    struct line_generator generator;
+};
+
+struct profile_set {
+    struct profile *profiles;
+    size_t count;
+    //Mapped cache the policy tables are in, NULL if the policies were counted
+    void *map;
+    size_t map_size;
+};
+
+bool profiles_load(struct profile_set *set, const char *path);
+void profiles_free(struct profile_set *set);
+const struct profile *profiles_find(const struct profile_set *set, const char *name);
+double profile_entropy(const struct profile *profile);
+
+#endif //PASSWORD_GENERATOR_PROFILES_H
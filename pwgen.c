@@ -0,0 +1,358 @@
+#include "pwgen.h"
+#include "character_pool.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <openssl/crypto.h>
+
+/**
+ * @note Prepares the generator for passwords (or passphrases if options->words is not 0) of the options.
+ *
+ * @param generator Generator to be initialized. Free it with pwgen_generator_free.
+ * @return true on success, false on failure (the reason is printed)
+ */
+bool pwgen_generator_init(struct pwgen_generator *generator, const struct pwgen_options *options)
+{
+    generator->use_policy = false;
+    generator->pool_ready = false;
+
+    if (options->words != 0) {
+        if (! passphrase_format_init(&generator->format, options->words,
+                                     options->separator == NULL ? PASSPHRASE_DEFAULT_SEPARATOR : options->separator)) {
+            return false;
+        }
+        line_generator_passphrases(&generator->lines, &generator->format);
+        return true;
+    }
+
+    if (options->length < MIN_GENERATED_LENGTH || options->length > MAX_GENERATED_LENGTH) {
+        fprintf(stderr, "A password must have between %d and %d characters, included.\n", MIN_GENERATED_LENGTH,
+                MAX_GENERATED_LENGTH);
+        return false;
+    }
+
+    char character_pool[CHAR_POOL_LENGTH];
+    int char_pool_end_index = 0;
+    build_character_pool(options->excluded == NULL ? "" : options->excluded, character_pool, &char_pool_end_index);
+
+    if (password_policy_active(&options->policy)) {
+        if (! policy_generator_init(&generator->policy, &options->policy, character_pool, char_pool_end_index,
+                                    options->length)) {
+            return false;
+        }
+        generator->use_policy = true;
+        line_generator_policy(&generator->lines, &generator->policy);
+        return true;
+    }
+
+    if (! char_mapping_init(&generator->mapping, character_pool, char_pool_end_index)) {
+        return false;
+    }
+    generator->character_lines.mapping = &generator->mapping;
+    generator->character_lines.length = options->length;
+    line_generator_characters(&generator->lines, &generator->character_lines);
+    return true;
+}
+
+/**
+ * @note Prepares the generator for passwords of a loaded profile, the profile has to stay loaded as long
+ * as the generator is used. Free the generator with pwgen_generator_free.
+ */
+void pwgen_generator_from_profile(struct pwgen_generator *generator, const struct profile *profile)
+{
+    generator->use_policy = false;
+    generator->pool_ready = false;
+    generator->lines = profile->generator;
+}
+
+/**
+ * @return length of the longest password of the generator, without the terminating zero
+ */
+size_t pwgen_max_length(const struct pwgen_generator *generator)
+{
+    return generator->lines.longest_line - 1;
+}
+
+/**
+ * @return entropy of the passwords of the generator in bits
+ */
+double pwgen_entropy(const struct pwgen_generator *generator, const struct pwgen_options *options)
+{
+    if (options->words != 0) {
+        return passphrase_entropy(&generator->format);
+    }
+    if (generator->use_policy) {
+        return policy_entropy(&generator->policy);
+    }
+    return (double) options->length * log2(generator->mapping.size);
+}
+
+/**
+ * @note Generates one password to output and terminates it by '\0'. The random pool of the generator is prepared
+ * on the first call.
+ *
+ * @param output Buffer for the password.
+ * @param capacity Capacity of output, at least pwgen_max_length(generator) + 1.
+ * @return length of the password, 0 on failure
+ */
+size_t pwgen_generate(struct pwgen_generator *generator, char *output, size_t capacity)
+{
+    if (capacity < generator->lines.longest_line) {
+        fprintf(stderr, "the buffer is too small for the password\n");
+        return 0;
+    }
+
+    if (! generator->pool_ready) {
+        if (! initialize_generator() || ! random_pool_init(&generator->pool)) {
+            return 0;
+        }
+        generator->pool_ready = true;
+    }
+
+    //The line generator ends the password by '\n', which is replaced by the terminating zero
+    size_t used = 0;
+    if (! generator->lines.generate_lines(generator->lines.source, &generator->pool, output, 1, &used)) {
+        return 0;
+    }
+    output[used - 1] = '\0';
+    return used - 1;
+}
+
+void pwgen_generator_free(struct pwgen_generator *generator)
+{
+    if (generator->pool_ready) {
+        random_pool_free(&generator->pool);
+        generator->pool_ready = false;
+    }
+    if (generator->use_policy) {
+        policy_generator_free(&generator->policy);
+        generator->use_policy = false;
+    }
+}
+
+/**
+ * @param scorer Scorer to be initialized. Free it with pwgen_scorer_free.
+ * @param filter_path Breach filter the passwords are looked up in, NULL to score them without one.
+ * @return true on success, false on failure
+ */
+bool pwgen_scorer_init(struct pwgen_scorer *scorer, const char *filter_path)
+{
+    scorer->use_filter = false;
+    if (filter_path != NULL) {
+        if (! breach_filter_open(&scorer->filter, filter_path)) {
+            return false;
+        }
+        scorer->use_filter = true;
+    }
+
+    if (! pattern_scorer_init(&scorer->patterns)) {
+        if (scorer->use_filter) {
+            breach_filter_close(&scorer->filter);
+        }
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @note Estimates the strength of the password by the pattern matcher. Passwords found in the breach filter
+ * are very weak no matter how random they look, because attackers try them first. The matches stay
+ * in scorer->patterns until the next password is scored.
+ *
+ * @return true on success, false on failure
+ */
+bool pwgen_score(struct pwgen_scorer *scorer, const char *password, size_t length, struct pwgen_score *score)
+{
+    score->entropy = pattern_entropy(&scorer->patterns, password, length, strength_classes(password, length));
+    score->strength = strength_classify(score->entropy);
+    score->breached = false;
+    score->breach_checked = false;
+
+    if (scorer->use_filter) {
+        if (! breach_filter_contains_password(&scorer->filter, password, length, &score->breached)) {
+            return false;
+        }
+        score->breach_checked = true;
+        if (score->breached) {
+            score->strength = STRENGTH_VERY_WEAK;
+        }
+    }
+    return true;
+}
+
+void pwgen_scorer_free(struct pwgen_scorer *scorer)
+{
+    pattern_scorer_free(&scorer->patterns);
+    if (scorer->use_filter) {
+        breach_filter_close(&scorer->filter);
+        scorer->use_filter = false;
+    }
+}
+
+/**
+ * @note Opens the vault and unlocks it by the master password. All records are loaded to the in-memory index,
+ * so lookups are fast. A vault that is not encrypted yet (a new one) is not opened, pwgen_vault_encrypt does that.
+ *
+ * @param path Path to the vault file, it has to stay valid until the vault is closed.
+ * @param correct Set to false if the master password is wrong, true otherwise.
+ * @return true if the vault is open, false otherwise (then it does not have to be closed)
+ */
+bool pwgen_vault_open(struct vault *vault, const char *path, const char *master_password, bool *correct)
+{
+    *correct = false;
+    if (master_password[0] == '\0') {
+        fprintf(stderr, "The master password cannot be empty.\n");
+        return false;
+    }
+    if (! vault_open(vault, path)) {
+        return false;
+    }
+
+    bool encrypted = vault_is_encrypted(vault);
+    if (! encrypted) {
+        fprintf(stderr, "%s is not encrypted, encrypt it with pwgen_vault_encrypt first\n", path);
+    }
+    if (! encrypted || ! vault_unlock(vault, master_password, correct) || ! *correct || ! vault_use_index(vault)) {
+        vault_close(vault);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @note Opens a vault that is not encrypted yet (a new one is created if there is no file) and encrypts all its
+ * passwords by the master password. The vault stays open and unlocked, like after pwgen_vault_open.
+ * An encrypted vault is not opened, so its master password is never replaced by mistake.
+ *
+ * @param path Path to the vault file, it has to stay valid until the vault is closed.
+ * @return true if the vault is encrypted and open, false otherwise (then it does not have to be closed)
+ */
+bool pwgen_vault_encrypt(struct vault *vault, const char *path, const char *master_password)
+{
+    if (master_password[0] == '\0') {
+        fprintf(stderr, "The master password cannot be empty.\n");
+        return false;
+    }
+    if (! vault_open(vault, path)) {
+        return false;
+    }
+
+    bool encrypted = vault_is_encrypted(vault);
+    if (encrypted) {
+        fprintf(stderr, "%s is encrypted already, open it with pwgen_vault_open\n", path);
+    }
+    if (encrypted || ! vault_encrypt_all(vault, master_password) || ! vault_use_index(vault)) {
+        vault_close(vault);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @note Copies a name or password of the caller to a terminated buffer, if it has no null character and fits.
+ *
+ * @param capacity Capacity of buffer, one more than the longest allowed text.
+ * @return true if the text is valid, false otherwise (the reason is printed)
+ */
+static bool copy_terminated(const char *what, const char *text, size_t length, char *buffer, size_t capacity)
+{
+    if (length >= capacity) {
+        fprintf(stderr, "The %s can have at most %zu characters.\n", what, capacity - 1);
+        return false;
+    }
+    if (memchr(text, '\0', length) != NULL) {
+        fprintf(stderr, "The %s cannot contain the null character.\n", what);
+        return false;
+    }
+    memcpy(buffer, text, length);
+    buffer[length] = '\0';
+    return true;
+}
+
+/**
+ * @note Checks the site and the account the way the daemon does and copies them to terminated buffers.
+ *
+ * @return true if both are valid, false otherwise (the reason is printed)
+ */
+static bool copy_names(const char *site, size_t site_length, const char *account, size_t account_length,
+                       char *site_buffer, char *account_buffer)
+{
+    if (site_length == 0 || account_length == 0) {
+        fprintf(stderr, "The site and the account cannot be empty.\n");
+        return false;
+    }
+    return copy_terminated("site", site, site_length, site_buffer, VAULT_MAX_NAME_LENGTH + 1)
+           && copy_terminated("account", account, account_length, account_buffer, VAULT_MAX_NAME_LENGTH + 1);
+}
+
+/**
+ * @note Saves the password for the account, an older password of the same account is replaced.
+ * The texts are given by their lengths, so a null character in them is refused instead of cutting them short.
+ *
+ * @return true on success, false on failure (an invalid text is reported)
+ */
+bool pwgen_vault_put(struct vault *vault, const char *site, size_t site_length, const char *account,
+                     size_t account_length, const char *password, size_t password_length)
+{
+    char site_buffer[VAULT_MAX_NAME_LENGTH + 1];
+    char account_buffer[VAULT_MAX_NAME_LENGTH + 1];
+    char password_buffer[VAULT_MAX_PASSWORD_LENGTH + 1];
+
+    bool result = copy_names(site, site_length, account, account_length, site_buffer, account_buffer)
+                  && copy_terminated("password", password, password_length, password_buffer,
+                                     sizeof(password_buffer))
+                  && vault_put(vault, site_buffer, account_buffer, password_buffer);
+    OPENSSL_cleanse(password_buffer, sizeof(password_buffer));
+    return result;
+}
+
+/**
+ * @note Removes the account from the vault, its texts are checked like by pwgen_vault_put.
+ *
+ * @param found Set to true if the account was there and was removed, false otherwise.
+ * @return true on success, false on failure
+ */
+bool pwgen_vault_delete(struct vault *vault, const char *site, size_t site_length, const char *account,
+                        size_t account_length, bool *found)
+{
+    char site_buffer[VAULT_MAX_NAME_LENGTH + 1];
+    char account_buffer[VAULT_MAX_NAME_LENGTH + 1];
+
+    *found = false;
+    return copy_names(site, site_length, account, account_length, site_buffer, account_buffer)
+           && vault_delete(vault, site_buffer, account_buffer, found);
+}
+
+/**
+ * @note Looks up the password of an account and copies it to the buffer of the caller, terminated by '\0'.
+ *
+ * @param capacity Capacity of password, VAULT_MAX_PASSWORD_LENGTH + 1 is always enough.
+ * @param length Length of the password is stored here.
+ * @param found Set to true if the account was found, false otherwise.
+ * @return true if no error occurs, false otherwise
+ */
+bool pwgen_vault_get(struct vault *vault, const char *site, const char *account, char *password, size_t capacity,
+                     size_t *length, bool *found)
+{
+    struct vault_record record;
+    if (! vault_get(vault, site, account, &record, found)) {
+        return false;
+    }
+    if (! *found) {
+        return true;
+    }
+
+    bool result = record.password_length < capacity;
+    if (result) {
+        memcpy(password, record.password, record.password_length);
+        password[record.password_length] = '\0';
+        *length = record.password_length;
+    } else {
+        fprintf(stderr, "the buffer is too small for the password\n");
+    }
+
+    vault_record_free(&record);
+    return result;
+}
@@ -0,0 +1,95 @@
+#ifndef PASSWORD_GENERATOR_PWGEN_H
+#define PASSWORD_GENERATOR_PWGEN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "batch_generation.h"
+#include "breach_filter.h"
+#include "patterns.h"
+#include "profiles.h"
+#include "random_pool.h"
+#include "strength.h"
+#include "vault.h"
+#include "vault_directory.h"
+
+/**
+ * Core API of libpwgen, the part of the password generator that asks nothing. Functions of the library never
+ * read the standard input and never print anything except error messages to the standard error, so they can be
+ * called in-process by other programs; the interactive program is built on top of them.
+ *
+ * - generation: pwgen_generator_init (or pwgen_generator_from_profile) once, then pwgen_generate for every
+ *   password. A generator has its own random pool, so it must be used by one thread at a time.
+ * - scoring: pwgen_scorer_init once, then pwgen_score for every password, by one thread at a time.
+ * - vault: pwgen_vault_open (pwgen_vault_encrypt for a vault that is not encrypted yet), then pwgen_vault_get,
+ *   pwgen_vault_put and pwgen_vault_delete, vault_close (vault.h) at the end.
+ *   Bulk saves can use vault_set_group_commit and vault_sync, so they fsync once per batch.
+ * - names: vault_directory_build lists the sites and accounts without the master password, vault_directory_prefix
+ *   and vault_directory_fuzzy search them (vault_directory.h).
+ * - listing: vault_list passes one page of the records that match the patterns, names only unless asked
+ *   for passwords, and moves the cursor to the next page.
+ *
+ * Buffers with passwords should be wiped by OPENSSL_cleanse when the caller is done with them.
+ */
+struct pwgen_options {
+    //Length of passwords of random characters, 0 for passphrases
+    long length;
+    //Characters left out of the pool, NULL for none
+    const char *excluded;
+    struct password_policy policy;
+    //Number of words of passphrases, 0 for passwords of random characters
+    long words;
+    //Separator of the words, NULL for PASSPHRASE_DEFAULT_SEPARATOR
+    const char *separator;
+};
+
+struct pwgen_generator {
+    //Only the parts of the kind of the passwords are used
+    struct char_mapping mapping;
+    struct character_lines character_lines;
+    struct policy_generator policy;
+    bool use_policy;
+    struct passphrase_format format;
+
+    struct line_generator lines;
+    //Prepared when the first password is generated, batch generation uses pools of its own
+    struct random_pool pool;
+    bool pool_ready;
+};
+
+struct pwgen_score {
+    enum strength_class strength;
+    //Bits of entropy, log2 of the guesses needed to find the password
+    double entropy;
+    //Set only if the scorer has a breach filter
+    bool breached;
+    bool breach_checked;
+};
+
+struct pwgen_scorer {
+    struct pattern_scorer patterns;
+    struct breach_filter filter;
+    bool use_filter;
+};
+
+bool pwgen_generator_init(struct pwgen_generator *generator, const struct pwgen_options *options);
+void pwgen_generator_from_profile(struct pwgen_generator *generator, const struct profile *profile);
+size_t pwgen_max_length(const struct pwgen_generator *generator);
+double pwgen_entropy(const struct pwgen_generator *generator, const struct pwgen_options *options);
+size_t pwgen_generate(struct pwgen_generator *generator, char *output, size_t capacity);
+void pwgen_generator_free(struct pwgen_generator *generator);
+
+bool pwgen_scorer_init(struct pwgen_scorer *scorer, const char *filter_path);
+bool pwgen_score(struct pwgen_scorer *scorer, const char *password, size_t length, struct pwgen_score *score);
+void pwgen_scorer_free(struct pwgen_scorer *scorer);
+
+bool pwgen_vault_open(struct vault *vault, const char *path, const char *master_password, bool *correct);
+bool pwgen_vault_encrypt(struct vault *vault, const char *path, const char *master_password);
+bool pwgen_vault_get(struct vault *vault, const char *site, const char *account, char *password, size_t capacity,
+                     size_t *length, bool *found);
+bool pwgen_vault_put(struct vault *vault, const char *site, size_t site_length, const char *account,
+                     size_t account_length, const char *password, size_t password_length);
+bool pwgen_vault_delete(struct vault *vault, const char *site, size_t site_length, const char *account,
+                        size_t account_length, bool *found);
+
+#endif //PASSWORD_GENERATOR_PWGEN_H
@@ -0,0 +1,213 @@
+#include "random_pool.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <openssl/core_names.h>
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+
+/**
+ * @note The pool is filled lazily by the first random_pool_take call.
+ *
+ * @param pool Pool to be initialized. Free it with random_pool_free.
+ * @return true on success, false on failure
+ */
+bool random_pool_init(struct random_pool *pool)
+{
+    pool->buffer = malloc(RANDOM_POOL_SIZE * sizeof(unsigned char));
+    if (pool->buffer == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        return false;
+    }
+
+    pool->size = RANDOM_POOL_SIZE;
+    pool->position = RANDOM_POOL_SIZE;
+    pool->wiped = RANDOM_POOL_SIZE;
+    pool->drbg = NULL;
+    return true;
+}
+
+/**
+ * @note Like random_pool_init, but the pool gets its own AES-256 CTR-DRBG seeded from OpenSSL's primary DRBG.
+ * Pools used by different threads then never share the global RAND state or its locks.
+ *
+ * @param pool Pool to be initialized. Free it with random_pool_free.
+ * @return true on success, false on failure
+ */
+bool random_pool_init_drbg(struct random_pool *pool)
+{
+    if (! random_pool_init(pool)) {
+        return false;
+    }
+
+    EVP_RAND *rand = EVP_RAND_fetch(NULL, "CTR-DRBG", NULL);
+    if (rand == NULL) {
+        fprintf(stderr, "failed to fetch CTR-DRBG\n");
+        random_pool_free(pool);
+        return false;
+    }
+
+    pool->drbg = EVP_RAND_CTX_new(rand, RAND_get0_primary(NULL));
+    EVP_RAND_free(rand);
+    if (pool->drbg == NULL) {
+        fprintf(stderr, "failed to create DRBG\n");
+        random_pool_free(pool);
+        return false;
+    }
+
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_utf8_string(OSSL_DRBG_PARAM_CIPHER, "AES-256-CTR", 0),
+        OSSL_PARAM_construct_end()
+    };
+
+    if (EVP_RAND_instantiate(pool->drbg, 256, 0, NULL, 0, params) != 1) {
+        fprintf(stderr, "failed to seed DRBG\n");
+        random_pool_free(pool);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @note Overwrites all random bytes that are still in the pool and frees the buffer.
+ */
+void random_pool_free(struct random_pool *pool)
+{
+    if (pool->buffer == NULL) {
+        return;
+    }
+
+    OPENSSL_cleanse(pool->buffer, pool->size);
+    free(pool->buffer);
+    pool->buffer = NULL;
+
+    EVP_RAND_CTX_free(pool->drbg);
+    pool->drbg = NULL;
+}
+
+/**
+ * @return true if the buffer was filled by the pool's DRBG
+ */
+static bool generate_from_drbg(struct random_pool *pool)
+{
+    for (size_t done = 0; done < pool->size; done += RANDOM_POOL_DRBG_REQUEST) {
+        size_t request = pool->size - done < RANDOM_POOL_DRBG_REQUEST ? pool->size - done : RANDOM_POOL_DRBG_REQUEST;
+        if (EVP_RAND_generate(pool->drbg, pool->buffer + done, request, 256, 0, NULL, 0) != 1) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Refills the whole pool with one RAND_bytes call, or from the pool's own DRBG if it has one.
+ */
+static bool refill(struct random_pool *pool)
+{
+    bool generated = pool->drbg == NULL ? RAND_bytes(pool->buffer, (int) pool->size) == 1 : generate_from_drbg(pool);
+
+    if (! generated) {
+        fprintf(stderr, "failed to generate random numbers\n");
+        OPENSSL_cleanse(pool->buffer, pool->size);
+        pool->position = pool->size;
+        pool->wiped = pool->size;
+        return false;
+    }
+
+    pool->position = 0;
+    pool->wiped = 0;
+    return true;
+}
+
+/**
+ * @note The bytes handed out by the previous call are overwritten before anything else happens,
+ * so the returned bytes are valid only until the next call. If there are not enough bytes left,
+ * the rest of the pool is thrown away and the pool is refilled.
+ *
+ * @param pool Initialized pool.
+ * @param count Number of random bytes needed, at most RANDOM_POOL_SIZE.
+ * @return pointer to count random bytes, NULL on failure
+ */
+const unsigned char *random_pool_take(struct random_pool *pool, size_t count)
+{
+    OPENSSL_cleanse(pool->buffer + pool->wiped, pool->position - pool->wiped);
+    pool->wiped = pool->position;
+
+    if (count > pool->size) {
+        fprintf(stderr, "too many random bytes requested\n");
+        return NULL;
+    }
+
+    if (pool->size - pool->position < count) {
+        OPENSSL_cleanse(pool->buffer + pool->position, pool->size - pool->position);
+        if (! refill(pool)) {
+            return NULL;
+        }
+    }
+
+    const unsigned char *bytes = pool->buffer + pool->position;
+    pool->position += count;
+    return bytes;
+}
+
+/**
+ * @note For consumers that don't know in advance how many bytes they need. Returns all bytes that
+ * were not handed out yet (refilling the pool if there are none), the consumer then tells
+ * how many of them it used by random_pool_consume.
+ *
+ * @param pool Initialized pool.
+ * @param available Number of returned bytes is stored here.
+ * @return pointer to the unused random bytes, NULL on failure
+ */
+const unsigned char *random_pool_next(struct random_pool *pool, size_t *available)
+{
+    OPENSSL_cleanse(pool->buffer + pool->wiped, pool->position - pool->wiped);
+    pool->wiped = pool->position;
+
+    if (pool->position == pool->size && ! refill(pool)) {
+        return NULL;
+    }
+
+    *available = pool->size - pool->position;
+    return pool->buffer + pool->position;
+}
+
+/**
+ * @note Marks count bytes returned by random_pool_next as used and overwrites them right away.
+ */
+void random_pool_consume(struct random_pool *pool, size_t count)
+{
+    pool->position += count;
+    OPENSSL_cleanse(pool->buffer + pool->wiped, pool->position - pool->wiped);
+    pool->wiped = pool->position;
+}
+
+//OpenSSL is seeded once per process, generators of all threads share it
+static pthread_mutex_t seed_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool seeded = false;
+
+/**
+ * @note Seeds OpenSSL's random functions the first time it is called, later calls only tell whether that
+ * worked. A failed seeding is tried again by the next call.
+ *
+ * @return true if OpenSSL's random functions are initialized; false otherwise
+ */
+bool initialize_generator(void)
+{
+    pthread_mutex_lock(&seed_lock);
+    if (! seeded) {
+        if (RAND_poll() == 0) {
+            fprintf(stderr, "Error initializing OpenSSL.\n");
+        } else if (RAND_status() == 0) {
+            fprintf(stderr, "Insufficient entropy for secure random numbers.\n"
+                            "Wait a bit before trying again.\n");
+        } else {
+            seeded = true;
+        }
+    }
+    bool result = seeded;
+    pthread_mutex_unlock(&seed_lock);
+    return result;
+}
@@ -0,0 +1,35 @@
+#ifndef PASSWORD_GENERATOR_RANDOM_POOL_H
+#define PASSWORD_GENERATOR_RANDOM_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <openssl/evp.h>
+
+//How many random bytes are fetched from OpenSSL at once
+#define RANDOM_POOL_SIZE (64 * 1024)
+//Largest request a CTR-DRBG serves in one generate call
+#define RANDOM_POOL_DRBG_REQUEST (64 * 1024)
+
+struct random_pool {
+    unsigned char *buffer;
+    size_t size;
+
+    //Bytes before position were already handed out
+    size_t position;
+    //Bytes before wiped were already overwritten
+    size_t wiped;
+
+    //Own DRBG of the pool, NULL if the pool is filled by RAND_bytes
+    EVP_RAND_CTX *drbg;
+};
+
+bool initialize_generator(void);
+bool random_pool_init(struct random_pool *pool);
+bool random_pool_init_drbg(struct random_pool *pool);
+void random_pool_free(struct random_pool *pool);
+const unsigned char *random_pool_take(struct random_pool *pool, size_t count);
+const unsigned char *random_pool_next(struct random_pool *pool, size_t *available);
+void random_pool_consume(struct random_pool *pool, size_t count);
+
+#endif //PASSWORD_GENERATOR_RANDOM_POOL_H
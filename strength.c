@@ -0,0 +1,517 @@
+#include "strength.h"
+#include "character_pool.h"
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <openssl/crypto.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define STRENGTH_X86 1
+#include <immintrin.h>
+#else
+#define STRENGTH_X86 0
+#endif
+
+static const char *const class_names[STRENGTH_CLASS_COUNT] = {
+    "very weak", "weak", "reasonable", "strong", "very strong"
+};
+//Verdict of a password from the breach filter, no matter its entropy
+#define BREACHED_NAME "breached"
+
+//Class bit of every byte, bytes that are not letters or digits are special
+static uint8_t byte_classes[256];
+//log2 of the character range of every combination of classes, 0 for none
+static double range_bits[STRENGTH_CLASS_MASKS];
+//Scorers of different threads prepare the tables at the same time, so they are built exactly once
+static pthread_once_t tables_once = PTHREAD_ONCE_INIT;
+
+typedef unsigned (*classes_kernel)(const char *bytes, size_t length);
+static enum strength_kernel current_kernel = STRENGTH_SCALAR;
+
+static unsigned classes_scalar(const char *bytes, size_t length)
+{
+    unsigned classes = 0;
+    for (size_t i = 0; i < length; i++) {
+        classes |= byte_classes[(unsigned char) bytes[i]];
+    }
+    return classes;
+}
+
+#if STRENGTH_X86
+
+/*
+ * A byte b is in the range [first, first + size) exactly when b + (0x80 - first) wraps to one of the lowest
+ * size signed bytes, so every range check is one addition and one signed comparison.
+ */
+#define RANGE_SHIFT(first) ((char) (0x80 - (first)))
+#define RANGE_LIMIT(size) ((char) (0x80 + (size)))
+
+/**
+ * @note Classes of the bytes of a 16 byte block whose bits are set in lanes.
+ */
+__attribute__((target("sse2"), always_inline))
+static inline unsigned classify_block_16(__m128i data, unsigned lanes)
+{
+    __m128i is_upper = _mm_cmplt_epi8(_mm_add_epi8(data, _mm_set1_epi8(RANGE_SHIFT('A'))),
+                                      _mm_set1_epi8(RANGE_LIMIT(LETTER_COUNT)));
+    __m128i is_lower = _mm_cmplt_epi8(_mm_add_epi8(data, _mm_set1_epi8(RANGE_SHIFT('a'))),
+                                      _mm_set1_epi8(RANGE_LIMIT(LETTER_COUNT)));
+    __m128i is_digit = _mm_cmplt_epi8(_mm_add_epi8(data, _mm_set1_epi8(RANGE_SHIFT('0'))),
+                                      _mm_set1_epi8(RANGE_LIMIT(DIGIT_COUNT)));
+    unsigned alphanumeric = (unsigned) _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(is_upper, is_lower), is_digit));
+
+    return ((_mm_movemask_epi8(is_upper) & lanes) != 0 ? STRENGTH_UPPER : 0)
+           | ((_mm_movemask_epi8(is_lower) & lanes) != 0 ? STRENGTH_LOWER : 0)
+           | ((_mm_movemask_epi8(is_digit) & lanes) != 0 ? STRENGTH_DIGIT : 0)
+           | ((alphanumeric & lanes) != lanes ? STRENGTH_SPECIAL : 0);
+}
+
+/**
+ * @note Inlined into both vector kernels, so the AVX2 one uses VEX encoded instructions for its tail too.
+ * Most passwords are shorter than 16 bytes, so they are not left to a scalar loop: inputs of 16 bytes or more
+ * end with one overlapping block (classes do not care about bytes seen twice) and shorter ones are loaded
+ * as one block with the lanes past the end ignored, if the block does not cross into the next page.
+ */
+__attribute__((target("sse2"), always_inline))
+static inline unsigned classes_vector_16(const char *bytes, size_t length)
+{
+    unsigned classes = 0;
+    size_t i = 0;
+
+    for (; i + 16 <= length; i += 16) {
+        classes |= classify_block_16(_mm_loadu_si128((const __m128i *) (bytes + i)), 0xFFFF);
+    }
+
+    if (i == length) {
+        return classes;
+    }
+    if (length >= 16) {
+        return classes | classify_block_16(_mm_loadu_si128((const __m128i *) (bytes + length - 16)), 0xFFFF);
+    }
+    if (((uintptr_t) bytes & 4095) <= 4096 - 16) {
+        return classify_block_16(_mm_loadu_si128((const __m128i *) bytes), (1u << length) - 1);
+    }
+    return classes_scalar(bytes, length);
+}
+
+__attribute__((target("sse2"), no_sanitize_address))
+static unsigned classes_sse2(const char *bytes, size_t length)
+{
+    return classes_vector_16(bytes, length);
+}
+
+__attribute__((target("avx2"), no_sanitize_address))
+static unsigned classes_avx2(const char *bytes, size_t length)
+{
+    if (length < 32) {
+        return classes_vector_16(bytes, length);
+    }
+
+    const __m256i upper_shift = _mm256_set1_epi8(RANGE_SHIFT('A'));
+    const __m256i lower_shift = _mm256_set1_epi8(RANGE_SHIFT('a'));
+    const __m256i digit_shift = _mm256_set1_epi8(RANGE_SHIFT('0'));
+    const __m256i letter_limit = _mm256_set1_epi8(RANGE_LIMIT(LETTER_COUNT));
+    const __m256i digit_limit = _mm256_set1_epi8(RANGE_LIMIT(DIGIT_COUNT));
+
+    __m256i upper = _mm256_setzero_si256();
+    __m256i lower = _mm256_setzero_si256();
+    __m256i digit = _mm256_setzero_si256();
+    //Bytes that are letters or digits, special bytes are the ones where it stays 0
+    __m256i alphanumeric = _mm256_set1_epi8(-1);
+
+    //The last block overlaps the one before it, unless the length is a multiple of 32
+    for (size_t i = 0; i < length; i += 32) {
+        size_t start = i + 32 <= length ? i : length - 32;
+        __m256i data = _mm256_loadu_si256((const __m256i *) (bytes + start));
+        __m256i is_upper = _mm256_cmpgt_epi8(letter_limit, _mm256_add_epi8(data, upper_shift));
+        __m256i is_lower = _mm256_cmpgt_epi8(letter_limit, _mm256_add_epi8(data, lower_shift));
+        __m256i is_digit = _mm256_cmpgt_epi8(digit_limit, _mm256_add_epi8(data, digit_shift));
+
+        upper = _mm256_or_si256(upper, is_upper);
+        lower = _mm256_or_si256(lower, is_lower);
+        digit = _mm256_or_si256(digit, is_digit);
+        alphanumeric = _mm256_and_si256(alphanumeric, _mm256_or_si256(_mm256_or_si256(is_upper, is_lower), is_digit));
+    }
+
+    return (_mm256_movemask_epi8(upper) != 0 ? STRENGTH_UPPER : 0)
+           | (_mm256_movemask_epi8(lower) != 0 ? STRENGTH_LOWER : 0)
+           | (_mm256_movemask_epi8(digit) != 0 ? STRENGTH_DIGIT : 0)
+           | ((unsigned) _mm256_movemask_epi8(alphanumeric) != 0xFFFFFFFFu ? STRENGTH_SPECIAL : 0);
+}
+
+#endif
+
+static const classes_kernel kernels[STRENGTH_KERNEL_COUNT] = {
+    classes_scalar,
+#if STRENGTH_X86
+    classes_sse2,
+    classes_avx2,
+#endif
+};
+
+/**
+ * @return true if this CPU can run the kernel
+ */
+static bool kernel_supported(enum strength_kernel kernel)
+{
+    switch (kernel) {
+        case STRENGTH_SCALAR:
+            return true;
+#if STRENGTH_X86
+        case STRENGTH_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case STRENGTH_AVX2:
+            return __builtin_cpu_supports("avx2");
+#endif
+        default:
+            return false;
+    }
+}
+
+const char *strength_kernel_name(enum strength_kernel kernel)
+{
+    switch (kernel) {
+        case STRENGTH_SCALAR:
+            return "scalar";
+        case STRENGTH_SSE2:
+            return "SSE2";
+        case STRENGTH_AVX2:
+            return "AVX2";
+        default:
+            return "unknown";
+    }
+}
+
+static void prepare_tables(void);
+
+/**
+ * @note Makes strength_classes and the audit use the given kernel, nothing changes if the CPU can't run it.
+ *
+ * @return true if the kernel is used, false if this CPU doesn't support it
+ */
+bool strength_use_kernel(enum strength_kernel kernel)
+{
+    prepare_tables();
+    if (! kernel_supported(kernel)) {
+        return false;
+    }
+    current_kernel = kernel;
+    return true;
+}
+
+enum strength_kernel strength_current_kernel(void)
+{
+    prepare_tables();
+    return current_kernel;
+}
+
+/**
+ * @note Fills the lookup tables and picks the fastest kernel this CPU supports.
+ */
+static void build_tables(void)
+{
+    for (int byte = 0; byte < 256; byte++) {
+        if (byte >= 'A' && byte <= 'Z') {
+            byte_classes[byte] = STRENGTH_UPPER;
+        } else if (byte >= 'a' && byte <= 'z') {
+            byte_classes[byte] = STRENGTH_LOWER;
+        } else if (byte >= '0' && byte <= '9') {
+            byte_classes[byte] = STRENGTH_DIGIT;
+        } else {
+            byte_classes[byte] = STRENGTH_SPECIAL;
+        }
+    }
+
+    for (unsigned classes = 0; classes < STRENGTH_CLASS_MASKS; classes++) {
+        int range = ((classes & STRENGTH_UPPER) ? LETTER_COUNT : 0) + ((classes & STRENGTH_LOWER) ? LETTER_COUNT : 0)
+                    + ((classes & STRENGTH_DIGIT) ? DIGIT_COUNT : 0) + ((classes & STRENGTH_SPECIAL) ? SPECIAL_CHARS : 0);
+        range_bits[classes] = range == 0 ? 0 : log2(range);
+    }
+
+    for (int kernel = STRENGTH_KERNEL_COUNT - 1; kernel > STRENGTH_SCALAR; kernel--) {
+        if (kernel_supported(kernel)) {
+            current_kernel = kernel;
+            break;
+        }
+    }
+}
+
+static void prepare_tables(void)
+{
+    pthread_once(&tables_once, build_tables);
+}
+
+/**
+ * @return bit mask of the character classes (STRENGTH_UPPER, ...) used in the password
+ */
+unsigned strength_classes(const char *password, size_t length)
+{
+    prepare_tables();
+    return kernels[current_kernel](password, length);
+}
+
+/**
+ * @return entropy in bits of a password of given length that uses the classes
+ */
+double strength_entropy(unsigned classes, size_t length)
+{
+    prepare_tables();
+    return (double) length * range_bits[classes & (STRENGTH_CLASS_MASKS - 1)];
+}
+
+enum strength_class strength_classify(double entropy)
+{
+    if (entropy < 25) {
+        return STRENGTH_VERY_WEAK;
+    } else if (entropy < 50) {
+        return STRENGTH_WEAK;
+    } else if (entropy < 75) {
+        return STRENGTH_REASONABLE;
+    } else if (entropy < 100) {
+        return STRENGTH_STRONG;
+    }
+    return STRENGTH_VERY_STRONG;
+}
+
+const char *strength_class_name(enum strength_class strength)
+{
+    return class_names[strength];
+}
+
+/**
+ * @note Writes the buffer to output.
+ *
+ * @return true if everything was written, false otherwise
+ */
+static bool flush_verdicts(char *buffer, size_t *used, FILE *output)
+{
+    bool result = fwrite(buffer, 1, *used, output) == *used;
+    *used = 0;
+
+    if (! result) {
+        fprintf(stderr, "failed to write the results\n");
+    }
+    return result;
+}
+
+/**
+ * @note Scores every line of input (one password per line, a '\r' before the '\n' is ignored) with the pattern
+ * matcher and counts the verdicts. Input is read in AUDIT_BLOCK_SIZE blocks and a line is scored as its bytes go by,
+ * so the memory used does not depend on the size of the input or the length of the lines. The block
+ * with the passwords is overwritten at the end.
+ *
+ * @param input File descriptor with the passwords.
+ * @param filter Passwords in this filter are rated very weak and their verdict is "breached", NULL for no filter.
+ * @param output If per_line is true, the verdict of every line is written here, one per line and in order.
+ * @param result Histogram of the verdicts and totals are stored here.
+ * @return true on success, false on failure
+ */
+bool audit_passwords(int input, const struct breach_filter *filter, FILE *output, bool per_line,
+                     struct audit_result *result)
+{
+    prepare_tables();
+    memset(result, 0, sizeof(*result));
+    classes_kernel classify = kernels[current_kernel];
+
+    //The digest of a line is computed piece by piece like its classes
+    struct breach_hasher hasher;
+    unsigned char digest[BREACH_FILTER_DIGEST_SIZE];
+    if (filter != NULL && ! breach_hasher_init(&hasher)) {
+        return false;
+    }
+
+    //Patterns are searched only at the start of a line, so the start is all that has to be kept
+    struct pattern_scorer scorer;
+    char line_start[PATTERN_MAX_LENGTH];
+    size_t line_start_length = 0;
+    if (! pattern_scorer_init(&scorer)) {
+        if (filter != NULL) {
+            breach_hasher_free(&hasher);
+        }
+        return false;
+    }
+
+    char *block = malloc(AUDIT_BLOCK_SIZE);
+    char *verdicts = per_line ? malloc(AUDIT_BLOCK_SIZE) : NULL;
+    if (block == NULL || (per_line && verdicts == NULL)) {
+        free(block);
+        free(verdicts);
+        if (filter != NULL) {
+            breach_hasher_free(&hasher);
+        }
+        pattern_scorer_free(&scorer);
+        fprintf(stderr, "malloc failed\n");
+        return false;
+    }
+
+    size_t name_lengths[STRENGTH_CLASS_COUNT];
+    for (int i = 0; i < STRENGTH_CLASS_COUNT; i++) {
+        name_lengths[i] = strlen(class_names[i]);
+    }
+
+    //State of the line that is being read, it may span more blocks
+    unsigned classes = 0;
+    size_t length = 0;
+    bool pending_return = false;
+
+    size_t verdicts_used = 0;
+    bool success = filter == NULL || breach_hasher_start(&hasher);
+
+    while (success) {
+        ssize_t got = read(input, block, AUDIT_BLOCK_SIZE);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got < 0) {
+            fprintf(stderr, "failed to read the passwords\n");
+            success = false;
+            break;
+        }
+
+        const char *position = block;
+        const char *end = block + got;
+        result->bytes += (unsigned long long) got;
+
+        while (position < end || (got == 0 && (length > 0 || pending_return))) {
+            const char *newline = got == 0 ? NULL : memchr(position, '\n', (size_t) (end - position));
+            const char *line_end = newline == NULL ? end : newline;
+
+            if (line_end > position) {
+                //The '\r' before '\n' is not a part of the password, but it is known only when the line ends
+                if (pending_return) {
+                    classes |= STRENGTH_SPECIAL;
+                    length++;
+                    pending_return = false;
+                    if (line_start_length < PATTERN_MAX_LENGTH) {
+                        line_start[line_start_length++] = '\r';
+                    }
+                    if (filter != NULL && ! breach_hasher_update(&hasher, "\r", 1)) {
+                        fprintf(stderr, "failed to hash a password\n");
+                        success = false;
+                        break;
+                    }
+                }
+
+                const char *segment_end = line_end;
+                if (segment_end[-1] == '\r') {
+                    segment_end--;
+                    pending_return = true;
+                }
+
+                size_t segment_length = (size_t) (segment_end - position);
+                classes |= classify(position, segment_length);
+                length += segment_length;
+
+                size_t kept = PATTERN_MAX_LENGTH - line_start_length;
+                kept = kept < segment_length ? kept : segment_length;
+                memcpy(line_start + line_start_length, position, kept);
+                line_start_length += kept;
+
+                if (filter != NULL && ! breach_hasher_update(&hasher, position, (size_t) (segment_end - position))) {
+                    fprintf(stderr, "failed to hash a password\n");
+                    success = false;
+                    break;
+                }
+            }
+
+            //The last line does not need to end with '\n'
+            if (newline == NULL && got != 0) {
+                break;
+            }
+
+            enum strength_class strength = strength_classify(pattern_entropy(&scorer, line_start, length, classes));
+            const char *name = class_names[strength];
+            size_t name_length = name_lengths[strength];
+
+            if (filter != NULL) {
+                if (! breach_hasher_finish(&hasher, digest) || ! breach_hasher_start(&hasher)) {
+                    fprintf(stderr, "failed to hash a password\n");
+                    success = false;
+                    break;
+                }
+                if (breach_filter_contains(filter, digest)) {
+                    strength = STRENGTH_VERY_WEAK;
+                    name = BREACHED_NAME;
+                    name_length = sizeof(BREACHED_NAME) - 1;
+                    result->breached++;
+                }
+            }
+
+            result->histogram[strength]++;
+            result->passwords++;
+
+            if (per_line) {
+                if (AUDIT_BLOCK_SIZE - verdicts_used < name_length + 1
+                    && ! flush_verdicts(verdicts, &verdicts_used, output)) {
+                    success = false;
+                    break;
+                }
+                memcpy(verdicts + verdicts_used, name, name_length);
+                verdicts_used += name_length;
+                verdicts[verdicts_used++] = '\n';
+            }
+
+            classes = 0;
+            length = 0;
+            line_start_length = 0;
+            pending_return = false;
+            position = newline == NULL ? end : newline + 1;
+        }
+
+        if (got == 0) {
+            break;
+        }
+    }
+
+    if (success && per_line) {
+        success = flush_verdicts(verdicts, &verdicts_used, output) && fflush(output) == 0;
+    }
+
+    if (filter != NULL) {
+        //The context holds the hashed password too, it is wiped by freeing
+        breach_hasher_free(&hasher);
+        OPENSSL_cleanse(digest, sizeof(digest));
+    }
+
+    pattern_scorer_free(&scorer);
+    OPENSSL_cleanse(line_start, sizeof(line_start));
+    OPENSSL_cleanse(block, AUDIT_BLOCK_SIZE);
+    free(block);
+    free(verdicts);
+    return success;
+}
+
+/**
+ * @note Prints the histogram of verdicts and the throughput of the audit.
+ */
+void print_audit_summary(const struct audit_result *result, double seconds, FILE *output)
+{
+    fprintf(output, "Audited %llu passwords:\n", result->passwords);
+
+    for (int i = 0; i < STRENGTH_CLASS_COUNT; i++) {
+        double share = result->passwords == 0 ? 0 : 100.0 * (double) result->histogram[i] / (double) result->passwords;
+        int bar = (int) (share / 2 + 0.5);
+
+        fprintf(output, "%12s %12llu %6.2f %% ", class_names[i], result->histogram[i], share);
+        for (int j = 0; j < bar; j++) {
+            putc('#', output);
+        }
+        putc('\n', output);
+    }
+
+    if (result->breached > 0) {
+        fprintf(output, "%llu of the passwords are in the breach filter, they are counted as very weak.\n",
+                result->breached);
+    }
+
+    if (seconds > 0) {
+        fprintf(output, "%.1f MB in %.3f s, %.1f MB/s\n", (double) result->bytes / 1e6, seconds,
+                (double) result->bytes / 1e6 / seconds);
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef PASSWORD_GENERATOR_STRENGTH_H
+#define PASSWORD_GENERATOR_STRENGTH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "breach_filter.h"
+#include "patterns.h"
+
+/**
+ * Strength of a password is estimated from its entropy, length * log2(size of the character range), where
+ * the range is the sum of the sizes of the used classes: uppercase and lowercase letters (26 each),
+ * digits (10) and special characters (20, everything else).
+ */
+#define STRENGTH_UPPER 1u
+#define STRENGTH_LOWER 2u
+#define STRENGTH_DIGIT 4u
+#define STRENGTH_SPECIAL 8u
+#define STRENGTH_CLASS_MASKS 16
+
+enum strength_class {
+    STRENGTH_VERY_WEAK,
+    STRENGTH_WEAK,
+    STRENGTH_REASONABLE,
+    STRENGTH_STRONG,
+    STRENGTH_VERY_STRONG,
+    STRENGTH_CLASS_COUNT
+};
+
+/**
+ * Kernels that find the classes used in a run of bytes. The vector ones compare 16 or 32 bytes at once
+ * with range checks, all of them give the same result.
+ */
+enum strength_kernel {
+    STRENGTH_SCALAR,
+    STRENGTH_SSE2,
+    STRENGTH_AVX2,
+    STRENGTH_KERNEL_COUNT
+};
+
+//Input of the audit is read in blocks of this size, it is all the memory the audit needs
+#define AUDIT_BLOCK_SIZE (1 << 20)
+
+struct audit_result {
+    unsigned long long histogram[STRENGTH_CLASS_COUNT];
+    //Passwords found in the breach filter, they are counted as very weak in the histogram
+    unsigned long long breached;
+    unsigned long long passwords;
+    unsigned long long bytes;
+};
+
+bool strength_use_kernel(enum strength_kernel kernel);
+enum strength_kernel strength_current_kernel(void);
+const char *strength_kernel_name(enum strength_kernel kernel);
+unsigned strength_classes(const char *password, size_t length);
+double strength_entropy(unsigned classes, size_t length);
+enum strength_class strength_classify(double entropy);
+const char *strength_class_name(enum strength_class strength);
+
+bool audit_passwords(int input, const struct breach_filter *filter, FILE *output, bool per_line, struct audit_result *result);
+void print_audit_summary(const struct audit_result *result, double seconds, FILE *output);
+
+#endif //PASSWORD_GENERATOR_STRENGTH_H
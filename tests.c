@@ -0,0 +1,1360 @@
+#include "character_pool.h"
+#include "random_pool.h"
+#include "char_mapping.h"
+#include "strength.h"
+#include "passphrase.h"
+#include "passphrase_words.h"
+#include "policy.h"
+#include "vault.h"
+#include "vault_directory.h"
+#include "vault_index.h"
+#include "vault_transfer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include <openssl/crypto.h>
+#include <openssl/rand.h>
+
+//Characters whose frequencies are tested for every pool size
+#define CHARACTER_UNIFORMITY_COUNT (16 << 20)
+
+//Passphrases whose words are counted by the uniformity test
+#define PASSPHRASE_UNIFORMITY_COUNT 1000000
+
+//Passwords of every policy checked against the policy
+#define POLICY_COMPLIANCE_COUNT 100000
+
+//Characters and length of the policy whose compliant passwords are all counted by the uniformity test
+#define POLICY_UNIFORMITY_POOL "12abcAB"
+#define POLICY_UNIFORMITY_LENGTH 4
+//Generated passwords per compliant password of that policy
+#define POLICY_UNIFORMITY_SAMPLES 2000
+
+//Vaults of the vault tests are created in a new directory here, which is removed afterwards
+#define SCRATCH_TEMPLATE "/tmp/pwgen_tests.XXXXXX"
+#define SCRATCH_PATH_SIZE 64
+
+//Records saved by the writer process of the compaction test, the log is compacted every VAULT_LOG_COMPACTION_ENTRIES
+#define COMPACTION_TEST_RECORDS (16 * VAULT_LOG_COMPACTION_ENTRIES)
+
+//Accounts of the log test, enough for two background compactions
+#define LOG_TEST_RECORDS (2 * VAULT_LOG_COMPACTION_ENTRIES + 100)
+
+//Writer processes of the multi-process test and records each of them saves
+#define PROCESS_TEST_WRITERS 4
+#define PROCESS_TEST_RECORDS 500
+
+//Records of the listing test and the size of its pages
+#define LIST_TEST_RECORDS 25
+#define LIST_TEST_PAGE 10
+
+/**
+ * @note Pearson's chi-squared test of the frequencies. The critical value for significance level 10^-6
+ * is approximated by the Wilson-Hilferty transformation, so a correct generator fails about once
+ * in a million runs.
+ *
+ * @return true if the frequencies look uniform, false otherwise
+ */
+static bool is_uniform(const char *name, const unsigned long *frequencies, unsigned size, unsigned long total)
+{
+    double expected = (double) total / size;
+    double chi_squared = 0;
+
+    for (unsigned i = 0; i < size; i++) {
+        double difference = frequencies[i] - expected;
+        chi_squared += difference * difference / expected;
+    }
+
+    double degrees = size - 1;
+    double z = 4.753424; //1 - 10^-6 quantile of the standard normal distribution
+    double critical = degrees * pow(1 - 2 / (9 * degrees) + z * sqrt(2 / (9 * degrees)), 3);
+
+    bool uniform = chi_squared < critical;
+    printf("%-40s chi-squared %12.1f (critical %.1f) - %s\n", name, chi_squared, critical,
+           uniform ? "uniform" : "NOT uniform");
+    return uniform;
+}
+
+/**
+ * @note Maps the same random bytes by every kernel the CPU supports, for every pool size and many output lengths,
+ * and compares the characters and the number of used bytes with the scalar kernel.
+ *
+ * @return true if every kernel gave the same result as the scalar one, false otherwise
+ */
+static bool test_kernels(void)
+{
+    const size_t lengths[] = { 0, 1, 15, 16, 17, 31, 32, 33, 63, 100, 999, 4096, 40000 };
+    const size_t byte_count = 64 * 1024;
+
+    unsigned char *bytes = malloc(byte_count * sizeof(unsigned char));
+    char *expected = malloc(byte_count * sizeof(char));
+    char *actual = malloc(byte_count * sizeof(char));
+    if (bytes == NULL || expected == NULL || actual == NULL) {
+        free(bytes);
+        free(expected);
+        free(actual);
+        fprintf(stderr, "malloc failed\n");
+        return false;
+    }
+
+    if (RAND_bytes(bytes, (int) byte_count) != 1) {
+        fprintf(stderr, "failed to generate random numbers\n");
+        free(bytes);
+        free(expected);
+        free(actual);
+        return false;
+    }
+
+    char character_pool[CHAR_POOL_LENGTH];
+    int char_pool_end_index = 0;
+    build_character_pool("", character_pool, &char_pool_end_index);
+
+    bool matching = true;
+    unsigned long comparisons = 0;
+
+    for (int end_index = 0; end_index <= char_pool_end_index; end_index++) {
+        struct char_mapping scalar;
+        struct char_mapping vectorized;
+        char_mapping_init(&scalar, character_pool, end_index);
+        char_mapping_init(&vectorized, character_pool, end_index);
+        char_mapping_use_kernel(&scalar, CHAR_MAPPING_SCALAR);
+
+        for (int kernel = CHAR_MAPPING_SCALAR + 1; kernel < CHAR_MAPPING_KERNEL_COUNT; kernel++) {
+            if (! char_mapping_use_kernel(&vectorized, kernel)) {
+                continue;
+            }
+
+            for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+                //Offset of the input, so unaligned loads and short inputs are covered too
+                size_t offset = (i * 7) % 64;
+                size_t expected_count = 0;
+                size_t actual_count = 0;
+
+                size_t expected_used = char_mapping_map(&scalar, bytes + offset, byte_count - offset,
+                                                        expected, lengths[i], &expected_count);
+                size_t actual_used = char_mapping_map(&vectorized, bytes + offset, byte_count - offset,
+                                                      actual, lengths[i], &actual_count);
+
+                if (expected_used != actual_used || expected_count != actual_count
+                    || memcmp(expected, actual, expected_count) != 0) {
+                    printf("%s kernel differs from scalar for pool size %d and length %zu\n",
+                           char_mapping_kernel_name(kernel), end_index + 1, lengths[i]);
+                    matching = false;
+                }
+                comparisons++;
+            }
+        }
+    }
+
+    printf("Vectorized kernels compared with scalar on %lu inputs: %s\n", comparisons,
+           matching ? "identical" : "DIFFERENT");
+
+    OPENSSL_cleanse(bytes, byte_count);
+    free(bytes);
+    free(expected);
+    free(actual);
+    return matching;
+}
+
+/**
+ * @note Counts how often each character of the pool is generated by the mapping and tests whether the counts
+ * are uniformly distributed. Pools of a power of two characters, just above and just below one are tested
+ * along with the whole pool, because each of them rejects a different share of the random bytes.
+ *
+ * @return true if every pool looks uniform, false otherwise
+ */
+static bool test_characters(void)
+{
+    const int pool_sizes[] = { 2, 10, 31, 32, 33, 64, 65, CHAR_POOL_LENGTH };
+    char character_pool[CHAR_POOL_LENGTH];
+    int char_pool_end_index = 0;
+    build_character_pool("", character_pool, &char_pool_end_index);
+
+    struct random_pool pool;
+    if (! random_pool_init(&pool)) {
+        return false;
+    }
+
+    bool uniform = true;
+    char block[4096];
+
+    for (size_t i = 0; i < sizeof(pool_sizes) / sizeof(pool_sizes[0]); i++) {
+        int end_index = pool_sizes[i] - 1 < char_pool_end_index ? pool_sizes[i] - 1 : char_pool_end_index;
+        struct char_mapping mapping;
+        if (! char_mapping_init(&mapping, character_pool, end_index)) {
+            random_pool_free(&pool);
+            return false;
+        }
+
+        unsigned long frequencies[CHAR_POOL_LENGTH] = { 0 };
+        for (long done = 0; done < CHARACTER_UNIFORMITY_COUNT; done += (long) sizeof(block)) {
+            if (! char_mapping_generate(&mapping, &pool, block, sizeof(block))) {
+                random_pool_free(&pool);
+                return false;
+            }
+            //The pool is built from the whole printable ASCII, so character index and pool index are the same
+            for (size_t j = 0; j < sizeof(block); j++) {
+                frequencies[block[j] - ' ']++;
+            }
+        }
+
+        char name[64];
+        snprintf(name, sizeof(name), "rejection mapping, pool of %u", mapping.size);
+        uniform = is_uniform(name, frequencies, mapping.size, CHARACTER_UNIFORMITY_COUNT) && uniform;
+    }
+
+    random_pool_free(&pool);
+    OPENSSL_cleanse(block, sizeof(block));
+    return uniform;
+}
+
+static int compare_word_offsets(const void *first, const void *second)
+{
+    uint32_t a = *(const uint32_t *) first;
+    uint32_t b = *(const uint32_t *) second;
+    size_t a_length = passphrase_word_offsets[a + 1] - passphrase_word_offsets[a];
+    size_t b_length = passphrase_word_offsets[b + 1] - passphrase_word_offsets[b];
+
+    int result = memcmp(passphrase_words + passphrase_word_offsets[a], passphrase_words + passphrase_word_offsets[b],
+                        a_length < b_length ? a_length : b_length);
+    if (result != 0) {
+        return result;
+    }
+    return a_length < b_length ? -1 : a_length > b_length;
+}
+
+/**
+ * @return index of the word in the word list, -1 if it is not there
+ */
+static long find_word(const uint32_t *sorted, const char *word, size_t length)
+{
+    size_t low = 0;
+    size_t high = passphrase_word_count;
+    while (low < high) {
+        size_t middle = (low + high) / 2;
+        uint32_t index = sorted[middle];
+        size_t middle_length = passphrase_word_offsets[index + 1] - passphrase_word_offsets[index];
+        int result = memcmp(word, passphrase_words + passphrase_word_offsets[index],
+                            length < middle_length ? length : middle_length);
+        if (result == 0) {
+            result = length < middle_length ? -1 : length > middle_length;
+        }
+        if (result == 0) {
+            return index;
+        }
+        if (result < 0) {
+            high = middle;
+        } else {
+            low = middle + 1;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @note Counts how often each word of the list is in the passphrases of the block.
+ * Every word of the passphrases has to be in the list.
+ */
+static bool count_words(const char *block, size_t used, const uint32_t *sorted, unsigned long *frequencies,
+                        unsigned long *total)
+{
+    for (size_t position = 0; position < used;) {
+        size_t length = strcspn(block + position, "-\n");
+        long index = find_word(sorted, block + position, length);
+        if (index < 0) {
+            fprintf(stderr, "generated word %.*s is not in the word list\n", (int) length, block + position);
+            return false;
+        }
+        frequencies[index]++;
+        (*total)++;
+        position += length + 1;
+    }
+    return true;
+}
+
+/**
+ * @note Generates PASSPHRASE_UNIFORMITY_COUNT passphrases of PASSPHRASE_DEFAULT_WORDS words and tests whether
+ * their words are picked uniformly from the word list.
+ *
+ * @return true if the words look uniform, false otherwise
+ */
+static bool test_passphrases(void)
+{
+    struct passphrase_format format;
+    if (! passphrase_format_init(&format, PASSPHRASE_DEFAULT_WORDS, PASSPHRASE_DEFAULT_SEPARATOR)) {
+        return false;
+    }
+    const size_t block_size = 1 << 20;
+    size_t lines_per_block = block_size / (passphrase_longest(&format) + 1);
+
+    char *block = malloc(block_size * sizeof(char));
+    uint32_t *sorted = malloc(passphrase_word_count * sizeof(*sorted));
+    unsigned long *frequencies = calloc(passphrase_word_count, sizeof(*frequencies));
+    if (block == NULL || sorted == NULL || frequencies == NULL) {
+        free(block);
+        free(sorted);
+        free(frequencies);
+        fprintf(stderr, "malloc failed\n");
+        return false;
+    }
+
+    struct random_pool pool;
+    if (! random_pool_init(&pool)) {
+        free(block);
+        free(sorted);
+        free(frequencies);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < passphrase_word_count; i++) {
+        sorted[i] = i;
+    }
+    qsort(sorted, passphrase_word_count, sizeof(*sorted), compare_word_offsets);
+
+    bool result = true;
+    size_t used = 0;
+    unsigned long total = 0;
+    for (long done = 0; result && done < PASSPHRASE_UNIFORMITY_COUNT; done += (long) lines_per_block) {
+        size_t lines = PASSPHRASE_UNIFORMITY_COUNT - done < (long) lines_per_block
+                       ? (size_t) (PASSPHRASE_UNIFORMITY_COUNT - done) : lines_per_block;
+        result = passphrase_generate_lines(&format, &pool, block, lines, &used)
+                 && count_words(block, used, sorted, frequencies, &total);
+    }
+
+    if (result) {
+        char name[64];
+        snprintf(name, sizeof(name), "%lu words from a list of %u", total, passphrase_word_count);
+        result = is_uniform(name, frequencies, passphrase_word_count, total);
+    }
+
+    random_pool_free(&pool);
+    OPENSSL_cleanse(block, block_size);
+    free(block);
+    free(sorted);
+    free(frequencies);
+    return result;
+}
+
+/**
+ * @note Generates passwords of the strictest policies (no repeats, no sequences and all classes of the pool)
+ * by the policy generator and checks every one of them against the policy.
+ *
+ * @return true if every password complies, false otherwise
+ */
+static bool test_policies(void)
+{
+    const struct {
+        size_t length;
+        bool digits_only;
+    } cases[] = { { 4, false }, { 8, false }, { 16, false }, { POLICY_MAX_LENGTH, false }, { 16, true } };
+
+    char non_digits[CHAR_POOL_LENGTH + 1];
+    size_t non_digit_count = 0;
+    for (char chr = ' '; chr <= '~'; chr++) {
+        if (chr < '0' || chr > '9') {
+            non_digits[non_digit_count++] = chr;
+        }
+    }
+    non_digits[non_digit_count] = '\0';
+
+    char password[POLICY_MAX_LENGTH];
+    struct random_pool pool;
+    if (! random_pool_init(&pool)) {
+        return false;
+    }
+
+    bool result = true;
+    for (size_t i = 0; result && i < sizeof(cases) / sizeof(cases[0]); i++) {
+        size_t length = cases[i].length;
+        struct password_policy policy = {
+            .required = cases[i].digits_only ? STRENGTH_DIGIT
+                                             : STRENGTH_LOWER | STRENGTH_UPPER | STRENGTH_DIGIT | STRENGTH_SPECIAL,
+            .no_repeats = true,
+            .no_sequences = true
+        };
+
+        char character_pool[CHAR_POOL_LENGTH];
+        int char_pool_end_index = 0;
+        build_character_pool(cases[i].digits_only ? non_digits : "", character_pool, &char_pool_end_index);
+
+        struct policy_generator generator;
+        if (! policy_generator_init(&generator, &policy, character_pool, char_pool_end_index, length)) {
+            random_pool_free(&pool);
+            return false;
+        }
+
+        //Retried passwords comply by definition, the single pass is what has to be checked
+        generator.retry = false;
+        unsigned long rejected = 0;
+        for (long done = 0; result && done < POLICY_COMPLIANCE_COUNT; done++) {
+            result = policy_generate(&generator, &pool, password);
+            rejected += result && ! password_policy_allows(&policy, password, length);
+        }
+        policy_generator_free(&generator);
+
+        printf("%ld passwords of %zu %s: %lu broke the policy\n", (long) POLICY_COMPLIANCE_COUNT, length,
+               cases[i].digits_only ? "digits" : "characters of all classes", rejected);
+        result = result && rejected == 0;
+    }
+
+    random_pool_free(&pool);
+    OPENSSL_cleanse(password, sizeof(password));
+    return result;
+}
+
+/**
+ * @return index of the password among all passwords of the pool with its length, pool is in ascending order
+ */
+static size_t password_index(const char *pool, size_t size, const char *password, size_t length)
+{
+    size_t index = 0;
+    for (size_t i = 0; i < length; i++) {
+        index = index * size + (size_t) (strchr(pool, password[i]) - pool);
+    }
+    return index;
+}
+
+/**
+ * @note Counts how often each compliant password of a small policy is generated, once by the single pass
+ * and once by retrying, and tests whether the counts are uniformly distributed. All passwords of the pool
+ * are checked against the policy, so the number of compliant passwords is known without the generator.
+ *
+ * @return true if both ways look uniform, false otherwise
+ */
+static bool test_policy_uniformity(void)
+{
+    const char *kept = POLICY_UNIFORMITY_POOL;
+    char excluded[CHAR_POOL_LENGTH + 1];
+    size_t excluded_count = 0;
+    for (char chr = ' '; chr <= '~'; chr++) {
+        if (strchr(kept, chr) == NULL) {
+            excluded[excluded_count++] = chr;
+        }
+    }
+    excluded[excluded_count] = '\0';
+
+    char character_pool[CHAR_POOL_LENGTH];
+    int char_pool_end_index = 0;
+    build_character_pool(excluded, character_pool, &char_pool_end_index);
+    size_t size = (size_t) char_pool_end_index + 1;
+    character_pool[size] = '\0';
+
+    struct password_policy policy = {
+        .required = STRENGTH_LOWER | STRENGTH_UPPER | STRENGTH_DIGIT,
+        .no_repeats = true,
+        .no_sequences = true
+    };
+
+    //Compliant passwords get their own counters, the others none
+    size_t all = 1;
+    for (size_t i = 0; i < POLICY_UNIFORMITY_LENGTH; i++) {
+        all *= size;
+    }
+    long *counter = malloc(all * sizeof(*counter));
+    if (counter == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        return false;
+    }
+
+    unsigned compliant = 0;
+    char password[POLICY_UNIFORMITY_LENGTH];
+    for (size_t index = 0; index < all; index++) {
+        for (size_t i = 0, rest = index; i < POLICY_UNIFORMITY_LENGTH; i++, rest /= size) {
+            password[POLICY_UNIFORMITY_LENGTH - 1 - i] = character_pool[rest % size];
+        }
+        counter[index] = password_policy_allows(&policy, password, POLICY_UNIFORMITY_LENGTH) ? (long) compliant++ : -1;
+    }
+
+    struct policy_generator generator;
+    unsigned long *frequencies = calloc(compliant, sizeof(*frequencies));
+    if (frequencies == NULL || ! policy_generator_init(&generator, &policy, character_pool, char_pool_end_index,
+                                                       POLICY_UNIFORMITY_LENGTH)) {
+        if (frequencies == NULL) {
+            fprintf(stderr, "malloc failed\n");
+        }
+        free(frequencies);
+        free(counter);
+        return false;
+    }
+
+    //Both ways are tested whichever the generator chose, so the retrying one needs its mapping
+    bool result = char_mapping_init(&generator.mapping, character_pool, char_pool_end_index);
+    printf("%u of %zu passwords comply, the generator counted %.0f\n", compliant, all,
+           exp2(policy_entropy(&generator)));
+    result = result && fabs(policy_entropy(&generator) - log2(compliant)) < 1e-9;
+
+    struct random_pool pool;
+    if (! result || ! random_pool_init(&pool)) {
+        policy_generator_free(&generator);
+        free(frequencies);
+        free(counter);
+        return false;
+    }
+
+    unsigned long total = (unsigned long) compliant * POLICY_UNIFORMITY_SAMPLES;
+    for (int retry = 0; result && retry < 2; retry++) {
+        generator.retry = retry;
+        memset(frequencies, 0, compliant * sizeof(*frequencies));
+
+        for (unsigned long done = 0; result && done < total; done++) {
+            result = policy_generate(&generator, &pool, password);
+            long index = result ? counter[password_index(character_pool, size, password, POLICY_UNIFORMITY_LENGTH)] : 0;
+            if (index < 0) {
+                printf("generated password %.*s breaks the policy\n", POLICY_UNIFORMITY_LENGTH, password);
+                result = false;
+            } else {
+                frequencies[index]++;
+            }
+        }
+
+        result = result && is_uniform(retry ? "retrying policy generator" : "single pass policy generator",
+                                      frequencies, compliant, total);
+    }
+
+    random_pool_free(&pool);
+    policy_generator_free(&generator);
+    OPENSSL_cleanse(password, sizeof(password));
+    free(frequencies);
+    free(counter);
+    return result;
+}
+
+/**
+ * @note Creates a new empty directory for the files of one test.
+ *
+ * @param directory Buffer of SCRATCH_PATH_SIZE characters, the path of the directory is stored here.
+ * @return true on success, false on failure
+ */
+static bool make_scratch(char *directory)
+{
+    strcpy(directory, SCRATCH_TEMPLATE);
+    if (mkdtemp(directory) == NULL) {
+        fprintf(stderr, "failed to create %s\n", SCRATCH_TEMPLATE);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @note Removes the files of a test and its directory.
+ */
+static void remove_scratch(const char *directory)
+{
+    DIR *entries = opendir(directory);
+    if (entries != NULL) {
+        char path[SCRATCH_PATH_SIZE + 256];
+        struct dirent *entry;
+        while ((entry = readdir(entries)) != NULL) {
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
+                snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+                unlink(path);
+            }
+        }
+        closedir(entries);
+    }
+    rmdir(directory);
+}
+
+/**
+ * @return true if the vault has the account with the password, false otherwise (what differs is printed)
+ */
+static bool has_password(struct vault *vault, const char *site, const char *account, const char *password)
+{
+    struct vault_record record;
+    bool found = false;
+    if (! vault_get(vault, site, account, &record, &found) || ! found) {
+        printf("  %s %s is missing\n", site, account);
+        return false;
+    }
+
+    bool same = record.password_length == strlen(password) && memcmp(record.password, password, strlen(password)) == 0;
+    if (! same) {
+        printf("  %s %s has a different password\n", site, account);
+    }
+    vault_record_free(&record);
+    return same;
+}
+
+//Records with every character that has to be quoted or escaped by the formats
+static const struct {
+    const char *site;
+    const char *account;
+    const char *password;
+} transfer_records[] = {
+    { "example.com", "joe", "pass,word" },
+    { "\"quoted\" site", "a,b", "\"\"" },
+    { "back\\slash", "tab\tbed", "{\"json\": 1}" },
+    { "unicode", "\xc5\xbelu\xc5\xa5", "\xc3\xbc\xe2\x82\xac" },
+    { "spaces", " leading", "trailing " },
+};
+
+/**
+ * @note Exports a vault to path in the format and imports the file to a new vault next to it.
+ *
+ * @return true if the new vault has all the records, false otherwise
+ */
+static bool transfer_round_trip(struct vault *vault, const char *directory, enum transfer_format format)
+{
+    const char *name = format == TRANSFER_CSV ? "csv" : "jsonl";
+    char path[SCRATCH_PATH_SIZE + 16];
+    char copy_path[SCRATCH_PATH_SIZE + 16];
+    snprintf(path, sizeof(path), "%s/export.%s", directory, name);
+    snprintf(copy_path, sizeof(copy_path), "%s/copy-%s", directory, name);
+
+    FILE *output = fopen(path, "w");
+    size_t exported = 0;
+    bool result = output != NULL && vault_export(vault, output, format, &exported);
+    if (output != NULL) {
+        result = fclose(output) == 0 && result;
+    }
+
+    struct vault copy;
+    size_t imported = 0;
+    if (! result || ! vault_open(&copy, copy_path)) {
+        printf("  %s: failed to export\n", name);
+        return false;
+    }
+
+    result = vault_import(&copy, path, format, 2, &imported);
+    size_t count = sizeof(transfer_records) / sizeof(transfer_records[0]);
+    printf("  %s: %zu records exported, %zu imported\n", name, exported, imported);
+    result = result && exported == count && imported == count;
+    for (size_t i = 0; result && i < count; i++) {
+        result = has_password(&copy, transfer_records[i].site, transfer_records[i].account,
+                              transfer_records[i].password);
+    }
+    vault_close(&copy);
+    return result;
+}
+
+/**
+ * @note Exports a vault with names and passwords that have to be quoted or escaped, imports the exports back
+ * and checks that line breaks are refused by the vault and by the import (a record is one line in both formats).
+ *
+ * @return true if the records survive both formats and line breaks are refused, false otherwise
+ */
+static bool test_transfer(void)
+{
+    char directory[SCRATCH_PATH_SIZE];
+    if (! make_scratch(directory)) {
+        return false;
+    }
+
+    char path[SCRATCH_PATH_SIZE + 16];
+    snprintf(path, sizeof(path), "%s/vault", directory);
+    struct vault vault;
+    bool opened = vault_open(&vault, path);
+    bool result = opened;
+    for (size_t i = 0; result && i < sizeof(transfer_records) / sizeof(transfer_records[0]); i++) {
+        result = vault_put(&vault, transfer_records[i].site, transfer_records[i].account,
+                           transfer_records[i].password);
+    }
+
+    result = result && transfer_round_trip(&vault, directory, TRANSFER_CSV)
+             && transfer_round_trip(&vault, directory, TRANSFER_JSONL);
+
+    //Both refusals print why
+    bool put_refused = result && ! vault_put(&vault, "line\nbreak", "joe", "password")
+                       && ! vault_put(&vault, "site", "joe", "pass\rword");
+    printf("  line breaks refused by the vault: %s\n", put_refused ? "yes" : "no");
+    result = result && put_refused;
+
+    snprintf(path, sizeof(path), "%s/breaks.jsonl", directory);
+    FILE *output = fopen(path, "w");
+    result = result && output != NULL
+             && fputs("{\"site\": \"line\\nbreak\", \"account\": \"joe\", \"password\": \"x\"}\n", output) >= 0;
+    if (output != NULL) {
+        result = fclose(output) == 0 && result;
+    }
+    size_t imported = 0;
+    bool import_refused = result && ! vault_import(&vault, path, TRANSFER_JSONL, 1, &imported);
+    printf("  line breaks refused by the import: %s\n", import_refused ? "yes" : "no");
+    result = result && import_refused;
+
+    if (opened) {
+        vault_close(&vault);
+    }
+    remove_scratch(directory);
+    return result;
+}
+
+/**
+ * @note Counts the records of the compaction test saved before the limit (their sites are site-NUMBER).
+ */
+static bool count_saved(const struct vault_record *record, void *context)
+{
+    size_t *counter = context;
+    char site[VAULT_MAX_NAME_LENGTH + 1];
+    memcpy(site, record->site, record->site_length);
+    site[record->site_length] = '\0';
+
+    size_t number = 0;
+    if (sscanf(site, "site-%zu", &number) == 1 && number < counter[0]) {
+        counter[1]++;
+    }
+    return true;
+}
+
+/**
+ * @note Saves COMPACTION_TEST_RECORDS records in a child process, which compacts the log in the background as it
+ * grows, and opens the vault again and again meanwhile. Every opening has to see all records whose saving finished
+ * before it started, also when the vault file and the log are being replaced.
+ *
+ * @return true if no opening missed a record, false otherwise
+ */
+static bool test_open_during_compaction(void)
+{
+    char directory[SCRATCH_PATH_SIZE];
+    if (! make_scratch(directory)) {
+        return false;
+    }
+    char path[SCRATCH_PATH_SIZE + 16];
+    snprintf(path, sizeof(path), "%s/vault", directory);
+
+    //Number of records the child has saved so far
+    size_t *saved = mmap(NULL, sizeof(*saved), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (saved == MAP_FAILED) {
+        fprintf(stderr, "mmap failed\n");
+        remove_scratch(directory);
+        return false;
+    }
+    *saved = 0;
+
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        struct vault vault;
+        bool opened = vault_open(&vault, path);
+        bool result = opened && vault_set_group_commit(&vault, true);
+        char site[32];
+        for (size_t i = 0; result && i < COMPACTION_TEST_RECORDS; i++) {
+            snprintf(site, sizeof(site), "site-%zu", i);
+            result = vault_put(&vault, site, "joe", "password");
+            __atomic_store_n(saved, i + 1, __ATOMIC_RELEASE);
+        }
+        if (opened) {
+            vault_close(&vault);
+        }
+        _exit(result ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    bool result = child > 0;
+    size_t openings = 0;
+    size_t missed = 0;
+    while (result && __atomic_load_n(saved, __ATOMIC_ACQUIRE) < COMPACTION_TEST_RECORDS) {
+        size_t counter[2] = { __atomic_load_n(saved, __ATOMIC_ACQUIRE), 0 };
+        if (counter[0] == 0) {
+            continue;
+        }
+
+        struct vault vault;
+        result = vault_open(&vault, path);
+        if (result) {
+            result = vault_for_each_name(&vault, count_saved, counter);
+            vault_close(&vault);
+        }
+        openings++;
+        missed += counter[1] != counter[0];
+    }
+
+    int status = 0;
+    if (child > 0) {
+        result = waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS
+                 && result;
+    }
+    printf("  %zu openings, %zu of them missed records\n", openings, missed);
+
+    munmap(saved, sizeof(*saved));
+    remove_scratch(directory);
+    return result && missed == 0;
+}
+
+/**
+ * @return contents of the file in a new buffer with its size in *size, NULL on failure
+ */
+static unsigned char *read_whole_file(const char *path, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    unsigned char *data = NULL;
+    if (file != NULL && fseek(file, 0, SEEK_END) == 0 && ftell(file) >= 0) {
+        *size = (size_t) ftell(file);
+        data = malloc(*size + 1);
+        if (data != NULL && (fseek(file, 0, SEEK_SET) != 0 || fread(data, 1, *size, file) != *size)) {
+            free(data);
+            data = NULL;
+        }
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+    if (data == NULL) {
+        fprintf(stderr, "failed to read %s\n", path);
+    }
+    return data;
+}
+
+/**
+ * @return true if the file was overwritten by the data, false otherwise
+ */
+static bool write_whole_file(const char *path, const unsigned char *data, size_t size)
+{
+    FILE *file = fopen(path, "wb");
+    bool result = file != NULL && fwrite(data, 1, size, file) == size;
+    if (file != NULL) {
+        result = fclose(file) == 0 && result;
+    }
+    if (! result) {
+        fprintf(stderr, "failed to write %s\n", path);
+    }
+    return result;
+}
+
+/**
+ * @return true if the text is somewhere in the data
+ */
+static bool data_contains(const unsigned char *data, size_t size, const char *text)
+{
+    size_t length = strlen(text);
+    for (size_t i = 0; i + length <= size; i++) {
+        if (memcmp(data + i, text, length) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @note Puts back the log a vault had before a new vault file was written, like a crash between renaming
+ * the vault file and replacing the log leaves it.
+ *
+ * @return true on success, false on failure
+ */
+static bool restore_log(const char *log_path, const unsigned char *log, size_t log_size)
+{
+    return log != NULL && write_whole_file(log_path, log, log_size);
+}
+
+/**
+ * @note Writes new vault files by vault_put_all and vault_encrypt_all and then puts the old logs back, as a crash
+ * right after the vault file is renamed leaves them. Entries of an old log must not be applied over the new vault
+ * file, and the plain text log left by the encryption must be replaced by the next change.
+ *
+ * @return true if the old logs are skipped and the plain text one is replaced, false otherwise
+ */
+static bool test_stale_log(void)
+{
+    char directory[SCRATCH_PATH_SIZE];
+    if (! make_scratch(directory)) {
+        return false;
+    }
+    char path[SCRATCH_PATH_SIZE + 16];
+    char log_path[SCRATCH_PATH_SIZE + 16];
+    snprintf(path, sizeof(path), "%s/vault", directory);
+    snprintf(log_path, sizeof(log_path), "%s%s", path, VAULT_LOG_SUFFIX);
+
+    struct vault vault;
+    unsigned char *log = NULL;
+    size_t log_size = 0;
+    bool opened = vault_open(&vault, path);
+    bool result = opened && vault_put(&vault, "a.com", "joe", "old") && vault_put(&vault, "b.com", "joe", "kept")
+                  && (log = read_whole_file(log_path, &log_size)) != NULL;
+
+    struct vault_record imported = { .site = "a.com", .site_length = 5, .account = "joe", .account_length = 3,
+                                     .password = "imported", .password_length = 8 };
+    result = result && vault_put_all(&vault, &imported, 1, false);
+    if (opened) {
+        vault_close(&vault);
+    }
+    opened = result && restore_log(log_path, log, log_size) && vault_open(&vault, path);
+    result = opened;
+    bool imported_kept = result && has_password(&vault, "a.com", "joe", "imported")
+                         && has_password(&vault, "b.com", "joe", "kept");
+    printf("  log left by an import skipped: %s\n", imported_kept ? "yes" : "no");
+    result = result && imported_kept;
+
+    free(log);
+    log = NULL;
+    result = result && vault_put(&vault, "c.com", "joe", "plaintext secret")
+             && (log = read_whole_file(log_path, &log_size)) != NULL && vault_encrypt_all(&vault, "master password");
+    if (opened) {
+        vault_close(&vault);
+    }
+    opened = result && restore_log(log_path, log, log_size) && vault_open(&vault, path);
+    result = opened;
+
+    bool correct = false;
+    bool encrypted_kept = result && vault_unlock(&vault, "master password", &correct) && correct
+                          && has_password(&vault, "a.com", "joe", "imported")
+                          && has_password(&vault, "c.com", "joe", "plaintext secret");
+    printf("  log left by an encryption skipped: %s\n", encrypted_kept ? "yes" : "no");
+    result = result && encrypted_kept;
+
+    //The next change replaces the plain text log
+    free(log);
+    log = NULL;
+    result = result && vault_put(&vault, "d.com", "joe", "new") && has_password(&vault, "c.com", "joe", "plaintext secret")
+             && has_password(&vault, "d.com", "joe", "new") && (log = read_whole_file(log_path, &log_size)) != NULL;
+    bool replaced = result && ! data_contains(log, log_size, "plaintext secret");
+    printf("  plain text log replaced: %s\n", replaced ? "yes" : "no");
+    result = result && replaced;
+
+    free(log);
+    if (opened) {
+        vault_close(&vault);
+    }
+    remove_scratch(directory);
+    return result;
+}
+
+/**
+ * @return password of the log test's account number i, changed if i is divisible by 3 and removed if by 5
+ */
+static const char *log_test_password(size_t i, char *password, size_t size)
+{
+    if (i % 5 == 0) {
+        return NULL;
+    }
+    snprintf(password, size, "%s-%zu", i % 3 == 0 ? "changed" : "first", i);
+    return password;
+}
+
+/**
+ * @return true if the vault has the final state of the log test, false otherwise (what differs is printed)
+ */
+static bool check_log_test(struct vault *vault)
+{
+    char account[32];
+    char password[32];
+    bool result = true;
+    for (size_t i = 0; result && i < LOG_TEST_RECORDS; i++) {
+        snprintf(account, sizeof(account), "user%zu", i);
+        if (log_test_password(i, password, sizeof(password)) != NULL) {
+            result = has_password(vault, "log.test", account, password);
+            continue;
+        }
+
+        struct vault_record record;
+        bool found = true;
+        result = vault_get(vault, "log.test", account, &record, &found) && ! found;
+        if (found) {
+            printf("  removed account %s is still there\n", account);
+            vault_record_free(&record);
+        }
+    }
+    return result;
+}
+
+/**
+ * @note Saves, changes and removes more accounts than fit one log, so the log is compacted in the background,
+ * and checks the vault after reopening it (which replays the log) and after compacting the rest of the log.
+ *
+ * @return true if every state has the right passwords, false otherwise
+ */
+static bool test_vault_log(void)
+{
+    char directory[SCRATCH_PATH_SIZE];
+    if (! make_scratch(directory)) {
+        return false;
+    }
+    char path[SCRATCH_PATH_SIZE + 16];
+    snprintf(path, sizeof(path), "%s/vault", directory);
+
+    struct vault vault;
+    char account[32];
+    char password[32];
+    bool opened = vault_open(&vault, path);
+    bool result = opened;
+    for (size_t i = 0; result && i < LOG_TEST_RECORDS; i++) {
+        snprintf(account, sizeof(account), "user%zu", i);
+        snprintf(password, sizeof(password), "first-%zu", i);
+        result = vault_put(&vault, "log.test", account, password);
+    }
+
+    bool found = false;
+    for (size_t i = 0; result && i < LOG_TEST_RECORDS; i++) {
+        snprintf(account, sizeof(account), "user%zu", i);
+        if (i % 5 == 0) {
+            result = vault_delete(&vault, "log.test", account, &found) && found;
+        } else if (i % 3 == 0) {
+            result = vault_put(&vault, "log.test", account, log_test_password(i, password, sizeof(password)));
+        }
+    }
+    if (opened) {
+        vault_close(&vault);
+    }
+
+    opened = result && vault_open(&vault, path);
+    bool replayed = opened && check_log_test(&vault);
+    printf("  %zu entries replayed from the log: %s\n", opened ? vault.log_count : 0, replayed ? "right" : "wrong");
+
+    bool compacted = replayed && vault_compact(&vault) && vault.log_count == 0 && check_log_test(&vault);
+    if (opened) {
+        vault_close(&vault);
+    }
+    opened = compacted && vault_open(&vault, path);
+    compacted = opened && vault.log_count == 0 && check_log_test(&vault);
+    printf("  compacted vault: %s\n", compacted ? "right" : "wrong");
+    if (opened) {
+        vault_close(&vault);
+    }
+
+    remove_scratch(directory);
+    return replayed && compacted;
+}
+
+/**
+ * @note Replaces and removes records of an index many times, so its arena is also collected, and checks
+ * what is found after every change.
+ *
+ * @return true if every lookup finds the last record of the account, false otherwise
+ */
+static bool test_vault_index(void)
+{
+    struct vault_index index;
+    if (! vault_index_init(&index)) {
+        return false;
+    }
+
+    char site[32];
+    char password[32];
+    bool result = true;
+    for (size_t round = 0; result && round < 20; round++) {
+        for (size_t i = 0; result && i < 1000; i++) {
+            snprintf(site, sizeof(site), "site%zu", i);
+            snprintf(password, sizeof(password), "password-%zu-%zu", round, i);
+            struct vault_record record;
+            result = vault_record_init(&record, site, (uint32_t) strlen(site), "joe", 3, password,
+                                       (uint32_t) strlen(password));
+            if (result) {
+                result = vault_index_put(&index, &record);
+                vault_record_free(&record);
+            }
+        }
+
+        //Every other account is removed in odd rounds, and put back by the next round
+        for (size_t i = 0; result && round % 2 == 1 && i < 1000; i += 2) {
+            snprintf(site, sizeof(site), "site%zu", i);
+            result = vault_index_remove(&index, site, strlen(site), "joe", 3);
+        }
+
+        for (size_t i = 0; result && i < 1000; i++) {
+            snprintf(site, sizeof(site), "site%zu", i);
+            snprintf(password, sizeof(password), "password-%zu-%zu", round, i);
+            const struct vault_record *found = vault_index_find(&index, site, strlen(site), "joe", 3);
+            bool removed = round % 2 == 1 && i % 2 == 0;
+            result = removed ? found == NULL
+                             : found != NULL && found->password_length == strlen(password)
+                               && memcmp(found->password, password, strlen(password)) == 0;
+        }
+        result = result && index.count == (round % 2 == 1 ? 500 : 1000);
+    }
+
+    bool removed = result && vault_index_remove(&index, "site1", 5, "joe", 3)
+                   && ! vault_index_remove(&index, "site1", 5, "joe", 3)
+                   && vault_index_find(&index, "site1", 5, "joe", 3) == NULL;
+    printf("  %zu records after 20 rounds of replacing, %zu live and %zu garbage bytes\n", index.count,
+           index.live_bytes, index.garbage_bytes);
+    printf("  removed record gone: %s\n", removed ? "yes" : "no");
+
+    vault_index_free(&index);
+    return result && removed;
+}
+
+/**
+ * @note Saves the records of one writer of the multi-process test and reads the records of the next writer.
+ *
+ * @return EXIT_SUCCESS if every call succeeds, EXIT_FAILURE otherwise
+ */
+static int run_writer(const char *path, size_t writer)
+{
+    struct vault vault;
+    if (! vault_open(&vault, path)) {
+        return EXIT_FAILURE;
+    }
+
+    //Half of the writers read through an index, which has to follow the changes of the others too
+    bool result = writer % 2 == 0 || vault_use_index(&vault);
+    char site[32];
+    char other[32];
+    char account[32];
+    char password[32];
+    snprintf(site, sizeof(site), "writer%zu", writer);
+    snprintf(other, sizeof(other), "writer%zu", (writer + 1) % PROCESS_TEST_WRITERS);
+
+    for (size_t i = 0; result && i < PROCESS_TEST_RECORDS; i++) {
+        snprintf(account, sizeof(account), "user%zu", i);
+        snprintf(password, sizeof(password), "password-%zu-%zu", writer, i);
+        struct vault_record record;
+        bool found = false;
+        result = vault_put(&vault, site, account, password) && vault_get(&vault, other, account, &record, &found);
+        if (result && found) {
+            vault_record_free(&record);
+        }
+    }
+    vault_close(&vault);
+    return result ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @note Several processes save records to one vault at once, each reading what another one saves,
+ * and the log is compacted meanwhile. Then every record must be in the vault.
+ *
+ * @return true if all writers succeeded and no record is missing, false otherwise
+ */
+static bool test_vault_processes(void)
+{
+    char directory[SCRATCH_PATH_SIZE];
+    if (! make_scratch(directory)) {
+        return false;
+    }
+    char path[SCRATCH_PATH_SIZE + 16];
+    snprintf(path, sizeof(path), "%s/vault", directory);
+
+    fflush(stdout);
+    size_t started = 0;
+    for (; started < PROCESS_TEST_WRITERS; started++) {
+        pid_t child = fork();
+        if (child == 0) {
+            _exit(run_writer(path, started));
+        }
+        if (child < 0) {
+            fprintf(stderr, "fork failed\n");
+            break;
+        }
+    }
+
+    bool result = started == PROCESS_TEST_WRITERS;
+    int status = 0;
+    for (size_t i = 0; i < started; i++) {
+        result = wait(&status) > 0 && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS && result;
+    }
+
+    struct vault vault;
+    char site[32];
+    char account[32];
+    char password[32];
+    bool opened = vault_open(&vault, path);
+    size_t missing = 0;
+    for (size_t writer = 0; opened && writer < PROCESS_TEST_WRITERS; writer++) {
+        for (size_t i = 0; i < PROCESS_TEST_RECORDS; i++) {
+            snprintf(site, sizeof(site), "writer%zu", writer);
+            snprintf(account, sizeof(account), "user%zu", i);
+            snprintf(password, sizeof(password), "password-%zu-%zu", writer, i);
+            missing += ! has_password(&vault, site, account, password);
+        }
+    }
+    if (opened) {
+        vault_close(&vault);
+    }
+    printf("  %d writers, %zu records missing\n", PROCESS_TEST_WRITERS, missing);
+
+    remove_scratch(directory);
+    return result && opened && missing == 0;
+}
+
+/**
+ * @note Builds the directory of a few sites and checks the sites found by a prefix and by the fuzzy search.
+ *
+ * @return true if both searches find the right sites, false otherwise
+ */
+static bool test_vault_directory(void)
+{
+    char directory_path[SCRATCH_PATH_SIZE];
+    if (! make_scratch(directory_path)) {
+        return false;
+    }
+    char path[SCRATCH_PATH_SIZE + 16];
+    snprintf(path, sizeof(path), "%s/vault", directory_path);
+
+    const char *sites[] = { "github.com", "gitlab.com", "google.com", "example.org", "git", "bitbucket.org" };
+    struct vault vault;
+    if (! vault_open(&vault, path)) {
+        remove_scratch(directory_path);
+        return false;
+    }
+
+    bool result = true;
+    for (size_t i = 0; result && i < sizeof(sites) / sizeof(sites[0]); i++) {
+        result = vault_put(&vault, sites[i], "joe", "password") && vault_put(&vault, sites[i], "ann", "password");
+    }
+
+    struct vault_directory directory;
+    if (! result || ! vault_directory_build(&directory, &vault)) {
+        if (result) {
+            vault_directory_free(&directory);
+        }
+        vault_close(&vault);
+        remove_scratch(directory_path);
+        return false;
+    }
+
+    //Sites are sorted by their bytes: git, github.com, gitlab.com
+    size_t first = 0;
+    size_t end = 0;
+    vault_directory_prefix(&directory, "git", 3, &first, &end);
+    bool prefix = end - first == 3 && strncmp(directory.sites[first].name, "git", directory.sites[first].length) == 0
+                  && directory.sites[first].account_count == 2;
+    vault_directory_prefix(&directory, "gitz", 4, &first, &end);
+    prefix = prefix && first == end;
+    printf("  prefix search: %s\n", prefix ? "right" : "wrong");
+
+    struct vault_directory_match *matches = NULL;
+    size_t count = 0;
+    //Swapped neighbours are one typo
+    bool fuzzy = vault_directory_fuzzy(&directory, "gihtub.com", 10, 2, &matches, &count) && count == 1
+                 && directory.sites[matches[0].site].length == 10
+                 && memcmp(directory.sites[matches[0].site].name, "github.com", 10) == 0 && matches[0].distance == 1;
+    free(matches);
+    matches = NULL;
+    fuzzy = fuzzy && vault_directory_fuzzy(&directory, "gitlab.co", 9, 1, &matches, &count) && count == 1
+            && matches[0].distance == 1;
+    free(matches);
+    printf("  fuzzy search: %s\n", fuzzy ? "right" : "wrong");
+
+    vault_directory_free(&directory);
+    vault_close(&vault);
+    remove_scratch(directory_path);
+    return prefix && fuzzy;
+}
+
+struct listed {
+    char names[LIST_TEST_RECORDS + 1][32];
+    size_t count;
+};
+
+/**
+ * @note Remembers the site of a listed record.
+ */
+static bool remember_listed(const struct vault_record *record, void *context)
+{
+    struct listed *listed = context;
+    if (listed->count <= LIST_TEST_RECORDS && record->site_length < sizeof(listed->names[0])) {
+        memcpy(listed->names[listed->count], record->site, record->site_length);
+        listed->names[listed->count][record->site_length] = '\0';
+    }
+    listed->count++;
+    return true;
+}
+
+/**
+ * @note Lists a vault page by page with one cursor, while records are added in front of the cursor and after it.
+ * Every record that was there from the start must be listed once, in order, and the last page must say
+ * there is no more.
+ *
+ * @return true if the pages are right, false otherwise
+ */
+static bool test_vault_list(void)
+{
+    char directory[SCRATCH_PATH_SIZE];
+    if (! make_scratch(directory)) {
+        return false;
+    }
+    char path[SCRATCH_PATH_SIZE + 16];
+    snprintf(path, sizeof(path), "%s/vault", directory);
+
+    struct vault vault;
+    char site[32];
+    if (! vault_open(&vault, path)) {
+        remove_scratch(directory);
+        return false;
+    }
+
+    bool result = true;
+    for (size_t i = 0; result && i < LIST_TEST_RECORDS; i++) {
+        snprintf(site, sizeof(site), "site%02zu.com", i);
+        result = vault_put(&vault, site, "joe", "password");
+    }
+
+    struct vault_list_query query = { .site_pattern = "site*", .limit = LIST_TEST_PAGE };
+    struct vault_cursor cursor = { .started = false };
+    struct listed listed = { .count = 0 };
+    bool more = true;
+    size_t pages = 0;
+    while (result && more && pages <= LIST_TEST_RECORDS) {
+        size_t before = listed.count;
+        result = vault_list(&vault, &query, &cursor, remember_listed, &listed, &more);
+        result = result && listed.count - before <= LIST_TEST_PAGE && (! more || listed.count - before == LIST_TEST_PAGE);
+        pages++;
+
+        //A record before the cursor is not listed anymore, one after it is
+        if (pages == 1) {
+            result = result && vault_put(&vault, "site00a.com", "joe", "password")
+                     && vault_put(&vault, "site99.com", "joe", "password") && vault_put(&vault, "other.com", "joe", "x");
+        }
+    }
+
+    bool ordered = result && listed.count == LIST_TEST_RECORDS + 1;
+    for (size_t i = 0; ordered && i < LIST_TEST_RECORDS; i++) {
+        snprintf(site, sizeof(site), "site%02zu.com", i);
+        ordered = strcmp(listed.names[i], site) == 0;
+    }
+    ordered = ordered && strcmp(listed.names[LIST_TEST_RECORDS], "site99.com") == 0;
+    printf("  %zu records listed in %zu pages: %s\n", listed.count, pages, ordered ? "right" : "wrong");
+
+    vault_close(&vault);
+    remove_scratch(directory);
+    return ordered;
+}
+
+static const struct {
+    const char *name;
+    bool (*run)(void);
+} tests[] = {
+    { "kernels", test_kernels },
+    { "characters", test_characters },
+    { "passphrases", test_passphrases },
+    { "policies", test_policies },
+    { "policy-uniformity", test_policy_uniformity },
+    { "transfer", test_transfer },
+    { "open-during-compaction", test_open_during_compaction },
+    { "stale-log", test_stale_log },
+    { "vault-log", test_vault_log },
+    { "vault-index", test_vault_index },
+    { "vault-processes", test_vault_processes },
+    { "vault-directory", test_vault_directory },
+    { "vault-list", test_vault_list },
+};
+
+/**
+ * @note Runs the test named by the only argument, or all tests without arguments. Every test prints what it found.
+ *
+ * @return EXIT_SUCCESS if all run tests pass, EXIT_FAILURE otherwise
+ */
+int main(int argc, char **argv)
+{
+    if (argc > 2) {
+        fprintf(stderr, "Usage: %s [TEST]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (! initialize_generator()) {
+        return EXIT_FAILURE;
+    }
+
+    bool passed = true;
+    bool found = false;
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+        if (argc == 2 && strcmp(argv[1], tests[i].name) != 0) {
+            continue;
+        }
+        found = true;
+        printf("%s:\n", tests[i].name);
+        bool result = tests[i].run();
+        printf("%s %s\n\n", tests[i].name, result ? "passed" : "FAILED");
+        passed = passed && result;
+    }
+
+    if (! found) {
+        fprintf(stderr, "Unknown test %s.\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,2461 @@
+#include "vault.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <openssl/crypto.h>
+
+static void put_u32(unsigned char *destination, uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        destination[i] = (unsigned char) (value >> (8 * i));
+    }
+}
+
+static void put_u64(unsigned char *destination, uint64_t value)
+{
+    for (int i = 0; i < 8; i++) {
+        destination[i] = (unsigned char) (value >> (8 * i));
+    }
+}
+
+static uint32_t get_u32(const unsigned char *source)
+{
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; i--) {
+        value = (value << 8) | source[i];
+    }
+    return value;
+}
+
+static uint64_t get_u64(const unsigned char *source)
+{
+    uint64_t value = 0;
+    for (int i = 7; i >= 0; i--) {
+        value = (value << 8) | source[i];
+    }
+    return value;
+}
+
+/**
+ * @return FNV-1a hash of the site, a zero byte and the account
+ */
+uint64_t vault_hash_key(const char *site, size_t site_length, const char *account, size_t account_length)
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (size_t i = 0; i < site_length; i++) {
+        hash = (hash ^ (unsigned char) site[i]) * 1099511628211ULL;
+    }
+    hash *= 1099511628211ULL;
+    for (size_t i = 0; i < account_length; i++) {
+        hash = (hash ^ (unsigned char) account[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * @return FNV-1a hash of the bytes, used as checksum of log entries
+ */
+static uint32_t checksum(const unsigned char *data, size_t length)
+{
+    uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ data[i]) * 16777619U;
+    }
+    return hash;
+}
+
+/**
+ * @note Writes all length bytes.
+ *
+ * @return true on success, false on failure
+ */
+static bool write_all(int fd, const void *buffer, size_t length)
+{
+    size_t done = 0;
+
+    while (done < length) {
+        ssize_t result = write(fd, (const char *) buffer + done, length - done);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return false;
+        }
+        done += result;
+    }
+    return true;
+}
+
+/**
+ * @note Reads exactly length bytes from offset.
+ *
+ * @return true on success, false on failure or if the file is shorter
+ */
+static bool read_at(int fd, void *buffer, size_t length, uint64_t offset)
+{
+    size_t done = 0;
+
+    while (done < length) {
+        ssize_t result = pread(fd, (char *) buffer + done, length - done, (off_t) (offset + done));
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            return false;
+        }
+        done += result;
+    }
+    return true;
+}
+
+/**
+ * @return newly allocated path followed by suffix, NULL on failure
+ */
+static char *path_with_suffix(const char *path, const char *suffix)
+{
+    size_t length = strlen(path) + strlen(suffix) + 1;
+    char *result = malloc(length);
+    if (result == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        return NULL;
+    }
+    snprintf(result, length, "%s%s", path, suffix);
+    return result;
+}
+
+/**
+ * @note Creates an empty file next to path with a unique name, so temporary files of more processes
+ * never collide. Only the owner can read it.
+ *
+ * @param temporary Allocated name of the file is stored here, free it.
+ * @return descriptor of the file, -1 on failure
+ */
+static int create_temporary(const char *path, char **temporary)
+{
+    *temporary = path_with_suffix(path, ".XXXXXX");
+    if (*temporary == NULL) {
+        return -1;
+    }
+
+    int fd = mkstemp(*temporary);
+    if (fd < 0 || fcntl(fd, F_SETFD, FD_CLOEXEC) != 0) {
+        fprintf(stderr, "failed to create a temporary file for %s\n", path);
+        if (fd >= 0) {
+            close(fd);
+            remove(*temporary);
+        }
+        free(*temporary);
+        *temporary = NULL;
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @note Flushes the directory of path to the disk, so a file renamed into it stays there after a crash.
+ *
+ * @return true on success, false on failure
+ */
+static bool sync_directory(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    char *directory = slash == NULL ? strdup(".") : strndup(path, slash == path ? 1 : (size_t) (slash - path));
+    if (directory == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        return false;
+    }
+
+    int fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    bool result = fd >= 0 && fsync(fd) == 0;
+    if (! result) {
+        fprintf(stderr, "failed to sync %s\n", directory);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(directory);
+    return result;
+}
+
+/**
+ * @note Opens the file at path and creates it if it does not exist yet. A newly created file
+ * is written to its directory right away, so it does not vanish after a crash.
+ *
+ * @param flags Flags for open, without O_CREAT.
+ * @return descriptor of the file, -1 on failure
+ */
+static int open_created(const char *path, int flags)
+{
+    int fd = open(path, flags | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0) {
+        if (! sync_directory(path)) {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+    if (errno != EEXIST) {
+        return -1;
+    }
+    //Somebody else created it first, they sync the directory
+    return open(path, flags);
+}
+
+/**
+ * @note Takes the writer lock of the vault, waits while another process or thread holds it.
+ * Every taker opens the lock file on its own, so the lock works between threads too.
+ *
+ * @return descriptor that holds the lock, pass it to unlock_writers; -1 on failure
+ */
+static int lock_writers(const struct vault *vault)
+{
+    int fd = open_created(vault->lock_path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "failed to open %s\n", vault->lock_path);
+        return -1;
+    }
+
+    while (flock(fd, LOCK_EX) != 0) {
+        if (errno != EINTR) {
+            fprintf(stderr, "failed to lock %s\n", vault->lock_path);
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+static void unlock_writers(int fd)
+{
+    //Closing the only descriptor of the lock file releases the lock
+    close(fd);
+}
+
+/**
+ * @note Maps the whole vault file to memory and checks its header. All reads of the vault file
+ * go through this mapping, records are parsed right from it without copying.
+ *
+ * @return true on success, false on failure
+ */
+static bool map_file(struct vault *vault)
+{
+    struct stat status;
+    if (fstat(vault->fd, &status) != 0 || status.st_size < VAULT_HEADER_SIZE) {
+        fprintf(stderr, "%s is not a vault file\n", vault->path);
+        return false;
+    }
+
+    vault->map_size = (size_t) status.st_size;
+    void *map = mmap(NULL, vault->map_size, PROT_READ, MAP_SHARED, vault->fd, 0);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "failed to map %s\n", vault->path);
+        return false;
+    }
+    vault->map = map;
+
+    if (memcmp(vault->map, VAULT_MAGIC, VAULT_MAGIC_LENGTH) != 0) {
+        fprintf(stderr, "%s is not a vault file\n", vault->path);
+        return false;
+    }
+
+    vault->header.version = get_u32(vault->map + 8);
+    vault->header.flags = get_u32(vault->map + 12);
+    vault->header.record_count = get_u64(vault->map + 16);
+    vault->header.index_offset = get_u64(vault->map + 24);
+    vault->header.index_capacity = get_u64(vault->map + 32);
+    memcpy(vault->header.kdf.salt, vault->map + 40, VAULT_SALT_SIZE);
+    vault->header.kdf.log_n = get_u32(vault->map + 56);
+    vault->header.kdf.r = get_u32(vault->map + 60);
+    vault->header.kdf.p = get_u32(vault->map + 64);
+    memcpy(vault->header.key_check, vault->map + 68, VAULT_CIPHER_OVERHEAD);
+    vault->header.order_offset = get_u64(vault->map + 96);
+    vault->header.generation = get_u64(vault->map + 104);
+    vault->header.merged_log_size = get_u64(vault->map + 112);
+
+    if (vault->header.version != VAULT_VERSION) {
+        fprintf(stderr, "unsupported vault version %u\n", vault->header.version);
+        return false;
+    }
+
+    if (vault->header.index_offset < VAULT_HEADER_SIZE || vault->header.index_offset > vault->map_size
+        || (vault->header.index_capacity & (vault->header.index_capacity - 1)) != 0
+        || (vault->map_size - vault->header.index_offset) / VAULT_INDEX_SLOT_SIZE < vault->header.index_capacity
+        || (vault->header.order_offset != 0
+            && (vault->header.order_offset < VAULT_HEADER_SIZE || vault->header.order_offset > vault->map_size
+                || (vault->map_size - vault->header.order_offset) / 8 < vault->header.record_count))) {
+        fprintf(stderr, "vault file was probably altered\n");
+        return false;
+    }
+    return true;
+}
+
+static void unmap_file(struct vault *vault)
+{
+    if (vault->map != NULL) {
+        munmap((void *) vault->map, vault->map_size);
+    }
+    vault->map = NULL;
+    vault->map_size = 0;
+}
+
+static bool open_log(struct vault *vault);
+static bool read_log_tail(struct vault *vault, bool repair);
+
+/**
+ * @note Opens the vault at path, an empty vault is created if there is no file yet.
+ * Changes saved in the log are loaded too.
+ *
+ * @param vault Vault to be opened. Close it with vault_close.
+ * @param path Path to the vault file, it has to stay valid until the vault is closed.
+ * @return true on success, false on failure
+ */
+bool vault_open(struct vault *vault, const char *path)
+{
+    vault->path = path;
+    vault->fd = -1;
+    vault->log_fd = -1;
+    vault->log_entries = NULL;
+    vault->log_count = 0;
+    vault->log_capacity = 0;
+    arena_init(&vault->log_arena);
+    vault->compactor_started = false;
+    vault->map = NULL;
+    vault->map_size = 0;
+    vault->index_built = false;
+    vault->unlocked = false;
+    vault->group_commit = false;
+    vault->unsynced = false;
+
+    vault->log_path = path_with_suffix(path, VAULT_LOG_SUFFIX);
+    vault->lock_path = path_with_suffix(path, VAULT_LOCK_SUFFIX);
+    if (vault->log_path == NULL || vault->lock_path == NULL) {
+        free(vault->log_path);
+        free(vault->lock_path);
+        return false;
+    }
+
+    if (pthread_mutex_init(&vault->lock, NULL) != 0) {
+        free(vault->log_path);
+        free(vault->lock_path);
+        fprintf(stderr, "failed to create a lock\n");
+        return false;
+    }
+
+    if (access(path, F_OK) != 0) {
+        //Another process may be creating the vault right now
+        int lock_fd = lock_writers(vault);
+        bool result = lock_fd >= 0 && (access(path, F_OK) == 0 || vault_write(path, NULL, NULL, 0));
+        if (lock_fd >= 0) {
+            unlock_writers(lock_fd);
+        }
+        if (! result) {
+            vault_close(vault);
+            return false;
+        }
+    }
+
+    //The log is opened first, as in reopen_files, so a compaction that replaces both files meanwhile
+    //can't leave this process with the old vault file and the new log
+    if (! open_log(vault)) {
+        vault_close(vault);
+        return false;
+    }
+
+    vault->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (vault->fd < 0) {
+        fprintf(stderr, "failed to open %s\n", path);
+        vault_close(vault);
+        return false;
+    }
+
+    if (! map_file(vault) || ! read_log_tail(vault, false)) {
+        vault_close(vault);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @note Waits for a running compaction, syncs changes made with group commit and closes the vault.
+ */
+void vault_close(struct vault *vault)
+{
+    if (vault->compactor_started) {
+        pthread_join(vault->compactor, NULL);
+        vault->compactor_started = false;
+    }
+
+    if (vault->unsynced) {
+        vault_sync(vault);
+    }
+
+    unmap_file(vault);
+    if (vault->fd >= 0) {
+        close(vault->fd);
+    }
+    vault->fd = -1;
+
+    if (vault->log_fd >= 0) {
+        close(vault->log_fd);
+    }
+    vault->log_fd = -1;
+
+    free(vault->log_entries);
+    arena_free(&vault->log_arena);
+    vault->log_entries = NULL;
+    vault->log_count = 0;
+    vault->log_capacity = 0;
+
+    if (vault->index_built) {
+        vault_index_free(&vault->index);
+    }
+    vault->index_built = false;
+
+    if (vault->unlocked) {
+        vault_key_free(&vault->key);
+    }
+    vault->unlocked = false;
+
+    if (vault->log_path != NULL) {
+        pthread_mutex_destroy(&vault->lock);
+    }
+    free(vault->log_path);
+    vault->log_path = NULL;
+    free(vault->lock_path);
+    vault->lock_path = NULL;
+}
+
+/**
+ * @note Copies the strings of the record to block, which has room for all three of them.
+ */
+static void fill_record(struct vault_record *record, char *block, const char *site, uint32_t site_length,
+                        const char *account, uint32_t account_length, const char *password, uint32_t password_length)
+{
+    record->site = block;
+    record->site_length = site_length;
+    memcpy(record->site, site, site_length);
+    record->site[site_length] = '\0';
+
+    record->account = record->site + site_length + 1;
+    record->account_length = account_length;
+    memcpy(record->account, account, account_length);
+    record->account[account_length] = '\0';
+
+    record->password = record->account + account_length + 1;
+    record->password_length = password_length;
+    memcpy(record->password, password, password_length);
+    record->password[password_length] = '\0';
+}
+
+/**
+ * @note Allocates one block for all three strings of the record. Free it with vault_record_free.
+ *
+ * @return true on success, false on failure
+ */
+bool vault_record_init(struct vault_record *record, const char *site, uint32_t site_length,
+                       const char *account, uint32_t account_length, const char *password, uint32_t password_length)
+{
+    char *block = malloc((size_t) site_length + account_length + password_length + 3);
+    if (block == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        return false;
+    }
+
+    fill_record(record, block, site, site_length, account, account_length, password, password_length);
+    return true;
+}
+
+/**
+ * @note Like vault_record_init, but the strings are allocated in the arena. The record must not be passed
+ * to vault_record_free, it is wiped and freed together with the arena.
+ *
+ * @return true on success, false on failure
+ */
+bool vault_record_init_in(struct vault_record *record, struct arena *arena, const char *site, uint32_t site_length,
+                          const char *account, uint32_t account_length, const char *password, uint32_t password_length)
+{
+    char *block = arena_alloc(arena, (size_t) site_length + account_length + password_length + 3);
+    if (block == NULL) {
+        return false;
+    }
+
+    fill_record(record, block, site, site_length, account, account_length, password, password_length);
+    return true;
+}
+
+/**
+ * @note Overwrites the password and frees the record's strings.
+ */
+void vault_record_free(struct vault_record *record)
+{
+    if (record->site == NULL) {
+        return;
+    }
+
+    OPENSSL_cleanse(record->password, record->password_length);
+    free(record->site);
+    record->site = NULL;
+    record->account = NULL;
+    record->password = NULL;
+}
+
+void vault_free_records(struct vault_record *records, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        vault_record_free(&records[i]);
+    }
+    free(records);
+}
+
+/**
+ * @note Parses a record from data, which holds the record header and at least available bytes.
+ *
+ * @return size of the record, 0 if the record does not fit to available bytes or is too long
+ */
+static size_t parse_record(const unsigned char *data, size_t available, const char **site, uint32_t *site_length,
+                           const char **account, uint32_t *account_length, const char **password, uint32_t *password_length)
+{
+    if (available < VAULT_RECORD_HEADER_SIZE) {
+        return 0;
+    }
+
+    *site_length = get_u32(data);
+    *account_length = get_u32(data + 4);
+    *password_length = get_u32(data + 8);
+
+    if (*site_length > VAULT_MAX_NAME_LENGTH || *account_length > VAULT_MAX_NAME_LENGTH
+        || *password_length > VAULT_MAX_STORED_PASSWORD_LENGTH) {
+        return 0;
+    }
+
+    size_t size = VAULT_RECORD_HEADER_SIZE + (size_t) *site_length + *account_length + *password_length;
+    if (size > available) {
+        return 0;
+    }
+
+    *site = (const char *) data + VAULT_RECORD_HEADER_SIZE;
+    *account = *site + *site_length;
+    *password = *account + *account_length;
+    return size;
+}
+
+/**
+ * @note Looks the account up only in the vault file, not in the log.
+ *
+ * @param record If the account is found, it is stored here. Free it with vault_record_free.
+ * @param found Set to true if the account was found, false otherwise.
+ * @return true if no error occurs, false otherwise
+ */
+static bool base_get(struct vault *vault, const char *site, size_t site_length, const char *account,
+                     size_t account_length, struct vault_record *record, bool *found)
+{
+    *found = false;
+    record->site = NULL;
+
+    if (vault->header.index_capacity == 0) {
+        return true;
+    }
+
+    uint64_t hash = vault_hash_key(site, site_length, account, account_length);
+    uint64_t mask = vault->header.index_capacity - 1;
+    const unsigned char *index = vault->map + vault->header.index_offset;
+
+    for (uint64_t probe = 0; probe < vault->header.index_capacity; probe++) {
+        const unsigned char *slot = index + ((hash + probe) & mask) * VAULT_INDEX_SLOT_SIZE;
+
+        uint64_t record_offset = get_u64(slot + 8);
+        if (record_offset == 0) {
+            return true;
+        }
+        if (get_u64(slot) != hash) {
+            continue;
+        }
+
+        const char *record_site = NULL;
+        const char *record_account = NULL;
+        const char *record_password = NULL;
+        uint32_t record_site_length = 0;
+        uint32_t record_account_length = 0;
+        uint32_t record_password_length = 0;
+
+        if (record_offset < VAULT_HEADER_SIZE || record_offset >= vault->header.index_offset
+            || parse_record(vault->map + record_offset, vault->header.index_offset - record_offset,
+                            &record_site, &record_site_length, &record_account, &record_account_length,
+                            &record_password, &record_password_length) == 0) {
+            fprintf(stderr, "vault file was probably altered\n");
+            return false;
+        }
+
+        if (record_site_length == site_length && record_account_length == account_length
+            && memcmp(record_site, site, site_length) == 0 && memcmp(record_account, account, account_length) == 0) {
+            *found = vault_record_init(record, record_site, record_site_length, record_account,
+                                       record_account_length, record_password, record_password_length);
+            return *found;
+        }
+    }
+    return true;
+}
+
+static int compare_names(const char *first, uint32_t first_length, const char *second, uint32_t second_length)
+{
+    int result = memcmp(first, second, first_length < second_length ? first_length : second_length);
+    if (result != 0) {
+        return result;
+    }
+    return (first_length > second_length) - (first_length < second_length);
+}
+
+static int compare_records(const void *first, const void *second)
+{
+    const struct vault_record *first_record = first;
+    const struct vault_record *second_record = second;
+
+    int result = compare_names(first_record->site, first_record->site_length,
+                               second_record->site, second_record->site_length);
+    if (result != 0) {
+        return result;
+    }
+    return compare_names(first_record->account, first_record->account_length,
+                         second_record->account, second_record->account_length);
+}
+
+/**
+ * @note Writes a new vault with given records to a new temporary file next to path, the file is not renamed
+ * over path yet. The records are sorted in place.
+ *
+ * @param header Flags, encryption parameters, the generation and the merged log size of the vault are taken
+ * from here, the rest is computed. Can be NULL for a new vault that is not encrypted.
+ * @param records Records to be saved, they must have different site and account pairs. Can be NULL if count is 0.
+ * @param temporary Allocated name of the written file is stored here, free it.
+ * @return true on success, false on failure
+ */
+static bool write_temporary_vault(const char *path, const struct vault_header *header_fields,
+                                  struct vault_record *records, size_t count, char **temporary)
+{
+    if (count > 0) {
+        qsort(records, count, sizeof(*records), compare_records);
+    }
+
+    uint64_t capacity = 0;
+    if (count > 0) {
+        capacity = 16;
+        while (capacity < 2 * count) {
+            capacity *= 2;
+        }
+    }
+
+    unsigned char *index = calloc(capacity == 0 ? 1 : capacity, VAULT_INDEX_SLOT_SIZE);
+    unsigned char *order = malloc(count == 0 ? 1 : count * 8);
+    if (index == NULL || order == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        free(index);
+        free(order);
+        return false;
+    }
+
+    int fd = create_temporary(path, temporary);
+    if (fd < 0) {
+        free(index);
+        free(order);
+        return false;
+    }
+
+    FILE *file = fdopen(fd, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "failed to create %s\n", *temporary);
+        close(fd);
+        remove(*temporary);
+        free(*temporary);
+        free(index);
+        free(order);
+        return false;
+    }
+
+    unsigned char header[VAULT_HEADER_SIZE] = { 0 };
+    bool result = fwrite(header, 1, VAULT_HEADER_SIZE, file) == VAULT_HEADER_SIZE;
+    uint64_t offset = VAULT_HEADER_SIZE;
+
+    for (size_t i = 0; i < count && result; i++) {
+        unsigned char record_header[VAULT_RECORD_HEADER_SIZE];
+        put_u32(record_header, records[i].site_length);
+        put_u32(record_header + 4, records[i].account_length);
+        put_u32(record_header + 8, records[i].password_length);
+
+        result = fwrite(record_header, 1, VAULT_RECORD_HEADER_SIZE, file) == VAULT_RECORD_HEADER_SIZE
+                 && fwrite(records[i].site, 1, records[i].site_length, file) == records[i].site_length
+                 && fwrite(records[i].account, 1, records[i].account_length, file) == records[i].account_length
+                 && fwrite(records[i].password, 1, records[i].password_length, file) == records[i].password_length;
+
+        uint64_t hash = vault_hash_key(records[i].site, records[i].site_length, records[i].account, records[i].account_length);
+        uint64_t slot = hash & (capacity - 1);
+        while (get_u64(index + slot * VAULT_INDEX_SLOT_SIZE + 8) != 0) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        put_u64(index + slot * VAULT_INDEX_SLOT_SIZE, hash);
+        put_u64(index + slot * VAULT_INDEX_SLOT_SIZE + 8, offset);
+        put_u64(order + i * 8, offset);
+
+        offset += VAULT_RECORD_HEADER_SIZE + records[i].site_length + records[i].account_length + records[i].password_length;
+    }
+
+    memcpy(header, VAULT_MAGIC, VAULT_MAGIC_LENGTH);
+    put_u32(header + 8, VAULT_VERSION);
+    put_u32(header + 12, header_fields == NULL ? 0 : header_fields->flags);
+    put_u64(header + 16, count);
+    put_u64(header + 24, offset);
+    put_u64(header + 32, capacity);
+    put_u64(header + 96, offset + capacity * VAULT_INDEX_SLOT_SIZE);
+    if (header_fields != NULL) {
+        put_u64(header + 104, header_fields->generation);
+        put_u64(header + 112, header_fields->merged_log_size);
+    }
+
+    if (header_fields != NULL && (header_fields->flags & VAULT_FLAG_ENCRYPTED)) {
+        memcpy(header + 40, header_fields->kdf.salt, VAULT_SALT_SIZE);
+        put_u32(header + 56, header_fields->kdf.log_n);
+        put_u32(header + 60, header_fields->kdf.r);
+        put_u32(header + 64, header_fields->kdf.p);
+        memcpy(header + 68, header_fields->key_check, VAULT_CIPHER_OVERHEAD);
+    }
+
+    //The file has to be on the disk before it is renamed over the old one, or a crash could leave neither of them
+    result = result
+             && fwrite(index, VAULT_INDEX_SLOT_SIZE, capacity, file) == capacity
+             && fwrite(order, 8, count, file) == count
+             && fseek(file, 0, SEEK_SET) == 0
+             && fwrite(header, 1, VAULT_HEADER_SIZE, file) == VAULT_HEADER_SIZE
+             && fflush(file) == 0 && fsync(fileno(file)) == 0;
+    result = fclose(file) == 0 && result;
+    free(index);
+    free(order);
+
+    if (! result) {
+        fprintf(stderr, "failed to write %s\n", *temporary);
+        remove(*temporary);
+        free(*temporary);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @note Renames the synced temporary file over path, in one step, so there is always either the old or the new
+ * file, and syncs the directory. Frees the name, the file is removed on failure.
+ *
+ * @return true on success, false on failure
+ */
+static bool rename_temporary(char *temporary, const char *path)
+{
+    bool result = rename(temporary, path) == 0;
+    if (! result) {
+        fprintf(stderr, "failed to replace %s\n", path);
+        remove(temporary);
+    }
+    free(temporary);
+    return result && sync_directory(path);
+}
+
+/**
+ * @note Writes a new vault with given records to a temporary file with a unique name and then renames it over path,
+ * so readers see either the old or the new vault file. The records are sorted in place.
+ *
+ * @param path Path of the vault file.
+ * @param header Flags, encryption parameters, the generation and the merged log size of the vault are taken
+ * from here, the rest is computed. Can be NULL for a new vault that is not encrypted.
+ * @param records Records to be saved, they must have different site and account pairs. Can be NULL if count is 0.
+ * @param count Number of records.
+ * @return true on success, false on failure
+ */
+bool vault_write(const char *path, const struct vault_header *header_fields, struct vault_record *records, size_t count)
+{
+    char *temporary = NULL;
+    return write_temporary_vault(path, header_fields, records, count, &temporary)
+           && rename_temporary(temporary, path);
+}
+
+/**
+ * @return true if the record belongs to the site and account
+ */
+static bool record_matches(const struct vault_record *record, const char *site, size_t site_length,
+                           const char *account, size_t account_length)
+{
+    return record->site_length == site_length && record->account_length == account_length
+           && memcmp(record->site, site, site_length) == 0 && memcmp(record->account, account, account_length) == 0;
+}
+
+/**
+ * @note Adds a copy of the entry to the vault's entries in memory, its strings are stored in the log arena.
+ *
+ * @return true on success, false on failure
+ */
+static bool add_log_entry(struct vault *vault, enum vault_log_type type, const char *site, uint32_t site_length,
+                          const char *account, uint32_t account_length, const char *password, uint32_t password_length)
+{
+    if (vault->log_count == vault->log_capacity) {
+        size_t capacity = vault->log_capacity == 0 ? 64 : 2 * vault->log_capacity;
+        struct vault_log_entry *bigger = realloc(vault->log_entries, capacity * sizeof(*bigger));
+        if (bigger == NULL) {
+            fprintf(stderr, "malloc failed\n");
+            return false;
+        }
+        vault->log_entries = bigger;
+        vault->log_capacity = capacity;
+    }
+
+    struct vault_log_entry *entry = &vault->log_entries[vault->log_count];
+    entry->type = type;
+    if (! vault_record_init_in(&entry->record, &vault->log_arena, site, site_length, account, account_length,
+                               password, password_length)) {
+        return false;
+    }
+    vault->log_count++;
+    return true;
+}
+
+/**
+ * @note Parses one log entry.
+ *
+ * @return size of the entry, 0 if the entry is incomplete or damaged
+ */
+static size_t parse_log_entry(const unsigned char *data, size_t available, enum vault_log_type *type,
+                              const char **site, uint32_t *site_length, const char **account, uint32_t *account_length,
+                              const char **password, uint32_t *password_length)
+{
+    if (available < VAULT_LOG_ENTRY_HEADER_SIZE) {
+        return 0;
+    }
+
+    *type = get_u32(data + 4);
+    size_t size = parse_record(data + 8, available - 8, site, site_length, account, account_length,
+                               password, password_length);
+
+    if (size == 0 || (*type != VAULT_LOG_PUT && *type != VAULT_LOG_DELETE)
+        || checksum(data + 4, size + 4) != get_u32(data)) {
+        return 0;
+    }
+    return size + 8;
+}
+
+/**
+ * @note Reads the header of the log at the start of data and decides which of its entries the vault file
+ * does not have yet: all of a log of the vault file's generation, those after the merged log size of a log
+ * of the previous generation and none of any other log. Logs written before the header was added have no header
+ * and generation 0.
+ *
+ * @return offset of the first entry to be loaded in data, 0 with *incomplete set if the header is not whole yet
+ */
+static size_t start_log(struct vault *vault, const unsigned char *data, size_t size, bool *incomplete)
+{
+    *incomplete = false;
+    size_t start = 0;
+    if (size >= VAULT_LOG_HEADER_SIZE && memcmp(data, VAULT_LOG_MAGIC, VAULT_MAGIC_LENGTH) == 0) {
+        vault->log_generation = get_u64(data + VAULT_MAGIC_LENGTH);
+        start = VAULT_LOG_HEADER_SIZE;
+    } else if (size < VAULT_LOG_HEADER_SIZE && memcmp(data, VAULT_LOG_MAGIC, size) == 0) {
+        *incomplete = true;
+        return 0;
+    } else {
+        vault->log_generation = 0;
+    }
+
+    if (vault->log_generation == vault->header.generation) {
+        return start;
+    }
+    if (vault->log_generation + 1 == vault->header.generation) {
+        size_t merged = vault->header.merged_log_size < size ? (size_t) vault->header.merged_log_size : size;
+        return merged > start ? merged : start;
+    }
+    return size;
+}
+
+/**
+ * @note Loads the log entries appended after the loaded ones, by this or another process, and adds them
+ * to the index if it is built. Entries already merged in the vault file are skipped, see start_log.
+ * An incomplete or damaged entry at the end is left for later, another process may be just writing it.
+ * With repair (only while the writer lock is held, so nobody writes) it was left by a crash in the middle
+ * of a write and it is cut off, together with everything after it. The vault must be locked.
+ *
+ * @return true on success, false on failure
+ */
+static bool read_log_tail(struct vault *vault, bool repair)
+{
+    struct stat status;
+    if (fstat(vault->log_fd, &status) != 0) {
+        fprintf(stderr, "failed to read %s\n", vault->log_path);
+        return false;
+    }
+
+    if ((uint64_t) status.st_size <= vault->log_size) {
+        return true;
+    }
+    size_t size = (size_t) ((uint64_t) status.st_size - vault->log_size);
+
+    unsigned char *data = malloc(size);
+    if (data == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        return false;
+    }
+
+    if (! read_at(vault->log_fd, data, size, vault->log_size)) {
+        fprintf(stderr, "failed to read %s\n", vault->log_path);
+        free(data);
+        return false;
+    }
+
+    size_t offset = 0;
+    bool result = true;
+    if (vault->log_size == 0) {
+        bool incomplete = false;
+        offset = start_log(vault, data, size, &incomplete);
+        if (incomplete && repair) {
+            fprintf(stderr, "the header of %s is damaged, the log is started again\n", vault->log_path);
+            result = ftruncate(vault->log_fd, 0) == 0;
+        }
+        if (incomplete) {
+            free(data);
+            return result;
+        }
+    }
+
+    while (offset < size) {
+        enum vault_log_type type = VAULT_LOG_PUT;
+        struct vault_record record = { 0 };
+
+        size_t entry_size = parse_log_entry(data + offset, size - offset, &type, (const char **) &record.site,
+                                            &record.site_length, (const char **) &record.account,
+                                            &record.account_length, (const char **) &record.password,
+                                            &record.password_length);
+        if (entry_size == 0) {
+            if (repair) {
+                fprintf(stderr, "the end of %s is damaged, the last unfinished change is dropped\n", vault->log_path);
+                result = ftruncate(vault->log_fd, (off_t) (vault->log_size + offset)) == 0;
+            }
+            break;
+        }
+
+        if (! add_log_entry(vault, type, record.site, record.site_length, record.account, record.account_length,
+                            record.password, record.password_length)) {
+            result = false;
+            break;
+        }
+
+        if (vault->index_built && type == VAULT_LOG_PUT) {
+            result = vault_index_put(&vault->index, &record);
+        } else if (vault->index_built) {
+            vault_index_remove(&vault->index, record.site, record.site_length, record.account, record.account_length);
+        }
+        offset += entry_size;
+        if (! result) {
+            break;
+        }
+    }
+
+    vault->log_size += offset;
+    OPENSSL_cleanse(data, size);
+    free(data);
+    return result;
+}
+
+/**
+ * @note Opens the log and remembers which file it is, its entries are loaded by read_log_tail.
+ *
+ * @return true on success, false on failure
+ */
+static bool open_log(struct vault *vault)
+{
+    vault->log_fd = open_created(vault->log_path, O_RDWR | O_APPEND | O_CLOEXEC);
+    if (vault->log_fd < 0) {
+        fprintf(stderr, "failed to open %s\n", vault->log_path);
+        return false;
+    }
+
+    struct stat status;
+    if (fstat(vault->log_fd, &status) != 0) {
+        fprintf(stderr, "failed to read %s\n", vault->log_path);
+        return false;
+    }
+    vault->log_inode = status.st_ino;
+    vault->log_size = 0;
+    return true;
+}
+
+static bool build_index(struct vault *vault);
+static bool replace_log(struct vault *vault, const struct vault_log_entry *entries, size_t count,
+                        uint64_t generation);
+
+/**
+ * @note Switches to the log and the vault file another process has just replaced: the log is opened first,
+ * so the vault file opened after it is never older than the log. The index is built again.
+ * The vault must be locked.
+ *
+ * @return true on success, false on failure
+ */
+static bool reopen_files(struct vault *vault, bool repair)
+{
+    int log_fd = open_created(vault->log_path, O_RDWR | O_APPEND | O_CLOEXEC);
+    if (log_fd < 0) {
+        fprintf(stderr, "failed to open %s\n", vault->log_path);
+        return false;
+    }
+
+    int fd = open(vault->path, O_RDONLY | O_CLOEXEC);
+    struct stat status;
+    if (fd < 0 || fstat(log_fd, &status) != 0) {
+        fprintf(stderr, "failed to open %s\n", vault->path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        close(log_fd);
+        return false;
+    }
+
+    unmap_file(vault);
+    close(vault->fd);
+    vault->fd = fd;
+    close(vault->log_fd);
+    vault->log_fd = log_fd;
+    vault->log_inode = status.st_ino;
+    vault->log_size = 0;
+
+    free(vault->log_entries);
+    arena_free(&vault->log_arena);
+    vault->log_entries = NULL;
+    vault->log_count = 0;
+    vault->log_capacity = 0;
+
+    bool index_built = vault->index_built;
+    if (index_built) {
+        vault_index_free(&vault->index);
+        vault->index_built = false;
+    }
+
+    return map_file(vault) && read_log_tail(vault, repair) && (! index_built || build_index(vault));
+}
+
+/**
+ * @note Loads the changes made by other processes since the last call. Usually it is just one stat of the log,
+ * which shows that nothing changed. The vault must be locked.
+ *
+ * @param repair true only while the writer lock is held, see read_log_tail.
+ * @return true on success, false on failure
+ */
+static bool catch_up(struct vault *vault, bool repair)
+{
+    struct stat status;
+    if (stat(vault->log_path, &status) != 0) {
+        fprintf(stderr, "failed to read %s\n", vault->log_path);
+        return false;
+    }
+
+    bool result = true;
+    if (status.st_ino != vault->log_inode) {
+        result = reopen_files(vault, repair);
+    } else if ((uint64_t) status.st_size != vault->log_size) {
+        result = read_log_tail(vault, repair);
+    }
+
+    //A log left by a crash between the renames of a vault file and its log would be skipped by readers,
+    //so it is replaced before anything is appended to it. Its loaded entries are the ones the vault file lacks
+    if (result && repair && vault->log_size != 0 && vault->log_generation != vault->header.generation) {
+        result = replace_log(vault, vault->log_entries, vault->log_count, vault->header.generation);
+    }
+    return result;
+}
+
+/**
+ * @return the newest log entry of the account, NULL if the account is not in the log
+ */
+static const struct vault_log_entry *find_in_log(struct vault *vault, const char *site, size_t site_length,
+                                                 const char *account, size_t account_length)
+{
+    for (size_t i = vault->log_count; i > 0; i--) {
+        if (record_matches(&vault->log_entries[i - 1].record, site, site_length, account, account_length)) {
+            return &vault->log_entries[i - 1];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @return true if the passwords are encrypted, then the vault has to be unlocked before it is used
+ */
+bool vault_is_encrypted(const struct vault *vault)
+{
+    return (vault->header.flags & VAULT_FLAG_ENCRYPTED) != 0;
+}
+
+/**
+ * @return true if the vault can be used, prints an error otherwise
+ */
+static bool check_unlocked(const struct vault *vault)
+{
+    if (vault_is_encrypted(vault) && ! vault->unlocked) {
+        fprintf(stderr, "the vault is locked\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @note Decrypts the password of a record made by vault_record_init in place, if the vault is encrypted.
+ * The record is freed on failure.
+ *
+ * @return true on success, false on failure
+ */
+static bool decrypt_record(struct vault *vault, struct vault_record *record, bool *found)
+{
+    if (! vault_is_encrypted(vault)) {
+        return true;
+    }
+
+    char password[VAULT_MAX_STORED_PASSWORD_LENGTH + 1];
+    bool result = check_unlocked(vault)
+                  && vault_decrypt(&vault->key, record->site, record->site_length, record->account,
+                                   record->account_length, (const unsigned char *) record->password,
+                                   record->password_length, password);
+    if (! result) {
+        if (vault->unlocked) {
+            fprintf(stderr, "failed to decrypt the password - vault file was probably altered\n");
+        }
+        vault_record_free(record);
+        *found = false;
+        return false;
+    }
+
+    uint32_t password_length = record->password_length - VAULT_CIPHER_OVERHEAD;
+    OPENSSL_cleanse(record->password, record->password_length);
+    memcpy(record->password, password, password_length + 1);
+    record->password_length = password_length;
+    OPENSSL_cleanse(password, password_length);
+    return true;
+}
+
+/**
+ * @param vault Opened vault.
+ * @param site Site name, terminated by '\0'.
+ * @param account Account name, terminated by '\0'.
+ * @param record If the account is found, it is stored here. Free it with vault_record_free.
+ * @param found Set to true if the account was found, false otherwise.
+ * @return true if no error occurs, false otherwise
+ */
+bool vault_get(struct vault *vault, const char *site, const char *account, struct vault_record *record, bool *found)
+{
+    size_t site_length = strlen(site);
+    size_t account_length = strlen(account);
+
+    *found = false;
+    record->site = NULL;
+
+    pthread_mutex_lock(&vault->lock);
+
+    if (! catch_up(vault, false)) {
+        pthread_mutex_unlock(&vault->lock);
+        return false;
+    }
+
+    if (vault->index_built) {
+        const struct vault_record *saved = vault_index_find(&vault->index, site, site_length, account, account_length);
+        bool result = true;
+        *found = false;
+        record->site = NULL;
+
+        if (saved != NULL) {
+            result = vault_record_init(record, saved->site, saved->site_length, saved->account, saved->account_length,
+                                       saved->password, saved->password_length);
+            *found = result;
+        }
+
+        pthread_mutex_unlock(&vault->lock);
+        return result && (! *found || decrypt_record(vault, record, found));
+    }
+
+    const struct vault_log_entry *entry = find_in_log(vault, site, site_length, account, account_length);
+    bool result = true;
+
+    if (entry == NULL) {
+        result = base_get(vault, site, site_length, account, account_length, record, found);
+    } else if (entry->type == VAULT_LOG_DELETE) {
+        record->site = NULL;
+        *found = false;
+    } else {
+        const struct vault_record *saved = &entry->record;
+        result = vault_record_init(record, saved->site, saved->site_length, saved->account, saved->account_length,
+                                   saved->password, saved->password_length);
+        *found = result;
+    }
+
+    pthread_mutex_unlock(&vault->lock);
+    return result && (! *found || decrypt_record(vault, record, found));
+}
+
+/**
+ * @note Orders log entries by site and account, entries of the same account by their position in the log.
+ */
+static int compare_log_entries(const void *first, const void *second)
+{
+    const struct vault_log_entry *first_entry = *(const struct vault_log_entry *const *) first;
+    const struct vault_log_entry *second_entry = *(const struct vault_log_entry *const *) second;
+
+    int result = compare_records(&first_entry->record, &second_entry->record);
+    if (result != 0) {
+        return result;
+    }
+    return (first_entry > second_entry) - (first_entry < second_entry);
+}
+
+/**
+ * @note Finds the first record of the vault file that is not before start. With the order of the records it is
+ * a binary search, files of older versions without it are read from the beginning.
+ *
+ * @param offset Offset of the record is stored here.
+ * @param position Position of the record in the order is stored here, record count if all records are before start.
+ * @return true if no error occurs, false otherwise
+ */
+static bool seek_base(struct vault *vault, const struct vault_record *start, uint64_t *offset, uint64_t *position)
+{
+    struct vault_record base = { 0 };
+    uint64_t low = 0;
+    uint64_t high = vault->header.record_count;
+    *offset = VAULT_HEADER_SIZE;
+
+    if (vault->header.order_offset != 0) {
+        const unsigned char *order = vault->map + vault->header.order_offset;
+
+        while (low < high) {
+            uint64_t middle = low + (high - low) / 2;
+            uint64_t record_offset = get_u64(order + middle * 8);
+            if (record_offset < VAULT_HEADER_SIZE || record_offset >= vault->header.index_offset
+                || parse_record(vault->map + record_offset, vault->header.index_offset - record_offset,
+                                (const char **) &base.site, &base.site_length,
+                                (const char **) &base.account, &base.account_length,
+                                (const char **) &base.password, &base.password_length) == 0) {
+                fprintf(stderr, "vault file was probably altered\n");
+                return false;
+            }
+
+            if (compare_records(&base, start) < 0) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+
+        *position = low;
+        if (low < vault->header.record_count) {
+            *offset = get_u64(order + low * 8);
+        }
+        return true;
+    }
+
+    for (*position = 0; *position < vault->header.record_count; (*position)++) {
+        size_t size = parse_record(vault->map + *offset, vault->header.index_offset - *offset,
+                                   (const char **) &base.site, &base.site_length,
+                                   (const char **) &base.account, &base.account_length,
+                                   (const char **) &base.password, &base.password_length);
+        if (size == 0) {
+            fprintf(stderr, "vault file was probably altered\n");
+            return false;
+        }
+        if (compare_records(&base, start) >= 0) {
+            break;
+        }
+        *offset += size;
+    }
+    return true;
+}
+
+/**
+ * @note Goes through the records of the vault file with the first entry_count log entries applied,
+ * in order of sites and accounts, starting at the first record that is not before start (NULL for all records).
+ * Both are sorted, so it is a merge of two sorted lists, where only the newest log entry of each account counts.
+ * Records of the vault file are passed right from the mapped file and their strings are not terminated by '\0'.
+ * Stops if the callback returns false.
+ *
+ * @return true if no error occurs, false otherwise
+ */
+static bool for_each_merged_from(struct vault *vault, const struct vault_log_entry *entries, size_t entry_count,
+                                 const struct vault_record *start, vault_callback callback, void *context)
+{
+    const struct vault_log_entry **sorted = malloc((entry_count + 1) * sizeof(*sorted));
+    if (sorted == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        return false;
+    }
+
+    for (size_t i = 0; i < entry_count; i++) {
+        sorted[i] = &entries[i];
+    }
+    qsort(sorted, entry_count, sizeof(*sorted), compare_log_entries);
+
+    uint64_t offset = VAULT_HEADER_SIZE;
+    uint64_t base_position = 0;
+    size_t entry_position = 0;
+
+    if (start != NULL) {
+        if (! seek_base(vault, start, &offset, &base_position)) {
+            free(sorted);
+            return false;
+        }
+        while (entry_position < entry_count && compare_records(&sorted[entry_position]->record, start) < 0) {
+            entry_position++;
+        }
+    }
+
+    struct vault_record base = { 0 };
+    bool have_base = false;
+
+    while (true) {
+        if (! have_base && base_position < vault->header.record_count) {
+            size_t size = parse_record(vault->map + offset, vault->header.index_offset - offset,
+                                       (const char **) &base.site, &base.site_length,
+                                       (const char **) &base.account, &base.account_length,
+                                       (const char **) &base.password, &base.password_length);
+            if (size == 0) {
+                fprintf(stderr, "vault file was probably altered\n");
+                free(sorted);
+                return false;
+            }
+            offset += size;
+            base_position++;
+            have_base = true;
+        }
+
+        while (entry_position + 1 < entry_count
+               && compare_records(&sorted[entry_position]->record, &sorted[entry_position + 1]->record) == 0) {
+            entry_position++;
+        }
+
+        int order = 0;
+        if (! have_base && entry_position == entry_count) {
+            break;
+        } else if (! have_base) {
+            order = 1;
+        } else if (entry_position == entry_count) {
+            order = -1;
+        } else {
+            order = compare_records(&base, &sorted[entry_position]->record);
+        }
+
+        if (order < 0) {
+            have_base = false;
+            if (! callback(&base, context)) {
+                break;
+            }
+            continue;
+        }
+
+        if (order == 0) {
+            have_base = false;
+        }
+
+        const struct vault_log_entry *entry = sorted[entry_position++];
+        if (entry->type == VAULT_LOG_PUT && ! callback(&entry->record, context)) {
+            break;
+        }
+    }
+
+    free(sorted);
+    return true;
+}
+
+/**
+ * @note Goes through all records of the vault file with the first entry_count log entries applied,
+ * see for_each_merged_from.
+ *
+ * @return true if no error occurs, false otherwise
+ */
+static bool for_each_merged(struct vault *vault, const struct vault_log_entry *entries, size_t entry_count,
+                            vault_callback callback, void *context)
+{
+    return for_each_merged_from(vault, entries, entry_count, NULL, callback, context);
+}
+
+struct record_list {
+    //Strings of the records
+    struct arena *arena;
+    struct vault_record *records;
+    size_t count;
+    size_t capacity;
+    bool failed;
+};
+
+/**
+ * @note Callback for for_each_merged that adds a copy of the record to a record_list.
+ */
+static bool collect_record(const struct vault_record *record, void *context)
+{
+    struct record_list *list = context;
+
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity == 0 ? 64 : 2 * list->capacity;
+        struct vault_record *bigger = realloc(list->records, capacity * sizeof(*bigger));
+        if (bigger == NULL) {
+            fprintf(stderr, "malloc failed\n");
+            list->failed = true;
+            return false;
+        }
+        list->records = bigger;
+        list->capacity = capacity;
+    }
+
+    if (! vault_record_init_in(&list->records[list->count], list->arena, record->site, record->site_length,
+                               record->account, record->account_length, record->password, record->password_length)) {
+        list->failed = true;
+        return false;
+    }
+    list->count++;
+    return true;
+}
+
+/**
+ * @note Copies the records of the vault file with the first entry_count log entries applied.
+ *
+ * @param arena Strings of the records are allocated here.
+ * @param records Allocated sorted array of records is stored here. Free it with free, the strings with the arena.
+ * @param count Number of records is stored here.
+ * @return true on success, false on failure
+ */
+static bool load_merged(struct vault *vault, const struct vault_log_entry *entries, size_t entry_count,
+                        struct arena *arena, struct vault_record **records, size_t *count)
+{
+    struct record_list list = { .arena = arena, .records = NULL, .count = 0, .capacity = 0, .failed = false };
+
+    if (! for_each_merged(vault, entries, entry_count, collect_record, &list) || list.failed) {
+        free(list.records);
+        return false;
+    }
+
+    *records = list.records;
+    *count = list.count;
+    return true;
+}
+
+struct index_build {
+    struct vault_index *index;
+    bool failed;
+};
+
+/**
+ * @note Callback for for_each_merged that adds the record to the index.
+ */
+static bool index_record(const struct vault_record *record, void *context)
+{
+    struct index_build *build = context;
+    build->failed = ! vault_index_put(build->index, record);
+    return ! build->failed;
+}
+
+/**
+ * @note Loads all records to the in-memory index. The vault must be locked.
+ *
+ * @return true on success, false on failure
+ */
+static bool build_index(struct vault *vault)
+{
+    if (! vault_index_init(&vault->index)) {
+        return false;
+    }
+
+    struct index_build build = { .index = &vault->index, .failed = false };
+    bool result = for_each_merged(vault, vault->log_entries, vault->log_count, index_record, &build) && ! build.failed;
+    if (result) {
+        vault->index_built = true;
+    } else {
+        vault_index_free(&vault->index);
+    }
+    return result;
+}
+
+/**
+ * @note Loads all records of the vault to an in-memory index, once. From then on lookups are just hash table
+ * lookups and the index is updated by every change made through this vault. Meant for sessions that use
+ * the vault many times, a single lookup is cheaper through the index in the vault file.
+ *
+ * @return true on success, false on failure
+ */
+bool vault_use_index(struct vault *vault)
+{
+    pthread_mutex_lock(&vault->lock);
+
+    if (vault->index_built) {
+        pthread_mutex_unlock(&vault->lock);
+        return true;
+    }
+
+    bool result = catch_up(vault, false) && build_index(vault);
+    pthread_mutex_unlock(&vault->lock);
+    return result;
+}
+
+struct decrypting_callback {
+    struct vault *vault;
+    vault_callback callback;
+    void *context;
+    bool failed;
+};
+
+/**
+ * @note Callback for for_each_merged that passes the record with a decrypted password to another callback.
+ * The password is overwritten right after the call.
+ */
+static bool decrypt_and_call(const struct vault_record *record, void *context)
+{
+    struct decrypting_callback *decrypting = context;
+    char password[VAULT_MAX_STORED_PASSWORD_LENGTH + 1];
+
+    if (! vault_decrypt(&decrypting->vault->key, record->site, record->site_length, record->account,
+                        record->account_length, (const unsigned char *) record->password, record->password_length,
+                        password)) {
+        fprintf(stderr, "failed to decrypt the password - vault file was probably altered\n");
+        decrypting->failed = true;
+        return false;
+    }
+
+    struct vault_record decrypted = *record;
+    decrypted.password = password;
+    decrypted.password_length = record->password_length - VAULT_CIPHER_OVERHEAD;
+
+    bool result = decrypting->callback(&decrypted, decrypting->context);
+    OPENSSL_cleanse(password, decrypted.password_length);
+    return result;
+}
+
+/**
+ * @note Calls callback for every record, in order of sites and accounts. Stops if the callback returns false.
+ * The records are read right from the mapped vault file, so their strings are not terminated by '\0',
+ * use the lengths. Passwords of an encrypted vault are decrypted one by one just for the call.
+ * The vault is locked while the callbacks run, other processes can still change it, the callbacks see
+ * the vault as it was when the call started.
+ *
+ * @return true if no error occurs, false otherwise
+ */
+bool vault_for_each(struct vault *vault, vault_callback callback, void *context)
+{
+    if (! check_unlocked(vault)) {
+        return false;
+    }
+
+    pthread_mutex_lock(&vault->lock);
+
+    bool result = false;
+    if (! catch_up(vault, false)) {
+        result = false;
+    } else if (vault_is_encrypted(vault)) {
+        struct decrypting_callback decrypting = { .vault = vault, .callback = callback, .context = context,
+                                                  .failed = false };
+        result = for_each_merged(vault, vault->log_entries, vault->log_count, decrypt_and_call, &decrypting)
+                 && ! decrypting.failed;
+    } else {
+        result = for_each_merged(vault, vault->log_entries, vault->log_count, callback, context);
+    }
+
+    pthread_mutex_unlock(&vault->lock);
+    return result;
+}
+
+struct naming_callback {
+    vault_callback callback;
+    void *context;
+};
+
+/**
+ * @note Callback for for_each_merged that passes the record without its password to another callback.
+ */
+static bool hide_password(const struct vault_record *record, void *context)
+{
+    struct naming_callback *naming = context;
+
+    struct vault_record names = *record;
+    names.password = NULL;
+    names.password_length = 0;
+    return naming->callback(&names, naming->context);
+}
+
+/**
+ * @note Like vault_for_each, but the records are passed without passwords (password is NULL). Nothing is decrypted,
+ * so the vault does not have to be unlocked and going through all names is as fast as reading them.
+ *
+ * @return true if no error occurs, false otherwise
+ */
+bool vault_for_each_name(struct vault *vault, vault_callback callback, void *context)
+{
+    pthread_mutex_lock(&vault->lock);
+
+    struct naming_callback naming = { .callback = callback, .context = context };
+    bool result = catch_up(vault, false)
+                  && for_each_merged(vault, vault->log_entries, vault->log_count, hide_password, &naming);
+
+    pthread_mutex_unlock(&vault->lock);
+    return result;
+}
+
+struct listing {
+    const struct vault_list_query *query;
+    struct vault_cursor *cursor;
+    //Leading characters of the site pattern without wildcards, every listed site starts with them
+    const char *prefix;
+    size_t prefix_length;
+    //Passes the record on, with or without its password
+    vault_callback pass;
+    void *pass_context;
+    size_t count;
+    bool *more;
+};
+
+/**
+ * @return true if the name matches the pattern of fnmatch, or the pattern is NULL
+ */
+static bool name_matches(const char *pattern, const char *name, uint32_t length)
+{
+    if (pattern == NULL) {
+        return true;
+    }
+
+    //Names are not terminated in the mapped vault
+    char terminated[VAULT_MAX_NAME_LENGTH + 1];
+    memcpy(terminated, name, length);
+    terminated[length] = '\0';
+    return fnmatch(pattern, terminated, 0) == 0;
+}
+
+/**
+ * @note Callback for for_each_merged_from that passes the records of a page that match the patterns on and moves
+ * the cursor after them. Stops at the first site past the prefix of the site pattern and at the first match
+ * that does not fit to the page.
+ */
+static bool list_record(const struct vault_record *record, void *context)
+{
+    struct listing *listing = context;
+    struct vault_cursor *cursor = listing->cursor;
+
+    if (record->site_length < listing->prefix_length
+        || memcmp(record->site, listing->prefix, listing->prefix_length) != 0) {
+        return false;
+    }
+
+    //The listing starts at the record of the cursor, which was on the previous page
+    if (cursor->started && compare_names(record->site, record->site_length, cursor->site, cursor->site_length) == 0
+        && compare_names(record->account, record->account_length, cursor->account, cursor->account_length) == 0) {
+        return true;
+    }
+
+    if (! name_matches(listing->query->site_pattern, record->site, record->site_length)
+        || ! name_matches(listing->query->account_pattern, record->account, record->account_length)) {
+        return true;
+    }
+
+    if (listing->query->limit != 0 && listing->count == listing->query->limit) {
+        *listing->more = true;
+        return false;
+    }
+
+    if (! listing->pass(record, listing->pass_context)) {
+        return false;
+    }
+
+    memcpy(cursor->site, record->site, record->site_length);
+    cursor->site_length = record->site_length;
+    memcpy(cursor->account, record->account, record->account_length);
+    cursor->account_length = record->account_length;
+    cursor->started = true;
+    listing->count++;
+    return true;
+}
+
+/**
+ * @note Lists one page of the records that match the query, in order of sites and accounts, starting after
+ * the cursor. Only the records of the page are read: the first one is found by a binary search of the order
+ * of the vault file (of the cursor, or of the part of the site pattern before its first wildcard), and the
+ * listing stops right after the page or after the last site with that part. So a page costs the same no matter
+ * how big the vault is, as long as the patterns do not skip many records. Records are passed to the callback
+ * like by vault_for_each, or like by vault_for_each_name unless query->passwords is set.
+ *
+ * @param cursor Where the listing starts, a cursor with started == false starts at the beginning. It is moved
+ * to the last listed record, so the same cursor lists the next page.
+ * @param more Set to true if more records match after the page, false otherwise.
+ * @return true if no error occurs, false otherwise
+ */
+bool vault_list(struct vault *vault, const struct vault_list_query *query, struct vault_cursor *cursor,
+                vault_callback callback, void *context, bool *more)
+{
+    *more = false;
+    if (query->passwords && ! check_unlocked(vault)) {
+        return false;
+    }
+
+    struct listing listing = { .query = query, .cursor = cursor, .prefix = "", .prefix_length = 0, .count = 0,
+                               .more = more };
+    if (query->site_pattern != NULL) {
+        listing.prefix = query->site_pattern;
+        listing.prefix_length = strcspn(query->site_pattern, "*?[\\");
+    }
+
+    //The listing starts at the later of the cursor and the first site with the prefix
+    struct vault_record start = { .site = (char *) listing.prefix, .site_length = (uint32_t) listing.prefix_length,
+                                  .account = "", .account_length = 0 };
+    struct vault_record after_cursor = { .site = cursor->site, .site_length = cursor->site_length,
+                                         .account = cursor->account, .account_length = cursor->account_length };
+    if (cursor->started && compare_records(&after_cursor, &start) > 0) {
+        start = after_cursor;
+    }
+
+    struct naming_callback naming = { .callback = callback, .context = context };
+    struct decrypting_callback decrypting = { .vault = vault, .callback = callback, .context = context,
+                                              .failed = false };
+    listing.pass = hide_password;
+    listing.pass_context = &naming;
+
+    pthread_mutex_lock(&vault->lock);
+
+    bool result = catch_up(vault, false);
+    if (result && query->passwords && vault_is_encrypted(vault)) {
+        listing.pass = decrypt_and_call;
+        listing.pass_context = &decrypting;
+    } else if (result && query->passwords) {
+        listing.pass = callback;
+        listing.pass_context = context;
+    }
+
+    result = result
+             && for_each_merged_from(vault, vault->log_entries, vault->log_count, &start, list_record, &listing)
+             && ! decrypting.failed;
+
+    pthread_mutex_unlock(&vault->lock);
+    return result;
+}
+
+/**
+ * @note Writes entries to a new log file and renames it over the log. The vault and the writer lock must be locked.
+ *
+ * @return true on success, false on failure
+ */
+
+/**
+ * @note Copies the strings of the remaining log entries to a new arena and wipes the old one with the strings
+ * of the compacted entries. If the copy fails, the old arena is kept. The vault must be locked.
+ */
+static void move_log_entries(struct vault *vault)
+{
+    struct arena arena;
+    arena_init(&arena);
+
+    struct vault_record *records = malloc((vault->log_count + 1) * sizeof(*records));
+    bool result = records != NULL;
+
+    for (size_t i = 0; result && i < vault->log_count; i++) {
+        const struct vault_record *record = &vault->log_entries[i].record;
+        result = vault_record_init_in(&records[i], &arena, record->site, record->site_length, record->account,
+                                      record->account_length, record->password, record->password_length);
+    }
+
+    if (! result) {
+        free(records);
+        arena_free(&arena);
+        return;
+    }
+
+    for (size_t i = 0; i < vault->log_count; i++) {
+        vault->log_entries[i].record = records[i];
+    }
+    free(records);
+    arena_free(&vault->log_arena);
+    vault->log_arena = arena;
+}
+
+/**
+ * @note Writes the vault file of the next generation with the loaded log entries merged in and then replaces
+ * the log with the entries that were added after them. Only the replacement is done with the vault and the writer
+ * lock locked, so the vault can be used while the new vault file is written. If another process compacts the vault
+ * meanwhile, the written file is dropped.
+ *
+ * @return true on success, false on failure
+ */
+static bool compact_entries(struct vault *vault)
+{
+    //Entries may be reallocated by other threads while the lock is not held, so a copy is used. The vault file
+    //is mapped once more too, readers switch to a newer one as soon as another process writes it
+    struct arena arena;
+    arena_init(&arena);
+    struct vault base = { .path = vault->path, .fd = -1, .map = NULL, .map_size = 0 };
+
+    //The log stays open until the end, so its inode is not reused by a newer log while this thread compares them
+    pthread_mutex_lock(&vault->lock);
+    ino_t log_inode = vault->log_inode;
+    int log_fd = fcntl(vault->log_fd, F_DUPFD_CLOEXEC, 0);
+    size_t entry_count = vault->log_count;
+    uint64_t merged_log_size = vault->log_size;
+    base.fd = fcntl(vault->fd, F_DUPFD_CLOEXEC, 0);
+    struct vault_log_entry *entries = calloc(entry_count + 1, sizeof(*entries));
+    size_t copied = 0;
+
+    while (entries != NULL && copied < entry_count) {
+        const struct vault_log_entry *entry = &vault->log_entries[copied];
+        entries[copied].type = entry->type;
+        if (! vault_record_init_in(&entries[copied].record, &arena, entry->record.site, entry->record.site_length,
+                                   entry->record.account, entry->record.account_length,
+                                   entry->record.password, entry->record.password_length)) {
+            break;
+        }
+        copied++;
+    }
+    pthread_mutex_unlock(&vault->lock);
+
+    struct vault_record *records = NULL;
+    size_t count = 0;
+    char *temporary = NULL;
+
+    bool result = copied == entry_count && log_fd >= 0 && base.fd >= 0 && map_file(&base);
+    base.header.generation++;
+    base.header.merged_log_size = merged_log_size;
+    uint64_t generation = base.header.generation;
+    result = result && load_merged(&base, entries, entry_count, &arena, &records, &count)
+             && write_temporary_vault(vault->path, &base.header, records, count, &temporary);
+    free(records);
+    free(entries);
+    arena_free(&arena);
+    unmap_file(&base);
+    if (base.fd >= 0) {
+        close(base.fd);
+    }
+    if (! result) {
+        fprintf(stderr, "failed to compact the vault\n");
+        if (log_fd >= 0) {
+            close(log_fd);
+        }
+        return false;
+    }
+
+    int lock_fd = lock_writers(vault);
+    if (lock_fd < 0) {
+        remove(temporary);
+        free(temporary);
+        close(log_fd);
+        return false;
+    }
+
+    pthread_mutex_lock(&vault->lock);
+
+    result = catch_up(vault, true);
+    if (! result || vault->log_inode != log_inode) {
+        //Another process has compacted the vault meanwhile, the written file would lose its changes
+        remove(temporary);
+        free(temporary);
+    } else {
+        //Until the log is replaced, readers of the new vault file apply only the entries of the old log
+        //after the merged ones
+        result = rename_temporary(temporary, vault->path)
+                 && replace_log(vault, vault->log_entries + entry_count, vault->log_count - entry_count, generation);
+
+        int fd = result ? open(vault->path, O_RDONLY | O_CLOEXEC) : -1;
+        if (result && fd < 0) {
+            fprintf(stderr, "failed to open %s\n", vault->path);
+            result = false;
+        }
+
+        if (result) {
+            unmap_file(vault);
+            close(vault->fd);
+            vault->fd = fd;
+            result = map_file(vault);
+
+            memmove(vault->log_entries, vault->log_entries + entry_count,
+                    (vault->log_count - entry_count) * sizeof(*vault->log_entries));
+            vault->log_count -= entry_count;
+            move_log_entries(vault);
+        }
+    }
+
+    pthread_mutex_unlock(&vault->lock);
+    unlock_writers(lock_fd);
+    close(log_fd);
+    return result;
+}
+
+static void *run_compaction(void *argument)
+{
+    compact_entries(argument);
+    return NULL;
+}
+
+/**
+ * @note Merges the whole log into the vault file right away.
+ *
+ * @return true on success, false on failure
+ */
+bool vault_compact(struct vault *vault)
+{
+    if (vault->compactor_started) {
+        pthread_join(vault->compactor, NULL);
+        vault->compactor_started = false;
+    }
+    return compact_entries(vault);
+}
+
+/**
+ * @return the log entry encoded to a newly allocated buffer, NULL on failure
+ */
+static unsigned char *encode_log_entry(enum vault_log_type type, const struct vault_record *record, size_t *size)
+{
+    *size = VAULT_LOG_ENTRY_HEADER_SIZE + (size_t) record->site_length + record->account_length + record->password_length;
+
+    unsigned char *data = malloc(*size);
+    if (data == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        return NULL;
+    }
+
+    put_u32(data + 4, type);
+    put_u32(data + 8, record->site_length);
+    put_u32(data + 12, record->account_length);
+    put_u32(data + 16, record->password_length);
+
+    unsigned char *position = data + VAULT_LOG_ENTRY_HEADER_SIZE;
+    memcpy(position, record->site, record->site_length);
+    position += record->site_length;
+    memcpy(position, record->account, record->account_length);
+    position += record->account_length;
+    memcpy(position, record->password, record->password_length);
+
+    put_u32(data, checksum(data + 4, *size - 4));
+    return data;
+}
+
+/**
+ * @note Writes the header of a log of the generation.
+ *
+ * @return true on success, false on failure
+ */
+static bool write_log_header(int fd, uint64_t generation)
+{
+    unsigned char header[VAULT_LOG_HEADER_SIZE];
+    memcpy(header, VAULT_LOG_MAGIC, VAULT_MAGIC_LENGTH);
+    put_u64(header + VAULT_MAGIC_LENGTH, generation);
+    return write_all(fd, header, sizeof(header));
+}
+
+/**
+ * @note Renames a new log of the generation with the entries over the log. The vault and the writer lock must be locked.
+ *
+ * @return true on success, false on failure
+ */
+static bool replace_log(struct vault *vault, const struct vault_log_entry *entries, size_t count,
+                        uint64_t generation)
+{
+    char *temporary = NULL;
+    int fd = create_temporary(vault->log_path, &temporary);
+    if (fd < 0) {
+        return false;
+    }
+
+    //Appended to like the log it replaces
+    if (fcntl(fd, F_SETFL, O_APPEND) != 0) {
+        fprintf(stderr, "failed to create %s\n", temporary);
+        close(fd);
+        remove(temporary);
+        free(temporary);
+        return false;
+    }
+
+    bool result = write_log_header(fd, generation);
+    for (size_t i = 0; i < count && result; i++) {
+        size_t size = 0;
+        unsigned char *data = encode_log_entry(entries[i].type, &entries[i].record, &size);
+        result = data != NULL && write_all(fd, data, size);
+        if (data != NULL) {
+            OPENSSL_cleanse(data, size);
+        }
+        free(data);
+    }
+
+    result = result && fsync(fd) == 0;
+    if (! result) {
+        fprintf(stderr, "failed to write %s\n", temporary);
+        close(fd);
+        remove(temporary);
+        free(temporary);
+        return false;
+    }
+
+    if (! rename_temporary(temporary, vault->log_path)) {
+        close(fd);
+        return false;
+    }
+
+    //The entries of the old log are all in the new one or in the vault file, so they are durable now
+    close(vault->log_fd);
+    vault->log_fd = fd;
+    vault->unsynced = false;
+
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+        fprintf(stderr, "failed to read %s\n", vault->log_path);
+        return false;
+    }
+    vault->log_inode = status.st_ino;
+    vault->log_size = (uint64_t) status.st_size;
+    vault->log_generation = generation;
+    return true;
+}
+
+/**
+ * @return true if the vault can be changed, false if another process encrypted it after this process opened it
+ * without a key. The vault must be locked and caught up.
+ */
+static bool check_still_unlocked(const struct vault *vault)
+{
+    if (vault_is_encrypted(vault) && ! vault->unlocked) {
+        fprintf(stderr, "the vault was encrypted by another process meanwhile, open it again\n");
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @note Makes the record of a log entry with the password in the form it is stored in, encrypted if the vault is.
+ * The vault must be locked and caught up, so the password is never stored in plaintext to a vault that another
+ * process has encrypted. Free the record with vault_record_free.
+ *
+ * @return true on success, false on failure
+ */
+static bool init_log_record(struct vault *vault, enum vault_log_type type, struct vault_record *record,
+                            const char *site, uint32_t site_length, const char *account, uint32_t account_length,
+                            const char *password, uint32_t password_length)
+{
+    if (type != VAULT_LOG_PUT || ! vault_is_encrypted(vault)) {
+        return vault_record_init(record, site, site_length, account, account_length, password, password_length);
+    }
+
+    unsigned char stored[VAULT_MAX_STORED_PASSWORD_LENGTH];
+    bool result = check_still_unlocked(vault)
+                  && vault_encrypt(&vault->key, site, site_length, account, account_length, password, password_length,
+                                   stored)
+                  && vault_record_init(record, site, site_length, account, account_length, (const char *) stored,
+                                       password_length + VAULT_CIPHER_OVERHEAD);
+    OPENSSL_cleanse(stored, sizeof(stored));
+    return result;
+}
+
+/**
+ * @note Appends the change to the log with one write and one fsync (just the write with group commit),
+ * with the writer lock, and starts a background compaction when the log is long enough.
+ *
+ * @return true on success, false on failure
+ */
+static bool append_log(struct vault *vault, enum vault_log_type type, const char *site, uint32_t site_length,
+                       const char *account, uint32_t account_length, const char *password, uint32_t password_length)
+{
+    int lock_fd = lock_writers(vault);
+    if (lock_fd < 0) {
+        return false;
+    }
+
+    pthread_mutex_lock(&vault->lock);
+
+    //The entry goes after the changes of other processes, they have to be loaded first. One of them may have
+    //encrypted the vault meanwhile, so the password is sealed only after that
+    struct vault_record record = { .site = NULL };
+    unsigned char *data = NULL;
+    size_t size = 0;
+    bool result = catch_up(vault, true)
+                  && init_log_record(vault, type, &record, site, site_length, account, account_length, password,
+                                     password_length)
+                  && (data = encode_log_entry(type, &record, &size)) != NULL;
+
+    //An empty log gets the header with its first entry
+    if (result && vault->log_size == 0 && write_log_header(vault->log_fd, vault->header.generation)) {
+        vault->log_size = VAULT_LOG_HEADER_SIZE;
+        vault->log_generation = vault->header.generation;
+    }
+    if (result && vault->log_size != 0 && write_all(vault->log_fd, data, size)
+        && (vault->group_commit || fsync(vault->log_fd) == 0)) {
+        vault->log_size += size;
+        vault->unsynced = vault->group_commit;
+    } else if (result) {
+        fprintf(stderr, "failed to write to %s\n", vault->log_path);
+        result = false;
+    }
+
+    result = result && add_log_entry(vault, type, record.site, record.site_length, record.account,
+                                     record.account_length, record.password, record.password_length);
+
+    if (result && vault->index_built) {
+        if (type == VAULT_LOG_PUT) {
+            result = vault_index_put(&vault->index, &record);
+        } else {
+            vault_index_remove(&vault->index, record.site, record.site_length, record.account, record.account_length);
+        }
+    }
+    bool compact = result && vault->log_count >= VAULT_LOG_COMPACTION_ENTRIES;
+
+    pthread_mutex_unlock(&vault->lock);
+    unlock_writers(lock_fd);
+
+    if (data != NULL) {
+        OPENSSL_cleanse(data, size);
+        free(data);
+    }
+    vault_record_free(&record);
+
+    if (compact) {
+        if (vault->compactor_started) {
+            pthread_join(vault->compactor, NULL);
+            vault->compactor_started = false;
+        }
+        vault->compactor_started = pthread_create(&vault->compactor, NULL, run_compaction, vault) == 0;
+    }
+    return result;
+}
+
+/**
+ * @note Saves the password for the account, an older password of the same account is replaced.
+ * Line breaks are refused in the names and the password, so every record can be exported to one line.
+ *
+ * @return true on success, false on failure
+ */
+bool vault_put(struct vault *vault, const char *site, const char *account, const char *password)
+{
+    size_t site_length = strlen(site);
+    size_t account_length = strlen(account);
+    size_t password_length = strlen(password);
+
+    if (site_length > VAULT_MAX_NAME_LENGTH || account_length > VAULT_MAX_NAME_LENGTH
+        || password_length > VAULT_MAX_PASSWORD_LENGTH) {
+        fprintf(stderr, "The name or password is too long.\n");
+        return false;
+    }
+    //Exported records are one per line
+    if (strpbrk(site, "\r\n") != NULL || strpbrk(account, "\r\n") != NULL || strpbrk(password, "\r\n") != NULL) {
+        fprintf(stderr, "The name or password cannot contain a line break.\n");
+        return false;
+    }
+
+    return check_unlocked(vault)
+           && append_log(vault, VAULT_LOG_PUT, site, site_length, account, account_length, password, password_length);
+}
+
+/**
+ * @param found Set to true if the account was there and was removed, false otherwise.
+ * @return true on success, false on failure
+ */
+bool vault_delete(struct vault *vault, const char *site, const char *account, bool *found)
+{
+    struct vault_record record;
+
+    if (! vault_get(vault, site, account, &record, found)) {
+        return false;
+    }
+
+    if (! *found) {
+        return true;
+    }
+    vault_record_free(&record);
+
+    return append_log(vault, VAULT_LOG_DELETE, site, strlen(site), account, strlen(account), "", 0);
+}
+
+/**
+ * @note Turns group commit on or off. With group commit vault_put and vault_delete only write their changes
+ * to the log, which makes them visible to other processes right away, and vault_sync then flushes all of them
+ * to the disk with one fsync. Meant for bulk saves and for the daemon, which sync once per batch of changes
+ * instead of once per change. Changes are synced when group commit is turned off and when the vault is closed.
+ *
+ * @return true on success, false if the changes could not be synced
+ */
+bool vault_set_group_commit(struct vault *vault, bool enabled)
+{
+    vault->group_commit = enabled;
+    return enabled || vault_sync(vault);
+}
+
+/**
+ * @note Flushes all changes written with group commit to the disk. A change is not safe from a crash
+ * before this returns true, so nobody should be told it is saved sooner.
+ *
+ * @return true on success, false on failure
+ */
+bool vault_sync(struct vault *vault)
+{
+    pthread_mutex_lock(&vault->lock);
+
+    bool result = true;
+    if (vault->unsynced) {
+        result = fsync(vault->log_fd) == 0;
+        if (result) {
+            vault->unsynced = false;
+        } else {
+            fprintf(stderr, "failed to write to %s\n", vault->log_path);
+        }
+    }
+
+    pthread_mutex_unlock(&vault->lock);
+    return result;
+}
+
+/**
+ * @note Switches to a vault file of the next generation that was just written with all changes of the log merged
+ * in: maps the new file, rebuilds the index and empties the log. If the log can't be replaced, the vault file
+ * is still used and the old log is skipped, it is replaced before the next change. The vault and the writer lock
+ * must be locked.
+ *
+ * @return true on success, false on failure
+ */
+static bool install_vault_file(struct vault *vault)
+{
+    int fd = open(vault->path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "failed to open %s\n", vault->path);
+        return false;
+    }
+
+    free(vault->log_entries);
+    arena_free(&vault->log_arena);
+    vault->log_entries = NULL;
+    vault->log_count = 0;
+    vault->log_capacity = 0;
+
+    unmap_file(vault);
+    close(vault->fd);
+    vault->fd = fd;
+    bool result = map_file(vault);
+
+    if (vault->index_built) {
+        vault_index_free(&vault->index);
+        vault->index_built = false;
+        result = result && build_index(vault);
+    }
+    return result && replace_log(vault, NULL, 0, vault->header.generation);
+}
+
+/**
+ * @note Turns the password of the record to the form it is stored in: if the vault is encrypted, the password
+ * is encrypted to a new buffer in the arena. Records sealed this way can be passed to vault_put_all.
+ * Can be called from more threads at once.
+ *
+ * @return true on success, false on failure
+ */
+bool vault_seal_record(const struct vault *vault, struct arena *arena, struct vault_record *record)
+{
+    if (! vault_is_encrypted(vault)) {
+        return true;
+    }
+
+    if (! check_unlocked(vault)) {
+        return false;
+    }
+
+    unsigned char *stored = arena_alloc(arena, (size_t) record->password_length + VAULT_CIPHER_OVERHEAD);
+    if (stored == NULL || ! vault_encrypt(&vault->key, record->site, record->site_length, record->account,
+                                          record->account_length, record->password, record->password_length, stored)) {
+        return false;
+    }
+
+    record->password = (char *) stored;
+    record->password_length += VAULT_CIPHER_OVERHEAD;
+    return true;
+}
+
+/**
+ * @note Saves many records at once: they are merged with the vault and its log in one sorted pass and written
+ * to a new vault file, the log is emptied. When an account is in records more times, the last one is kept.
+ *
+ * @param records Records sealed by vault_seal_record, with names and passwords no longer than the limits.
+ * @param encrypted Whether the passwords of the records are encrypted, vault_is_encrypted from before they were
+ * sealed. If another process has encrypted the vault since, plaintext records are sealed now, or refused
+ * if this process has no key.
+ * @return true on success, false on failure
+ */
+bool vault_put_all(struct vault *vault, const struct vault_record *records, size_t count, bool encrypted)
+{
+    if (vault->compactor_started) {
+        pthread_join(vault->compactor, NULL);
+        vault->compactor_started = false;
+    }
+
+    int lock_fd = lock_writers(vault);
+    if (lock_fd < 0) {
+        return false;
+    }
+
+    pthread_mutex_lock(&vault->lock);
+
+    if (! catch_up(vault, true)) {
+        pthread_mutex_unlock(&vault->lock);
+        unlock_writers(lock_fd);
+        return false;
+    }
+
+    //New records go after the log, so they win over older changes of the same accounts
+    size_t entry_count = vault->log_count + count;
+    struct vault_log_entry *entries = malloc((entry_count + 1) * sizeof(*entries));
+    if (entries == NULL) {
+        pthread_mutex_unlock(&vault->lock);
+        unlock_writers(lock_fd);
+        fprintf(stderr, "malloc failed\n");
+        return false;
+    }
+
+    struct arena arena;
+    arena_init(&arena);
+    bool result = true;
+
+    //The records were sealed before the writer lock was taken, the vault could have been encrypted since
+    bool seal = vault_is_encrypted(vault) && ! encrypted;
+    if (! vault_is_encrypted(vault) && encrypted) {
+        fprintf(stderr, "the vault was replaced by another process meanwhile, open it again\n");
+        result = false;
+    } else if (seal) {
+        result = check_still_unlocked(vault);
+    }
+
+    if (vault->log_count > 0) {
+        memcpy(entries, vault->log_entries, vault->log_count * sizeof(*entries));
+    }
+    for (size_t i = 0; result && i < count; i++) {
+        entries[vault->log_count + i].type = VAULT_LOG_PUT;
+        entries[vault->log_count + i].record = records[i];
+        if (seal) {
+            result = vault_seal_record(vault, &arena, &entries[vault->log_count + i].record);
+        }
+    }
+
+    struct vault_record *merged = NULL;
+    size_t merged_count = 0;
+    struct vault_header header = vault->header;
+    header.generation++;
+    header.merged_log_size = vault->log_size;
+
+    result = result && load_merged(vault, entries, entry_count, &arena, &merged, &merged_count)
+             && vault_write(vault->path, &header, merged, merged_count);
+    free(merged);
+    free(entries);
+    arena_free(&arena);
+
+    result = result && install_vault_file(vault);
+
+    pthread_mutex_unlock(&vault->lock);
+    unlock_writers(lock_fd);
+    return result;
+}
+
+/**
+ * @note Derives the key of an encrypted vault from the master password and keeps it until the vault is closed.
+ * Does nothing if the vault is not encrypted.
+ *
+ * @param correct Set to false if the master password is wrong, true otherwise.
+ * @return true if no error occurs, false otherwise
+ */
+bool vault_unlock(struct vault *vault, const char *master_password, bool *correct)
+{
+    *correct = true;
+    if (! vault_is_encrypted(vault) || vault->unlocked) {
+        return true;
+    }
+
+    struct vault_key key;
+    if (! vault_key_derive(&key, master_password, &vault->header.kdf)) {
+        return false;
+    }
+
+    char empty[1];
+    *correct = vault_decrypt(&key, "", 0, "", 0, vault->header.key_check, VAULT_CIPHER_OVERHEAD, empty);
+    if (! *correct) {
+        vault_key_free(&key);
+        return true;
+    }
+
+    vault->key = key;
+    vault->unlocked = true;
+    return true;
+}
+
+/**
+ * @note Encrypts all passwords of a vault that is not encrypted yet with a key derived from the master password.
+ * A new vault file with the log merged in is written and the log is emptied. The vault stays unlocked.
+ *
+ * @return true on success, false on failure
+ */
+bool vault_encrypt_all(struct vault *vault, const char *master_password)
+{
+    if (vault->compactor_started) {
+        pthread_join(vault->compactor, NULL);
+        vault->compactor_started = false;
+    }
+
+    if (vault_is_encrypted(vault)) {
+        fprintf(stderr, "the vault is already encrypted\n");
+        return false;
+    }
+
+    struct vault_header header = vault->header;
+    header.flags |= VAULT_FLAG_ENCRYPTED;
+
+    struct vault_key key;
+    if (! vault_kdf_params_init(&header.kdf) || ! vault_key_derive(&key, master_password, &header.kdf)) {
+        return false;
+    }
+
+    if (! vault_encrypt(&key, "", 0, "", 0, "", 0, header.key_check)) {
+        vault_key_free(&key);
+        return false;
+    }
+
+    int lock_fd = lock_writers(vault);
+    if (lock_fd < 0) {
+        vault_key_free(&key);
+        return false;
+    }
+
+    struct arena arena;
+    arena_init(&arena);
+    struct vault_record *records = NULL;
+    size_t count = 0;
+
+    pthread_mutex_lock(&vault->lock);
+
+    bool result = catch_up(vault, true);
+    if (result && vault_is_encrypted(vault)) {
+        fprintf(stderr, "the vault was encrypted by another process meanwhile\n");
+        result = false;
+    }
+    result = result && load_merged(vault, vault->log_entries, vault->log_count, &arena, &records, &count);
+
+    for (size_t i = 0; result && i < count; i++) {
+        unsigned char *stored = arena_alloc(&arena, (size_t) records[i].password_length + VAULT_CIPHER_OVERHEAD);
+        result = stored != NULL
+                 && vault_encrypt(&key, records[i].site, records[i].site_length, records[i].account,
+                                  records[i].account_length, records[i].password, records[i].password_length, stored);
+        records[i].password = (char *) stored;
+        records[i].password_length += VAULT_CIPHER_OVERHEAD;
+    }
+
+    header.generation = vault->header.generation + 1;
+    header.merged_log_size = vault->log_size;
+    bool written = result && vault_write(vault->path, &header, records, count);
+    free(records);
+    arena_free(&arena);
+
+    //The new vault file already has all changes, so the plain text log is skipped and then replaced. Once
+    //the file is written the key is kept, the vault on the disk is encrypted even if the log is not replaced yet
+    result = written && install_vault_file(vault);
+
+    if (written) {
+        vault->key = key;
+        vault->unlocked = true;
+    } else {
+        vault_key_free(&key);
+    }
+
+    pthread_mutex_unlock(&vault->lock);
+    unlock_writers(lock_fd);
+    return result;
+}
@@ -0,0 +1,215 @@
+#ifndef PASSWORD_GENERATOR_VAULT_H
+#define PASSWORD_GENERATOR_VAULT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "vault_crypto.h"
+#include "vault_index.h"
+
+#define VAULT_FILE "vault"
+#define VAULT_MAGIC "PWGVAULT"
+#define VAULT_MAGIC_LENGTH 8
+#define VAULT_VERSION 1
+
+/**
+ * Layout of the vault file, all numbers are little endian:
+ *
+ * header       VAULT_HEADER_SIZE bytes - magic, version, flags, record count, index offset, index capacity,
+ *              scrypt salt (VAULT_SALT_SIZE bytes), scrypt log2 N, r and p (u32 each), the key check
+ *              (VAULT_CIPHER_OVERHEAD bytes, an empty password encrypted with the key), order offset, generation
+ *              and merged log size (u64 each), the rest is reserved and zero
+ * records      sorted by site and account, each is site length, account length and password length (u32 each)
+ *              followed by the site, account and password bytes
+ * index        index capacity slots (power of two), each is a 64 bit hash of site and account and offset
+ *              of the record (u64 each), offset 0 marks an empty slot; collisions are solved by linear probing
+ * order        record count offsets of the records (u64 each), in their sorted order, at the order offset
+ *              (0 in files written by older versions, which do not have it)
+ *
+ * So a lookup reads the header once and then one index slot (rarely more) and one record, and a listing finds
+ * its first record by a binary search of the order.
+ */
+#define VAULT_HEADER_SIZE 128
+#define VAULT_RECORD_HEADER_SIZE 12
+#define VAULT_INDEX_SLOT_SIZE 16
+
+#define VAULT_MAX_NAME_LENGTH 128
+#define VAULT_MAX_PASSWORD_LENGTH 1000
+//Passwords of encrypted vaults are stored with the nonce and tag
+#define VAULT_MAX_STORED_PASSWORD_LENGTH (VAULT_MAX_PASSWORD_LENGTH + VAULT_CIPHER_OVERHEAD)
+
+//Passwords in the vault and its log are encrypted, see vault_crypto.h
+#define VAULT_FLAG_ENCRYPTED 1
+
+struct vault_header {
+    uint32_t version;
+    uint32_t flags;
+    uint64_t record_count;
+    uint64_t index_offset;
+    uint64_t index_capacity;
+    //0 if the file has no order of the records
+    uint64_t order_offset;
+    //Every new vault file is one generation after the one it was made from, merged_log_size bytes of the log
+    //of that older generation are merged in it
+    uint64_t generation;
+    uint64_t merged_log_size;
+
+    //Used only if flags has VAULT_FLAG_ENCRYPTED
+    struct vault_kdf_params kdf;
+    unsigned char key_check[VAULT_CIPHER_OVERHEAD];
+};
+
+/**
+ * Records made by vault_record_init (or vault_record_init_in, in an arena) have site, account and password
+ * in one allocation and each of them is terminated by '\0'. Records passed to vault_for_each callbacks may point right to the mapped vault file,
+ * then they are not terminated.
+ */
+struct vault_record {
+    char *site;
+    uint32_t site_length;
+
+    char *account;
+    uint32_t account_length;
+
+    char *password;
+    uint32_t password_length;
+};
+
+/**
+ * Changes are not written to the vault file right away, they are appended to the log file (vault path + ".log").
+ * The log starts with a header, VAULT_LOG_MAGIC and the generation of the vault file it belongs to (u64), written
+ * with the first entry. Each log entry is a checksum (u32, FNV-1a of the rest of the entry), type (u32), site length,
+ * account length and password length (u32 each) and the site, account and password bytes. Reads merge the log
+ * with the vault file.
+ * When the log has VAULT_LOG_COMPACTION_ENTRIES entries, a background thread writes a new vault file with the
+ * log merged in and starts a new log with only the entries that were added meanwhile.
+ *
+ * More processes can use one vault at once. Changes (appends to the log and new vault files) are made only
+ * with the writer lock, an flock of the lock file (vault path + ".lock"), and every writer first loads
+ * the changes made by the others. Readers never take the writer lock: new vault files and logs are written
+ * to unique temporary files and renamed over the old ones, so a reader always sees whole files. A reader applies
+ * only the log of the vault file's generation and the entries of the previous generation's log after the merged
+ * log size, any other log is skipped. So the vault file and the log may be renamed (or a crash may stop between
+ * the renames) in any order, the entries merged in a vault file are never applied over it again. A writer
+ * replaces a log of another generation before it appends to it. Before every read the log is checked by one stat
+ * and entries appended by other processes are loaded.
+ */
+#define VAULT_LOG_SUFFIX ".log"
+#define VAULT_LOCK_SUFFIX ".lock"
+#define VAULT_LOG_MAGIC "PWGVLOG1"
+#define VAULT_LOG_HEADER_SIZE 16
+#define VAULT_LOG_ENTRY_HEADER_SIZE 20
+#define VAULT_LOG_COMPACTION_ENTRIES 1024
+
+enum vault_log_type {
+    VAULT_LOG_PUT = 1,
+    VAULT_LOG_DELETE = 2
+};
+
+struct vault_log_entry {
+    enum vault_log_type type;
+    struct vault_record record;
+};
+
+struct vault {
+    const char *path;
+    int fd;
+    struct vault_header header;
+    const unsigned char *map;
+    size_t map_size;
+
+    char *log_path;
+    int log_fd;
+    //Identifies the log file, so a log replaced by another process is noticed
+    ino_t log_inode;
+    //Bytes of the log that are loaded in log_entries (or skipped) and the generation from its header,
+    //valid when log_size is not 0
+    uint64_t log_size;
+    uint64_t log_generation;
+    struct vault_log_entry *log_entries;
+    size_t log_count;
+    size_t log_capacity;
+    //Strings of the log entries
+    struct arena log_arena;
+
+    //All records of the vault in memory, built by vault_use_index
+    struct vault_index index;
+    bool index_built;
+
+    //Key of an encrypted vault, set by vault_unlock
+    struct vault_key key;
+    bool unlocked;
+
+    //Path of the lock file of writers
+    char *lock_path;
+
+    //Changes are fsynced by vault_sync instead of one by one, unsynced is set while some are not
+    bool group_commit;
+    bool unsynced;
+
+    //Guards everything above while a compaction runs
+    pthread_mutex_t lock;
+    pthread_t compactor;
+    bool compactor_started;
+};
+
+typedef bool (*vault_callback)(const struct vault_record *record, void *context);
+
+/**
+ * Filters and size of a page of vault_list.
+ */
+struct vault_list_query {
+    //Patterns of fnmatch(3) the site and the account must match, NULL matches everything
+    const char *site_pattern;
+    const char *account_pattern;
+    //Most records of one page, 0 for all of them
+    size_t limit;
+    //Passwords are decrypted and passed only if this is set (the vault must be unlocked), otherwise they are NULL
+    bool passwords;
+};
+
+/**
+ * Position of a listing, the site and account of the last listed record.
+ */
+struct vault_cursor {
+    char site[VAULT_MAX_NAME_LENGTH];
+    uint32_t site_length;
+    char account[VAULT_MAX_NAME_LENGTH];
+    uint32_t account_length;
+    //false before the first page
+    bool started;
+};
+
+bool vault_open(struct vault *vault, const char *path);
+void vault_close(struct vault *vault);
+bool vault_use_index(struct vault *vault);
+bool vault_is_encrypted(const struct vault *vault);
+bool vault_unlock(struct vault *vault, const char *master_password, bool *correct);
+bool vault_encrypt_all(struct vault *vault, const char *master_password);
+uint64_t vault_hash_key(const char *site, size_t site_length, const char *account, size_t account_length);
+
+bool vault_get(struct vault *vault, const char *site, const char *account, struct vault_record *record, bool *found);
+bool vault_put(struct vault *vault, const char *site, const char *account, const char *password);
+bool vault_delete(struct vault *vault, const char *site, const char *account, bool *found);
+bool vault_for_each(struct vault *vault, vault_callback callback, void *context);
+bool vault_for_each_name(struct vault *vault, vault_callback callback, void *context);
+bool vault_list(struct vault *vault, const struct vault_list_query *query, struct vault_cursor *cursor,
+                vault_callback callback, void *context, bool *more);
+bool vault_set_group_commit(struct vault *vault, bool enabled);
+bool vault_sync(struct vault *vault);
+bool vault_seal_record(const struct vault *vault, struct arena *arena, struct vault_record *record);
+bool vault_put_all(struct vault *vault, const struct vault_record *records, size_t count, bool encrypted);
+bool vault_compact(struct vault *vault);
+
+bool vault_record_init(struct vault_record *record, const char *site, uint32_t site_length,
+                       const char *account, uint32_t account_length, const char *password, uint32_t password_length);
+bool vault_record_init_in(struct vault_record *record, struct arena *arena, const char *site, uint32_t site_length,
+                          const char *account, uint32_t account_length, const char *password, uint32_t password_length);
+void vault_record_free(struct vault_record *record);
+void vault_free_records(struct vault_record *records, size_t count);
+bool vault_write(const char *path, const struct vault_header *header, struct vault_record *records, size_t count);
+
+#endif //PASSWORD_GENERATOR_VAULT_H
@@ -0,0 +1,151 @@
+#include "vault_crypto.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <openssl/rand.h>
+
+/**
+ * @note Fills params with a new random salt and the default cost.
+ *
+ * @return true on success, false on failure
+ */
+bool vault_kdf_params_init(struct vault_kdf_params *params)
+{
+    if (RAND_bytes(params->salt, VAULT_SALT_SIZE) != 1) {
+        fprintf(stderr, "failed to generate random bytes\n");
+        return false;
+    }
+
+    params->log_n = VAULT_KDF_LOG_N;
+    params->r = VAULT_KDF_R;
+    params->p = VAULT_KDF_P;
+    return true;
+}
+
+/**
+ * @note Derives the key from the master password. It is stored in a locked arena until vault_key_free.
+ *
+ * @return true on success, false on failure
+ */
+bool vault_key_derive(struct vault_key *key, const char *master_password, const struct vault_kdf_params *params)
+{
+    arena_init(&key->arena);
+    key->key = NULL;
+    key->cipher = NULL;
+
+    if (params->log_n < 10 || params->log_n > VAULT_KDF_MAX_LOG_N || params->r == 0 || params->r > 32
+        || params->p == 0 || params->p > 16) {
+        fprintf(stderr, "vault file was probably altered\n");
+        return false;
+    }
+
+    key->key = arena_alloc(&key->arena, VAULT_KEY_SIZE);
+    key->cipher = EVP_CIPHER_fetch(NULL, "AES-256-GCM", NULL);
+    if (key->key == NULL || key->cipher == NULL) {
+        fprintf(stderr, "failed to prepare the encryption\n");
+        vault_key_free(key);
+        return false;
+    }
+
+    uint64_t n = (uint64_t) 1 << params->log_n;
+    uint64_t max_memory = 2 * 128 * (uint64_t) params->r * (n + params->p);
+
+    if (EVP_PBE_scrypt(master_password, strlen(master_password), params->salt, VAULT_SALT_SIZE, n, params->r,
+                       params->p, max_memory, key->key, VAULT_KEY_SIZE) != 1) {
+        fprintf(stderr, "failed to derive the key\n");
+        vault_key_free(key);
+        return false;
+    }
+    return true;
+}
+
+void vault_key_free(struct vault_key *key)
+{
+    EVP_CIPHER_free(key->cipher);
+    key->cipher = NULL;
+    key->key = NULL;
+    arena_free(&key->arena);
+}
+
+/**
+ * @note Passes site and account as additional authenticated data. The site length goes first,
+ * so the boundary between the names is authenticated too.
+ */
+static bool add_names(EVP_CIPHER_CTX *context, bool encrypt, const char *site, uint32_t site_length,
+                      const char *account, uint32_t account_length)
+{
+    unsigned char length[4] = { site_length, site_length >> 8, site_length >> 16, site_length >> 24 };
+    int written = 0;
+
+    if (encrypt) {
+        return EVP_EncryptUpdate(context, NULL, &written, length, sizeof(length)) == 1
+               && EVP_EncryptUpdate(context, NULL, &written, (const unsigned char *) site, (int) site_length) == 1
+               && EVP_EncryptUpdate(context, NULL, &written, (const unsigned char *) account, (int) account_length) == 1;
+    }
+    return EVP_DecryptUpdate(context, NULL, &written, length, sizeof(length)) == 1
+           && EVP_DecryptUpdate(context, NULL, &written, (const unsigned char *) site, (int) site_length) == 1
+           && EVP_DecryptUpdate(context, NULL, &written, (const unsigned char *) account, (int) account_length) == 1;
+}
+
+/**
+ * @param output Room for password_length + VAULT_CIPHER_OVERHEAD bytes, the nonce, ciphertext and tag are stored here.
+ * @return true on success, false on failure
+ */
+bool vault_encrypt(const struct vault_key *key, const char *site, uint32_t site_length, const char *account,
+                   uint32_t account_length, const char *password, uint32_t password_length, unsigned char *output)
+{
+    EVP_CIPHER_CTX *context = EVP_CIPHER_CTX_new();
+    int written = 0;
+
+    bool result = context != NULL && RAND_bytes(output, VAULT_NONCE_SIZE) == 1
+                  && EVP_EncryptInit_ex(context, key->cipher, NULL, key->key, output) == 1
+                  && add_names(context, true, site, site_length, account, account_length)
+                  && EVP_EncryptUpdate(context, output + VAULT_NONCE_SIZE, &written,
+                                       (const unsigned char *) password, (int) password_length) == 1
+                  && EVP_EncryptFinal_ex(context, output + VAULT_NONCE_SIZE + written, &written) == 1
+                  && EVP_CIPHER_CTX_ctrl(context, EVP_CTRL_GCM_GET_TAG, VAULT_TAG_SIZE,
+                                         output + VAULT_NONCE_SIZE + password_length) == 1;
+
+    EVP_CIPHER_CTX_free(context);
+    if (! result) {
+        fprintf(stderr, "failed to encrypt the password\n");
+    }
+    return result;
+}
+
+/**
+ * @param input Nonce, ciphertext and tag made by vault_encrypt.
+ * @param password Room for input_length - VAULT_CIPHER_OVERHEAD + 1 bytes, the password terminated by '\0'
+ * is stored here.
+ * @return true on success, false if the key is wrong or the record was altered
+ */
+bool vault_decrypt(const struct vault_key *key, const char *site, uint32_t site_length, const char *account,
+                   uint32_t account_length, const unsigned char *input, uint32_t input_length, char *password)
+{
+    if (input_length < VAULT_CIPHER_OVERHEAD) {
+        return false;
+    }
+
+    uint32_t password_length = input_length - VAULT_CIPHER_OVERHEAD;
+    EVP_CIPHER_CTX *context = EVP_CIPHER_CTX_new();
+    int written = 0;
+
+    bool result = context != NULL
+                  && EVP_DecryptInit_ex(context, key->cipher, NULL, key->key, input) == 1
+                  && add_names(context, false, site, site_length, account, account_length)
+                  && EVP_DecryptUpdate(context, (unsigned char *) password, &written,
+                                       input + VAULT_NONCE_SIZE, (int) password_length) == 1
+                  && EVP_CIPHER_CTX_ctrl(context, EVP_CTRL_GCM_SET_TAG, VAULT_TAG_SIZE,
+                                         (void *) (input + VAULT_NONCE_SIZE + password_length)) == 1
+                  && EVP_DecryptFinal_ex(context, (unsigned char *) password + written, &written) == 1;
+
+    EVP_CIPHER_CTX_free(context);
+    if (! result) {
+        OPENSSL_cleanse(password, password_length);
+        return false;
+    }
+
+    password[password_length] = '\0';
+    return true;
+}
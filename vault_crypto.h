@@ -0,0 +1,57 @@
+#ifndef PASSWORD_GENERATOR_VAULT_CRYPTO_H
+#define PASSWORD_GENERATOR_VAULT_CRYPTO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <openssl/evp.h>
+
+#include "arena.h"
+
+/**
+ * Passwords of an encrypted vault are encrypted one by one with AES-256-GCM, so a lookup decrypts only
+ * the record it needs. A stored password is a random nonce, the ciphertext (as long as the password) and the tag.
+ * Site and account are not encrypted (the index and the sorted order need them), but they are authenticated
+ * together with the password, so a password cannot be moved to another account unnoticed.
+ * The key is derived from the master password by scrypt with the salt and cost saved in the vault header.
+ */
+#define VAULT_KEY_SIZE 32
+#define VAULT_SALT_SIZE 16
+#define VAULT_NONCE_SIZE 12
+#define VAULT_TAG_SIZE 16
+#define VAULT_CIPHER_OVERHEAD (VAULT_NONCE_SIZE + VAULT_TAG_SIZE)
+
+//scrypt cost of new vaults, N = 2^15 and r = 8 takes 32 MiB of memory and roughly 0.1 s
+#define VAULT_KDF_LOG_N 15
+#define VAULT_KDF_R 8
+#define VAULT_KDF_P 1
+//Highest accepted cost, so an altered header cannot make the derivation take forever
+#define VAULT_KDF_MAX_LOG_N 22
+
+struct vault_kdf_params {
+    unsigned char salt[VAULT_SALT_SIZE];
+    uint32_t log_n;
+    uint32_t r;
+    uint32_t p;
+};
+
+/**
+ * Derived key, kept in locked memory for the whole session.
+ */
+struct vault_key {
+    struct arena arena;
+    unsigned char *key;
+    EVP_CIPHER *cipher;
+};
+
+bool vault_kdf_params_init(struct vault_kdf_params *params);
+bool vault_key_derive(struct vault_key *key, const char *master_password, const struct vault_kdf_params *params);
+void vault_key_free(struct vault_key *key);
+
+bool vault_encrypt(const struct vault_key *key, const char *site, uint32_t site_length, const char *account,
+                   uint32_t account_length, const char *password, uint32_t password_length, unsigned char *output);
+bool vault_decrypt(const struct vault_key *key, const char *site, uint32_t site_length, const char *account,
+                   uint32_t account_length, const unsigned char *input, uint32_t input_length, char *password);
+
+#endif //PASSWORD_GENERATOR_VAULT_CRYPTO_H
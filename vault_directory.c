@@ -0,0 +1,302 @@
+#include "vault_directory.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//Rows of the edit distance table, one for every character of the path in the trie
+typedef uint8_t distance_rows[VAULT_MAX_NAME_LENGTH + 1][VAULT_MAX_NAME_LENGTH + 1];
+
+static int compare_names(const char *first, size_t first_length, const char *second, size_t second_length)
+{
+    int result = memcmp(first, second, first_length < second_length ? first_length : second_length);
+    if (result != 0) {
+        return result;
+    }
+    return (first_length > second_length) - (first_length < second_length);
+}
+
+static size_t shared_prefix(const char *first, size_t first_length, const char *second, size_t second_length)
+{
+    size_t length = 0;
+    while (length < first_length && length < second_length && first[length] == second[length]) {
+        length++;
+    }
+    return length;
+}
+
+/**
+ * @note Adds the account, and its site if it is new, to the directory. The records come sorted by site
+ * and account, so the arrays stay sorted.
+ *
+ * @return true on success, false on failure
+ */
+static bool add_account(struct vault_directory *directory, const struct vault_record *record)
+{
+    const struct vault_directory_site *last = NULL;
+    if (directory->site_count > 0) {
+        last = &directory->sites[directory->site_count - 1];
+    }
+    if (last == NULL || last->length != record->site_length
+        || memcmp(last->name, record->site, record->site_length) != 0) {
+        //The previous site may move with the array
+        uint32_t shared = last == NULL ? 0 : (uint32_t) shared_prefix(last->name, last->length, record->site,
+                                                                       record->site_length);
+        if (directory->site_count == directory->site_capacity) {
+            size_t capacity = directory->site_capacity == 0 ? 64 : 2 * directory->site_capacity;
+            struct vault_directory_site *bigger = realloc(directory->sites, capacity * sizeof(*bigger));
+            if (bigger == NULL) {
+                fprintf(stderr, "malloc failed\n");
+                return false;
+            }
+            directory->sites = bigger;
+            directory->site_capacity = capacity;
+        }
+
+        struct vault_directory_site *site = &directory->sites[directory->site_count];
+        site->name = arena_copy(&directory->names, record->site, record->site_length);
+        if (site->name == NULL) {
+            return false;
+        }
+        site->length = record->site_length;
+        site->shared_prefix = shared;
+        site->first_account = directory->account_count;
+        site->account_count = 0;
+        directory->site_count++;
+    }
+
+    if (directory->account_count == directory->account_capacity) {
+        size_t capacity = directory->account_capacity == 0 ? 64 : 2 * directory->account_capacity;
+        struct vault_directory_account *bigger = realloc(directory->accounts, capacity * sizeof(*bigger));
+        if (bigger == NULL) {
+            fprintf(stderr, "malloc failed\n");
+            return false;
+        }
+        directory->accounts = bigger;
+        directory->account_capacity = capacity;
+    }
+
+    struct vault_directory_account *account = &directory->accounts[directory->account_count];
+    account->name = arena_copy(&directory->names, record->account, record->account_length);
+    if (account->name == NULL) {
+        return false;
+    }
+    account->length = record->account_length;
+    account->site = directory->site_count - 1;
+    directory->account_count++;
+    directory->sites[directory->site_count - 1].account_count++;
+    return true;
+}
+
+struct directory_build {
+    struct vault_directory *directory;
+    bool failed;
+};
+
+/**
+ * @note Callback for vault_for_each_name that adds the record to the directory.
+ */
+static bool add_name(const struct vault_record *record, void *context)
+{
+    struct directory_build *build = context;
+    build->failed = ! add_account(build->directory, record);
+    return ! build->failed;
+}
+
+/**
+ * @note Builds the directory of all sites and accounts of the vault, in one pass over the sorted records.
+ * Passwords are not read, so the vault does not have to be unlocked.
+ *
+ * @param directory Directory to be built. Free it with vault_directory_free, also when this fails.
+ * @return true on success, false on failure
+ */
+bool vault_directory_build(struct vault_directory *directory, struct vault *vault)
+{
+    directory->sites = NULL;
+    directory->site_count = 0;
+    directory->site_capacity = 0;
+    directory->accounts = NULL;
+    directory->account_count = 0;
+    directory->account_capacity = 0;
+    arena_init(&directory->names);
+
+    struct directory_build build = { .directory = directory, .failed = false };
+    return vault_for_each_name(vault, add_name, &build) && ! build.failed;
+}
+
+void vault_directory_free(struct vault_directory *directory)
+{
+    free(directory->sites);
+    free(directory->accounts);
+    arena_free(&directory->names);
+    directory->sites = NULL;
+    directory->site_count = 0;
+    directory->accounts = NULL;
+    directory->account_count = 0;
+}
+
+/**
+ * @return index of the first site at or after from that does not start with the prefix, all sites from from
+ * up to it must start with it
+ */
+static size_t prefix_end(const struct vault_directory *directory, size_t from, const char *prefix, size_t prefix_length)
+{
+    size_t low = from;
+    size_t high = directory->site_count;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        const struct vault_directory_site *site = &directory->sites[middle];
+        if (site->length >= prefix_length && memcmp(site->name, prefix, prefix_length) == 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+/**
+ * @note Finds the sites that start with the prefix by two binary searches, in O(log n). They are
+ * directory->sites[*first] up to directory->sites[*end - 1], in order; none if *first == *end.
+ */
+void vault_directory_prefix(const struct vault_directory *directory, const char *prefix, size_t prefix_length,
+                            size_t *first, size_t *end)
+{
+    size_t low = 0;
+    size_t high = directory->site_count;
+
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        const struct vault_directory_site *site = &directory->sites[middle];
+        if (compare_names(site->name, site->length, prefix, prefix_length) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    *first = low;
+    *end = prefix_end(directory, low, prefix, prefix_length);
+}
+
+/**
+ * @note Fills the row of the edit distance table for the depth-th character of the path, from the rows above it.
+ * Insertions, deletions, substitutions and swaps of two neighbouring characters cost 1 each.
+ *
+ * @return the smallest distance of the row, no site below this node of the trie can be closer to the query
+ */
+static uint8_t fill_row(distance_rows rows, size_t depth, const char *path, const char *query, size_t query_length)
+{
+    uint8_t *row = rows[depth];
+    const uint8_t *above = rows[depth - 1];
+    char character = path[depth - 1];
+
+    row[0] = (uint8_t) depth;
+    uint8_t smallest = row[0];
+
+    for (size_t j = 1; j <= query_length; j++) {
+        uint8_t value = above[j - 1] + (character != query[j - 1]);
+        if (above[j] + 1 < value) {
+            value = above[j] + 1;
+        }
+        if (row[j - 1] + 1 < value) {
+            value = row[j - 1] + 1;
+        }
+        if (depth > 1 && j > 1 && character == query[j - 2] && path[depth - 2] == query[j - 1]
+            && rows[depth - 2][j - 2] + 1 < value) {
+            value = rows[depth - 2][j - 2] + 1;
+        }
+
+        row[j] = value;
+        if (value < smallest) {
+            smallest = value;
+        }
+    }
+    return smallest;
+}
+
+static int compare_matches(const void *first, const void *second)
+{
+    const struct vault_directory_match *first_match = first;
+    const struct vault_directory_match *second_match = second;
+
+    if (first_match->distance != second_match->distance) {
+        return (first_match->distance > second_match->distance) - (first_match->distance < second_match->distance);
+    }
+    return (first_match->site > second_match->site) - (first_match->site < second_match->site);
+}
+
+/**
+ * @note Finds the sites within max_distance typos of the query. The sorted sites are walked like a trie:
+ * the edit distance table has one row per character of the path, so sites that share a prefix share its rows,
+ * and once every value of a row is over max_distance, all sites below that node are skipped at once.
+ *
+ * @param matches Allocated array of the matches is stored here, closest first, sites of the same distance
+ * in order. Free it with free.
+ * @param count Number of the matches is stored here.
+ * @return true on success, false on failure
+ */
+bool vault_directory_fuzzy(const struct vault_directory *directory, const char *query, size_t query_length,
+                           uint32_t max_distance, struct vault_directory_match **matches, size_t *count)
+{
+    *matches = NULL;
+    *count = 0;
+
+    if (query_length > VAULT_MAX_NAME_LENGTH || max_distance > VAULT_DIRECTORY_MAX_DISTANCE) {
+        fprintf(stderr, "The searched name can have at most %d characters and %d typos.\n", VAULT_MAX_NAME_LENGTH,
+                VAULT_DIRECTORY_MAX_DISTANCE);
+        return false;
+    }
+
+    distance_rows rows;
+    for (size_t j = 0; j <= query_length; j++) {
+        rows[0][j] = (uint8_t) j;
+    }
+
+    size_t capacity = 0;
+    //Rows up to this depth belong to the path of the last visited site
+    size_t computed = 0;
+    size_t i = 0;
+
+    while (i < directory->site_count) {
+        const struct vault_directory_site *site = &directory->sites[i];
+        size_t depth = computed < site->shared_prefix ? computed : site->shared_prefix;
+        bool pruned = false;
+
+        while (depth < site->length && ! pruned) {
+            depth++;
+            pruned = fill_row(rows, depth, site->name, query, query_length) > max_distance;
+        }
+        computed = depth;
+
+        if (pruned) {
+            i = prefix_end(directory, i + 1, site->name, depth);
+            continue;
+        }
+
+        if (rows[depth][query_length] <= max_distance) {
+            if (*count == capacity) {
+                capacity = capacity == 0 ? 16 : 2 * capacity;
+                struct vault_directory_match *bigger = realloc(*matches, capacity * sizeof(*bigger));
+                if (bigger == NULL) {
+                    fprintf(stderr, "malloc failed\n");
+                    free(*matches);
+                    *matches = NULL;
+                    *count = 0;
+                    return false;
+                }
+                *matches = bigger;
+            }
+            (*matches)[*count].site = i;
+            (*matches)[*count].distance = rows[depth][query_length];
+            (*count)++;
+        }
+        i++;
+    }
+
+    if (*count > 1) {
+        qsort(*matches, *count, sizeof(**matches), compare_matches);
+    }
+    return true;
+}
@@ -0,0 +1,65 @@
+#ifndef PASSWORD_GENERATOR_VAULT_DIRECTORY_H
+#define PASSWORD_GENERATOR_VAULT_DIRECTORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "vault.h"
+
+//Largest edit distance of the fuzzy search
+#define VAULT_DIRECTORY_MAX_DISTANCE 8
+
+struct vault_directory_site {
+    const char *name;
+    uint32_t length;
+    //Length of the prefix shared with the previous site, the fuzzy search keeps its rows for that part
+    uint32_t shared_prefix;
+    //Accounts of the site are accounts[first_account] up to accounts[first_account + account_count - 1]
+    size_t first_account;
+    size_t account_count;
+};
+
+struct vault_directory_account {
+    const char *name;
+    uint32_t length;
+    //Index of the site of the account
+    size_t site;
+};
+
+/**
+ * Sorted list of the sites of a vault with their accounts, names only (no passwords). The sites are sorted
+ * by their bytes, so all sites with a prefix are next to each other and are found by two binary searches.
+ * The sorted list is also a trie laid out flat: shared_prefix tells how deep the path of each site leaves
+ * the path of the previous one, which is all the fuzzy search needs to walk it like a trie.
+ * The directory is a snapshot, it does not change with the vault.
+ */
+struct vault_directory {
+    struct vault_directory_site *sites;
+    size_t site_count;
+    size_t site_capacity;
+
+    //Sorted by site and account
+    struct vault_directory_account *accounts;
+    size_t account_count;
+    size_t account_capacity;
+
+    //Strings of the names
+    struct arena names;
+};
+
+struct vault_directory_match {
+    //Index of the site
+    size_t site;
+    uint32_t distance;
+};
+
+bool vault_directory_build(struct vault_directory *directory, struct vault *vault);
+void vault_directory_free(struct vault_directory *directory);
+void vault_directory_prefix(const struct vault_directory *directory, const char *prefix, size_t prefix_length,
+                            size_t *first, size_t *end);
+bool vault_directory_fuzzy(const struct vault_directory *directory, const char *query, size_t query_length,
+                           uint32_t max_distance, struct vault_directory_match **matches, size_t *count);
+
+#endif //PASSWORD_GENERATOR_VAULT_DIRECTORY_H
@@ -0,0 +1,245 @@
+#include "vault_index.h"
+#include "vault.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define VAULT_INDEX_INITIAL_CAPACITY 64
+//Replaced and removed records below this many bytes are never copied away, it is not worth it
+#define VAULT_INDEX_MIN_GARBAGE ARENA_CHUNK_SIZE
+
+//Marks a slot whose record was removed, so probing goes on past it
+static struct vault_record removed_record;
+#define VAULT_INDEX_REMOVED (&removed_record)
+
+/**
+ * @return true on success, false on failure
+ */
+bool vault_index_init(struct vault_index *index)
+{
+    index->slots = calloc(VAULT_INDEX_INITIAL_CAPACITY, sizeof(*index->slots));
+    if (index->slots == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        return false;
+    }
+
+    index->capacity = VAULT_INDEX_INITIAL_CAPACITY;
+    index->count = 0;
+    index->used = 0;
+    arena_init(&index->arena);
+    index->live_bytes = 0;
+    index->garbage_bytes = 0;
+    return true;
+}
+
+/**
+ * @note Frees the table and overwrites all records in the arena.
+ */
+void vault_index_free(struct vault_index *index)
+{
+    free(index->slots);
+    index->slots = NULL;
+    index->capacity = 0;
+    index->count = 0;
+    index->used = 0;
+    arena_free(&index->arena);
+    index->live_bytes = 0;
+    index->garbage_bytes = 0;
+}
+
+static bool record_has_key(const struct vault_record *record, const char *site, size_t site_length,
+                           const char *account, size_t account_length)
+{
+    return record->site_length == site_length && record->account_length == account_length
+           && memcmp(record->site, site, site_length) == 0 && memcmp(record->account, account, account_length) == 0;
+}
+
+/**
+ * @return slot with the record, or NULL if the record is not there
+ */
+static struct vault_index_slot *find_slot(const struct vault_index *index, uint64_t hash, const char *site,
+                                          size_t site_length, const char *account, size_t account_length)
+{
+    size_t mask = index->capacity - 1;
+
+    for (size_t probe = 0; probe < index->capacity; probe++) {
+        struct vault_index_slot *slot = &index->slots[(hash + probe) & mask];
+
+        if (slot->record == NULL) {
+            return NULL;
+        }
+        if (slot->record != VAULT_INDEX_REMOVED && slot->hash == hash
+            && record_has_key(slot->record, site, site_length, account, account_length)) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @return the record of the account, NULL if it is not in the index
+ */
+const struct vault_record *vault_index_find(const struct vault_index *index, const char *site, size_t site_length,
+                                            const char *account, size_t account_length)
+{
+    uint64_t hash = vault_hash_key(site, site_length, account, account_length);
+    struct vault_index_slot *slot = find_slot(index, hash, site, site_length, account, account_length);
+    return slot == NULL ? NULL : slot->record;
+}
+
+/**
+ * @note Puts the record to the first empty slot of its probe sequence. There must be one.
+ */
+static void insert_slot(struct vault_index_slot *slots, size_t capacity, uint64_t hash, struct vault_record *record)
+{
+    size_t position = hash & (capacity - 1);
+    while (slots[position].record != NULL) {
+        position = (position + 1) & (capacity - 1);
+    }
+    slots[position].hash = hash;
+    slots[position].record = record;
+}
+
+/**
+ * @note Rehashes live records to a table twice as big (or the same size, if there are mostly removed records).
+ *
+ * @return true on success, false on failure
+ */
+static bool grow(struct vault_index *index)
+{
+    size_t capacity = index->count * 4 >= index->capacity ? index->capacity * 2 : index->capacity;
+
+    struct vault_index_slot *slots = calloc(capacity, sizeof(*slots));
+    if (slots == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        return false;
+    }
+
+    for (size_t i = 0; i < index->capacity; i++) {
+        struct vault_record *record = index->slots[i].record;
+        if (record != NULL && record != VAULT_INDEX_REMOVED) {
+            insert_slot(slots, capacity, index->slots[i].hash, record);
+        }
+    }
+
+    free(index->slots);
+    index->slots = slots;
+    index->capacity = capacity;
+    index->used = index->count;
+    return true;
+}
+
+/**
+ * @return bytes of the arena taken by a copy of the record, about (the arena rounds the allocations up)
+ */
+static size_t record_size(const struct vault_record *record)
+{
+    return sizeof(*record) + (size_t) record->site_length + record->account_length + record->password_length + 3;
+}
+
+/**
+ * @note Copies the record with its strings to the arena.
+ *
+ * @return the copy, NULL on failure
+ */
+static struct vault_record *copy_record(struct arena *arena, const struct vault_record *record)
+{
+    struct vault_record *copy = arena_alloc(arena, sizeof(*copy));
+    if (copy == NULL || ! vault_record_init_in(copy, arena, record->site, record->site_length, record->account,
+                                               record->account_length, record->password, record->password_length)) {
+        return NULL;
+    }
+    return copy;
+}
+
+/**
+ * @note Copies the live records to a new arena and wipes the old one with the replaced and removed records,
+ * once there are more bytes of those than of the live ones. If the copy fails, the old arena is kept.
+ */
+static void drop_garbage(struct vault_index *index)
+{
+    if (index->garbage_bytes < VAULT_INDEX_MIN_GARBAGE || index->garbage_bytes < index->live_bytes) {
+        return;
+    }
+
+    struct arena arena;
+    arena_init(&arena);
+    struct vault_record **copies = malloc((index->capacity + 1) * sizeof(*copies));
+    bool result = copies != NULL;
+
+    for (size_t i = 0; result && i < index->capacity; i++) {
+        struct vault_record *record = index->slots[i].record;
+        copies[i] = record;
+        if (record != NULL && record != VAULT_INDEX_REMOVED) {
+            copies[i] = copy_record(&arena, record);
+            result = copies[i] != NULL;
+        }
+    }
+
+    if (result) {
+        for (size_t i = 0; i < index->capacity; i++) {
+            index->slots[i].record = copies[i];
+        }
+        arena_free(&index->arena);
+        index->arena = arena;
+        index->garbage_bytes = 0;
+    } else {
+        arena_free(&arena);
+    }
+    free(copies);
+}
+
+/**
+ * @note Copies the record to the arena and adds it to the index, replacing the record of the same account.
+ *
+ * @return true on success, false on failure
+ */
+bool vault_index_put(struct vault_index *index, const struct vault_record *record)
+{
+    if (2 * (index->used + 1) > index->capacity && ! grow(index)) {
+        return false;
+    }
+
+    struct vault_record *copy = copy_record(&index->arena, record);
+    if (copy == NULL) {
+        return false;
+    }
+    index->live_bytes += record_size(copy);
+
+    uint64_t hash = vault_hash_key(record->site, record->site_length, record->account, record->account_length);
+    struct vault_index_slot *slot = find_slot(index, hash, record->site, record->site_length,
+                                              record->account, record->account_length);
+    if (slot != NULL) {
+        index->live_bytes -= record_size(slot->record);
+        index->garbage_bytes += record_size(slot->record);
+        slot->record = copy;
+        drop_garbage(index);
+        return true;
+    }
+
+    insert_slot(index->slots, index->capacity, hash, copy);
+    index->count++;
+    index->used++;
+    return true;
+}
+
+/**
+ * @return true if the record was in the index and was removed, false otherwise
+ */
+bool vault_index_remove(struct vault_index *index, const char *site, size_t site_length,
+                        const char *account, size_t account_length)
+{
+    uint64_t hash = vault_hash_key(site, site_length, account, account_length);
+    struct vault_index_slot *slot = find_slot(index, hash, site, site_length, account, account_length);
+    if (slot == NULL) {
+        return false;
+    }
+
+    index->live_bytes -= record_size(slot->record);
+    index->garbage_bytes += record_size(slot->record);
+    slot->record = VAULT_INDEX_REMOVED;
+    index->count--;
+    drop_garbage(index);
+    return true;
+}
@@ -0,0 +1,44 @@
+#ifndef PASSWORD_GENERATOR_VAULT_INDEX_H
+#define PASSWORD_GENERATOR_VAULT_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+struct vault_record;
+
+struct vault_index_slot {
+    uint64_t hash;
+    //NULL for an empty slot, VAULT_INDEX_REMOVED for a removed record
+    struct vault_record *record;
+};
+
+/**
+ * Open addressing hash table of all records of a vault keyed by site and account, with linear probing.
+ * The records and their strings are copied to an arena, so they lie next to each other in a few big blocks.
+ * Replaced and removed records stay in the arena until there is more of them than of the live ones, then the live
+ * records are copied to a new arena and the old one is wiped, so a long-running process does not keep growing.
+ */
+struct vault_index {
+    struct vault_index_slot *slots;
+    size_t capacity;
+    size_t count;
+    //Slots that are not empty, removed records included
+    size_t used;
+    struct arena arena;
+    //Bytes of the arena taken by live records and by replaced or removed ones
+    size_t live_bytes;
+    size_t garbage_bytes;
+};
+
+bool vault_index_init(struct vault_index *index);
+void vault_index_free(struct vault_index *index);
+const struct vault_record *vault_index_find(const struct vault_index *index, const char *site, size_t site_length,
+                                            const char *account, size_t account_length);
+bool vault_index_put(struct vault_index *index, const struct vault_record *record);
+bool vault_index_remove(struct vault_index *index, const char *site, size_t site_length,
+                        const char *account, size_t account_length);
+
+#endif //PASSWORD_GENERATOR_VAULT_INDEX_H
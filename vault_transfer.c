@@ -0,0 +1,692 @@
+#include "vault_transfer.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define CSV_HEADER "site,account,password"
+
+/**
+ * @return true if name is "csv" or "jsonl", the format is stored in format
+ */
+bool transfer_format_parse(const char *name, enum transfer_format *format)
+{
+    if (strcmp(name, "csv") == 0) {
+        *format = TRANSFER_CSV;
+        return true;
+    }
+    if (strcmp(name, "jsonl") == 0) {
+        *format = TRANSFER_JSONL;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @return true if the format is known from the extension of path (.csv, .jsonl or .json), false otherwise
+ */
+bool transfer_format_from_path(const char *path, enum transfer_format *format)
+{
+    const char *extension = strrchr(path, '.');
+    if (extension == NULL) {
+        return false;
+    }
+    if (strcmp(extension, ".json") == 0) {
+        *format = TRANSFER_JSONL;
+        return true;
+    }
+    return transfer_format_parse(extension + 1, format);
+}
+
+/**
+ * Part of the imported file parsed by one thread. Chunks start at line beginnings, so they are parsed
+ * independently, and their records are joined in order of the chunks afterwards.
+ */
+struct import_chunk {
+    const struct vault *vault;
+    //Whether the vault was encrypted when the import started, the records are sealed by that
+    bool encrypted;
+    enum transfer_format format;
+    const char *start;
+    const char *end;
+    bool first;
+
+    struct arena arena;
+    struct vault_record *records;
+    size_t count;
+    size_t capacity;
+
+    //First error in the chunk, error is NULL if there is none
+    const char *error;
+    const char *error_position;
+    pthread_t thread;
+};
+
+/**
+ * @note Decodes one CSV field starting at position, the field is stored in the arena.
+ *
+ * @return position after the field, NULL if the field is malformed
+ */
+static const char *parse_csv_field(struct arena *arena, const char *position, const char *end, char **field,
+                                   size_t *length)
+{
+    bool quoted = position < end && *position == '"';
+    if (quoted) {
+        position++;
+    }
+
+    //The decoded field is never longer than the rest of the line
+    *field = arena_alloc(arena, (size_t) (end - position) + 1);
+    if (*field == NULL) {
+        return NULL;
+    }
+    *length = 0;
+
+    while (position < end) {
+        if (! quoted && *position == ',') {
+            break;
+        }
+        if (quoted && *position == '"') {
+            if (position + 1 < end && position[1] == '"') {
+                (*field)[(*length)++] = '"';
+                position += 2;
+                continue;
+            }
+            position++;
+            quoted = false;
+            if (position < end && *position != ',') {
+                return NULL;
+            }
+            break;
+        }
+        (*field)[(*length)++] = *position++;
+    }
+
+    if (quoted) {
+        return NULL;
+    }
+    (*field)[*length] = '\0';
+    return position;
+}
+
+/**
+ * @return NULL on success, description of the error otherwise
+ */
+static const char *parse_csv_line(struct arena *arena, const char *line, const char *end, struct vault_record *record)
+{
+    char *fields[3];
+    size_t lengths[3];
+    const char *position = line;
+
+    for (int i = 0; i < 3; i++) {
+        if (i > 0) {
+            if (position == end || *position != ',') {
+                return "expected 3 fields: site,account,password";
+            }
+            position++;
+        }
+
+        position = parse_csv_field(arena, position, end, &fields[i], &lengths[i]);
+        if (position == NULL) {
+            return "malformed quoted field";
+        }
+    }
+
+    if (position != end) {
+        return "expected 3 fields: site,account,password";
+    }
+
+    record->site = fields[0];
+    record->site_length = lengths[0];
+    record->account = fields[1];
+    record->account_length = lengths[1];
+    record->password = fields[2];
+    record->password_length = lengths[2];
+    return NULL;
+}
+
+static const char *skip_spaces(const char *position, const char *end)
+{
+    while (position < end && (*position == ' ' || *position == '\t')) {
+        position++;
+    }
+    return position;
+}
+
+static int hex_value(char digit)
+{
+    if (digit >= '0' && digit <= '9') {
+        return digit - '0';
+    }
+    if (digit >= 'a' && digit <= 'f') {
+        return digit - 'a' + 10;
+    }
+    if (digit >= 'A' && digit <= 'F') {
+        return digit - 'A' + 10;
+    }
+    return -1;
+}
+
+/**
+ * @return the code unit of a \uXXXX escape at position (just after "\u"), -1 if it is malformed
+ */
+static long parse_unicode_escape(const char *position, const char *end)
+{
+    if (end - position < 4) {
+        return -1;
+    }
+
+    long value = 0;
+    for (int i = 0; i < 4; i++) {
+        int digit = hex_value(position[i]);
+        if (digit < 0) {
+            return -1;
+        }
+        value = value * 16 + digit;
+    }
+    return value;
+}
+
+/**
+ * @note Appends the code point to text in UTF-8.
+ */
+static void put_utf8(char *text, size_t *length, uint32_t code_point)
+{
+    if (code_point < 0x80) {
+        text[(*length)++] = (char) code_point;
+    } else if (code_point < 0x800) {
+        text[(*length)++] = (char) (0xC0 | (code_point >> 6));
+        text[(*length)++] = (char) (0x80 | (code_point & 0x3F));
+    } else if (code_point < 0x10000) {
+        text[(*length)++] = (char) (0xE0 | (code_point >> 12));
+        text[(*length)++] = (char) (0x80 | ((code_point >> 6) & 0x3F));
+        text[(*length)++] = (char) (0x80 | (code_point & 0x3F));
+    } else {
+        text[(*length)++] = (char) (0xF0 | (code_point >> 18));
+        text[(*length)++] = (char) (0x80 | ((code_point >> 12) & 0x3F));
+        text[(*length)++] = (char) (0x80 | ((code_point >> 6) & 0x3F));
+        text[(*length)++] = (char) (0x80 | (code_point & 0x3F));
+    }
+}
+
+/**
+ * @note Decodes a JSON string starting at its opening quote, the string is stored in the arena.
+ *
+ * @return position after the closing quote, NULL if the string is malformed
+ */
+static const char *parse_json_string(struct arena *arena, const char *position, const char *end, char **text,
+                                     size_t *length)
+{
+    if (position == end || *position != '"') {
+        return NULL;
+    }
+    position++;
+
+    //Every escape is at least as long as the UTF-8 it stands for
+    *text = arena_alloc(arena, (size_t) (end - position) + 1);
+    if (*text == NULL) {
+        return NULL;
+    }
+    *length = 0;
+
+    while (position < end && *position != '"') {
+        unsigned char character = (unsigned char) *position++;
+
+        if (character < 0x20) {
+            return NULL;
+        }
+        if (character != '\\') {
+            (*text)[(*length)++] = (char) character;
+            continue;
+        }
+
+        if (position == end) {
+            return NULL;
+        }
+
+        char escape = *position++;
+        const char *simple = strchr("\"\\/bfnrt", escape);
+        if (escape != '\0' && simple != NULL) {
+            (*text)[(*length)++] = "\"\\/\b\f\n\r\t"[simple - "\"\\/bfnrt"];
+            continue;
+        }
+        if (escape != 'u') {
+            return NULL;
+        }
+
+        long code_point = parse_unicode_escape(position, end);
+        if (code_point < 0 || (code_point >= 0xDC00 && code_point <= 0xDFFF)) {
+            return NULL;
+        }
+        position += 4;
+
+        if (code_point >= 0xD800 && code_point <= 0xDBFF) {
+            if (end - position < 2 || position[0] != '\\' || position[1] != 'u') {
+                return NULL;
+            }
+            long low = parse_unicode_escape(position + 2, end);
+            if (low < 0xDC00 || low > 0xDFFF) {
+                return NULL;
+            }
+            position += 6;
+            code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+        }
+        put_utf8(*text, length, (uint32_t) code_point);
+    }
+
+    if (position == end) {
+        return NULL;
+    }
+    (*text)[*length] = '\0';
+    return position + 1;
+}
+
+/**
+ * @return NULL on success, description of the error otherwise
+ */
+static const char *parse_json_line(struct arena *arena, const char *line, const char *end, struct vault_record *record)
+{
+    const char *position = skip_spaces(line, end);
+    if (position == end || *position != '{') {
+        return "expected a JSON object";
+    }
+    position = skip_spaces(position + 1, end);
+
+    bool have_site = false;
+    bool have_account = false;
+    bool have_password = false;
+
+    while (position < end && *position != '}') {
+        char *key = NULL;
+        char *value = NULL;
+        size_t key_length = 0;
+        size_t value_length = 0;
+
+        position = parse_json_string(arena, position, end, &key, &key_length);
+        if (position == NULL) {
+            return "malformed JSON string";
+        }
+
+        position = skip_spaces(position, end);
+        if (position == end || *position != ':') {
+            return "expected ':' after a member name";
+        }
+
+        position = parse_json_string(arena, skip_spaces(position + 1, end), end, &value, &value_length);
+        if (position == NULL) {
+            return "members must be JSON strings";
+        }
+
+        if (strcmp(key, "site") == 0) {
+            record->site = value;
+            record->site_length = value_length;
+            have_site = true;
+        } else if (strcmp(key, "account") == 0) {
+            record->account = value;
+            record->account_length = value_length;
+            have_account = true;
+        } else if (strcmp(key, "password") == 0) {
+            record->password = value;
+            record->password_length = value_length;
+            have_password = true;
+        }
+
+        position = skip_spaces(position, end);
+        if (position < end && *position == ',') {
+            position = skip_spaces(position + 1, end);
+        } else if (position == end || *position != '}') {
+            return "expected ',' or '}'";
+        }
+    }
+
+    if (position == end || skip_spaces(position + 1, end) != end) {
+        return "expected '}' at the end of the line";
+    }
+    if (! have_site || ! have_account || ! have_password) {
+        return "site, account and password are required";
+    }
+    return NULL;
+}
+
+/**
+ * @return true on success, false if the array could not grow
+ */
+static bool add_chunk_record(struct import_chunk *chunk, const struct vault_record *record)
+{
+    if (chunk->count == chunk->capacity) {
+        size_t capacity = chunk->capacity == 0 ? 1024 : 2 * chunk->capacity;
+        struct vault_record *bigger = realloc(chunk->records, capacity * sizeof(*bigger));
+        if (bigger == NULL) {
+            return false;
+        }
+        chunk->records = bigger;
+        chunk->capacity = capacity;
+    }
+
+    chunk->records[chunk->count++] = *record;
+    return true;
+}
+
+/**
+ * @return true if the text contains '\n' or '\r'
+ */
+static bool has_line_break(const char *text, size_t length)
+{
+    return memchr(text, '\n', length) != NULL || memchr(text, '\r', length) != NULL;
+}
+
+/**
+ * @note Parses and seals all records of the chunk, stops at the first error.
+ */
+static void *import_chunk(void *argument)
+{
+    struct import_chunk *chunk = argument;
+    const char *line = chunk->start;
+
+    while (line < chunk->end && chunk->error == NULL) {
+        const char *line_end = memchr(line, '\n', (size_t) (chunk->end - line));
+        const char *next = line_end == NULL ? chunk->end : line_end + 1;
+        if (line_end == NULL) {
+            line_end = chunk->end;
+        }
+        if (line_end > line && line_end[-1] == '\r') {
+            line_end--;
+        }
+
+        bool header = chunk->first && line == chunk->start && chunk->format == TRANSFER_CSV
+                      && (size_t) (line_end - line) == strlen(CSV_HEADER) && memcmp(line, CSV_HEADER, strlen(CSV_HEADER)) == 0;
+
+        if (line_end > line && ! header) {
+            struct vault_record record;
+            const char *error = chunk->format == TRANSFER_CSV ? parse_csv_line(&chunk->arena, line, line_end, &record)
+                                                               : parse_json_line(&chunk->arena, line, line_end, &record);
+
+            if (error == NULL && (record.site_length == 0 || record.account_length == 0)) {
+                error = "site and account cannot be empty";
+            } else if (error == NULL && (memchr(record.site, '\0', record.site_length) != NULL
+                                         || memchr(record.account, '\0', record.account_length) != NULL
+                                         || memchr(record.password, '\0', record.password_length) != NULL)) {
+                //The rest of the program takes the names and passwords as C strings
+                error = "site, account and password cannot contain the null character";
+            } else if (error == NULL && (has_line_break(record.site, record.site_length)
+                                         || has_line_break(record.account, record.account_length)
+                                         || has_line_break(record.password, record.password_length))) {
+                //Records are split on line breaks, so an exported record with one could not be imported back
+                error = "site, account and password cannot contain line breaks";
+            } else if (error == NULL && (record.site_length > VAULT_MAX_NAME_LENGTH
+                                         || record.account_length > VAULT_MAX_NAME_LENGTH
+                                         || record.password_length > VAULT_MAX_PASSWORD_LENGTH)) {
+                error = "the name or password is too long";
+            } else if (error == NULL && ((chunk->encrypted && ! vault_seal_record(chunk->vault, &chunk->arena, &record))
+                                         || ! add_chunk_record(chunk, &record))) {
+                error = "failed to store the record";
+            }
+
+            if (error != NULL) {
+                chunk->error = error;
+                chunk->error_position = line;
+            }
+        }
+        line = next;
+    }
+    return NULL;
+}
+
+/**
+ * @return number of the line (from 1) that position is on
+ */
+static size_t line_number(const char *start, const char *position)
+{
+    size_t number = 1;
+    while ((start = memchr(start, '\n', (size_t) (position - start))) != NULL) {
+        number++;
+        start++;
+    }
+    return number;
+}
+
+/**
+ * @note Imports all records of a CSV or JSONL file. The file is mapped to memory and split into chunks
+ * of whole lines that are parsed (and encrypted, if the vault is) by thread_count threads. Then everything is
+ * merged into the vault at once by vault_put_all, so a record that is already there is replaced. Nothing is
+ * imported if any line is malformed.
+ *
+ * @param imported Number of imported records is stored here.
+ * @return true on success, false on failure
+ */
+bool vault_import(struct vault *vault, const char *path, enum transfer_format format, int thread_count,
+                  size_t *imported)
+{
+    *imported = 0;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "failed to open %s\n", path);
+        return false;
+    }
+
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+        fprintf(stderr, "failed to read %s\n", path);
+        close(fd);
+        return false;
+    }
+
+    size_t size = (size_t) status.st_size;
+    if (size == 0) {
+        close(fd);
+        return true;
+    }
+
+    const char *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "failed to map %s\n", path);
+        return false;
+    }
+
+    if ((size_t) thread_count > size / IMPORT_MIN_CHUNK_SIZE + 1) {
+        thread_count = (int) (size / IMPORT_MIN_CHUNK_SIZE + 1);
+    }
+
+    struct import_chunk *chunks = calloc(thread_count, sizeof(*chunks));
+    if (chunks == NULL) {
+        munmap((void *) map, size);
+        fprintf(stderr, "malloc failed\n");
+        return false;
+    }
+
+    //vault_put_all checks this again under the writer lock, another process may encrypt the vault meanwhile
+    bool encrypted = vault_is_encrypted(vault);
+    const char *start = map;
+    for (int i = 0; i < thread_count; i++) {
+        const char *end = map + size * (i + 1) / thread_count;
+        if (end < start) {
+            end = start;
+        }
+        if (i + 1 < thread_count && end < map + size) {
+            const char *newline = memchr(end, '\n', (size_t) (map + size - end));
+            end = newline == NULL ? map + size : newline + 1;
+        } else {
+            end = map + size;
+        }
+
+        chunks[i].vault = vault;
+        chunks[i].encrypted = encrypted;
+        chunks[i].format = format;
+        chunks[i].start = start;
+        chunks[i].end = end;
+        chunks[i].first = i == 0;
+        arena_init(&chunks[i].arena);
+        start = end;
+    }
+
+    //Chunk 0 is parsed by this thread, also any chunk whose thread could not be started
+    bool *started = calloc(thread_count, sizeof(*started));
+    for (int i = 1; started != NULL && i < thread_count; i++) {
+        started[i] = pthread_create(&chunks[i].thread, NULL, import_chunk, &chunks[i]) == 0;
+    }
+    for (int i = 0; i < thread_count; i++) {
+        if (started == NULL || ! started[i]) {
+            import_chunk(&chunks[i]);
+        }
+    }
+    for (int i = 1; started != NULL && i < thread_count; i++) {
+        if (started[i]) {
+            pthread_join(chunks[i].thread, NULL);
+        }
+    }
+    free(started);
+
+    bool result = true;
+    size_t count = 0;
+    for (int i = 0; i < thread_count; i++) {
+        if (result && chunks[i].error != NULL) {
+            fprintf(stderr, "%s:%zu: %s\n", path, line_number(map, chunks[i].error_position), chunks[i].error);
+            result = false;
+        }
+        count += chunks[i].count;
+    }
+
+    struct vault_record *records = result ? malloc((count + 1) * sizeof(*records)) : NULL;
+    if (result && records == NULL) {
+        fprintf(stderr, "malloc failed\n");
+        result = false;
+    }
+
+    if (result) {
+        size_t position = 0;
+        for (int i = 0; i < thread_count; i++) {
+            memcpy(records + position, chunks[i].records, chunks[i].count * sizeof(*records));
+            position += chunks[i].count;
+        }
+
+        result = vault_put_all(vault, records, count, encrypted);
+        if (result) {
+            *imported = count;
+        }
+    }
+
+    free(records);
+    for (int i = 0; i < thread_count; i++) {
+        free(chunks[i].records);
+        arena_free(&chunks[i].arena);
+    }
+    free(chunks);
+    munmap((void *) map, size);
+    return result;
+}
+
+/**
+ * @note Writes a CSV field, quoted if needed.
+ */
+static void write_csv_field(FILE *output, const char *text, size_t length)
+{
+    bool quote = false;
+    for (size_t i = 0; i < length && ! quote; i++) {
+        quote = text[i] == ',' || text[i] == '"' || text[i] == '\n' || text[i] == '\r';
+    }
+
+    if (! quote) {
+        fwrite(text, 1, length, output);
+        return;
+    }
+
+    putc('"', output);
+    for (size_t i = 0; i < length; i++) {
+        if (text[i] == '"') {
+            putc('"', output);
+        }
+        putc(text[i], output);
+    }
+    putc('"', output);
+}
+
+/**
+ * @note Writes a JSON string, control characters, quotes and backslashes are escaped.
+ */
+static void write_json_string(FILE *output, const char *text, size_t length)
+{
+    putc('"', output);
+    for (size_t i = 0; i < length; i++) {
+        unsigned char character = (unsigned char) text[i];
+
+        if (character == '"' || character == '\\') {
+            putc('\\', output);
+            putc(character, output);
+        } else if (character == '\n') {
+            fputs("\\n", output);
+        } else if (character == '\t') {
+            fputs("\\t", output);
+        } else if (character < 0x20) {
+            fprintf(output, "\\u%04x", character);
+        } else {
+            putc(character, output);
+        }
+    }
+    putc('"', output);
+}
+
+struct export_state {
+    FILE *output;
+    enum transfer_format format;
+    size_t count;
+};
+
+/**
+ * @note Callback for vault_for_each that writes one record.
+ */
+static bool export_record(const struct vault_record *record, void *context)
+{
+    struct export_state *state = context;
+
+    if (state->format == TRANSFER_CSV) {
+        write_csv_field(state->output, record->site, record->site_length);
+        putc(',', state->output);
+        write_csv_field(state->output, record->account, record->account_length);
+        putc(',', state->output);
+        write_csv_field(state->output, record->password, record->password_length);
+    } else {
+        fputs("{\"site\": ", state->output);
+        write_json_string(state->output, record->site, record->site_length);
+        fputs(", \"account\": ", state->output);
+        write_json_string(state->output, record->account, record->account_length);
+        fputs(", \"password\": ", state->output);
+        write_json_string(state->output, record->password, record->password_length);
+        putc('}', state->output);
+    }
+    putc('\n', state->output);
+
+    state->count++;
+    return ferror(state->output) == 0;
+}
+
+/**
+ * @note Writes all records, in order of sites and accounts. The records are streamed one by one right from
+ * the vault, so the whole vault is never copied to memory.
+ *
+ * @param exported Number of exported records is stored here.
+ * @return true on success, false on failure
+ */
+bool vault_export(struct vault *vault, FILE *output, enum transfer_format format, size_t *exported)
+{
+    struct export_state state = { .output = output, .format = format, .count = 0 };
+
+    if (format == TRANSFER_CSV) {
+        fputs(CSV_HEADER "\n", output);
+    }
+
+    bool result = vault_for_each(vault, export_record, &state);
+    result = fflush(output) == 0 && ! ferror(output) && result;
+    if (! result) {
+        fprintf(stderr, "failed to export the vault\n");
+    }
+
+    *exported = state.count;
+    return result;
+}
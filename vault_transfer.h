@@ -0,0 +1,35 @@
+#ifndef PASSWORD_GENERATOR_VAULT_TRANSFER_H
+#define PASSWORD_GENERATOR_VAULT_TRANSFER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "vault.h"
+
+/**
+ * Formats for moving records from and to other tools, one record per line:
+ *
+ * csv      site,account,password - fields with a comma or a quote are quoted and quotes in them doubled,
+ *          the first line may be the header "site,account,password"
+ * jsonl    {"site": "...", "account": "...", "password": "..."} - other string members are ignored
+ *
+ * Empty lines are skipped. Names and passwords cannot contain line breaks in either format, the vault refuses
+ * them too, so every exported file can be imported back.
+ */
+enum transfer_format {
+    TRANSFER_CSV,
+    TRANSFER_JSONL
+};
+
+//Smallest part of the imported file parsed by one thread, smaller files are not worth more threads
+#define IMPORT_MIN_CHUNK_SIZE (256 * 1024)
+
+bool transfer_format_parse(const char *name, enum transfer_format *format);
+bool transfer_format_from_path(const char *path, enum transfer_format *format);
+
+bool vault_import(struct vault *vault, const char *path, enum transfer_format format, int thread_count,
+                  size_t *imported);
+bool vault_export(struct vault *vault, FILE *output, enum transfer_format format, size_t *exported);
+
+#endif //PASSWORD_GENERATOR_VAULT_TRANSFER_H